@@ -15,9 +15,12 @@ TEST_BIN=test_libimage
 PLATFORM=
 AR_PATH=
 DEBUG_MODE=
+BENCH_BIN=bench_libimage
+RUN_BENCH=
+STATS_MODE=
 
 BEGIN=$(date +%s)
-while getopts 'C:chd' opt; do
+while getopts 'C:chdbs' opt; do
   case "$opt" in
      d)
 	     DEBUG_MODE="yes"
@@ -28,6 +31,12 @@ while getopts 'C:chd' opt; do
      c)
 	    SHOULD_CLEAN="yes"
 	   ;;
+     b)
+	     RUN_BENCH="yes"
+	     ;;
+     s)
+	     STATS_MODE="yes"
+	     ;;
      C)
 	     COMPILER="$OPTARG"
 	     echo "Gonna use "$(basename $COMPILER) " in path "$(dirname $COMPILER). 
@@ -37,6 +46,8 @@ while getopts 'C:chd' opt; do
       echo "-p				Set platform manually."
       echo "-c				Remove build folder before compiling."
       echo "-C  <compiler-fullpath>	Uses the compiler provided by the fullpath."
+      echo "-s				Build the decode statistics and trace hooks in."
+      echo "-b				Run the decode benchmark after building, the CSV goes to build/bench.csv."
       exit 1
       ;;
   esac
@@ -117,6 +128,10 @@ else
 	COMPILER_FLAGS="$COMPILER_FLAGS"" -DRELEASE=1 -O2" 
 fi
 
+if [ ! -z "$STATS_MODE" ]; then
+	COMPILER_FLAGS="$COMPILER_FLAGS"" -DLIBIMAGE_STATS=1"
+fi
+
 mkdir -p $WORKING_DIR/build
 mkdir -p $WORKING_DIR/libs
 pushd $WORKING_DIR/build > /dev/null 2>&1
@@ -128,7 +143,9 @@ OBJ_LIST=$(find $WORKING_DIR/build -name "*.o" -printf "%p ")
 $AR_PATH cr $LIB_NAME $OBJ_LIST
 mv $LIB_NAME $LIBS_FOLDER/
 
-$COMPILER $COMPILER_FLAGS $WORKING_DIR/tests/$TEST_BIN.c -o $TEST_BIN $INCLUDE_CMD -lm "$LIB_CMD" -limage
+$COMPILER $COMPILER_FLAGS $WORKING_DIR/tests/$TEST_BIN.c -o $TEST_BIN $INCLUDE_CMD -lm "$LIB_CMD" -limage -lpthread
+# The benchmark times the stages through the internal headers.
+$COMPILER $COMPILER_FLAGS $WORKING_DIR/tests/$BENCH_BIN.c -o $BENCH_BIN "$INCLUDE_CMD" "-I""$SRC_FOLDER" "$LIB_CMD" -limage -lm -lpthread
 popd > /dev/null 2>&1
 
 RUNTIME=$(( $(date +%s) - $BEGIN ))
@@ -141,3 +158,10 @@ else
 fi
 
 echo "Finished execution in: $RUNTIME_MSG"
+
+if [ ! -z "$RUN_BENCH" ]; then
+	echo "[INFO]: Running the decode benchmark"
+	pushd $WORKING_DIR > /dev/null 2>&1
+	$WORKING_DIR/build/$BENCH_BIN -o $WORKING_DIR/build/bench.csv $WORKING_DIR/tests/res
+	popd > /dev/null 2>&1
+fi
@@ -2,9 +2,391 @@
 #define  __LIBIMAGE__H__
 
 #include <inttypes.h>
+#include <stddef.h>
 
 void copy_to_buffer(uint8_t *dst, uint8_t *src, int size);
+
+/*
+*	libimage_decode_data decodes the size bytes at data and never reads past them, a file cut short fails with the
+*	truncated data error. libimage_process_data has no size and walks the chunks as far as they say, it is only for
+*	data known to hold the whole file. libimage_decode_file maps the file and reads it with its length. The images
+*	of all three are freed with free().
+*/
 void *libimage_process_data(char *data, unsigned int *width, unsigned int *height, int *error);
-void libimage_error_code_to_msg(unsigned char *buffer, int buffer_size, int error);
+void *libimage_decode_data(uint8_t *data, size_t size, uint32_t *width, uint32_t *height, int *error);
+void *libimage_decode_file(const char *path, uint32_t *width, uint32_t *height, int *error);
+void libimage_error_code_to_msg(char *buffer, int buffer_size, int error);
+
+/*
+*	Error codes the calls return or set in *error, zero is success. libimage_error_code_to_msg gives a line for
+*	each. New codes are only ever added at the end.
+*/
+enum {
+	LIBIMAGE_PNG_ERROR_HEADER = 1,
+	LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS,
+	LIBIMAGE_PNG_ERROR_IHDR_INTERLACE,
+	LIBIMAGE_PNG_ERROR_BIG_IMAGE,
+	LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND,
+	LIBIMAGE_PNG_ERROR_INVALID_FILE,
+	LIBIMAGE_PNG_ERROR_ZERO_SIZE,
+	LIBIMAGE_PNG_ERROR_IDAT_SIZE_LIMIT,
+	LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH,
+	LIBIMAGE_PNG_ERROR_CORRUPT_IHDR,
+	LIBIMAGE_PNG_ERROR_IHDR_COLOUR_TYPE,
+	LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH_COMBINATION,
+	LIBIMAGE_PNG_ERROR_CRC_NOT_MATCH,
+	LIBIMAGE_PNG_ERROR_MULTIPLE_IHDR,
+	LIBIMAGE_PNG_ERROR_NO_IDAT,
+	LIBIMAGE_PNG_ERROR_NO_PLTE,
+	LIBIMAGE_PNG_ERROR_GAMA_AFTER_PLTE,
+	LIBIMAGE_PNG_ERROR_MULTIPLE_GAMA,
+	LIBIMAGE_PNG_ERROR_UNEXPECTED_PLTE,
+	LIBIMAGE_ERROR_TYPE_NOT_SUPPORTED,
+	LIBIMAGE_ERROR_ZBUF_UNREACHABLE_STATE,
+	LIBIMAGE_ERROR_INVALID_ZLIB_VALUE,
+	LIBIMAGE_ERROR_OUT_OF_MEMORY,
+	LIBIMAGE_PNG_ERROR_ZLIB_COMPRESSION,
+	LIBIMAGE_ERROR_ZLIB_HEADER_CORRUPTED,
+	LIBIMAGE_PNG_ERROR_PRESET_DICT,
+	LIBIMAGE_PNG_ERROR_CORRUPTED_FILE,
+	LIBIMAGE_ERROR_MEMORY_ERROR,
+	LIBIMAGE_PNG_ERROR_DATA_OVERFLOW,
+	LIBIMAGE_PNG_ERROR_NOT_ENOUGH_DATA,
+	LIBIMAGE_ERROR_BUFFER_TOO_SMALL,
+	LIBIMAGE_PNG_ERROR_TRUNCATED_DATA,
+	LIBIMAGE_PNG_ERROR_BAD_FILTER,
+	LIBIMAGE_ERROR_INVALID_ARGUMENT,
+	LIBIMAGE_PNG_ERROR_ADLER_NOT_MATCH,
+	LIBIMAGE_ERROR_FILE_READ,
+	LIBIMAGE_ERROR_BAD_REGION,
+	LIBIMAGE_ERROR_NOT_BUILT_IN,
+	LIBIMAGE_ERROR_BAD_INDEX,
+	LIBIMAGE_PNG_ERROR_UNKNOWN_CRITICAL,
+	LIBIMAGE_ERROR_LIMIT_EXCEEDED,
+	LIBIMAGE_ERROR_CANCELLED,
+	LIBIMAGE_ERROR_DEADLINE
+};
+
+/*
+*	Messages of the library, for builds without RELEASE ( build.sh -d ). Release builds have none at all, setting a
+*	sink then fails with the not built in error. The sink gets the messages up to level, one line without the
+*	newline, and can be called from any thread that decodes. There is no sink by default, give NULL to go back to
+*	that. It is set once before decoding, not while decodes run.
+*/
+#define LIBIMAGE_LOG_ERROR	0
+#define LIBIMAGE_LOG_WARNING	1
+#define LIBIMAGE_LOG_INFO	2
+#define LIBIMAGE_LOG_DEBUG	3
+
+typedef void (*LibImageLogSink)(void *user, int level, const char *message);
+
+int libimage_set_log_sink(LibImageLogSink sink, void *user, int level);
+
+/*
+*	The vector kernels ( unfilter, filter, Adler-32, CRC, format conversion ) are picked once per process from the
+*	features of the CPU, when the library is first used. The LIBIMAGE_CPU environment variable, read then, limits
+*	them to the ones it names, comma separated ( sse2, ssse3, avx2, pclmul, neon, crc32 ), "scalar" for none, to
+*	compare the paths on one machine. libimage_cpu_features gives the LIBIMAGE_CPU_* in use.
+*/
+#define LIBIMAGE_CPU_SSE2	(1 << 0)
+#define LIBIMAGE_CPU_SSSE3	(1 << 1)
+#define LIBIMAGE_CPU_AVX2	(1 << 3)
+#define LIBIMAGE_CPU_PCLMUL	(1 << 4)
+#define LIBIMAGE_CPU_NEON	(1 << 5)
+#define LIBIMAGE_CPU_ARM_CRC32	(1 << 6)
+
+uint32_t libimage_cpu_features(void);
+
+/*
+*	Streaming decode. The file is fed in pieces of any size and each scanline reaches the callback as soon as it is
+*	decoded: the unfiltered row without the filter byte, y is the row in the image and pass the Adam7 pass ( 0 to 6 )
+*	for interlaced images, 0 otherwise. Feed and finish return zero or the error code that stopped the decode.
+*	Rows go out before the CRC of the IDAT they came from is checked, so a damaged chunk fails the feed after the
+*	callback got its rows: a caller that can't take rows of a bad file keeps them until finish returns zero.
+*	libimage_stream_set_verify_adler turns the Adler-32 check of the zlib stream off for trusted input, it is set
+*	before the image data is fed.
+*/
+typedef struct libimage_stream LibImageStream;
+typedef void (*LibImageRowCallback)(void *user, const uint8_t *row, uint32_t row_size, uint32_t y, int pass);
+
+LibImageStream *libimage_stream_create(LibImageRowCallback row_callback, void *user);
+int libimage_stream_feed(LibImageStream *s, const uint8_t *data, size_t size);
+int libimage_stream_finish(LibImageStream *s);
+int libimage_stream_set_verify_adler(LibImageStream *s, int verify);
+int libimage_stream_get_header(LibImageStream *s, uint32_t *width, uint32_t *height, uint8_t *bit_depth, uint8_t *color_type, uint8_t *interlace_method);
+void libimage_stream_destroy(LibImageStream *s);
+
+/*
+*	Reusable decoder, for decoding many images in a row. The scratch memory of a decode stays in the decoder for
+*	the next one, so once it has seen an image of a given size decoding does no allocation besides the returned
+*	image. Memory comes from the allocator given at creation, malloc and free when it is NULL. The image is given
+*	back with libimage_decoder_free_image. A decoder is used by one thread at a time, but it can spread a decode on
+*	thread_count threads ( one per online CPU when zero ) with libimage_decoder_set_threads, interlaced images are
+*	then decoded a pass at a time in parallel. It decodes on the calling thread only by default.
+*
+*	Images come in the sample layout of the file unless libimage_decoder_set_format picks one of the formats below,
+*	rows are then converted as they are decoded. Any colour type and bit depth converts to any of them: palettes and
+*	tRNS become colours and alpha, 16 bit samples are cut to their high byte for the 8 bit formats and RGBA16 is in
+*	the byte order of the machine. Formats without alpha drop it, GRAY8 is the BT.601 luma.
+*
+*	libimage_decoder_set_region cuts the images to width x height pixels from x, y, which is what width and height
+*	then give back. Rows past the region are not decoded at all for images that aren't interlaced. A region that
+*	doesn't fit in an image fails its decode, a width or height of zero goes back to the whole image.
+*
+*	libimage_decoder_set_scale shrinks the images ( the region when there is one ) to 1/2, 1/4 or 1/8 on both
+*	sides while they are decoded, each pixel the mean of the block it covers. The full size image is never held.
+*	It takes any format, LIBIMAGE_FORMAT_NATIVE only for 8 bit images that are not palette based.
+*
+*	libimage_decoder_set_parallel_inflate lets a decode on more than one thread inflate the compressed data itself
+*	in parallel, for files whose encoder did full flushes along the way ( Z_FULL_FLUSH in zlib ). The stream is cut
+*	at the flushes and the inflated image is held whole, other files decode as before. Off by default.
+*
+*	libimage_decoder_set_verify_adler with verify zero skips the Adler-32 at the end of the zlib stream, for inputs
+*	that are trusted, jobs of the decoder too. The chunk CRCs are still checked. On by default.
+*
+*	Files with critical chunks the decoder doesn't know fail, unknown ancillary chunks are stepped over.
+*/
+#define LIBIMAGE_FORMAT_NATIVE	0
+#define LIBIMAGE_FORMAT_RGBA8	1
+#define LIBIMAGE_FORMAT_RGB8	2
+#define LIBIMAGE_FORMAT_BGRA8	3
+#define LIBIMAGE_FORMAT_GRAY8	4
+#define LIBIMAGE_FORMAT_RGBA16	5
+
+typedef struct libimage_allocator {
+	void	*(*alloc)(void *user, size_t size);
+	void	(*free)(void *user, void *ptr);
+	void	*user;
+} LibImageAllocator;
+typedef struct libimage_decoder LibImageDecoder;
+
+/*
+*	What a decode did, for libraries built with LIBIMAGE_STATS ( build.sh -s ), otherwise setting it fails with the
+*	not built in error and the decode has no hooks at all. libimage_decoder_set_stats gives a struct every decode
+*	clears and fills in: the deflate blocks by type, literals, matches and the bytes they copied ( the mean match
+*	length is match_bytes / matches ), bytes inflated, Huffman tables built, buffers asked for, the ones of them
+*	that reached the allocator and the ones that grew, the scanlines of each filter type and the time of each
+*	LIBIMAGE_STAGE_*. libimage_decoder_set_trace is called on the decoding thread as each stage begins and ends.
+*/
+#define LIBIMAGE_STAGE_CHUNKS		0	// Chunk walk, outside the image data
+#define LIBIMAGE_STAGE_INFLATE		1	// Whole stream inflated at once
+#define LIBIMAGE_STAGE_RECONSTRUCT	2	// Unfilter, de-interlace, conversion and scaling after it
+#define LIBIMAGE_STAGE_ROWS		3	// Inflate and reconstruct a few rows at a time
+#define LIBIMAGE_STAGE_DECODE		4	// The whole decode
+#define LIBIMAGE_STAGE_COUNT		5
+
+typedef struct libimage_stats {
+	uint64_t	stored_blocks, fixed_blocks, dynamic_blocks;
+	uint64_t	literals, matches, match_bytes;
+	uint64_t	inflated_bytes;
+	uint64_t	huffman_builds;
+	uint64_t	allocations, heap_allocations, reallocations;
+	uint64_t	filter_rows[5];		// None, Sub, Up, Average, Paeth
+	uint64_t	stage_ns[LIBIMAGE_STAGE_COUNT];
+} LibImageStats;
+
+typedef void (*LibImageTraceCallback)(void *user, uint32_t stage, int end, uint64_t ns);
+
+LibImageDecoder *libimage_decoder_create(const LibImageAllocator *allocator);
+void *libimage_decoder_decode(LibImageDecoder *d, uint8_t *data, size_t size, uint32_t *width, uint32_t *height, int *error);
+void libimage_decoder_set_threads(LibImageDecoder *d, uint32_t thread_count);
+int libimage_decoder_set_format(LibImageDecoder *d, uint32_t format);
+void libimage_decoder_set_region(LibImageDecoder *d, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+int libimage_decoder_set_scale(LibImageDecoder *d, uint32_t denominator);
+void libimage_decoder_set_parallel_inflate(LibImageDecoder *d, int enable);
+void libimage_decoder_set_verify_adler(LibImageDecoder *d, int verify);
+int libimage_decoder_set_stats(LibImageDecoder *d, LibImageStats *stats);
+int libimage_decoder_set_trace(LibImageDecoder *d, LibImageTraceCallback trace, void *user);
+void libimage_decoder_free_image(LibImageDecoder *d, void *pixels);
+void libimage_decoder_destroy(LibImageDecoder *d);
+
+/*
+*	Limits of each decode of a decoder, set with libimage_decoder_set_limits ( NULL for none, the default ), a
+*	field left at zero doesn't limit. Sizes are worked out from the header and the region, format and scale of the
+*	decoder before anything is allocated for the image, a decode over any of them fails with an error and no cost
+*	beyond the chunks ahead of the image data. max_input_bytes is checked against the length of the file when the
+*	call has one, otherwise nothing past it is read. max_alloc_bytes caps the bytes the decode asks for, the returned
+*	image and the buffers of the inflate, so that a header asking for a huge image is turned down right away.
+*
+*	A decode that can be cancelled or has a time limit checks both while it inflates, every 256K of inflated data.
+*	cancel points to a flag another thread sets to stop it, time_limit_ns counts from the start of the
+*	decode ( from libimage_job_create for a job ). The async decoder and the batch take limits in their options,
+*	one cancel flag stops all of their decodes.
+*/
+typedef struct libimage_limits {
+	uint64_t	max_output_bytes;	// Of the image, whether it is handed back or written to the caller's memory
+	uint64_t	max_pixels;		// Width times height of the file
+	uint64_t	max_input_bytes;	// Of the file, from the signature to the end of IEND
+	uint64_t	max_alloc_bytes;	// The image and the buffers of the inflate
+	uint64_t	time_limit_ns;
+	const int	*cancel;
+} LibImageLimits;
+
+int libimage_decoder_set_limits(LibImageDecoder *d, const LibImageLimits *limits);
+
+/*
+*	Row index, for large images that are decoded a region at a time. Set on a decoder with
+*	libimage_decoder_set_index, it records where the inflate stood at least every interval rows of the decodes that
+*	go past them: the place in the IDAT chunks, the state of the deflate block, the 32K window and the unfiltered
+*	row above. A decode of a region further down then starts from the last of these above it instead of from the
+*	start of the stream. Only images that aren't interlaced are indexed, and only decodes that go row by row use
+*	it, not the ones inflating in parallel. Each checkpoint holds up to 64K and two rows.
+*
+*	An index is for one file, one handed another file drops its checkpoints and starts over for it. It is used by
+*	one decode at a time. libimage_index_save gives it as a blob from its allocator, to keep next to the file, and
+*	libimage_index_load reads one back. The blob is checked to be well formed and each checkpoint against the file
+*	when it is used, the window bytes it carries are taken as they are. Both return NULL with *error set on failure.
+*/
+typedef struct libimage_index LibImageIndex;
+
+LibImageIndex *libimage_index_create(const LibImageAllocator *allocator, uint32_t interval);
+void libimage_decoder_set_index(LibImageDecoder *d, LibImageIndex *index);
+uint32_t libimage_index_checkpoints(const LibImageIndex *index);
+void *libimage_index_save(const LibImageIndex *index, size_t *size, int *error);
+LibImageIndex *libimage_index_load(const LibImageAllocator *allocator, const uint8_t *data, size_t size, int *error);
+void libimage_index_destroy(LibImageIndex *index);
+
+/*
+*	Decodes into the caller's memory rather than an image of the decoder, a texture upload buffer or a mapped GPU
+*	buffer for instance. Rows are stride bytes apart ( the packed row size when stride is zero ), the last one only
+*	takes the bytes of a row, and the bytes between rows are left as they are. The pixels are in format, the one set
+*	on the decoder is not used. Region, scale and threads are the decoder's. Returns zero, or the error when out->size
+*	can't hold the image or the stride is less than a row, nothing is written then.
+*
+*	Outputs bigger than the last level cache are written with non-temporal stores a whole row at a time, they would
+*	only push the rest of the decode out of it. Memory that is mapped write-combined, where reads are slow and
+*	partial writes are costly, can't be told apart from the rest: LIBIMAGE_OUTPUT_WRITE_COMBINED streams every
+*	image, LIBIMAGE_OUTPUT_CACHED none. A failed decode can leave any rows written.
+*/
+#define LIBIMAGE_OUTPUT_WRITE_COMBINED	0x1	// The output is only ever written, rows at a time
+#define LIBIMAGE_OUTPUT_CACHED		0x2	// Plain stores whatever the size
+
+typedef struct libimage_output {
+	void		*pixels;
+	size_t		stride;
+	size_t		size;		// Bytes at pixels
+	uint32_t	format;		// LIBIMAGE_FORMAT_*
+	uint32_t	flags;		// LIBIMAGE_OUTPUT_*
+} LibImageOutput;
+
+int libimage_decoder_decode_into(LibImageDecoder *d, uint8_t *data, size_t size, const LibImageOutput *out, uint32_t *width, uint32_t *height);
+
+/*
+*	Decodes that don't hold up an event loop. A job is a decode of a decoder that its caller steps: each
+*	libimage_job_step goes through up to rows more scanlines ( the rest when rows is zero ) and returns non zero
+*	while there is more, so the loop can do other work in between. It decodes on the calling thread only, with the
+*	format, region, scale and index of the decoder, which is the job's until libimage_job_finish. That frees the job
+*	and returns its image, given back with libimage_decoder_free_image, or NULL with *error set when the decode
+*	failed or was left before its end.
+*
+*	The async decoder has workers of its own that stay up from one file to the next. libimage_async_decode decodes
+*	files up to inline_bytes ( 64K by default ) right away and calls done before it returns, a thread would cost
+*	more than the decode. Bigger ones are queued and done is called from a worker, or with poll set from
+*	libimage_async_poll, called on the thread of the loop once libimage_async_fd is readable. The data has to stay
+*	there until done. Each result is given back with libimage_async_free_image. Submit and poll from one thread.
+*	libimage_async_destroy waits for the files queued and calls back the ones not polled yet.
+*/
+typedef struct libimage_job LibImageJob;
+typedef struct libimage_async LibImageAsync;
+
+typedef struct libimage_async_result {
+	void		*pixels;	// Allocated with the allocator of the options, free() by default
+	uint32_t	width, height;
+	int		error;
+} LibImageAsyncResult;
+
+typedef void (*LibImageAsyncCallback)(void *user, const LibImageAsyncResult *result);
+
+typedef struct libimage_async_options {
+	uint32_t		thread_count;	// Workers, zero for one per online CPU
+	size_t			inline_bytes;	// Files up to this size are decoded inline, zero for 64K
+	const LibImageAllocator	*allocator;	// NULL for malloc and free
+	uint32_t		format;		// LIBIMAGE_FORMAT_* of the pixels
+	uint8_t			poll;		// Callbacks run from libimage_async_poll
+	const LibImageLimits	*limits;	// Of each file, NULL for none
+} LibImageAsyncOptions;
+
+LibImageJob *libimage_job_create(LibImageDecoder *d, uint8_t *data, size_t size);
+int libimage_job_step(LibImageJob *job, uint32_t rows);
+void *libimage_job_finish(LibImageJob *job, uint32_t *width, uint32_t *height, int *error);
+
+LibImageAsync *libimage_async_create(const LibImageAsyncOptions *opts);
+int libimage_async_decode(LibImageAsync *a, uint8_t *data, size_t size, LibImageAsyncCallback done, void *user);
+int libimage_async_fd(LibImageAsync *a);
+size_t libimage_async_poll(LibImageAsync *a);
+void libimage_async_free_image(LibImageAsync *a, void *pixels);
+void libimage_async_destroy(LibImageAsync *a);
+
+/*
+*	Decodes a list of files on thread_count threads ( one per online CPU when zero ), the calling thread being one of
+*	them, and returns when all are done. Small files are handed out in groups of about grain_bytes of input. Every
+*	result goes to outputs[i] when outputs isn't NULL and to on_complete, called from the worker thread, when set.
+*	Pixels come from the allocator of the options and are given back with its free ( free() by default ), in the
+*	LIBIMAGE_FORMAT_* of the options. Returns
+*	zero or the error that kept the batch from starting, the error of each image is in its output.
+*/
+typedef struct libimage_batch_input {
+	uint8_t	*data;
+	size_t	size;
+} LibImageBatchInput;
+
+typedef struct libimage_batch_output {
+	void		*pixels;
+	uint32_t	width, height;
+	int		error;
+} LibImageBatchOutput;
+
+typedef void (*LibImageBatchCallback)(void *user, size_t index, const LibImageBatchOutput *output);
+
+typedef struct libimage_batch_options {
+	uint32_t		thread_count;
+	size_t			grain_bytes;
+	LibImageBatchCallback	on_complete;
+	void			*user;
+	const LibImageAllocator	*allocator;
+	uint32_t		format;
+	const LibImageLimits	*limits;	// Of each image, NULL for none
+} LibImageBatchOptions;
+
+int libimage_decode_batch(const LibImageBatchInput *inputs, size_t count, LibImageBatchOutput *outputs, const LibImageBatchOptions *opts);
+
+/*
+*	Reads what the file says about the image without decoding it. size can be a prefix of the file, only the chunks
+*	before the image data are read ( a few hundred bytes for most files ), a prefix too short for them gives the
+*	truncated data error. gamma is the gAMA value times 100000, zero when the file has none. Returns zero or the
+*	error code.
+*/
+typedef struct libimage_probe_info {
+	uint32_t	width, height;
+	uint32_t	gamma;
+	uint16_t	palette_entries;
+	uint8_t		bit_depth, color_type, interlace_method;
+	uint8_t		has_transparency;
+} LibImageProbeInfo;
+
+int libimage_probe(const uint8_t *data, size_t size, LibImageProbeInfo *probe);
+
+/*
+*	Encodes width x height pixels of one of the LIBIMAGE_FORMAT_* ( anything but NATIVE ) into a PNG file: RGBA8 and
+*	BGRA8 as 8 bit truecolour with alpha, RGB8 as truecolour, GRAY8 as greyscale and RGBA16, in the byte order of
+*	the machine, as 16 bit truecolour with alpha. Rows are stride bytes apart, packed when it is zero. Each row gets
+*	the filter that leaves the smallest bytes. The level trades size for speed: STORED doesn't compress, RLE only
+*	repeats the previous byte and pixel and is the fastest that compresses, GREEDY and LAZY search a window of 32K.
+*	NULL opts is packed RGBA8 at the RLE level. Returns the file, *size bytes from the allocator of opts ( malloc
+*	when NULL, give it back with its free ), or NULL with *error set.
+*/
+#define LIBIMAGE_ENCODE_STORED	0
+#define LIBIMAGE_ENCODE_RLE	1
+#define LIBIMAGE_ENCODE_GREEDY	2
+#define LIBIMAGE_ENCODE_LAZY	3
+
+typedef struct libimage_encode_options {
+	uint32_t		format;
+	uint32_t		level;
+	size_t			stride;
+	const LibImageAllocator	*allocator;
+} LibImageEncodeOptions;
+
+void *libimage_encode_png(const void *pixels, uint32_t width, uint32_t height, const LibImageEncodeOptions *opts, size_t *size, int *error);
 
 #endif
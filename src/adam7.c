@@ -0,0 +1,323 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "filter.h"
+#include "arena.h"
+#include "pool.h"
+#include "convert.h"
+#include "scale.h"
+#include "adam7.h"
+#include "stats.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LIBIMAGE_ADAM7_SSE2	1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LIBIMAGE_ADAM7_NEON	1
+#endif
+
+#define LIBIMAGE_ADAM7_INLINE	static inline __attribute__((always_inline))
+
+typedef struct libimage_adam7_job {
+	LibImageImageInfo	*info;
+	LibImageAdam7Layout	layout;
+	const uint8_t		*zero_row;
+	uint8_t			*tmp;		// Three full rows per worker, and a converted row of a streamed output
+	uint64_t		row_bytes, out_row_bytes, tmp_bytes;
+	uint32_t		bpp, pixel_bits;
+	uint32_t		end_y;		// Bottom edge of the region, the rows of the passes past it are left filtered
+	LibImageScaleLane	*lanes;		// One per worker when info->scaler is set
+	int			error;
+} LibImageAdam7Job;
+
+void png_adam7_layout(LibImageImageInfo *info, LibImageAdam7Layout *layout)
+{
+int pass;
+
+	layout->size = 0;
+	for(pass = 0; pass < LIBIMAGE_PNG_ADAM7_PASSES; pass++) {
+		png_adam7_pass_size(info, pass, &layout->width[pass], &layout->height[pass]);
+		if(layout->width[pass] == 0 || layout->height[pass] == 0) layout->width[pass] = layout->height[pass] = 0;
+		layout->row_bytes[pass] = png_row_bytes(info, layout->width[pass]);
+		layout->offset[pass]	= layout->size;
+		layout->size	       += (uint64_t)layout->height[pass] * (1 + layout->row_bytes[pass]);
+	}
+}
+
+// Puts the pixels of a reduced Adam7 row at their place in the full image row.
+void png_adam7_scatter_row(LibImageImageInfo *info, uint8_t *dst, const uint8_t *row, uint32_t width, int pass)
+{
+uint32_t	pixel_bits, pixel_bytes, i, x, shift, value;
+
+	pixel_bits = png_channel_count(info->color_type) * info->bit_depth;
+	x	   = png_adam7_start_x[pass];
+	if(pixel_bits >= 8) {
+		pixel_bytes = pixel_bits / 8;
+		for(i = 0; i < width; i++, x += png_adam7_step_x[pass]) memcpy(dst + x * pixel_bytes, row + i * pixel_bytes, pixel_bytes);
+		return;
+	}
+	// Packed pixels, the leftmost one is in the high bits of the byte.
+	for(i = 0; i < width; i++, x += png_adam7_step_x[pass]) {
+		shift	= 8 - pixel_bits - (i * pixel_bits) % 8;
+		value	= (row[i * pixel_bits / 8] >> shift) & ((1 << pixel_bits) - 1);
+		shift	= 8 - pixel_bits - (x * pixel_bits) % 8;
+		dst[x * pixel_bits / 8] |= value << shift;
+	}
+}
+
+LIBIMAGE_ADAM7_INLINE void adam7_interleave_n(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint32_t count, uint32_t pb)
+{
+uint32_t	pairs, i;
+
+	pairs = count / 2;
+	i     = 0;
+#if defined(LIBIMAGE_ADAM7_SSE2)
+	// 16 bytes of each side per step, unpack puts pixel i of a right before pixel i of b.
+	if(pb == 1 || pb == 2 || pb == 4 || pb == 8) {
+		__m128i va, vb, lo, hi;
+
+		for(; (i + 16 / pb) <= pairs; i += 16 / pb) {
+			va = _mm_loadu_si128((const __m128i*)(a + i * pb));
+			vb = _mm_loadu_si128((const __m128i*)(b + i * pb));
+			if(pb == 1) {
+				lo = _mm_unpacklo_epi8(va, vb);
+				hi = _mm_unpackhi_epi8(va, vb);
+			} else if(pb == 2) {
+				lo = _mm_unpacklo_epi16(va, vb);
+				hi = _mm_unpackhi_epi16(va, vb);
+			} else if(pb == 4) {
+				lo = _mm_unpacklo_epi32(va, vb);
+				hi = _mm_unpackhi_epi32(va, vb);
+			} else {
+				lo = _mm_unpacklo_epi64(va, vb);
+				hi = _mm_unpackhi_epi64(va, vb);
+			}
+			_mm_storeu_si128((__m128i*)(dst + 2 * i * pb), lo);
+			_mm_storeu_si128((__m128i*)(dst + 2 * i * pb + 16), hi);
+		}
+	}
+#elif defined(LIBIMAGE_ADAM7_NEON)
+	// Two register stores interleave the lanes of a and b.
+	if(pb == 1) {
+		for(; i + 16 <= pairs; i += 16) {
+			uint8x16x2_t v = { { vld1q_u8(a + i), vld1q_u8(b + i) } };
+			vst2q_u8(dst + 2 * i, v);
+		}
+	} else if(pb == 2) {
+		for(; i + 8 <= pairs; i += 8) {
+			uint16x8x2_t v = { { vreinterpretq_u16_u8(vld1q_u8(a + 2 * i)), vreinterpretq_u16_u8(vld1q_u8(b + 2 * i)) } };
+			vst2q_u16((uint16_t*)(void*)(dst + 4 * i), v);
+		}
+	} else if(pb == 4) {
+		for(; i + 4 <= pairs; i += 4) {
+			uint32x4x2_t v = { { vreinterpretq_u32_u8(vld1q_u8(a + 4 * i)), vreinterpretq_u32_u8(vld1q_u8(b + 4 * i)) } };
+			vst2q_u32((uint32_t*)(void*)(dst + 8 * i), v);
+		}
+	}
+#endif
+	for(; i < pairs; i++) {
+		memcpy(dst + 2 * i * pb, a + i * pb, pb);
+		memcpy(dst + (2 * i + 1) * pb, b + i * pb, pb);
+	}
+	if(count & 1) memcpy(dst + (count - 1) * pb, a + pairs * pb, pb);
+}
+
+/*
+*	dst gets count pixels of pixel_bytes, a gives the even ones and b the odd ones. Each pass of Adam7 fills the
+*	gaps left by the ones before it at half the spacing, so a full row is at most three of these.
+*/
+void png_adam7_interleave(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint32_t count, uint32_t pixel_bytes)
+{
+	switch(pixel_bytes) {
+		case 1: adam7_interleave_n(dst, a, b, count, 1); break;
+		case 2: adam7_interleave_n(dst, a, b, count, 2); break;
+		case 3: adam7_interleave_n(dst, a, b, count, 3); break;
+		case 4: adam7_interleave_n(dst, a, b, count, 4); break;
+		case 6: adam7_interleave_n(dst, a, b, count, 6); break;
+		default: adam7_interleave_n(dst, a, b, count, 8); break;
+	}
+}
+
+// The reconstructed row r of a pass, it was unfiltered over its own scanline one byte to the left.
+static const uint8_t *adam7_pass_row(LibImageAdam7Job *job, int pass, uint32_t r)
+{
+	return job->info->uncompressed_data + job->layout.offset[pass] + r * (1 + job->layout.row_bytes[pass]);
+}
+
+/*
+*	Stage one, one task per pass and the biggest first. Passes are independent reduced images, each scanline is
+*	reconstructed in place over its filter byte so the row above is right before it.
+*/
+static void adam7_unfilter_pass(void *user, size_t task, uint32_t worker)
+{
+LibImageAdam7Job	*job = user;
+uint8_t			*line;
+const uint8_t		*prev;
+uint64_t		row_bytes;
+uint32_t		r;
+int			pass, ret;
+#ifdef LIBIMAGE_STATS
+uint64_t		filter_rows[LIBIMAGE_STATS_FILTER_TYPES] = {0};
+#endif
+
+	(void)worker;
+	pass	  = LIBIMAGE_PNG_ADAM7_PASSES - 1 - (int)task;
+	row_bytes = job->layout.row_bytes[pass];
+	line	  = job->info->uncompressed_data + job->layout.offset[pass];
+	prev	  = job->zero_row;
+	for(r = 0; r < job->layout.height[pass] && png_adam7_start_y[pass] + r * png_adam7_step_y[pass] < job->end_y; r++, line += 1 + row_bytes) {
+#ifdef LIBIMAGE_STATS
+		// The row is unfiltered over its filter byte.
+		if(line[0] < LIBIMAGE_STATS_FILTER_TYPES) filter_rows[line[0]]++;
+#endif
+		ret = png_unfilter_row(line, line + 1, prev, row_bytes, job->bpp, line[0]);
+		if(ret) {
+			__atomic_store_n(&job->error, ret, __ATOMIC_RELAXED);
+			break;
+		}
+		prev = line;
+	}
+#ifdef LIBIMAGE_STATS
+	for(r = 0; r < LIBIMAGE_STATS_FILTER_TYPES; r++) LIBIMAGE_STAT_ADD(job->info, filter_rows[r], filter_rows[r]);
+#endif
+}
+
+static void adam7_gather_row(LibImageAdam7Job *job, uint32_t y, uint8_t *out, uint8_t *tmp0, uint8_t *tmp1)
+{
+LibImageAdam7Layout	*l = &job->layout;
+uint32_t		pb, width;
+int			pass;
+
+	if(job->pixel_bits < 8) {
+		// Passes share the bytes of packed rows, the row is only written by its own task.
+		memset(out, 0, job->row_bytes);
+		for(pass = 0; pass < LIBIMAGE_PNG_ADAM7_PASSES; pass++) {
+			if(l->width[pass] == 0 || y < png_adam7_start_y[pass] || (y - png_adam7_start_y[pass]) % png_adam7_step_y[pass]) continue;
+			png_adam7_scatter_row(job->info, out, adam7_pass_row(job, pass, (y - png_adam7_start_y[pass]) / png_adam7_step_y[pass]), l->width[pass], pass);
+		}
+		return;
+	}
+
+	pb    = job->pixel_bits / 8;
+	width = job->info->width;
+	if(y & 1) {
+		memcpy(out, adam7_pass_row(job, 6, y / 2), l->row_bytes[6]);
+		return;
+	}
+	if((y & 3) == 2) {
+		png_adam7_interleave(out, adam7_pass_row(job, 4, y / 4), adam7_pass_row(job, 5, y / 2), width, pb);
+		return;
+	}
+	// Even columns first: every 4th from passes 1 and 2 ( or 3 ), the ones in between from pass 4.
+	if((y & 7) == 4) {
+		png_adam7_interleave(tmp0, adam7_pass_row(job, 2, y / 8), adam7_pass_row(job, 3, y / 4), (width + 1) / 2, pb);
+	} else {
+		png_adam7_interleave(tmp1, adam7_pass_row(job, 0, y / 8), adam7_pass_row(job, 1, y / 8), (width + 3) / 4, pb);
+		png_adam7_interleave(tmp0, tmp1, adam7_pass_row(job, 3, y / 4), (width + 1) / 2, pb);
+	}
+	png_adam7_interleave(out, tmp0, adam7_pass_row(job, 5, y / 2), width, pb);
+}
+
+/*
+*	Stage two, bands of output rows of the region. Every row is put together from the passes that have pixels in
+*	it, straight in the output unless it gets converted, scaled or cut to an x-window. Bands are whole blocks of
+*	the scaler, LIBIMAGE_ADAM7_BAND_ROWS is a multiple of the biggest one.
+*/
+static void adam7_deinterlace_band(void *user, size_t task, uint32_t worker)
+{
+LibImageAdam7Job	*job = user;
+LibImageImageInfo	*info = job->info;
+uint8_t			*tmp0, *tmp1, *row, *out;
+uint32_t		y, end;
+
+	tmp0 = job->tmp + (uint64_t)worker * job->tmp_bytes;
+	tmp1 = tmp0 + job->row_bytes;
+	row  = tmp1 + job->row_bytes;
+	y    = info->roi_y + task * LIBIMAGE_ADAM7_BAND_ROWS;
+	end  = y + LIBIMAGE_ADAM7_BAND_ROWS < job->end_y ? y + LIBIMAGE_ADAM7_BAND_ROWS : job->end_y;
+	for(; y < end; y++) {
+		out = info->processed_data + (uint64_t)(y - info->roi_y) * info->out_stride;
+		if(info->converter == NULL && info->scaler == NULL && info->roi_width == info->width && !info->out_stream) {
+			adam7_gather_row(job, y, out, tmp0, tmp1);
+			continue;
+		}
+		adam7_gather_row(job, y, row, tmp0, tmp1);
+		if(info->scaler) png_scale_row(info, &job->lanes[worker], y - info->roi_y, row);
+		else png_write_output_row(info, y - info->roi_y, row, row + job->row_bytes);
+	}
+}
+
+// Last pass with pixels in row y, the row is complete once it is in.
+int png_adam7_last_pass(LibImageImageInfo *info, uint32_t y)
+{
+uint32_t	width, height;
+int		pass;
+
+	for(pass = LIBIMAGE_PNG_ADAM7_PASSES - 1; pass > 0; pass--) {
+		if(y < png_adam7_start_y[pass] || (y - png_adam7_start_y[pass]) % png_adam7_step_y[pass]) continue;
+		png_adam7_pass_size(info, pass, &width, &height);
+		if(width) break;
+	}
+	return pass;
+}
+
+/*
+*	Reconstructs an interlaced image whose whole inflated stream is in uncompressed_data into processed_data, on up
+*	to thread_count threads ( the calling one included ). The passes are unfiltered in parallel, then the rows are
+*	de-interlaced in parallel, and converted when info->converter is set. Only the rows of the region set in info
+*	are put together. uncompressed_data is overwritten. Returns zero or the error.
+*/
+int png_adam7_decode(LibImageImageInfo *info, uint32_t thread_count)
+{
+LibImageAdam7Job	job;
+uint32_t		bands, workers, i;
+int			ret;
+
+	memset(&job, 0, sizeof(job));
+	job.info	= info;
+	job.row_bytes	  = png_row_bytes(info, info->width);
+	job.out_row_bytes = png_output_row_bytes(info);
+	job.bpp		= png_filter_bpp(info);
+	job.pixel_bits	= png_channel_count(info->color_type) * info->bit_depth;
+	job.end_y	= info->roi_y + info->roi_height;
+	png_adam7_layout(info, &job.layout);
+	if(job.layout.size != (uint64_t)info->un_size) return LIBIMAGE_PNG_ERROR_NOT_ENOUGH_DATA;
+	if(thread_count == 0) thread_count = 1;
+
+	bands	= (info->roi_height + LIBIMAGE_ADAM7_BAND_ROWS - 1) / LIBIMAGE_ADAM7_BAND_ROWS;
+	workers	= libimage_pool_thread_count(thread_count, bands);
+	job.tmp_bytes = 3 * job.row_bytes + (info->out_stream ? job.out_row_bytes : 0);
+	job.tmp	= libimage_scratch_alloc(info, workers * job.tmp_bytes + job.row_bytes + 1);
+	if(job.tmp == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	memset(job.tmp + workers * job.tmp_bytes, 0, job.row_bytes + 1);
+	job.zero_row = job.tmp + workers * job.tmp_bytes;
+
+	ret = 0;
+	if(info->scaler) {
+		job.lanes = libimage_scratch_alloc(info, workers * sizeof(*job.lanes));
+		if(job.lanes) memset(job.lanes, 0, workers * sizeof(*job.lanes));
+		else ret = LIBIMAGE_ERROR_OUT_OF_MEMORY;
+		for(i = 0; i < workers && ret == 0; i++) ret = png_scale_lane_alloc(info, &job.lanes[i]);
+	}
+
+	if(ret == 0) ret = libimage_pool_run(LIBIMAGE_PNG_ADAM7_PASSES, libimage_pool_thread_count(thread_count, LIBIMAGE_PNG_ADAM7_PASSES), adam7_unfilter_pass, &job);
+	if(ret == 0) ret = job.error;
+	if(ret == 0) ret = libimage_pool_run(bands, workers, adam7_deinterlace_band, &job);
+
+	for(i = 0; job.lanes && i < workers; i++) png_scale_lane_free(info, &job.lanes[i]);
+	libimage_scratch_free(info, job.lanes);
+	libimage_scratch_free(info, job.tmp);
+	return ret;
+}
@@ -0,0 +1,34 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_ADAM7_H__
+#define __LIB_IMAGE_ADAM7_H__
+
+#include <inttypes.h>
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+
+#define LIBIMAGE_ADAM7_BAND_ROWS	32	// Output rows per de-interlace task, a multiple of the scaler blocks
+
+/*
+*	Where the seven reduced images sit in the inflated stream, worked out from IHDR before anything is decoded.
+*	Passes without pixels have zero size.
+*/
+typedef struct libimage_adam7_layout {
+	uint32_t	width[LIBIMAGE_PNG_ADAM7_PASSES], height[LIBIMAGE_PNG_ADAM7_PASSES];
+	uint64_t	row_bytes[LIBIMAGE_PNG_ADAM7_PASSES];
+	uint64_t	offset[LIBIMAGE_PNG_ADAM7_PASSES];
+	uint64_t	size;
+} LibImageAdam7Layout;
+
+void png_adam7_layout(LibImageImageInfo *info, LibImageAdam7Layout *layout);
+void png_adam7_scatter_row(LibImageImageInfo *info, uint8_t *dst, const uint8_t *row, uint32_t width, int pass);
+void png_adam7_interleave(uint8_t *dst, const uint8_t *a, const uint8_t *b, uint32_t count, uint32_t pixel_bytes);
+int png_adam7_last_pass(LibImageImageInfo *info, uint32_t y);
+int png_adam7_decode(LibImageImageInfo *info, uint32_t thread_count);
+
+#endif
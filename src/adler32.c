@@ -0,0 +1,221 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "adler32.h"
+#include "cpu.h"
+
+#if defined(LIBIMAGE_ADLER32_SSSE3)
+#include <immintrin.h>
+#elif defined(LIBIMAGE_ADLER32_NEON)
+#include <arm_neon.h>
+#endif
+
+/*
+*	s1 is 1 plus the sum of the bytes and s2 the sum of every s1 on the way, both modulo LIBIMAGE_ADLER32_BASE.
+*	The modulo is only taken once per LIBIMAGE_ADLER32_NMAX bytes, the most s2 can take without overflowing.
+*/
+#define LIBIMAGE_ADLER32_BLOCK	32
+
+uint32_t adler32_update_scalar(uint32_t adler, const uint8_t *buf, size_t len)
+{
+uint32_t	s1 = adler & 0xffff, s2 = adler >> 16;
+size_t		n;
+int		i;
+
+	while(len > 0) {
+		n    = len < LIBIMAGE_ADLER32_NMAX ? len : LIBIMAGE_ADLER32_NMAX;
+		len -= n;
+		while(n >= 16) {
+			for(i = 0; i < 16; i++) {
+				s1 += buf[i];
+				s2 += s1;
+			}
+			buf += 16;
+			n   -= 16;
+		}
+		while(n--) {
+			s1 += *buf++;
+			s2 += s1;
+		}
+		s1 %= LIBIMAGE_ADLER32_BASE;
+		s2 %= LIBIMAGE_ADLER32_BASE;
+	}
+	return (s2 << 16) | s1;
+}
+
+#ifdef LIBIMAGE_ADLER32_SSSE3
+/*
+*	32 bytes per step: psadbw sums the bytes for s1, pmaddubsw weighs them by their distance to the end of the
+*	step for s2, and the s1 of every earlier step counts 32 times ( v_ps ).
+*/
+__attribute__((target("ssse3")))
+uint32_t adler32_update_ssse3(uint32_t adler, const uint8_t *buf, size_t len)
+{
+uint32_t	s1 = adler & 0xffff, s2 = adler >> 16;
+size_t		blocks, n;
+__m128i		tap1, tap2, zero, ones, v_ps, v_s1, v_s2, bytes1, bytes2;
+
+	tap1 = _mm_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17);
+	tap2 = _mm_setr_epi8(16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	zero = _mm_setzero_si128();
+	ones = _mm_set1_epi16(1);
+
+	blocks = len / LIBIMAGE_ADLER32_BLOCK;
+	len   -= blocks * LIBIMAGE_ADLER32_BLOCK;
+	while(blocks) {
+		n	= blocks < LIBIMAGE_ADLER32_NMAX / LIBIMAGE_ADLER32_BLOCK ? blocks : LIBIMAGE_ADLER32_NMAX / LIBIMAGE_ADLER32_BLOCK;
+		blocks -= n;
+		v_ps	= _mm_setr_epi32((int)(s1 * n), 0, 0, 0);
+		v_s2	= _mm_setr_epi32((int)s2, 0, 0, 0);
+		v_s1	= zero;
+		do {
+			bytes1	= _mm_loadu_si128((const __m128i*)buf);
+			bytes2	= _mm_loadu_si128((const __m128i*)(buf + 16));
+			v_ps	= _mm_add_epi32(v_ps, v_s1);
+			v_s1	= _mm_add_epi32(v_s1, _mm_sad_epu8(bytes1, zero));
+			v_s2	= _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes1, tap1), ones));
+			v_s1	= _mm_add_epi32(v_s1, _mm_sad_epu8(bytes2, zero));
+			v_s2	= _mm_add_epi32(v_s2, _mm_madd_epi16(_mm_maddubs_epi16(bytes2, tap2), ones));
+			buf    += LIBIMAGE_ADLER32_BLOCK;
+		} while(--n);
+		v_s2 = _mm_add_epi32(v_s2, _mm_slli_epi32(v_ps, 5));
+
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(2, 3, 0, 1)));
+		v_s1 = _mm_add_epi32(v_s1, _mm_shuffle_epi32(v_s1, _MM_SHUFFLE(1, 0, 3, 2)));
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(2, 3, 0, 1)));
+		v_s2 = _mm_add_epi32(v_s2, _mm_shuffle_epi32(v_s2, _MM_SHUFFLE(1, 0, 3, 2)));
+		s1   = (s1 + (uint32_t)_mm_cvtsi128_si32(v_s1)) % LIBIMAGE_ADLER32_BASE;
+		s2   = (uint32_t)_mm_cvtsi128_si32(v_s2) % LIBIMAGE_ADLER32_BASE;
+	}
+	return adler32_update_scalar((s2 << 16) | s1, buf, len);
+}
+#endif
+
+#ifdef LIBIMAGE_ADLER32_NEON
+// Same steps as the SSSE3 version, the weights are applied once per run to the per column byte sums.
+uint32_t adler32_update_neon(uint32_t adler, const uint8_t *buf, size_t len)
+{
+static const uint16_t taps[16] = { 32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17 };
+static const uint16_t taps2[16] = { 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1 };
+uint32_t	s1 = adler & 0xffff, s2 = adler >> 16;
+size_t		blocks, n;
+uint32x4_t	v_s1, v_s2;
+uint32x2_t	sum1, sum2, s1s2;
+uint16x8_t	col1, col2, col3, col4;
+uint8x16_t	bytes1, bytes2;
+
+	blocks = len / LIBIMAGE_ADLER32_BLOCK;
+	len   -= blocks * LIBIMAGE_ADLER32_BLOCK;
+	while(blocks) {
+		n	= blocks < LIBIMAGE_ADLER32_NMAX / LIBIMAGE_ADLER32_BLOCK ? blocks : LIBIMAGE_ADLER32_NMAX / LIBIMAGE_ADLER32_BLOCK;
+		blocks -= n;
+		v_s2	= vsetq_lane_u32(s1 * n, vdupq_n_u32(0), 0);
+		v_s1	= vdupq_n_u32(0);
+		col1	= col2 = col3 = col4 = vdupq_n_u16(0);
+		do {
+			bytes1	= vld1q_u8(buf);
+			bytes2	= vld1q_u8(buf + 16);
+			v_s2	= vaddq_u32(v_s2, v_s1);
+			v_s1	= vpadalq_u16(v_s1, vpadalq_u8(vpaddlq_u8(bytes1), bytes2));
+			col1	= vaddw_u8(col1, vget_low_u8(bytes1));
+			col2	= vaddw_u8(col2, vget_high_u8(bytes1));
+			col3	= vaddw_u8(col3, vget_low_u8(bytes2));
+			col4	= vaddw_u8(col4, vget_high_u8(bytes2));
+			buf    += LIBIMAGE_ADLER32_BLOCK;
+		} while(--n);
+		v_s2 = vshlq_n_u32(v_s2, 5);
+		v_s2 = vmlal_u16(v_s2, vget_low_u16(col1), vld1_u16(taps));
+		v_s2 = vmlal_u16(v_s2, vget_high_u16(col1), vld1_u16(taps + 4));
+		v_s2 = vmlal_u16(v_s2, vget_low_u16(col2), vld1_u16(taps + 8));
+		v_s2 = vmlal_u16(v_s2, vget_high_u16(col2), vld1_u16(taps + 12));
+		v_s2 = vmlal_u16(v_s2, vget_low_u16(col3), vld1_u16(taps2));
+		v_s2 = vmlal_u16(v_s2, vget_high_u16(col3), vld1_u16(taps2 + 4));
+		v_s2 = vmlal_u16(v_s2, vget_low_u16(col4), vld1_u16(taps2 + 8));
+		v_s2 = vmlal_u16(v_s2, vget_high_u16(col4), vld1_u16(taps2 + 12));
+
+		sum1 = vpadd_u32(vget_low_u32(v_s1), vget_high_u32(v_s1));
+		sum2 = vpadd_u32(vget_low_u32(v_s2), vget_high_u32(v_s2));
+		s1s2 = vpadd_u32(sum1, sum2);
+		s1   = (s1 + vget_lane_u32(s1s2, 0)) % LIBIMAGE_ADLER32_BASE;
+		s2   = (s2 + vget_lane_u32(s1s2, 1)) % LIBIMAGE_ADLER32_BASE;
+	}
+	return adler32_update_scalar((s2 << 16) | s1, buf, len);
+}
+#endif
+
+#ifdef LIBIMAGE_ADLER32_AVX2
+// The SSSE3 steps on 256 bit registers, a whole block per load.
+__attribute__((target("avx2")))
+uint32_t adler32_update_avx2(uint32_t adler, const uint8_t *buf, size_t len)
+{
+uint32_t	s1 = adler & 0xffff, s2 = adler >> 16;
+size_t		blocks, n;
+__m256i		tap, zero, ones, v_ps, v_s1, v_s2, bytes;
+__m128i		sum1, sum2;
+
+	tap  = _mm256_setr_epi8(32, 31, 30, 29, 28, 27, 26, 25, 24, 23, 22, 21, 20, 19, 18, 17, 16, 15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1);
+	zero = _mm256_setzero_si256();
+	ones = _mm256_set1_epi16(1);
+
+	blocks = len / LIBIMAGE_ADLER32_BLOCK;
+	len   -= blocks * LIBIMAGE_ADLER32_BLOCK;
+	while(blocks) {
+		n	= blocks < LIBIMAGE_ADLER32_NMAX / LIBIMAGE_ADLER32_BLOCK ? blocks : LIBIMAGE_ADLER32_NMAX / LIBIMAGE_ADLER32_BLOCK;
+		blocks -= n;
+		v_ps	= _mm256_setr_epi32((int)(s1 * n), 0, 0, 0, 0, 0, 0, 0);
+		v_s2	= _mm256_setr_epi32((int)s2, 0, 0, 0, 0, 0, 0, 0);
+		v_s1	= zero;
+		do {
+			bytes	= _mm256_loadu_si256((const __m256i*)buf);
+			v_ps	= _mm256_add_epi32(v_ps, v_s1);
+			v_s1	= _mm256_add_epi32(v_s1, _mm256_sad_epu8(bytes, zero));
+			v_s2	= _mm256_add_epi32(v_s2, _mm256_madd_epi16(_mm256_maddubs_epi16(bytes, tap), ones));
+			buf    += LIBIMAGE_ADLER32_BLOCK;
+		} while(--n);
+		v_s2 = _mm256_add_epi32(v_s2, _mm256_slli_epi32(v_ps, 5));
+
+		sum1 = _mm_add_epi32(_mm256_castsi256_si128(v_s1), _mm256_extracti128_si256(v_s1, 1));
+		sum2 = _mm_add_epi32(_mm256_castsi256_si128(v_s2), _mm256_extracti128_si256(v_s2, 1));
+		sum1 = _mm_add_epi32(sum1, _mm_shuffle_epi32(sum1, _MM_SHUFFLE(2, 3, 0, 1)));
+		sum1 = _mm_add_epi32(sum1, _mm_shuffle_epi32(sum1, _MM_SHUFFLE(1, 0, 3, 2)));
+		sum2 = _mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, _MM_SHUFFLE(2, 3, 0, 1)));
+		sum2 = _mm_add_epi32(sum2, _mm_shuffle_epi32(sum2, _MM_SHUFFLE(1, 0, 3, 2)));
+		s1   = (s1 + (uint32_t)_mm_cvtsi128_si32(sum1)) % LIBIMAGE_ADLER32_BASE;
+		s2   = (uint32_t)_mm_cvtsi128_si32(sum2) % LIBIMAGE_ADLER32_BASE;
+	}
+	return adler32_update_scalar((s2 << 16) | s1, buf, len);
+}
+#endif
+
+uint32_t adler32_update(uint32_t adler, const uint8_t *buf, size_t len)
+{
+	return libimage_kernels()->adler32_update(adler, buf, len);
+}
+
+/*
+*	Adler-32 of two pieces of data one after the other, from the checksum of each and the length of the second.
+*	s1 just adds up, the sum of s2 gets the s1 of the first piece once per byte of the second.
+*/
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t len2)
+{
+uint32_t	rem, s1, s2;
+
+	rem = len2 % LIBIMAGE_ADLER32_BASE;
+	s1  = adler1 & 0xffff;
+	s2  = (uint32_t)(((uint64_t)rem * s1) % LIBIMAGE_ADLER32_BASE);
+	s1 += (adler2 & 0xffff) + LIBIMAGE_ADLER32_BASE - 1;
+	s2 += (adler1 >> 16) + (adler2 >> 16) + LIBIMAGE_ADLER32_BASE - rem;
+	if(s1 >= LIBIMAGE_ADLER32_BASE) s1 -= LIBIMAGE_ADLER32_BASE;
+	if(s1 >= LIBIMAGE_ADLER32_BASE) s1 -= LIBIMAGE_ADLER32_BASE;
+	if(s2 >= 2 * LIBIMAGE_ADLER32_BASE) s2 -= 2 * LIBIMAGE_ADLER32_BASE;
+	if(s2 >= LIBIMAGE_ADLER32_BASE) s2 -= LIBIMAGE_ADLER32_BASE;
+	return s1 | (s2 << 16);
+}
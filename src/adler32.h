@@ -0,0 +1,49 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_ADLER32_H__
+#define __LIB_IMAGE_ADLER32_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/*
+*	The Adler-32 of the inflated data is checked against the zlib trailer unless LIBIMAGE_PNG_SKIP_ADLER is defined,
+*	or the decode asks to skip it with LibImageImageInfo.skip_adler ( libimage_decoder_set_verify_adler and
+*	libimage_stream_set_verify_adler ).
+*/
+#ifndef LIBIMAGE_PNG_SKIP_ADLER
+#define LIBIMAGE_PNG_CHECK_ADLER
+#endif
+
+#define LIBIMAGE_ADLER32_INIT	1u
+#define LIBIMAGE_ADLER32_BASE	65521u	// Largest prime below 2^16
+#define LIBIMAGE_ADLER32_NMAX	5552	// Most bytes s2 takes before it can overflow 32 bits
+
+// Variants of the update, libimage_kernels picks the one the CPU runs.
+#if defined(__x86_64__) || defined(__i386__)
+#define LIBIMAGE_ADLER32_SSSE3	1
+#define LIBIMAGE_ADLER32_AVX2	1
+#elif defined(__ARM_NEON)
+#define LIBIMAGE_ADLER32_NEON	1
+#endif
+
+typedef uint32_t (*LibImageAdlerUpdate)(uint32_t adler, const uint8_t *buf, size_t len);
+
+uint32_t adler32_update(uint32_t adler, const uint8_t *buf, size_t len);
+uint32_t adler32_update_scalar(uint32_t adler, const uint8_t *buf, size_t len);
+#ifdef LIBIMAGE_ADLER32_SSSE3
+uint32_t adler32_update_ssse3(uint32_t adler, const uint8_t *buf, size_t len);
+#endif
+#ifdef LIBIMAGE_ADLER32_AVX2
+uint32_t adler32_update_avx2(uint32_t adler, const uint8_t *buf, size_t len);
+#endif
+#ifdef LIBIMAGE_ADLER32_NEON
+uint32_t adler32_update_neon(uint32_t adler, const uint8_t *buf, size_t len);
+#endif
+uint32_t adler32_combine(uint32_t adler1, uint32_t adler2, uint64_t len2);
+
+#endif
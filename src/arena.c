@@ -0,0 +1,155 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "arena.h"
+#include "stats.h"
+
+#define LIBIMAGE_ARENA_ROUND(size)	(((size) + LIBIMAGE_ARENA_ALIGN - 1) & ~(size_t)(LIBIMAGE_ARENA_ALIGN - 1))
+
+static void *allocator_malloc(void *user, size_t size)
+{
+	(void)user;
+	return malloc(size);
+}
+
+static void allocator_free(void *user, void *ptr)
+{
+	(void)user;
+	free(ptr);
+}
+
+void libimage_allocator_default(LibImageAllocator *allocator)
+{
+	allocator->alloc = allocator_malloc;
+	allocator->free	 = allocator_free;
+	allocator->user	 = NULL;
+}
+
+void *libimage_allocator_alloc(const LibImageAllocator *allocator, size_t size)
+{
+	return allocator->alloc(allocator->user, size);
+}
+
+void libimage_allocator_free(const LibImageAllocator *allocator, void *ptr)
+{
+	if(ptr) allocator->free(allocator->user, ptr);
+}
+
+void arena_init(LibImageArena *arena, const LibImageAllocator *allocator)
+{
+	memset(arena, 0, sizeof(*arena));
+	if(allocator) arena->allocator = *allocator;
+	else libimage_allocator_default(&arena->allocator);
+}
+
+// The allocator only promises malloc alignment, base and overflow blocks are aligned by hand.
+static uint8_t *arena_align(void *ptr)
+{
+	return (uint8_t*)LIBIMAGE_ARENA_ROUND((uintptr_t)ptr);
+}
+
+void *arena_alloc(LibImageArena *arena, size_t size)
+{
+LibImageArenaBlock	*block;
+uint8_t			*ptr;
+
+	size = LIBIMAGE_ARENA_ROUND(size);
+	if(size == 0) size = LIBIMAGE_ARENA_ALIGN;
+	arena->needed += size;
+	if(arena->base && arena->size - arena->used >= size) {
+		ptr = arena_align(arena->base) + arena->used;
+		arena->used += size;
+		return ptr;
+	}
+
+	block = libimage_allocator_alloc(&arena->allocator, LIBIMAGE_ARENA_ALIGN + sizeof(*block) + size);
+	if(block == NULL) return NULL;
+	block->next	= arena->overflow;
+	arena->overflow	= block;
+	return arena_align((uint8_t*)(block + 1));
+}
+
+void arena_reset(LibImageArena *arena)
+{
+LibImageArenaBlock	*block, *next;
+size_t			needed;
+
+	for(block = arena->overflow; block; block = next) {
+		next = block->next;
+		libimage_allocator_free(&arena->allocator, block);
+	}
+	arena->overflow = NULL;
+
+	needed		= arena->needed;
+	arena->used	= 0;
+	arena->needed	= 0;
+	if(needed <= arena->size) return;
+
+	libimage_allocator_free(&arena->allocator, arena->base);
+	arena->size = 0;
+	arena->base = libimage_allocator_alloc(&arena->allocator, needed + LIBIMAGE_ARENA_ALIGN);
+	if(arena->base) arena->size = needed;
+}
+
+void arena_deinit(LibImageArena *arena)
+{
+	arena->needed = 0;
+	arena_reset(arena);
+	libimage_allocator_free(&arena->allocator, arena->base);
+	arena->base = NULL;
+	arena->size = 0;
+}
+
+void *libimage_scratch_alloc(LibImageImageInfo *info, size_t size)
+{
+#ifdef LIBIMAGE_STATS
+LibImageArenaBlock	*overflow;
+void			*ptr;
+
+	if(info->stats) {
+		LIBIMAGE_STAT_ADD(info, allocations, 1);
+		if(info->arena == NULL) {
+			LIBIMAGE_STAT_ADD(info, heap_allocations, 1);
+			return malloc(size);
+		}
+		// Whatever doesn't fit in the base block gets an overflow block of its own.
+		overflow = info->arena->overflow;
+		ptr	 = arena_alloc(info->arena, size);
+		if(info->arena->overflow != overflow) LIBIMAGE_STAT_ADD(info, heap_allocations, 1);
+		return ptr;
+	}
+#endif
+	return info->arena ? arena_alloc(info->arena, size) : malloc(size);
+}
+
+void libimage_scratch_free(LibImageImageInfo *info, void *ptr)
+{
+	if(info->arena == NULL) free(ptr);
+}
+
+void *libimage_output_alloc(LibImageImageInfo *info, size_t size, int zeroed)
+{
+void *ptr;
+
+	LIBIMAGE_STAT_ADD(info, allocations, 1);
+	LIBIMAGE_STAT_ADD(info, heap_allocations, 1);
+	if(info->arena == NULL) return zeroed ? calloc(1, size) : malloc(size);
+	ptr = libimage_allocator_alloc(&info->arena->allocator, size);
+	if(ptr && zeroed) memset(ptr, 0, size);
+	return ptr;
+}
+
+void libimage_output_free(LibImageImageInfo *info, void *ptr)
+{
+	if(info->arena == NULL) free(ptr);
+	else libimage_allocator_free(&info->arena->allocator, ptr);
+}
@@ -0,0 +1,53 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_ARENA_H__
+#define __LIB_IMAGE_ARENA_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "common.h"
+
+#define LIBIMAGE_ARENA_ALIGN	64
+
+typedef struct libimage_arena_block {
+	struct libimage_arena_block	*next;
+} LibImageArenaBlock;
+
+/*
+*	Bump allocator for the scratch of a decode ( the inflate window, unfilter rows, the flat inflate buffer ).
+*	Nothing is freed on its own, a reset drops everything at once. What didn't fit in the base block comes from the
+*	allocator until the next reset, which grows the base block to what the decode took, so decoding images of the
+*	same size again doesn't allocate.
+*/
+typedef struct libimage_arena {
+	LibImageAllocator	allocator;
+	uint8_t			*base;
+	size_t			size, used;
+	size_t			needed;		// Bytes asked since the last reset, base block or not
+	LibImageArenaBlock	*overflow;
+} LibImageArena;
+
+// Memory the library asks for goes through a LibImageAllocator, malloc and free when none is given.
+void libimage_allocator_default(LibImageAllocator *allocator);
+void *libimage_allocator_alloc(const LibImageAllocator *allocator, size_t size);
+void libimage_allocator_free(const LibImageAllocator *allocator, void *ptr);
+
+void arena_init(LibImageArena *arena, const LibImageAllocator *allocator);
+void *arena_alloc(LibImageArena *arena, size_t size);
+void arena_reset(LibImageArena *arena);
+void arena_deinit(LibImageArena *arena);
+
+/*
+*	Allocation helpers of the decode. Scratch comes from info->arena when the decode has one and from malloc
+*	otherwise, freeing it is then a no-op. The output comes from the allocator of the arena.
+*/
+void *libimage_scratch_alloc(LibImageImageInfo *info, size_t size);
+void libimage_scratch_free(LibImageImageInfo *info, void *ptr);
+void *libimage_output_alloc(LibImageImageInfo *info, size_t size, int zeroed);
+void libimage_output_free(LibImageImageInfo *info, void *ptr);
+
+#endif
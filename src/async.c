@@ -0,0 +1,316 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+
+#if defined(__linux__)
+#include <sys/eventfd.h>
+#endif
+
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "arena.h"
+#include "decoder.h"
+#include "pool.h"
+#include "convert.h"
+#include "job.h"
+#include "async.h"
+
+/*
+*	Starts a decode of the size bytes at data that libimage_job_step goes on with, with the settings of d but on
+*	the calling thread only. The decoder is the job's until libimage_job_finish. NULL when d is NULL or out of memory.
+*/
+LibImageJob *libimage_job_create(LibImageDecoder *d, uint8_t *data, size_t size)
+{
+LibImageJob	*job;
+
+	if(d == NULL || data == NULL) return NULL;
+	job = libimage_allocator_alloc(&d->arena.allocator, sizeof(*job));
+	if(job == NULL) return NULL;
+	memset(job, 0, sizeof(*job));
+	job->decoder = d;
+	libimage_decoder_info(d, &job->info);
+	// Decodes that split keep the whole inflated image and go through it at once, a job goes row by row.
+	job->info.thread_count	   = 1;
+	job->info.parallel_inflate = 0;
+	if(libimage_reader_open(&job->reader, data, size) == 0 && job->reader.type == LIBIMAGE_TYPE_PNG) {
+		png_job_init(&job->png, &job->info, &job->reader);
+		job->running = 1;
+	} else if(job->reader.error == 0) {
+		job->reader.error = LIBIMAGE_ERROR_TYPE_NOT_SUPPORTED;
+	}
+	return job;
+}
+
+/*
+*	Decodes up to rows more scanlines, all that are left when rows is zero, along with the chunks around them.
+*	Returns non zero while there is more to decode, zero once the image is done or the decode failed.
+*/
+int libimage_job_step(LibImageJob *job, uint32_t rows)
+{
+	if(job == NULL || !job->running) return 0;
+	job->running = png_job_step(&job->png, rows) != 0;
+	return job->running;
+}
+
+/*
+*	Ends the job, done or not, and frees it. Returns the image of a job that ran to its end, to be given back with
+*	libimage_decoder_free_image, or NULL with *error set. A job stopped early gives LIBIMAGE_ERROR_INVALID_ARGUMENT.
+*/
+void *libimage_job_finish(LibImageJob *job, uint32_t *width, uint32_t *height, int *error)
+{
+LibImageDecoder	*d;
+void		*pixels;
+
+	if(width)  *width  = 0;
+	if(height) *height = 0;
+	if(error)  *error  = 0;
+	if(job == NULL) {
+		if(error) *error = LIBIMAGE_ERROR_INVALID_ARGUMENT;
+		return NULL;
+	}
+	if(job->running) {
+		png_job_deinit(&job->png);
+		if(job->reader.error == 0) job->reader.error = LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	}
+	pixels = libimage_decode_result(&job->info, &job->reader, width, height, error);
+	d = job->decoder;
+	arena_reset(&d->arena);
+	libimage_allocator_free(&d->arena.allocator, job);
+	return pixels;
+}
+
+// Tells the loop there are results to poll, the fd stays readable until libimage_async_poll drains it.
+static void async_signal(LibImageAsync *a)
+{
+uint64_t	one = 1;
+ssize_t		n;
+
+	n = write(a->fd[1], &one, a->fd[0] == a->fd[1] ? sizeof(one) : 1);
+	(void)n;
+}
+
+static void async_drain(LibImageAsync *a)
+{
+uint8_t	buffer[64];
+
+	while(read(a->fd[0], buffer, sizeof(buffer)) > 0);
+}
+
+static void async_deliver(LibImageAsyncRequest *req)
+{
+	req->done(req->user, &req->result);
+	free(req);
+}
+
+static void async_decode(LibImageDecoder *d, LibImageAsyncRequest *req)
+{
+	memset(&req->result, 0, sizeof(req->result));
+	if(d == NULL) req->result.error = LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	else req->result.pixels = libimage_decoder_decode(d, req->data, req->size, &req->result.width, &req->result.height, &req->result.error);
+}
+
+// Worker, decodes what is queued with a decoder of its own until the async decoder is destroyed and the queue empty.
+static void *async_worker_run(void *arg)
+{
+LibImageAsync		*a = arg;
+LibImageAsyncRequest	*req;
+LibImageDecoder		*d;
+
+	d = libimage_decoder_create(&a->allocator);
+	if(d) {
+		libimage_decoder_set_format(d, a->format);
+		libimage_decoder_set_limits(d, &a->limits);
+	}
+	pthread_mutex_lock(&a->lock);
+	while(1) {
+		while(a->queue == NULL && !a->stopping) pthread_cond_wait(&a->wake, &a->lock);
+		if(a->queue == NULL) break;
+		req	 = a->queue;
+		a->queue = req->next;
+		if(a->queue == NULL) a->queue_tail = NULL;
+		pthread_mutex_unlock(&a->lock);
+
+		async_decode(d, req);
+		if(!a->poll) {
+			async_deliver(req);
+			pthread_mutex_lock(&a->lock);
+			continue;
+		}
+		req->next = NULL;
+		pthread_mutex_lock(&a->lock);
+		if(a->done_tail) a->done_tail->next = req;
+		else a->done = req;
+		a->done_tail = req;
+		async_signal(a);
+	}
+	pthread_mutex_unlock(&a->lock);
+	libimage_decoder_destroy(d);
+	return NULL;
+}
+
+static int async_open_fd(LibImageAsync *a)
+{
+#if defined(__linux__)
+	a->fd[0] = a->fd[1] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	return a->fd[0] >= 0 ? 0 : LIBIMAGE_ERROR_OUT_OF_MEMORY;
+#else
+	if(pipe(a->fd)) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	fcntl(a->fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(a->fd[1], F_SETFL, O_NONBLOCK);
+	fcntl(a->fd[0], F_SETFD, FD_CLOEXEC);
+	fcntl(a->fd[1], F_SETFD, FD_CLOEXEC);
+	return 0;
+#endif
+}
+
+static void async_close_fd(LibImageAsync *a)
+{
+	if(a->fd[0] >= 0) close(a->fd[0]);
+	if(a->fd[1] >= 0 && a->fd[1] != a->fd[0]) close(a->fd[1]);
+	a->fd[0] = a->fd[1] = -1;
+}
+
+/*
+*	Starts the workers, at least one of them has to. NULL for bad options or when the threads, the fd or the
+*	memory can't be had.
+*/
+LibImageAsync *libimage_async_create(const LibImageAsyncOptions *opts)
+{
+LibImageAsyncOptions	defaults = {0};
+LibImageAsync		*a;
+uint32_t		t, count;
+
+	if(opts == NULL) opts = &defaults;
+	if(opts->format >= LIBIMAGE_FORMAT_COUNT) return NULL;
+	a = calloc(1, sizeof(*a));
+	if(a == NULL) return NULL;
+	if(opts->allocator) a->allocator = *opts->allocator;
+	else libimage_allocator_default(&a->allocator);
+	a->format	= opts->format;
+	if(opts->limits) a->limits = *opts->limits;
+	a->inline_bytes	= opts->inline_bytes ? opts->inline_bytes : LIBIMAGE_ASYNC_DEFAULT_INLINE;
+	a->poll		= opts->poll != 0;
+	a->fd[0] = a->fd[1] = -1;
+	count		= libimage_pool_thread_count(opts->thread_count, LIBIMAGE_POOL_MAX_THREADS);
+	a->threads	= calloc(count, sizeof(*a->threads));
+	if(a->threads == NULL || (a->poll && async_open_fd(a))) {
+		free(a->threads);
+		free(a);
+		return NULL;
+	}
+	pthread_mutex_init(&a->lock, NULL);
+	pthread_cond_init(&a->wake, NULL);
+	for(t = 0; t < count; t++) {
+		if(pthread_create(&a->threads[a->thread_count], NULL, async_worker_run, a) == 0) a->thread_count++;
+	}
+	if(a->thread_count == 0) {
+		libimage_async_destroy(a);
+		return NULL;
+	}
+	return a;
+}
+
+/*
+*	Decodes the size bytes at data, which have to stay there until done is called. Files up to inline_bytes are
+*	decoded and handed to done before this returns, the others go to the workers. Returns zero or the error, done
+*	is not called then.
+*/
+int libimage_async_decode(LibImageAsync *a, uint8_t *data, size_t size, LibImageAsyncCallback done, void *user)
+{
+LibImageAsyncRequest	*req;
+
+	if(a == NULL || data == NULL || done == NULL) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	req = malloc(sizeof(*req));
+	if(req == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	req->next = NULL;
+	req->data = data;
+	req->size = size;
+	req->done = done;
+	req->user = user;
+
+	// Handing a small file to a thread costs more than decoding it.
+	if(size <= a->inline_bytes) {
+		if(a->inline_decoder == NULL) {
+			a->inline_decoder = libimage_decoder_create(&a->allocator);
+			if(a->inline_decoder) {
+				libimage_decoder_set_format(a->inline_decoder, a->format);
+				libimage_decoder_set_limits(a->inline_decoder, &a->limits);
+			}
+		}
+		async_decode(a->inline_decoder, req);
+		async_deliver(req);
+		return 0;
+	}
+
+	pthread_mutex_lock(&a->lock);
+	if(a->queue_tail) a->queue_tail->next = req;
+	else a->queue = req;
+	a->queue_tail = req;
+	pthread_cond_signal(&a->wake);
+	pthread_mutex_unlock(&a->lock);
+	return 0;
+}
+
+// Readable while decoded files wait for libimage_async_poll, -1 unless the options asked to poll.
+int libimage_async_fd(LibImageAsync *a)
+{
+	return a ? a->fd[0] : -1;
+}
+
+// Calls back every file decoded so far on the calling thread, returns how many.
+size_t libimage_async_poll(LibImageAsync *a)
+{
+LibImageAsyncRequest	*req, *next;
+size_t			count;
+
+	if(a == NULL || !a->poll) return 0;
+	pthread_mutex_lock(&a->lock);
+	req	     = a->done;
+	a->done	     = a->done_tail = NULL;
+	async_drain(a);
+	pthread_mutex_unlock(&a->lock);
+
+	for(count = 0; req; req = next, count++) {
+		next = req->next;
+		async_deliver(req);
+	}
+	return count;
+}
+
+// Gives back the pixels of a result.
+void libimage_async_free_image(LibImageAsync *a, void *pixels)
+{
+	if(a) libimage_allocator_free(&a->allocator, pixels);
+}
+
+// Waits for the files queued to be decoded, calls back those not polled yet and stops the workers.
+void libimage_async_destroy(LibImageAsync *a)
+{
+uint32_t	t;
+
+	if(a == NULL) return;
+	pthread_mutex_lock(&a->lock);
+	a->stopping = 1;
+	pthread_cond_broadcast(&a->wake);
+	pthread_mutex_unlock(&a->lock);
+	for(t = 0; t < a->thread_count; t++) pthread_join(a->threads[t], NULL);
+	libimage_async_poll(a);
+
+	pthread_cond_destroy(&a->wake);
+	pthread_mutex_destroy(&a->lock);
+	async_close_fd(a);
+	libimage_decoder_destroy(a->inline_decoder);
+	free(a->threads);
+	free(a);
+}
@@ -0,0 +1,59 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_ASYNC_H__
+#define __LIB_IMAGE_ASYNC_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "common.h"
+#include "arena.h"
+#include "decoder.h"
+#include "job.h"
+
+/*
+*	Decodes for event loops. A job is a decode stepped by its caller, a few rows at a time, on top of the
+*	resumable row pipeline. The async decoder hands files to workers of its own that stay up between files and
+*	tells of each result through a callback or an fd, small files are decoded right away on the calling thread.
+*/
+#define LIBIMAGE_ASYNC_DEFAULT_INLINE	Kilo(64)
+
+struct libimage_job {
+	LibImageDecoder		*decoder;
+	LibImageImageInfo	info;
+	LibImageDataReader	reader;
+	LibImagePngJob		png;
+	uint8_t			running;	// Steps are left
+};
+
+typedef struct libimage_async_request {
+	struct libimage_async_request	*next;
+	uint8_t				*data;
+	size_t				size;
+	LibImageAsyncCallback		done;
+	void				*user;
+	LibImageAsyncResult		result;
+} LibImageAsyncRequest;
+
+struct libimage_async {
+	LibImageAllocator	allocator;
+	uint32_t		format;
+	LibImageLimits		limits;
+	size_t			inline_bytes;
+	uint8_t			poll;
+	pthread_mutex_t		lock;
+	pthread_cond_t		wake;			// A request was queued or the workers are to stop
+	LibImageAsyncRequest	*queue, *queue_tail;	// Waiting for a worker
+	LibImageAsyncRequest	*done, *done_tail;	// Decoded, waiting for libimage_async_poll
+	uint8_t			stopping;
+	pthread_t		*threads;
+	uint32_t		thread_count;
+	LibImageDecoder		*inline_decoder;	// Of the calling thread, made on the first small file
+	int			fd[2];			// Read end and write end, the same eventfd on Linux
+};
+
+#endif
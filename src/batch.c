@@ -0,0 +1,102 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "arena.h"
+#include "decoder.h"
+#include "pool.h"
+#include "convert.h"
+#include "batch.h"
+
+// Cuts the inputs in runs of consecutive images of about grain bytes, an image bigger than that is a group alone.
+static size_t batch_make_groups(LibImageBatch *b, size_t count, size_t grain)
+{
+size_t	i, group_bytes;
+
+	b->group_count	= 0;
+	group_bytes	= 0;
+	for(i = 0; i < count; i++) {
+		if(i == 0 || group_bytes + b->inputs[i].size > grain) {
+			b->group_start[b->group_count++] = i;
+			group_bytes = 0;
+		}
+		group_bytes += b->inputs[i].size;
+	}
+	b->group_start[b->group_count] = count;
+	return b->group_count;
+}
+
+static void batch_decode_group(void *user, size_t group, uint32_t worker)
+{
+LibImageBatch		*b = user;
+LibImageBatchOutput	local, *out;
+LibImageDecoder		*d;
+size_t			i;
+
+	if(b->decoders[worker] == NULL) {
+		b->decoders[worker] = libimage_decoder_create(b->opts->allocator);
+		if(b->decoders[worker]) {
+			libimage_decoder_set_format(b->decoders[worker], b->opts->format);
+			libimage_decoder_set_limits(b->decoders[worker], b->opts->limits);
+		}
+	}
+	d = b->decoders[worker];
+
+	for(i = b->group_start[group]; i < b->group_start[group + 1]; i++) {
+		out = b->outputs ? &b->outputs[i] : &local;
+		memset(out, 0, sizeof(*out));
+		if(d == NULL) out->error = LIBIMAGE_ERROR_OUT_OF_MEMORY;
+		else out->pixels = libimage_decoder_decode(d, b->inputs[i].data, b->inputs[i].size, &out->width, &out->height, &out->error);
+		if(b->opts->on_complete) b->opts->on_complete(b->opts->user, i, out);
+	}
+}
+
+/*
+*	Decodes count files and returns once all are done. Each result goes to outputs[i] when outputs is given and
+*	to the completion callback when there is one; without outputs the callback owns the pixels. The calling thread
+*	is one of the workers. Returns zero, or the error that kept the batch from starting.
+*/
+int libimage_decode_batch(const LibImageBatchInput *inputs, size_t count, LibImageBatchOutput *outputs, const LibImageBatchOptions *opts)
+{
+LibImageBatchOptions	defaults = {0};
+LibImageBatch		b;
+size_t			grain;
+uint32_t		t, worker_count;
+int			ret;
+
+	if(opts == NULL) opts = &defaults;
+	if((inputs == NULL && count) || (outputs == NULL && opts->on_complete == NULL)) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	if(opts->format >= LIBIMAGE_FORMAT_COUNT) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	if(count == 0) return 0;
+
+	memset(&b, 0, sizeof(b));
+	b.inputs	= inputs;
+	b.outputs	= outputs;
+	b.opts		= opts;
+	b.group_start	= malloc((count + 1) * sizeof(*b.group_start));
+	if(b.group_start == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	grain		= opts->grain_bytes ? opts->grain_bytes : LIBIMAGE_BATCH_DEFAULT_GRAIN;
+	batch_make_groups(&b, count, grain);
+
+	worker_count	= libimage_pool_thread_count(opts->thread_count, b.group_count);
+	b.decoders	= calloc(worker_count, sizeof(*b.decoders));
+	if(b.decoders == NULL) {
+		free(b.group_start);
+		return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	}
+
+	ret = libimage_pool_run(b.group_count, worker_count, batch_decode_group, &b);
+
+	for(t = 0; t < worker_count; t++) libimage_decoder_destroy(b.decoders[t]);
+	free(b.decoders);
+	free(b.group_start);
+	return ret;
+}
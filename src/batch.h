@@ -0,0 +1,33 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_BATCH_H__
+#define __LIB_IMAGE_BATCH_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "common.h"
+#include "arena.h"
+#include "decoder.h"
+
+/*
+*	Batch decode. Consecutive images are put in groups of about grain_bytes of input, so tiny images aren't
+*	scheduled one by one, and the groups are the tasks of the work-stealing pool. Each worker decodes with its own
+*	LibImageDecoder, so the arena and the tables are reused from one image to the next. A grain_bytes of zero in
+*	the options is LIBIMAGE_BATCH_DEFAULT_GRAIN.
+*/
+#define LIBIMAGE_BATCH_DEFAULT_GRAIN	Kilo(256)
+
+typedef struct libimage_batch {
+	const LibImageBatchInput	*inputs;
+	LibImageBatchOutput		*outputs;
+	const LibImageBatchOptions	*opts;
+	size_t				*group_start;	// First image of every group, then the image count
+	size_t				group_count;
+	LibImageDecoder			**decoders;	// One per worker, made on its first group
+} LibImageBatch;
+
+#endif
@@ -23,6 +23,11 @@ uint8_t *peek_from_reader(LibImageDataReader *r, int n)
 	return r->data + r->cursor + n;
 }
 
+uint64_t reader_bytes_left(LibImageDataReader *r)
+{
+	return r->size > r->cursor ? r->size - r->cursor : 0;
+}
+
 void copy_to_buffer(uint8_t *dst, uint8_t *src, int size) {
 	memcpy(dst, src, size);	
 }
@@ -41,6 +46,12 @@ union   { uint32_t i; char b[4]; } test = { 0x01020304 };
 	return value;	
 }
 
+// Big endian field of a file at any alignment.
+uint32_t read_u32_be(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
 uint32_t bit_reverse(uint32_t value, int bits)
 {
 uint32_t res, i, inv;
@@ -54,13 +65,3 @@ uint32_t res, i, inv;
 	
 	return res;
 }
-
-void libimage_printf(const char *fmt, ...)
-{
-#ifdef LIBIMAGE_DEBUG 
-va_list va;
-	va_start(va, fmt);
-	vfprintf(stderr, fmt, va);
-	va_end(va);
-#endif
-}
@@ -9,25 +9,58 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <libimage.h>
 
 #define STATIC_ARRAY_SIZE(array) (int)((sizeof((array))/sizeof((array[0]))))
-#define IS_POWER_OF_TWO(num)			(((int)(num)) & ((((int)num) - 1)))
+#define IS_POWER_OF_TWO(num)			((((int)(num)) != 0) && ((((int)(num)) & (((int)(num)) - 1)) == 0))
 #define Kilo(num) ((num) * 1024)
 #define Mega(num) (Kilo((num)) * 1024)
 #define Giga(num) (Mega((num)) * 1024)
 
+#define LIBIMAGE_OUT_STREAM_AUTO	2	// out_stream for outputs that are streamed when they don't fit the last level cache
+
+struct libimage_arena;
+struct libimage_converter;
+struct libimage_scaler;
+struct libimage_stats;
+struct libimage_index;
+
 typedef struct libimage_image_info {
 	uint32_t width;
 	uint32_t height;
 	uint32_t gamma;
 	uint8_t  color_type;
+	uint8_t  bit_depth;
+	uint8_t  interlace_method;
 
-	uint8_t  *compressed_data;
-	off_t	 cd_offset, cd_size;
-	uint8_t  *uncompressed_data;
+	uint8_t  *uncompressed_data;	// Inflated stream, or the window of the row pipeline, scratch of the decode
 	off_t	 un_offset, un_size;
+	uint8_t	 skip_adler;		// Trusted input, the zlib trailer is read but not checked
+	uint32_t thread_count;		// Threads for the parts of a decode that split, 0 or 1 is the calling thread only
+	uint8_t	 parallel_inflate;	// Inflate the segments of a stream written with full flushes on thread_count threads
+	LibImageLimits limits;		// Of the decode, zero fields don't limit
+	uint64_t deadline_ns;		// Monotonic clock time the decode fails at, 0 for none
+	uint32_t output_format;		// LIBIMAGE_FORMAT_*, the layout of processed_data
+	uint32_t roi_x, roi_y;		// Region of the image that is decoded, all of it when roi_width or roi_height is 0
+	uint32_t roi_width, roi_height;
+	uint8_t	 scale_shift;		// The region is shrunk by 1 << scale_shift on both sides
+	struct libimage_scaler *scaler;	// Set while decoding to a smaller size
+	struct libimage_converter *converter;	// Set while decoding to a format other than the native one
+	uint8_t	 palette[256][4];	// PLTE as RGBA, the alpha comes from tRNS
+	uint16_t palette_entries;
+	uint16_t trns_key[3];		// Transparent grey or RGB sample of tRNS
+	uint8_t	 has_trns;
 	uint8_t  *processed_data;
 	off_t	 pr_offset, pr_size;
+	uint64_t out_stride;		// Bytes from a row of processed_data to the next, packed rows when left at 0
+	uint64_t out_capacity;		// Bytes the caller's processed_data holds
+	uint8_t	 out_external;		// processed_data is the caller's, it is neither allocated nor freed
+	uint8_t	 out_stream;		// processed_data is only written, whole rows with non-temporal stores, or LIBIMAGE_OUT_STREAM_AUTO
+	struct libimage_arena *arena;	// Scratch and output allocations of the decode, malloc when NULL
+	struct libimage_stats *stats;	// Filled in by the decode when built with LIBIMAGE_STATS, can be NULL
+	void	 (*trace)(void *user, uint32_t stage, int end, uint64_t ns);	// Stage boundaries, LibImageTraceCallback
+	void	 *trace_user;
+	struct libimage_index *index;	// Row index the decode starts from and extends, can be NULL
 
 	int error;
 } LibImageImageInfo;
@@ -36,52 +69,24 @@ typedef struct libimage_data_reader {
 	uint8_t 	*data;
 	uint16_t	type;
 	uint16_t	error;
-	uint32_t	cursor;
-	uint32_t	peek_cursor;
+	uint64_t	cursor;
+	uint64_t	peek_cursor;
+	uint64_t	size;		// Bytes readable at data, UINT64_MAX when the caller didn't give a length
 } LibImageDataReader;
 
-enum {
-	LIBIMAGE_PNG_ERROR_HEADER = 1,
-	LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS,
-	LIBIMAGE_PNG_ERROR_IHDR_INTERLACE,
-	LIBIMAGE_PNG_ERROR_BIG_IMAGE,
-	LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND,
-	LIBIMAGE_PNG_ERROR_INVALID_FILE,
-	LIBIMAGE_PNG_ERROR_ZERO_SIZE,
-	LIBIMAGE_PNG_ERROR_IDAT_SIZE_LIMIT,
-	LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH,
-	LIBIMAGE_PNG_ERROR_CORRUPT_IHDR,
-	LIBIMAGE_PNG_ERROR_IHDR_COLOUR_TYPE,
-	LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH_COMBINATION,
-	LIBIMAGE_PNG_ERROR_CRC_NOT_MATCH,
-	LIBIMAGE_PNG_ERROR_MULTIPLE_IHDR,
-	LIBIMAGE_PNG_ERROR_NO_IDAT,
-	LIBIMAGE_PNG_ERROR_NO_PLTE,
-	LIBIMAGE_PNG_ERROR_GAMA_AFTER_PLTE,
-	LIBIMAGE_PNG_ERROR_MULTIPLE_GAMA,
-	LIBIMAGE_PNG_ERROR_UNEXPECTED_PLTE,
-	LIBIMAGE_ERROR_TYPE_NOT_SUPPORTED,
-	LIBIMAGE_ERROR_ZBUF_UNREACHABLE_STATE,
-	LIBIMAGE_ERROR_INVALID_ZLIB_VALUE,
-	LIBIMAGE_ERROR_OUT_OF_MEMORY,
-	LIBIMAGE_PNG_ERROR_ZLIB_COMPRESSION,
-	LIBIMAGE_ERROR_ZLIB_HEADER_CORRUPTED,
-	LIBIMAGE_PNG_ERROR_PRESET_DICT,
-	LIBIMAGE_PNG_ERROR_CORRUPTED_FILE,
-	LIBIMAGE_ERROR_MEMORY_ERROR
-};
-
 enum {
 	LIBIMAGE_TYPE_PNG = 1
 };
 
 uint32_t bit_reverse(uint32_t value, int bits);
 uint32_t u32_endian_swap(uint32_t value);
+uint32_t read_u32_be(const uint8_t *p);
 int check_data_header(LibImageDataReader *r);
+int libimage_reader_open(LibImageDataReader *reader, uint8_t *data, uint64_t size);
+void *libimage_decode_result(LibImageImageInfo *info, LibImageDataReader *reader, uint32_t *width, uint32_t *height, int *error);
 
 void consume_bytes(LibImageDataReader *r, int n);
 uint8_t *read_from_reader(LibImageDataReader *r);
 uint8_t *peek_from_reader(LibImageDataReader *r, int n);
-void copy_to_buffer(uint8_t *dst, uint8_t *src, int size);
-void libimage_printf(const char *fmt, ...);
+uint64_t reader_bytes_left(LibImageDataReader *r);
 #endif
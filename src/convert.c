@@ -0,0 +1,631 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "convert.h"
+#include "cpu.h"
+
+#if defined(LIBIMAGE_CONVERT_SSE2)
+#include <immintrin.h>
+#elif defined(LIBIMAGE_CONVERT_NEON)
+#include <arm_neon.h>
+#endif
+
+#define LIBIMAGE_CONVERT_INLINE	static inline __attribute__((always_inline))
+
+// Layouts of the rows the kernels read, palette and low bit greyscale are indices into the lut.
+enum {
+	LIBIMAGE_CONVERT_SRC_GREY16 = 0,
+	LIBIMAGE_CONVERT_SRC_GA8,
+	LIBIMAGE_CONVERT_SRC_GA16,
+	LIBIMAGE_CONVERT_SRC_RGB8,
+	LIBIMAGE_CONVERT_SRC_RGB16,
+	LIBIMAGE_CONVERT_SRC_RGBA8,
+	LIBIMAGE_CONVERT_SRC_RGBA16,
+	LIBIMAGE_CONVERT_SRC_COUNT
+};
+
+static const uint8_t convert_pixel_bytes[LIBIMAGE_FORMAT_COUNT] = { 0, 4, 3, 4, 1, 8 };
+static const uint8_t convert_src_bytes[LIBIMAGE_CONVERT_SRC_COUNT] = { 2, 2, 4, 3, 6, 4, 8 };
+
+uint32_t png_format_pixel_bytes(uint32_t format)
+{
+	return format < LIBIMAGE_FORMAT_COUNT ? convert_pixel_bytes[format] : 0;
+}
+
+// Bytes of an output row of the decoded region, packed as in the file for LIBIMAGE_FORMAT_NATIVE.
+uint64_t png_output_row_bytes(LibImageImageInfo *info)
+{
+	if(info->output_format == LIBIMAGE_FORMAT_NATIVE) return png_row_bytes(info, info->roi_width);
+	return (uint64_t)info->roi_width * png_format_pixel_bytes(info->output_format);
+}
+
+LIBIMAGE_CONVERT_INLINE uint32_t convert_load16(const uint8_t *p)
+{
+	return ((uint32_t)p[0] << 8) | p[1];
+}
+
+/*
+*	One pixel of the source as r, g, b, a at the depth of the source, d16 tells which. The kind is a constant at
+*	every call site, so each kernel only keeps its own loads.
+*/
+LIBIMAGE_CONVERT_INLINE int convert_load(const LibImageConverter *c, int kind, const uint8_t *src, uint32_t i, uint32_t *r, uint32_t *g, uint32_t *b, uint32_t *a)
+{
+	switch(kind) {
+		case LIBIMAGE_CONVERT_SRC_GREY16: {
+			*r = *g = *b = convert_load16(src + 2 * i);
+			*a = c->has_key && *r == c->key[0] ? 0 : 0xffff;
+		} return 1;
+		case LIBIMAGE_CONVERT_SRC_GA8: {
+			*r = *g = *b = src[2 * i];
+			*a = src[2 * i + 1];
+		} return 0;
+		case LIBIMAGE_CONVERT_SRC_GA16: {
+			*r = *g = *b = convert_load16(src + 4 * i);
+			*a = convert_load16(src + 4 * i + 2);
+		} return 1;
+		case LIBIMAGE_CONVERT_SRC_RGB8: {
+			*r = src[3 * i];
+			*g = src[3 * i + 1];
+			*b = src[3 * i + 2];
+			*a = c->has_key && *r == c->key[0] && *g == c->key[1] && *b == c->key[2] ? 0 : 0xff;
+		} return 0;
+		case LIBIMAGE_CONVERT_SRC_RGB16: {
+			*r = convert_load16(src + 6 * i);
+			*g = convert_load16(src + 6 * i + 2);
+			*b = convert_load16(src + 6 * i + 4);
+			*a = c->has_key && *r == c->key[0] && *g == c->key[1] && *b == c->key[2] ? 0 : 0xffff;
+		} return 1;
+		case LIBIMAGE_CONVERT_SRC_RGBA8: {
+			*r = src[4 * i];
+			*g = src[4 * i + 1];
+			*b = src[4 * i + 2];
+			*a = src[4 * i + 3];
+		} return 0;
+		default: {
+			*r = convert_load16(src + 8 * i);
+			*g = convert_load16(src + 8 * i + 2);
+			*b = convert_load16(src + 8 * i + 4);
+			*a = convert_load16(src + 8 * i + 6);
+		} return 1;
+	}
+}
+
+// Stores one pixel given at 8 bits, or 16 when d16 is set.
+LIBIMAGE_CONVERT_INLINE void convert_store(uint8_t *dst, int format, int d16, uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+uint16_t wide[4];
+
+	if(format == LIBIMAGE_FORMAT_RGBA16) {
+		wide[0] = d16 ? r : r * 257;
+		wide[1] = d16 ? g : g * 257;
+		wide[2] = d16 ? b : b * 257;
+		wide[3] = d16 ? a : a * 257;
+		memcpy(dst, wide, sizeof(wide));
+		return;
+	}
+	if(d16) {
+		r >>= 8;
+		g >>= 8;
+		b >>= 8;
+		a >>= 8;
+	}
+	switch(format) {
+		case LIBIMAGE_FORMAT_RGBA8: {
+			dst[0] = r;
+			dst[1] = g;
+			dst[2] = b;
+			dst[3] = a;
+		} break;
+		case LIBIMAGE_FORMAT_RGB8: {
+			dst[0] = r;
+			dst[1] = g;
+			dst[2] = b;
+		} break;
+		case LIBIMAGE_FORMAT_BGRA8: {
+			dst[0] = b;
+			dst[1] = g;
+			dst[2] = r;
+			dst[3] = a;
+		} break;
+		default: {
+			// The weights add up to 256, grey stays grey.
+			dst[0] = (77 * r + 150 * g + 29 * b + 128) >> 8;
+		} break;
+	}
+}
+
+uint32_t png_convert_swap_rb_scalar(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+uint32_t	i;
+uint8_t		r;
+
+	for(i = 0; i < count; i++, dst += 4, src += 4) {
+		r	= src[0];
+		dst[0]	= src[2];
+		dst[1]	= src[1];
+		dst[2]	= r;
+		dst[3]	= src[3];
+	}
+	return count;
+}
+
+uint32_t png_convert_narrow16_scalar(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+uint32_t i;
+
+	for(i = 0; i < count; i++) dst[i] = src[2 * i];
+	return count;
+}
+
+uint32_t png_convert_swap16_scalar(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+uint32_t	i;
+uint8_t		hi;
+
+	for(i = 0; i < count; i++) {
+		hi	       = src[2 * i];
+		dst[2 * i]     = src[2 * i + 1];
+		dst[2 * i + 1] = hi;
+	}
+	return count;
+}
+
+#if defined(LIBIMAGE_CONVERT_SSE2)
+// Swaps bytes 0 and 2 of every 4.
+uint32_t png_convert_swap_rb_sse2(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+__m128i		v, ga, mask_ga, mask_lo;
+uint32_t	i;
+
+	mask_ga = _mm_set1_epi32((int)0xff00ff00);
+	mask_lo = _mm_set1_epi32(0xff);
+	for(i = 0; i + 4 <= count; i += 4) {
+		v  = _mm_loadu_si128((const __m128i*)(src + 4 * i));
+		ga = _mm_and_si128(v, mask_ga);
+		v  = _mm_or_si128(_mm_and_si128(_mm_srli_epi32(v, 16), mask_lo), _mm_slli_epi32(_mm_and_si128(v, mask_lo), 16));
+		_mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_or_si128(v, ga));
+	}
+	return i;
+}
+
+// Keeps the high byte of count big endian samples.
+uint32_t png_convert_narrow16_sse2(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+__m128i		mask, lo, hi;
+uint32_t	i;
+
+	mask = _mm_set1_epi16(0xff);
+	for(i = 0; i + 16 <= count; i += 16) {
+		lo = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 2 * i)), mask);
+		hi = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 2 * i + 16)), mask);
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_packus_epi16(lo, hi));
+	}
+	return i;
+}
+
+uint32_t png_convert_swap16_sse2(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+__m128i		v;
+uint32_t	i;
+
+	for(i = 0; i + 8 <= count; i += 8) {
+		v = _mm_loadu_si128((const __m128i*)(src + 2 * i));
+		_mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)));
+	}
+	return i;
+}
+#endif
+
+#if defined(LIBIMAGE_CONVERT_SSSE3)
+// One pshufb does what takes SSE2 five operations.
+__attribute__((target("ssse3")))
+uint32_t png_convert_swap_rb_ssse3(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+__m128i		order;
+uint32_t	i;
+
+	order = _mm_setr_epi8(2, 1, 0, 3, 6, 5, 4, 7, 10, 9, 8, 11, 14, 13, 12, 15);
+	for(i = 0; i + 4 <= count; i += 4) _mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 4 * i)), order));
+	return i;
+}
+
+__attribute__((target("ssse3")))
+uint32_t png_convert_swap16_ssse3(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+__m128i		order;
+uint32_t	i;
+
+	order = _mm_setr_epi8(1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14);
+	for(i = 0; i + 8 <= count; i += 8) _mm_storeu_si128((__m128i*)(dst + 2 * i), _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(src + 2 * i)), order));
+	return i;
+}
+
+// The 16 indices of 16 pixels of bits each, leftmost pixel in the high bits of its byte as in the file.
+__attribute__((target("ssse3")))
+static inline __m128i convert_unpack_ssse3(const uint8_t *src, uint32_t bits)
+{
+__m128i		v, a, b, c, d, bit;
+uint32_t	word;
+
+	switch(bits) {
+		case 1: {
+			// Each byte copied to 8 lanes, and each lane keeps the bit of its pixel.
+			v   = _mm_cvtsi32_si128(src[0] | (src[1] << 8));
+			v   = _mm_shuffle_epi8(v, _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1));
+			bit = _mm_setr_epi8(-128, 64, 32, 16, 8, 4, 2, 1, -128, 64, 32, 16, 8, 4, 2, 1);
+			return _mm_and_si128(_mm_cmpeq_epi8(_mm_and_si128(v, bit), bit), _mm_set1_epi8(1));
+		}
+		case 2: {
+			memcpy(&word, src, sizeof(word));
+			v = _mm_cvtsi32_si128(word);
+			a = _mm_and_si128(_mm_srli_epi16(v, 6), _mm_set1_epi8(3));
+			b = _mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(3));
+			c = _mm_and_si128(_mm_srli_epi16(v, 2), _mm_set1_epi8(3));
+			d = _mm_and_si128(v, _mm_set1_epi8(3));
+			return _mm_unpacklo_epi16(_mm_unpacklo_epi8(a, b), _mm_unpacklo_epi8(c, d));
+		}
+		default: {
+			v = _mm_loadl_epi64((const __m128i*)src);
+			return _mm_unpacklo_epi8(_mm_and_si128(_mm_srli_epi16(v, 4), _mm_set1_epi8(0x0f)), _mm_and_si128(v, _mm_set1_epi8(0x0f)));
+		}
+	}
+}
+
+/*
+*	Indices under 8 bits are below 16, so pshufb looks up a byte of 16 pixels at once in each plane of the lut, and
+*	the planes of 4 byte pixels are interleaved back.
+*/
+__attribute__((target("ssse3")))
+uint32_t png_convert_expand_ssse3(const LibImageConverter *c, uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t bits, uint32_t out_bytes)
+{
+__m128i		idx, p0, p1, p2, p3, lo, hi;
+uint32_t	i;
+
+	if(out_bytes != 1 && out_bytes != 4) return 0;
+	p0 = _mm_loadu_si128((const __m128i*)c->planes[0]);
+	p1 = _mm_loadu_si128((const __m128i*)c->planes[1]);
+	p2 = _mm_loadu_si128((const __m128i*)c->planes[2]);
+	p3 = _mm_loadu_si128((const __m128i*)c->planes[3]);
+	for(i = 0; i + 16 <= count; i += 16, src += 2 * bits) {
+		idx = convert_unpack_ssse3(src, bits);
+		if(out_bytes == 1) {
+			_mm_storeu_si128((__m128i*)(dst + i), _mm_shuffle_epi8(p0, idx));
+			continue;
+		}
+		lo = _mm_unpacklo_epi8(_mm_shuffle_epi8(p0, idx), _mm_shuffle_epi8(p1, idx));
+		hi = _mm_unpacklo_epi8(_mm_shuffle_epi8(p2, idx), _mm_shuffle_epi8(p3, idx));
+		_mm_storeu_si128((__m128i*)(dst + 4 * i), _mm_unpacklo_epi16(lo, hi));
+		_mm_storeu_si128((__m128i*)(dst + 4 * i + 16), _mm_unpackhi_epi16(lo, hi));
+		lo = _mm_unpackhi_epi8(_mm_shuffle_epi8(p0, idx), _mm_shuffle_epi8(p1, idx));
+		hi = _mm_unpackhi_epi8(_mm_shuffle_epi8(p2, idx), _mm_shuffle_epi8(p3, idx));
+		_mm_storeu_si128((__m128i*)(dst + 4 * i + 32), _mm_unpacklo_epi16(lo, hi));
+		_mm_storeu_si128((__m128i*)(dst + 4 * i + 48), _mm_unpackhi_epi16(lo, hi));
+	}
+	return i;
+}
+#endif
+
+#if defined(LIBIMAGE_CONVERT_AVX2)
+// Palette entries are 8 bytes apart in the lut, one gather fetches the 4 byte pixels of 8 indices.
+__attribute__((target("avx2")))
+uint32_t png_convert_lut8_4_avx2(const LibImageConverter *c, uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+__m256i		lo, hi;
+uint32_t	i;
+
+	for(i = 0; i + 16 <= count; i += 16) {
+		lo = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i)));
+		hi = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(src + i + 8)));
+		_mm256_storeu_si256((__m256i*)(dst + 4 * i), _mm256_i32gather_epi32((const int*)c->lut, lo, 8));
+		_mm256_storeu_si256((__m256i*)(dst + 4 * i + 32), _mm256_i32gather_epi32((const int*)c->lut, hi, 8));
+	}
+	return i;
+}
+#endif
+
+#if defined(LIBIMAGE_CONVERT_NEON)
+uint32_t png_convert_swap_rb_neon(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+uint8x16x4_t	v;
+uint8x16_t	t;
+uint32_t	i;
+
+	for(i = 0; i + 16 <= count; i += 16) {
+		v	 = vld4q_u8(src + 4 * i);
+		t	 = v.val[0];
+		v.val[0] = v.val[2];
+		v.val[2] = t;
+		vst4q_u8(dst + 4 * i, v);
+	}
+	return i;
+}
+
+uint32_t png_convert_narrow16_neon(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+uint32_t i;
+
+	// The high bytes are the even ones.
+	for(i = 0; i + 16 <= count; i += 16) vst1q_u8(dst + i, vld2q_u8(src + 2 * i).val[0]);
+	return i;
+}
+
+uint32_t png_convert_swap16_neon(uint8_t *dst, const uint8_t *src, uint32_t count)
+{
+uint32_t i;
+
+	for(i = 0; i + 8 <= count; i += 8) vst1q_u8(dst + 2 * i, vrev16q_u8(vld1q_u8(src + 2 * i)));
+	return i;
+}
+#endif
+
+LIBIMAGE_CONVERT_INLINE void convert_direct(const LibImageConverter *c, uint8_t *dst, const uint8_t *src, uint32_t x, uint32_t width, int kind, int format)
+{
+uint32_t	i, r, g, b, a, out_bytes, channels;
+int		d16;
+
+	out_bytes = convert_pixel_bytes[format];
+	src	 += (uint64_t)x * convert_src_bytes[kind];
+	channels  = kind == LIBIMAGE_CONVERT_SRC_RGB16 ? 3 : 4;
+	i	  = 0;
+	if(kind == LIBIMAGE_CONVERT_SRC_RGBA8 && format == LIBIMAGE_FORMAT_BGRA8) {
+		i = c->kernels->convert_swap_rb(dst, src, width);
+	} else if((kind == LIBIMAGE_CONVERT_SRC_RGBA16 && format == LIBIMAGE_FORMAT_RGBA8) || (kind == LIBIMAGE_CONVERT_SRC_RGB16 && format == LIBIMAGE_FORMAT_RGB8)) {
+		i = c->kernels->convert_narrow16(dst, src, width * channels) / channels;
+	}
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	else if(kind == LIBIMAGE_CONVERT_SRC_RGBA16 && format == LIBIMAGE_FORMAT_RGBA16) {
+		i = c->kernels->convert_swap16(dst, src, width * 4) / 4;
+	}
+#endif
+	for(; i < width; i++) {
+		d16 = convert_load(c, kind, src, i, &r, &g, &b, &a);
+		convert_store(dst + i * out_bytes, format, d16, r, g, b, a);
+	}
+}
+
+// Lut kernels, the index of each pixel is bits wide and the leftmost pixel is in the high bits.
+LIBIMAGE_CONVERT_INLINE void convert_indexed(const LibImageConverter *c, uint8_t *dst, const uint8_t *src, uint32_t x, uint32_t width, uint32_t bits, uint32_t out_bytes)
+{
+uint32_t	i, k, per_byte, mask, value;
+
+	per_byte = 8 / bits;
+	mask	 = (1u << bits) - 1;
+	src	+= x / per_byte;
+	i	 = 0;
+	// Starting inside a byte, the rest of that byte comes first.
+	if(x % per_byte) {
+		value = *src++;
+		for(k = x % per_byte; k < per_byte && i < width; i++, k++, dst += out_bytes) memcpy(dst, c->lut[(value >> (8 - bits * (k + 1))) & mask], out_bytes);
+	}
+	// The kernels of the CPU take the whole bytes they can.
+	if(bits == 8 && out_bytes == 4 && c->kernels->convert_lut8_4) {
+		k    = c->kernels->convert_lut8_4(c, dst, src, width - i);
+		i   += k;
+		src += k;
+		dst += k * out_bytes;
+	} else if(bits < 8 && (out_bytes == 1 || out_bytes == 4) && c->kernels->convert_expand) {
+		k    = c->kernels->convert_expand(c, dst, src, width - i, bits, out_bytes);
+		i   += k;
+		src += k / per_byte;
+		dst += k * out_bytes;
+	}
+	for(; i + per_byte <= width; i += per_byte) {
+		value = *src++;
+		for(k = 0; k < per_byte; k++, dst += out_bytes) memcpy(dst, c->lut[(value >> (8 - bits * (k + 1))) & mask], out_bytes);
+	}
+	if(i < width) {
+		value = *src;
+		for(k = 0; i < width; i++, k++, dst += out_bytes) memcpy(dst, c->lut[(value >> (8 - bits * (k + 1))) & mask], out_bytes);
+	}
+}
+
+#define LIBIMAGE_CONVERT_DIRECT(name, kind, format) \
+	static void name(const LibImageConverter *c, uint8_t *dst, const uint8_t *src, uint32_t x, uint32_t width) { convert_direct(c, dst, src, x, width, kind, format); }
+#define LIBIMAGE_CONVERT_DIRECT_ALL(suffix, kind) \
+	LIBIMAGE_CONVERT_DIRECT(convert_##suffix##_rgba8,  kind, LIBIMAGE_FORMAT_RGBA8) \
+	LIBIMAGE_CONVERT_DIRECT(convert_##suffix##_rgb8,   kind, LIBIMAGE_FORMAT_RGB8) \
+	LIBIMAGE_CONVERT_DIRECT(convert_##suffix##_bgra8,  kind, LIBIMAGE_FORMAT_BGRA8) \
+	LIBIMAGE_CONVERT_DIRECT(convert_##suffix##_gray8,  kind, LIBIMAGE_FORMAT_GRAY8) \
+	LIBIMAGE_CONVERT_DIRECT(convert_##suffix##_rgba16, kind, LIBIMAGE_FORMAT_RGBA16)
+#define LIBIMAGE_CONVERT_INDEXED(name, bits, out_bytes) \
+	static void name(const LibImageConverter *c, uint8_t *dst, const uint8_t *src, uint32_t x, uint32_t width) { convert_indexed(c, dst, src, x, width, bits, out_bytes); }
+#define LIBIMAGE_CONVERT_INDEXED_ALL(bits) \
+	LIBIMAGE_CONVERT_INDEXED(convert_index##bits##_1, bits, 1) \
+	LIBIMAGE_CONVERT_INDEXED(convert_index##bits##_3, bits, 3) \
+	LIBIMAGE_CONVERT_INDEXED(convert_index##bits##_4, bits, 4) \
+	LIBIMAGE_CONVERT_INDEXED(convert_index##bits##_8, bits, 8)
+
+LIBIMAGE_CONVERT_DIRECT_ALL(grey16, LIBIMAGE_CONVERT_SRC_GREY16)
+LIBIMAGE_CONVERT_DIRECT_ALL(ga8,    LIBIMAGE_CONVERT_SRC_GA8)
+LIBIMAGE_CONVERT_DIRECT_ALL(ga16,   LIBIMAGE_CONVERT_SRC_GA16)
+LIBIMAGE_CONVERT_DIRECT_ALL(rgb8,   LIBIMAGE_CONVERT_SRC_RGB8)
+LIBIMAGE_CONVERT_DIRECT_ALL(rgb16,  LIBIMAGE_CONVERT_SRC_RGB16)
+LIBIMAGE_CONVERT_DIRECT_ALL(rgba8,  LIBIMAGE_CONVERT_SRC_RGBA8)
+LIBIMAGE_CONVERT_DIRECT_ALL(rgba16, LIBIMAGE_CONVERT_SRC_RGBA16)
+LIBIMAGE_CONVERT_INDEXED_ALL(1)
+LIBIMAGE_CONVERT_INDEXED_ALL(2)
+LIBIMAGE_CONVERT_INDEXED_ALL(4)
+LIBIMAGE_CONVERT_INDEXED_ALL(8)
+
+#define LIBIMAGE_CONVERT_ROW_OF(suffix) { NULL, convert_##suffix##_rgba8, convert_##suffix##_rgb8, convert_##suffix##_bgra8, convert_##suffix##_gray8, convert_##suffix##_rgba16 }
+
+static const LibImageConvertRow convert_direct_kernels[LIBIMAGE_CONVERT_SRC_COUNT][LIBIMAGE_FORMAT_COUNT] = {
+	LIBIMAGE_CONVERT_ROW_OF(grey16),
+	LIBIMAGE_CONVERT_ROW_OF(ga8),
+	LIBIMAGE_CONVERT_ROW_OF(ga16),
+	LIBIMAGE_CONVERT_ROW_OF(rgb8),
+	LIBIMAGE_CONVERT_ROW_OF(rgb16),
+	LIBIMAGE_CONVERT_ROW_OF(rgba8),
+	LIBIMAGE_CONVERT_ROW_OF(rgba16)
+};
+
+// By index width ( 1, 2, 4, 8 bits ) and output pixel size ( 1, 3, 4, 8 bytes ).
+static const LibImageConvertRow convert_indexed_kernels[4][4] = {
+	{ convert_index1_1, convert_index1_3, convert_index1_4, convert_index1_8 },
+	{ convert_index2_1, convert_index2_3, convert_index2_4, convert_index2_8 },
+	{ convert_index4_1, convert_index4_3, convert_index4_4, convert_index4_8 },
+	{ convert_index8_1, convert_index8_3, convert_index8_4, convert_index8_8 }
+};
+
+// Slot of an index width or an output pixel size in convert_indexed_kernels.
+static int convert_slot(uint32_t value)
+{
+	switch(value) {
+		case 1:		return 0;
+		case 2:
+		case 3:		return 1;
+		case 4:		return 2;
+		default:	return 3;
+	}
+}
+
+// Output pixel of every palette index, or of every grey value of low bit depth greyscale.
+static void convert_build_lut(LibImageConverter *c, LibImageImageInfo *info, uint32_t format)
+{
+uint32_t	i, max, grey;
+
+	if(info->color_type == PNG_COLOR_TYPE_INDEXED_COLOUR) {
+		// Indices past the palette come out opaque black.
+		for(i = 0; i < 256; i++) {
+			if(i < info->palette_entries) convert_store(c->lut[i], format, 0, info->palette[i][0], info->palette[i][1], info->palette[i][2], info->palette[i][3]);
+			else convert_store(c->lut[i], format, 0, 0, 0, 0, 0xff);
+		}
+		return;
+	}
+	max = (1u << info->bit_depth) - 1;
+	for(i = 0; i <= max; i++) {
+		// Scaled to 16 bits, 65535 / max is a whole number for every depth.
+		grey = i * (0xffff / max);
+		convert_store(c->lut[i], format, 1, grey, grey, grey, info->has_trns && i == info->trns_key[0] ? 0 : 0xffff);
+	}
+}
+
+static void convert_build_planes(LibImageConverter *c)
+{
+uint32_t i, k;
+
+	for(k = 0; k < 4; k++) {
+		for(i = 0; i < 16; i++) c->planes[k][i] = c->lut[i][k];
+	}
+}
+
+/*
+*	Prepares the conversion of the rows of info to format, once IHDR and the chunks before the image data are known.
+*	Returns zero or LIBIMAGE_ERROR_INVALID_ARGUMENT for a format that isn't one.
+*/
+int png_converter_init(LibImageConverter *c, LibImageImageInfo *info, uint32_t format)
+{
+int	kind, d16;
+
+	if(format == LIBIMAGE_FORMAT_NATIVE || format >= LIBIMAGE_FORMAT_COUNT) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	memset(c, 0, sizeof(*c));
+	c->out_bytes = convert_pixel_bytes[format];
+	c->has_key   = info->has_trns;
+	c->kernels   = libimage_kernels();
+	memcpy(c->key, info->trns_key, sizeof(c->key));
+
+	d16 = info->bit_depth == 16;
+	if(info->color_type == PNG_COLOR_TYPE_INDEXED_COLOUR || (info->color_type == PNG_COLOR_TYPE_GREYSCALE && !d16)) {
+		convert_build_lut(c, info, format);
+		convert_build_planes(c);
+		c->row = convert_indexed_kernels[convert_slot(info->bit_depth)][convert_slot(c->out_bytes)];
+		return 0;
+	}
+	switch(info->color_type) {
+		case PNG_COLOR_TYPE_GREYSCALE:		   kind = LIBIMAGE_CONVERT_SRC_GREY16; break;
+		case PNG_COLOR_TYPE_GREYSCALE_WITH_ALPHA:  kind = d16 ? LIBIMAGE_CONVERT_SRC_GA16 : LIBIMAGE_CONVERT_SRC_GA8; break;
+		case PNG_COLOR_TYPE_TRUECOLOUR:		   kind = d16 ? LIBIMAGE_CONVERT_SRC_RGB16 : LIBIMAGE_CONVERT_SRC_RGB8; break;
+		default:				   kind = d16 ? LIBIMAGE_CONVERT_SRC_RGBA16 : LIBIMAGE_CONVERT_SRC_RGBA8; break;
+	}
+	c->row = convert_direct_kernels[kind][format];
+	return 0;
+}
+
+/*
+*	Writes the columns of the decoded region of a complete row in the sample layout of the file to dst, converted
+*	when info->converter is set. Packed pixels of a region that starts inside a byte are shifted up to the high
+*	bits, and the bits past the last pixel of the region are cleared.
+*/
+void png_output_row(LibImageImageInfo *info, uint8_t *dst, const uint8_t *row)
+{
+uint64_t	first_bit, bytes, src_bytes, i;
+uint32_t	pixel_bits, shift, tail;
+
+	if(info->converter) {
+		png_convert_row(info->converter, dst, row, info->roi_x, info->roi_width);
+		return;
+	}
+	pixel_bits = png_channel_count(info->color_type) * info->bit_depth;
+	first_bit  = (uint64_t)info->roi_x * pixel_bits;
+	bytes	   = png_row_bytes(info, info->roi_width);
+	row	  += first_bit / 8;
+	shift	   = first_bit % 8;
+	if(shift == 0) {
+		memcpy(dst, row, bytes);
+	} else {
+		src_bytes = png_row_bytes(info, info->roi_x + info->roi_width) - first_bit / 8;
+		for(i = 0; i < bytes; i++) dst[i] = (row[i] << shift) | (i + 1 < src_bytes ? row[i + 1] >> (8 - shift) : 0);
+	}
+	tail = ((uint64_t)info->roi_width * pixel_bits) % 8;
+	if(tail) dst[bytes - 1] &= 0xff << (8 - tail);
+}
+
+/*
+*	Writes row r of the output image from a complete row in the sample layout of the file. A streamed output gets
+*	the row converted in scratch, room for png_output_row_bytes, and copied out with png_stream_row, the output
+*	memory is never read.
+*/
+void png_write_output_row(LibImageImageInfo *info, uint32_t r, const uint8_t *row, uint8_t *scratch)
+{
+uint8_t	*dst;
+
+	dst = info->processed_data + (uint64_t)r * info->out_stride;
+	if(!info->out_stream) {
+		png_output_row(info, dst, row);
+		return;
+	}
+	png_output_row(info, scratch, row);
+	png_stream_row(dst, scratch, png_output_row_bytes(info));
+}
+
+void png_stream_row(uint8_t *dst, const uint8_t *src, uint64_t size)
+{
+	libimage_kernels()->stream_row(dst, src, size);
+}
+
+void png_stream_row_scalar(uint8_t *dst, const uint8_t *src, uint64_t size)
+{
+	memcpy(dst, src, size);
+}
+
+#if defined(LIBIMAGE_STREAM_SSE2)
+// Ordinary stores up to the first 16 byte boundary of dst and for the tail, streaming ones in between.
+void png_stream_row_sse2(uint8_t *dst, const uint8_t *src, uint64_t size)
+{
+uint64_t	head, i;
+
+	head = (16 - ((uintptr_t)dst & 15)) & 15;
+	if(head > size) head = size;
+	memcpy(dst, src, head);
+	for(i = head; i + 64 <= size; i += 64) {
+		_mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+		_mm_stream_si128((__m128i*)(dst + i + 16), _mm_loadu_si128((const __m128i*)(src + i + 16)));
+		_mm_stream_si128((__m128i*)(dst + i + 32), _mm_loadu_si128((const __m128i*)(src + i + 32)));
+		_mm_stream_si128((__m128i*)(dst + i + 48), _mm_loadu_si128((const __m128i*)(src + i + 48)));
+	}
+	for(; i + 16 <= size; i += 16) _mm_stream_si128((__m128i*)(dst + i), _mm_loadu_si128((const __m128i*)(src + i)));
+	memcpy(dst + i, src + i, size - i);
+	_mm_sfence();
+}
+#endif
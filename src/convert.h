@@ -0,0 +1,113 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_CONVERT_H__
+#define __LIB_IMAGE_CONVERT_H__
+
+#include <inttypes.h>
+#include "common.h"
+
+/*
+*	Output pixel formats are the LIBIMAGE_FORMAT_* of the public header. The 8 bit formats take the high byte of 16
+*	bit samples, RGBA16 is in the byte order of the machine. Formats without alpha drop it, GRAY8 weighs colour with
+*	the BT.601 luma. tRNS turns into alpha for the formats that have it.
+*/
+#define LIBIMAGE_FORMAT_COUNT	(LIBIMAGE_FORMAT_RGBA16 + 1)
+
+struct libimage_converter;
+struct libimage_kernels;
+typedef void (*LibImageConvertRow)(const struct libimage_converter *c, uint8_t *dst, const uint8_t *src, uint32_t x, uint32_t width);
+
+/*
+*	Turns complete rows in the sample layout of the file into rows of the output format. The kernel is picked once
+*	per image among one per source layout and format. Palette images and greyscale of 8 bits or less go through
+*	lut, the output pixel of every index or grey value with tRNS already applied.
+*/
+typedef struct libimage_converter {
+	LibImageConvertRow	row;
+	uint32_t		out_bytes;	// Bytes per output pixel
+	uint16_t		key[3];		// tRNS colour of truecolour and 16 bit greyscale, at the depth of the file
+	uint8_t			has_key;
+	const struct libimage_kernels	*kernels;	// Byte moving loops of the CPU, see cpu.h
+	uint8_t			lut[256][8];
+	uint8_t			planes[4][16];	// Byte k of the first 16 lut entries, for the shuffles of indices under 8 bits
+} LibImageConverter;
+
+/*
+*	Conversions that only move or narrow bytes, in the kernel table: RGBA8 to BGRA8, the high byte of big endian 16
+*	bit samples, and big endian samples to the byte order of the machine. Each does what it can of count pixels
+*	( samples for the 16 bit ones ) and returns how many, the converter finishes the row. The scalar ones do them all.
+*/
+typedef uint32_t (*LibImageConvertSpan)(uint8_t *dst, const uint8_t *src, uint32_t count);
+
+/*
+*	Lut lookups of whole source bytes, count pixels from a byte boundary, returning how many were done: 8 bit
+*	indices to 4 byte pixels, and indices of bits 1, 2 or 4 to pixels of out_bytes 1 or 4. The entries are NULL
+*	when the CPU has nothing better than the converter's own loop, which does the rest of the row either way.
+*/
+typedef uint32_t (*LibImageConvertLut8)(const struct libimage_converter *c, uint8_t *dst, const uint8_t *src, uint32_t count);
+typedef uint32_t (*LibImageConvertExpand)(const struct libimage_converter *c, uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t bits, uint32_t out_bytes);
+
+#if defined(__SSE2__)
+#define LIBIMAGE_CONVERT_SSE2	1
+#define LIBIMAGE_CONVERT_SSSE3	1
+#define LIBIMAGE_CONVERT_AVX2	1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LIBIMAGE_CONVERT_NEON	1
+#endif
+
+uint32_t png_convert_swap_rb_scalar(uint8_t *dst, const uint8_t *src, uint32_t count);
+uint32_t png_convert_narrow16_scalar(uint8_t *dst, const uint8_t *src, uint32_t count);
+uint32_t png_convert_swap16_scalar(uint8_t *dst, const uint8_t *src, uint32_t count);
+#if defined(LIBIMAGE_CONVERT_SSE2)
+uint32_t png_convert_swap_rb_sse2(uint8_t *dst, const uint8_t *src, uint32_t count);
+uint32_t png_convert_narrow16_sse2(uint8_t *dst, const uint8_t *src, uint32_t count);
+uint32_t png_convert_swap16_sse2(uint8_t *dst, const uint8_t *src, uint32_t count);
+#endif
+#if defined(LIBIMAGE_CONVERT_SSSE3)
+uint32_t png_convert_swap_rb_ssse3(uint8_t *dst, const uint8_t *src, uint32_t count);
+uint32_t png_convert_swap16_ssse3(uint8_t *dst, const uint8_t *src, uint32_t count);
+uint32_t png_convert_expand_ssse3(const struct libimage_converter *c, uint8_t *dst, const uint8_t *src, uint32_t count, uint32_t bits, uint32_t out_bytes);
+#endif
+#if defined(LIBIMAGE_CONVERT_AVX2)
+uint32_t png_convert_lut8_4_avx2(const struct libimage_converter *c, uint8_t *dst, const uint8_t *src, uint32_t count);
+#endif
+#if defined(LIBIMAGE_CONVERT_NEON)
+uint32_t png_convert_swap_rb_neon(uint8_t *dst, const uint8_t *src, uint32_t count);
+uint32_t png_convert_narrow16_neon(uint8_t *dst, const uint8_t *src, uint32_t count);
+uint32_t png_convert_swap16_neon(uint8_t *dst, const uint8_t *src, uint32_t count);
+#endif
+
+/*
+*	Copies a finished output row to memory that isn't read back, with non-temporal stores where there are some, so
+*	it doesn't go through the cache ( or get read for ownership ) on its way out. The stores are fenced before it
+*	returns, the row is out whatever thread looks at it next.
+*/
+typedef void (*LibImageStreamRow)(uint8_t *dst, const uint8_t *src, uint64_t size);
+
+#if defined(__SSE2__)
+#define LIBIMAGE_STREAM_SSE2	1
+#endif
+
+void png_stream_row_scalar(uint8_t *dst, const uint8_t *src, uint64_t size);
+#if defined(LIBIMAGE_STREAM_SSE2)
+void png_stream_row_sse2(uint8_t *dst, const uint8_t *src, uint64_t size);
+#endif
+
+int png_converter_init(LibImageConverter *c, LibImageImageInfo *info, uint32_t format);
+uint32_t png_format_pixel_bytes(uint32_t format);
+uint64_t png_output_row_bytes(LibImageImageInfo *info);
+void png_output_row(LibImageImageInfo *info, uint8_t *dst, const uint8_t *row);
+void png_write_output_row(LibImageImageInfo *info, uint32_t r, const uint8_t *row, uint8_t *scratch);
+void png_stream_row(uint8_t *dst, const uint8_t *src, uint64_t size);
+
+// Converts the width pixels of the source row src starting at pixel x.
+static inline void png_convert_row(const LibImageConverter *c, uint8_t *dst, const uint8_t *src, uint32_t x, uint32_t width)
+{
+	c->row(c, dst, src, x, width);
+}
+
+#endif
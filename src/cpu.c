@@ -0,0 +1,174 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#if defined(__aarch64__) && defined(__linux__) && !defined(__ARM_FEATURE_CRC32)
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#endif
+
+#include "common.h"
+#include "cpu.h"
+
+#define LIBIMAGE_CPU_DEFAULT_CACHE	Mega(8)
+
+typedef struct libimage_cpu_name {
+	const char	*name;
+	uint32_t	feature;
+} LibImageCpuName;
+
+static const LibImageCpuName cpu_names[] = {
+	{ "sse2", LIBIMAGE_CPU_SSE2 }, { "ssse3", LIBIMAGE_CPU_SSSE3 }, { "avx2", LIBIMAGE_CPU_AVX2 },
+	{ "pclmul", LIBIMAGE_CPU_PCLMUL }, { "neon", LIBIMAGE_CPU_NEON }, { "crc32", LIBIMAGE_CPU_ARM_CRC32 }
+};
+
+static LibImageKernels	cpu_kernels;
+static pthread_once_t	cpu_once = PTHREAD_ONCE_INIT;
+static int		cpu_ready;
+
+static uint32_t cpu_detect(void)
+{
+uint32_t features = 0;
+
+#if defined(__x86_64__) || defined(__i386__)
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse2"))	features |= LIBIMAGE_CPU_SSE2;
+	if(__builtin_cpu_supports("ssse3"))	features |= LIBIMAGE_CPU_SSSE3;
+	if(__builtin_cpu_supports("avx2"))	features |= LIBIMAGE_CPU_AVX2;
+	if(__builtin_cpu_supports("pclmul"))	features |= LIBIMAGE_CPU_PCLMUL;
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+	features |= LIBIMAGE_CPU_NEON;
+#if defined(__ARM_FEATURE_CRC32)
+	features |= LIBIMAGE_CPU_ARM_CRC32;
+#elif defined(__aarch64__) && defined(__linux__)
+	if(getauxval(AT_HWCAP) & HWCAP_CRC32) features |= LIBIMAGE_CPU_ARM_CRC32;
+#endif
+#endif
+	return features;
+}
+
+/*
+*	The features LIBIMAGE_CPU_ENV allows, all of them when it isn't set. Unknown names are skipped, so a list
+*	written for one machine works on the others.
+*/
+static uint32_t cpu_allowed_features(void)
+{
+const char	*env, *end;
+uint32_t	allowed, i;
+size_t		len;
+
+	env = getenv(LIBIMAGE_CPU_ENV);
+	if(env == NULL) return UINT32_MAX;
+	allowed = 0;
+	while(*env) {
+		end = env + strcspn(env, ", ");
+		len = end - env;
+		for(i = 0; i < sizeof(cpu_names) / sizeof(cpu_names[0]); i++) {
+			if(strlen(cpu_names[i].name) == len && memcmp(cpu_names[i].name, env, len) == 0) allowed |= cpu_names[i].feature;
+		}
+		env = *end ? end + 1 : end;
+	}
+	return allowed;
+}
+
+// Size of the last level cache as the C library reports it, a common one when it doesn't.
+static uint64_t cpu_cache_bytes(void)
+{
+long size = 0;
+
+#if defined(_SC_LEVEL3_CACHE_SIZE)
+	size = sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+#if defined(_SC_LEVEL2_CACHE_SIZE)
+	if(size <= 0) size = sysconf(_SC_LEVEL2_CACHE_SIZE);
+#endif
+	return size > 0 ? (uint64_t)size : LIBIMAGE_CPU_DEFAULT_CACHE;
+}
+
+// Fills the table from the best variant of each kernel the features allow, the scalar one being always there.
+static void cpu_init(void)
+{
+LibImageKernels	*k = &cpu_kernels;
+uint32_t	features;
+
+	features    = cpu_detect() & cpu_allowed_features();
+	k->features = features;
+
+	k->adler32_update = adler32_update_scalar;
+#if defined(LIBIMAGE_ADLER32_SSSE3)
+	if(features & LIBIMAGE_CPU_SSSE3) k->adler32_update = adler32_update_ssse3;
+	if(features & LIBIMAGE_CPU_AVX2) k->adler32_update = adler32_update_avx2;
+#elif defined(LIBIMAGE_ADLER32_NEON)
+	if(features & LIBIMAGE_CPU_NEON) k->adler32_update = adler32_update_neon;
+#endif
+
+	k->crc_update = crc_update_slice8;
+#if defined(LIBIMAGE_CRC32_PCLMUL)
+	if((features & (LIBIMAGE_CPU_PCLMUL | LIBIMAGE_CPU_SSE2)) == (LIBIMAGE_CPU_PCLMUL | LIBIMAGE_CPU_SSE2)) k->crc_update = crc_update_pclmul;
+#elif defined(LIBIMAGE_CRC32_ARMV8)
+	if(features & LIBIMAGE_CPU_ARM_CRC32) k->crc_update = crc_update_armv8;
+#endif
+
+	k->unfilter_row = png_unfilter_row_scalar;
+	k->filter_row	= png_filter_row_scalar;
+	k->filter_cost	= png_filter_cost_scalar;
+#if defined(LIBIMAGE_FILTER_SIMD)
+	if(features & (LIBIMAGE_CPU_SSE2 | LIBIMAGE_CPU_NEON)) {
+		k->unfilter_row = png_unfilter_row_simd;
+		k->filter_row	= png_filter_row_simd;
+		k->filter_cost	= png_filter_cost_simd;
+	}
+#endif
+
+	k->stream_row  = png_stream_row_scalar;
+#if defined(LIBIMAGE_STREAM_SSE2)
+	if(features & LIBIMAGE_CPU_SSE2) k->stream_row = png_stream_row_sse2;
+#endif
+
+	k->convert_swap_rb  = png_convert_swap_rb_scalar;
+	k->convert_narrow16 = png_convert_narrow16_scalar;
+	k->convert_swap16   = png_convert_swap16_scalar;
+	k->convert_lut8_4   = NULL;
+	k->convert_expand   = NULL;
+#if defined(LIBIMAGE_CONVERT_SSE2)
+	if(features & LIBIMAGE_CPU_SSE2) {
+		k->convert_swap_rb  = png_convert_swap_rb_sse2;
+		k->convert_narrow16 = png_convert_narrow16_sse2;
+		k->convert_swap16   = png_convert_swap16_sse2;
+	}
+	if(features & LIBIMAGE_CPU_SSSE3) {
+		k->convert_swap_rb  = png_convert_swap_rb_ssse3;
+		k->convert_swap16   = png_convert_swap16_ssse3;
+		k->convert_expand   = png_convert_expand_ssse3;
+	}
+	if(features & LIBIMAGE_CPU_AVX2) k->convert_lut8_4 = png_convert_lut8_4_avx2;
+#elif defined(LIBIMAGE_CONVERT_NEON)
+	if(features & LIBIMAGE_CPU_NEON) {
+		k->convert_swap_rb  = png_convert_swap_rb_neon;
+		k->convert_narrow16 = png_convert_narrow16_neon;
+		k->convert_swap16   = png_convert_swap16_neon;
+	}
+#endif
+	k->cache_bytes = cpu_cache_bytes();
+	__atomic_store_n(&cpu_ready, 1, __ATOMIC_RELEASE);
+}
+
+// The kernel table, built by the first caller of any thread. Later calls only check that it is there.
+const LibImageKernels *libimage_kernels(void)
+{
+	if(!__atomic_load_n(&cpu_ready, __ATOMIC_ACQUIRE)) pthread_once(&cpu_once, cpu_init);
+	return &cpu_kernels;
+}
+
+uint32_t libimage_cpu_features(void)
+{
+	return libimage_kernels()->features;
+}
@@ -0,0 +1,45 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_CPU_H__
+#define __LIB_IMAGE_CPU_H__
+
+#include <inttypes.h>
+#include "adler32.h"
+#include "crc32.h"
+#include "filter.h"
+#include "convert.h"
+
+/*
+*	The LIBIMAGE_CPU_* features of the public header are the ones the kernels can use. SSE2 and NEON are the
+*	baseline of x86-64 and AArch64, the rest are looked up when the library is first used.
+*/
+#define LIBIMAGE_CPU_ENV	"LIBIMAGE_CPU"	// Names of the features to allow, comma separated, "scalar" for none
+
+/*
+*	The version of each kernel the decoder and encoder stages call, picked once for the whole process. Every
+*	variant is built with the target attributes it needs, so the rest of the library is still built for the
+*	baseline and the one binary runs on all of them.
+*/
+typedef struct libimage_kernels {
+	uint32_t		features;	// Detected, less what LIBIMAGE_CPU_ENV leaves out
+	LibImageAdlerUpdate	adler32_update;
+	LibImageCrcUpdate	crc_update;
+	LibImageUnfilterRow	unfilter_row;
+	LibImageFilterRow	filter_row;
+	LibImageFilterCost	filter_cost;
+	LibImageStreamRow	stream_row;
+	LibImageConvertSpan	convert_swap_rb;
+	LibImageConvertSpan	convert_narrow16;
+	LibImageConvertSpan	convert_swap16;
+	LibImageConvertLut8	convert_lut8_4;
+	LibImageConvertExpand	convert_expand;
+	uint64_t		cache_bytes;	// Last level cache, outputs past it are streamed out
+} LibImageKernels;
+
+const LibImageKernels *libimage_kernels(void);
+
+#endif
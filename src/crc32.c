@@ -0,0 +1,181 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "crc32.h"
+#include "crc32_table.h"
+#include "cpu.h"
+
+#if defined(LIBIMAGE_CRC32_PCLMUL)
+#include <immintrin.h>
+#elif defined(LIBIMAGE_CRC32_ARMV8)
+#include <arm_acle.h>
+#endif
+
+/**
+*    CRC algorithm
+*
+*    Chunk CRCs are calculated using standard CRC methods with pre and post conditioning, as defined by ISO 3309 [ISO-3309] or ITU-T V.42 [ITU-T-V42]. 
+*    The CRC polynomial employed is x^32+x^26+x^23+x^22+x^16+x^12+x^11+x^10+x^8+x^7+x^5+x^4+x^2+x+1
+*
+*    The 32-bit CRC register is initialized to all 1's, and then the data from each byte is processed from the least significant bit (1) to the most significant bit (128). 
+*    After all the data bytes are processed, the CRC register is inverted (its ones complement is taken). 
+*    This value is transmitted (stored in the file) MSB first. For the purpose of separating into bytes and ordering, the least significant bit of the 32-bit CRC is defined 
+*    to be the coefficient of the x31 term. 
+**/
+
+static inline uint32_t crc_load_le32(const uint8_t *p)
+{
+uint32_t value;
+
+	memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap32(value);
+#endif
+	return value;
+}
+
+/*
+*	Based on the Annex D code of the PNG Spec And zlib. crc_update runs the register over more data, it starts
+*	at LIBIMAGE_CRC32_INIT and crc_final gives the value as it is laid out in the file. Eight bytes go through
+*	the register per step, each one looked up in the table that already accounts for the bytes after it.
+*/
+uint32_t crc_update_slice8(uint32_t result, const uint8_t *buf, size_t len)
+{
+uint32_t lo, hi;
+
+	while(len >= 8) {
+		lo = crc_load_le32(buf) ^ result;
+		hi = crc_load_le32(buf + 4);
+		result = crc32_table[7][lo & 0xff] ^ crc32_table[6][(lo >> 8) & 0xff] ^
+			 crc32_table[5][(lo >> 16) & 0xff] ^ crc32_table[4][lo >> 24] ^
+			 crc32_table[3][hi & 0xff] ^ crc32_table[2][(hi >> 8) & 0xff] ^
+			 crc32_table[1][(hi >> 16) & 0xff] ^ crc32_table[0][hi >> 24];
+		buf += 8;
+		len -= 8;
+	}
+	while(len--) {
+		result = crc32_table[0][(result ^ *buf++) & 0xff] ^ (result >> 8);
+	}
+	return result;
+}
+
+#ifdef LIBIMAGE_CRC32_PCLMUL
+/*
+*	Folds 64 bytes at a time with carry-less multiplies, then down to 128 and 32 bits with a Barrett reduction.
+*	Constants are x^n mod P for the bit reflected polynomial, as in Intel's "Fast CRC Computation Using PCLMULQDQ".
+*/
+__attribute__((target("pclmul,sse2")))
+uint32_t crc_update_pclmul(uint32_t result, const uint8_t *buf, size_t len)
+{
+static const uint64_t __attribute__((aligned(16))) k1k2[] = { 0x0154442bd4, 0x01c6e41596 };
+static const uint64_t __attribute__((aligned(16))) k3k4[] = { 0x01751997d0, 0x00ccaa009e };
+static const uint64_t __attribute__((aligned(16))) k5k0[] = { 0x0163cd6124, 0x0000000000 };
+static const uint64_t __attribute__((aligned(16))) poly[] = { 0x01db710641, 0x01f7011641 };
+__m128i	x0, x1, x2, x3, x4, x5, x6, x7, x8, mask;
+
+	if(len < 64) return crc_update_slice8(result, buf, len);
+
+	x1 = _mm_loadu_si128((const __m128i*)(buf + 0x00));
+	x2 = _mm_loadu_si128((const __m128i*)(buf + 0x10));
+	x3 = _mm_loadu_si128((const __m128i*)(buf + 0x20));
+	x4 = _mm_loadu_si128((const __m128i*)(buf + 0x30));
+	x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128((int)result));
+	x0 = _mm_load_si128((const __m128i*)k1k2);
+	buf += 64;
+	len -= 64;
+
+	while(len >= 64) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128(x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128(x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128(x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128(x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128(x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128(x4, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128((const __m128i*)(buf + 0x00)));
+		x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128((const __m128i*)(buf + 0x10)));
+		x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128((const __m128i*)(buf + 0x20)));
+		x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128((const __m128i*)(buf + 0x30)));
+		buf += 64;
+		len -= 64;
+	}
+
+	x0 = _mm_load_si128((const __m128i*)k3k4);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x2), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x3), x5);
+	x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+	x1 = _mm_xor_si128(_mm_xor_si128(x1, x4), x5);
+
+	while(len >= 16) {
+		x5 = _mm_clmulepi64_si128(x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128(x1, x0, 0x11);
+		x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128((const __m128i*)buf)), x5);
+		buf += 16;
+		len -= 16;
+	}
+
+	// 128 to 64 bits.
+	mask = _mm_setr_epi32(~0, 0, ~0, 0);
+	x2 = _mm_clmulepi64_si128(x1, x0, 0x10);
+	x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+	x0 = _mm_loadl_epi64((const __m128i*)k5k0);
+	x2 = _mm_srli_si128(x1, 4);
+	x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+
+	// Barrett reduction to 32 bits.
+	x0 = _mm_load_si128((const __m128i*)poly);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), x0, 0x10);
+	x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), x0, 0x00);
+	x1 = _mm_xor_si128(x1, x2);
+	result = (uint32_t)_mm_cvtsi128_si32(_mm_srli_si128(x1, 4));
+
+	return len ? crc_update_slice8(result, buf, len) : result;
+}
+#endif
+
+#ifdef LIBIMAGE_CRC32_ARMV8
+__attribute__((target("+crc")))
+uint32_t crc_update_armv8(uint32_t result, const uint8_t *buf, size_t len)
+{
+uint64_t value;
+
+	while(len >= 8) {
+		memcpy(&value, buf, sizeof(value));
+		result = __crc32d(result, value);
+		buf += 8;
+		len -= 8;
+	}
+	while(len--) result = __crc32b(result, *buf++);
+	return result;
+}
+#endif
+
+uint32_t crc_update(uint32_t result, const uint8_t *buf, size_t len)
+{
+	return libimage_kernels()->crc_update(result, buf, len);
+}
+
+uint32_t crc_final(uint32_t result)
+{
+	return u32_endian_swap(result ^ LIBIMAGE_CRC32_INIT);
+}
+
+uint32_t crc(const uint8_t *buf, size_t len)
+{
+	return crc_final(crc_update(LIBIMAGE_CRC32_INIT, buf, len));
+}
@@ -0,0 +1,43 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_CRC32_H__
+#define __LIB_IMAGE_CRC32_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+
+/*
+*	Chunk CRCs are checked unless LIBIMAGE_PNG_SKIP_CRC is defined, the check runs about as fast as the data can be
+*	read ( carry-less multiply where the CPU has it, slice by 8 otherwise ).
+*/
+#ifndef LIBIMAGE_PNG_SKIP_CRC
+#define LIBIMAGE_PNG_CHECK_CRC
+#endif
+
+#define LIBIMAGE_CRC32_INIT	0xffffffffu
+
+// Engines of the update, libimage_kernels picks the one the CPU runs.
+#if defined(__x86_64__) || defined(__i386__)
+#define LIBIMAGE_CRC32_PCLMUL	1
+#elif defined(__aarch64__) && (defined(__ARM_FEATURE_CRC32) || defined(__linux__))
+#define LIBIMAGE_CRC32_ARMV8	1
+#endif
+
+typedef uint32_t (*LibImageCrcUpdate)(uint32_t result, const uint8_t *buf, size_t len);
+
+uint32_t crc_update(uint32_t result, const uint8_t *buf, size_t len);
+uint32_t crc_update_slice8(uint32_t result, const uint8_t *buf, size_t len);
+#ifdef LIBIMAGE_CRC32_PCLMUL
+uint32_t crc_update_pclmul(uint32_t result, const uint8_t *buf, size_t len);
+#endif
+#ifdef LIBIMAGE_CRC32_ARMV8
+uint32_t crc_update_armv8(uint32_t result, const uint8_t *buf, size_t len);
+#endif
+uint32_t crc_final(uint32_t result);
+uint32_t crc(const uint8_t *buf, size_t len);
+
+#endif
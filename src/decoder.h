@@ -0,0 +1,37 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_DECODER_H__
+#define __LIB_IMAGE_DECODER_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "common.h"
+#include "arena.h"
+#include "stats.h"
+
+/*
+*	Decoder that is kept from one image to the next, its arena holds the scratch of a decode and is reset instead
+*	of freed. Not to be used by two threads at once, one decoder per thread.
+*/
+struct libimage_decoder {
+	LibImageArena	arena;
+	uint32_t	thread_count;
+	uint32_t	format;		// LIBIMAGE_FORMAT_* of the images it returns
+	uint32_t	roi_x, roi_y, roi_width, roi_height;
+	uint8_t		scale_shift;
+	uint8_t		parallel_inflate;
+	uint8_t		skip_adler;	// Trusted input, the Adler-32 of the zlib streams isn't checked
+	LibImageLimits	limits;		// Of each decode
+	LibImageStats	*stats;
+	LibImageTraceCallback trace;
+	void		*trace_user;
+	struct libimage_index *index;	// Not the decoder's, only used by it
+};
+
+void libimage_decoder_info(LibImageDecoder *d, LibImageImageInfo *info);
+
+#endif
@@ -0,0 +1,786 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "arena.h"
+#include "huffman.h"
+#include "adler32.h"
+#include "deflate.h"
+
+#define LIBIMAGE_DEFLATE_WINDOW_MASK	(LIBIMAGE_DEFLATE_WINDOW - 1)
+#define LIBIMAGE_DEFLATE_NUM_LITLEN	286	// Symbols a block can use, 286 and 287 never appear
+#define LIBIMAGE_DEFLATE_CODELEN_LIMIT	7
+#define LIBIMAGE_DEFLATE_HUFFMAN_LIMIT	LIBIMAGE_HUFFMAN_MAX_CODE_BITS
+
+static const LibImageDeflateSpecEntry deflate_length_spec[LIBIMAGE_DEFLATE_NUM_LENGTHS] = {
+	{3, 0}, {4, 0}, {5, 0}, {6, 0}, {7, 0}, {8, 0}, {9, 0}, {10, 0}, {11, 1}, {13, 1}, {15, 1}, {17, 1},
+	{19, 2}, {23, 2}, {27, 2}, {31, 2}, {35, 3}, {43, 3}, {51, 3}, {59, 3}, {67, 4}, {83, 4}, {99, 4},
+	{115, 4}, {131, 5}, {163, 5}, {195, 5}, {227, 5}, {258, 0}
+};
+static const LibImageDeflateSpecEntry deflate_distance_spec[LIBIMAGE_DEFLATE_NUM_DISTS] = {
+	{1, 0}, {2, 0}, {3, 0}, {4, 0}, {5, 1}, {7, 1}, {9, 2}, {13, 2}, {17, 3}, {25, 3}, {33, 4}, {49, 4},
+	{65, 5}, {97, 5}, {129, 6}, {193, 6}, {257, 7}, {385, 7}, {513, 8}, {769, 8}, {1025, 9}, {1537, 9},
+	{2049, 10}, {3073, 10}, {4097, 11}, {6145, 11}, {8193, 12}, {12289, 12}, {16385, 13}, {24577, 13}
+};
+static const uint8_t deflate_codelen_order[LIBIMAGE_DEFLATE_NUM_CODELEN_SYMBOLS] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+// Code lengths and the codes, bit reversed since the stream is written LSB first.
+typedef struct libimage_deflate_codes {
+	uint8_t		lit_len[LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS], dist_len[LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS];
+	uint16_t	lit_code[LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS], dist_code[LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS];
+} LibImageDeflateCodes;
+
+// Code lengths of a dynamic block run length coded with symbols 16 to 18, extra is the repeat count bits.
+typedef struct libimage_deflate_header {
+	uint8_t		symbol[LIBIMAGE_DEFLATE_NUM_LITLEN + LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS];
+	uint8_t		extra[LIBIMAGE_DEFLATE_NUM_LITLEN + LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS];
+	uint32_t	count, hlit, hdist, hclen;
+	uint32_t	freq[LIBIMAGE_DEFLATE_NUM_CODELEN_SYMBOLS];
+	uint8_t		len[LIBIMAGE_DEFLATE_NUM_CODELEN_SYMBOLS];
+	uint16_t	code[LIBIMAGE_DEFLATE_NUM_CODELEN_SYMBOLS];
+} LibImageDeflateHeader;
+
+typedef struct libimage_deflate_symbol_freq {
+	uint32_t	key;		// Frequency, then the code length
+	uint16_t	symbol;
+} LibImageDeflateSymbolFreq;
+
+int encode_buffer_reserve(LibImageEncodeBuffer *b, size_t n)
+{
+uint8_t	*data;
+size_t	capacity;
+
+	if(b->error) return b->error;
+	if(b->capacity - b->size >= n) return 0;
+	capacity = b->capacity ? b->capacity : Kilo(4);
+	while(capacity - b->size < n) capacity *= 2;
+	data = libimage_allocator_alloc(&b->allocator, capacity);
+	if(data == NULL) {
+		b->error = LIBIMAGE_ERROR_OUT_OF_MEMORY;
+		return b->error;
+	}
+	if(b->size) memcpy(data, b->data, b->size);
+	libimage_allocator_free(&b->allocator, b->data);
+	b->data	    = data;
+	b->capacity = capacity;
+	return 0;
+}
+
+void encode_buffer_bytes(LibImageEncodeBuffer *b, const void *bytes, size_t n)
+{
+	if(n == 0 || encode_buffer_reserve(b, n)) return;
+	memcpy(b->data + b->size, bytes, n);
+	b->size += n;
+}
+
+// Big endian, as every integer of the PNG and zlib framing.
+void encode_buffer_u32(LibImageEncodeBuffer *b, uint32_t value)
+{
+uint8_t bytes[4];
+
+	bytes[0] = value >> 24;
+	bytes[1] = value >> 16;
+	bytes[2] = value >> 8;
+	bytes[3] = value;
+	encode_buffer_bytes(b, bytes, sizeof(bytes));
+}
+
+/*
+*	Bit writer, the output has room for the block reserved before it is written. Up to 32 bits at a time, whole
+*	32 bit words go out as soon as they are there.
+*/
+static inline void deflate_put_bits(LibImageDeflate *d, uint32_t value, uint32_t n)
+{
+uint8_t	*out;
+
+	d->bit_buf   |= (uint64_t)value << d->bit_count;
+	d->bit_count += n;
+	if(d->bit_count >= 32) {
+		out = d->out->data + d->out->size;
+		out[0] = d->bit_buf;
+		out[1] = d->bit_buf >> 8;
+		out[2] = d->bit_buf >> 16;
+		out[3] = d->bit_buf >> 24;
+		d->out->size	+= 4;
+		d->bit_buf	>>= 32;
+		d->bit_count	-= 32;
+	}
+}
+
+static void deflate_align_to_byte(LibImageDeflate *d)
+{
+	while(d->bit_count > 0) {
+		d->out->data[d->out->size++] = d->bit_buf;
+		d->bit_buf   >>= 8;
+		d->bit_count = d->bit_count > 8 ? d->bit_count - 8 : 0;
+	}
+	d->bit_buf = 0;
+}
+
+static int deflate_compare_freq(const void *a, const void *b)
+{
+const LibImageDeflateSymbolFreq *x = a, *y = b;
+
+	if(x->key != y->key) return x->key < y->key ? -1 : 1;
+	return (int)x->symbol - (int)y->symbol;
+}
+
+/*
+*	Minimum redundancy code lengths of the sorted frequencies, in place ( Moffat and Katajainen ). The key of the
+*	most frequent symbol, last, ends up the shortest.
+*/
+static void deflate_minimum_redundancy(LibImageDeflateSymbolFreq *a, int n)
+{
+int root, leaf, next, available, used, depth;
+
+	a[0].key += a[1].key;
+	root = 0;
+	leaf = 2;
+	for(next = 1; next < n - 1; next++) {
+		if(leaf >= n || a[root].key < a[leaf].key) {
+			a[next].key = a[root].key;
+			a[root++].key = next;
+		} else {
+			a[next].key = a[leaf++].key;
+		}
+		if(leaf >= n || (root < next && a[root].key < a[leaf].key)) {
+			a[next].key += a[root].key;
+			a[root++].key = next;
+		} else {
+			a[next].key += a[leaf++].key;
+		}
+	}
+	a[n - 2].key = 0;
+	for(next = n - 3; next >= 0; next--) a[next].key = a[a[next].key].key + 1;
+
+	available = 1;
+	used	  = depth = 0;
+	root	  = n - 2;
+	next	  = n - 1;
+	while(available > 0) {
+		while(root >= 0 && (int)a[root].key == depth) {
+			used++;
+			root--;
+		}
+		while(available > used) {
+			a[next--].key = depth;
+			available--;
+		}
+		available = 2 * used;
+		depth++;
+		used = 0;
+	}
+}
+
+/*
+*	Code lengths of at most limit bits for freq. At least two symbols get a code, as zlib does, so every decoder
+*	takes the code and a block always has a distance code. Lengths over the limit are moved up the tree until the
+*	lengths add up again, the most frequent symbols get the shortest ones.
+*/
+static void deflate_build_lengths(const uint32_t *freq, int n, int limit, uint8_t *lengths)
+{
+LibImageDeflateSymbolFreq	syms[LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS];
+uint32_t			count[33], total;
+int				used, i, j, k;
+
+	memset(lengths, 0, n);
+	for(i = 0, used = 0; i < n; i++) {
+		if(freq[i] == 0) continue;
+		syms[used].key	  = freq[i];
+		syms[used].symbol = i;
+		used++;
+	}
+	for(i = 0; used < 2; i++) {
+		if(freq[i]) continue;
+		syms[used].key	  = 1;
+		syms[used].symbol = i;
+		used++;
+	}
+	qsort(syms, used, sizeof(*syms), deflate_compare_freq);
+	deflate_minimum_redundancy(syms, used);
+
+	memset(count, 0, sizeof(count));
+	for(i = 0; i < used; i++) count[syms[i].key < 32 ? syms[i].key : 32]++;
+	for(i = limit + 1; i <= 32; i++) {
+		count[limit] += count[i];
+		count[i] = 0;
+	}
+	for(i = limit, total = 0; i > 0; i--) total += count[i] << (limit - i);
+	while(total != (1u << limit)) {
+		count[limit]--;
+		for(i = limit - 1; i > 0; i--) {
+			if(count[i] == 0) continue;
+			count[i]--;
+			count[i + 1] += 2;
+			break;
+		}
+		total--;
+	}
+	for(i = limit, j = 0; i > 0; i--) {
+		for(k = count[i]; k > 0; k--) lengths[syms[j++].symbol] = i;
+	}
+}
+
+// Canonical codes of the lengths, RFC 1951 3.2.2.
+static void deflate_build_codes(const uint8_t *lengths, int n, uint16_t *codes)
+{
+uint32_t	count[LIBIMAGE_HUFFMAN_MAX_CODE_BITS + 1], next[LIBIMAGE_HUFFMAN_MAX_CODE_BITS + 1], code;
+int		i;
+
+	memset(count, 0, sizeof(count));
+	for(i = 0; i < n; i++) count[lengths[i]]++;
+	count[0] = 0;
+	for(i = 1, code = 0; i <= LIBIMAGE_HUFFMAN_MAX_CODE_BITS; i++) {
+		code	= (code + count[i - 1]) << 1;
+		next[i] = code;
+	}
+	for(i = 0; i < n; i++) codes[i] = lengths[i] ? bit_reverse(next[lengths[i]]++, lengths[i]) : 0;
+}
+
+static void deflate_fixed_codes(LibImageDeflateCodes *codes)
+{
+int i;
+
+	for(i = 0; i < LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS; i++) codes->lit_len[i] = i < 144 ? 8 : i < 256 ? 9 : i < 280 ? 7 : 8;
+	for(i = 0; i < LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS; i++) codes->dist_len[i] = 5;
+	deflate_build_codes(codes->lit_len, LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS, codes->lit_code);
+	deflate_build_codes(codes->dist_len, LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS, codes->dist_code);
+}
+
+static void deflate_header_add(LibImageDeflateHeader *h, uint8_t symbol, uint8_t extra)
+{
+	h->symbol[h->count] = symbol;
+	h->extra[h->count]  = extra;
+	h->count++;
+	h->freq[symbol]++;
+}
+
+// Run length codes the code lengths of the block and fits the code length code to them.
+static void deflate_build_header(LibImageDeflateHeader *h, const LibImageDeflateCodes *codes)
+{
+uint8_t		lengths[LIBIMAGE_DEFLATE_NUM_LITLEN + LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS];
+uint32_t	total, i, run, r;
+
+	memset(h, 0, sizeof(*h));
+	for(h->hlit = LIBIMAGE_DEFLATE_NUM_LITLEN; h->hlit > 257 && codes->lit_len[h->hlit - 1] == 0; h->hlit--);
+	for(h->hdist = LIBIMAGE_DEFLATE_NUM_DISTS; h->hdist > 1 && codes->dist_len[h->hdist - 1] == 0; h->hdist--);
+	memcpy(lengths, codes->lit_len, h->hlit);
+	memcpy(lengths + h->hlit, codes->dist_len, h->hdist);
+	total = h->hlit + h->hdist;
+
+	for(i = 0; i < total; i += run) {
+		for(run = 1; i + run < total && lengths[i + run] == lengths[i]; run++);
+		r = run;
+		if(lengths[i] == 0) {
+			for(; r >= 11; r -= r < 138 ? r : 138) deflate_header_add(h, 18, (r < 138 ? r : 138) - 11);
+			if(r >= 3) {
+				deflate_header_add(h, 17, r - 3);
+				r = 0;
+			}
+		} else {
+			deflate_header_add(h, lengths[i], 0);
+			for(r--; r >= 3; r -= r < 6 ? r : 6) deflate_header_add(h, 16, (r < 6 ? r : 6) - 3);
+		}
+		for(; r > 0; r--) deflate_header_add(h, lengths[i], 0);
+	}
+
+	deflate_build_lengths(h->freq, LIBIMAGE_DEFLATE_NUM_CODELEN_SYMBOLS, LIBIMAGE_DEFLATE_CODELEN_LIMIT, h->len);
+	deflate_build_codes(h->len, LIBIMAGE_DEFLATE_NUM_CODELEN_SYMBOLS, h->code);
+	for(h->hclen = LIBIMAGE_DEFLATE_NUM_CODELEN_SYMBOLS; h->hclen > 4 && h->len[deflate_codelen_order[h->hclen - 1]] == 0; h->hclen--);
+}
+
+static uint64_t deflate_header_bits(const LibImageDeflateHeader *h)
+{
+uint64_t	bits;
+int		i;
+
+	bits = 5 + 5 + 4 + 3 * h->hclen;
+	for(i = 0; i < LIBIMAGE_DEFLATE_NUM_CODELEN_SYMBOLS; i++) bits += (uint64_t)h->freq[i] * h->len[i];
+	return bits + 2 * h->freq[16] + 3 * h->freq[17] + 7 * h->freq[18];
+}
+
+// Bits of the symbols of the block with these codes, the extra bits left out since every code has them.
+static uint64_t deflate_symbol_bits(LibImageDeflate *d, const LibImageDeflateCodes *codes)
+{
+uint64_t	bits;
+int		i;
+
+	bits = 0;
+	for(i = 0; i < LIBIMAGE_DEFLATE_NUM_LITLEN; i++) bits += (uint64_t)d->lit_freq[i] * codes->lit_len[i];
+	for(i = 0; i < LIBIMAGE_DEFLATE_NUM_DISTS; i++) bits += (uint64_t)d->dist_freq[i] * codes->dist_len[i];
+	return bits;
+}
+
+static uint64_t deflate_extra_bits(LibImageDeflate *d)
+{
+uint64_t	bits;
+int		i;
+
+	bits = 0;
+	for(i = 0; i < LIBIMAGE_DEFLATE_NUM_LENGTHS; i++) bits += (uint64_t)d->lit_freq[257 + i] * deflate_length_spec[i].extra_bits;
+	for(i = 0; i < LIBIMAGE_DEFLATE_NUM_DISTS; i++) bits += (uint64_t)d->dist_freq[i] * deflate_distance_spec[i].extra_bits;
+	return bits;
+}
+
+static inline uint32_t deflate_distance_code(LibImageDeflate *d, uint32_t distance)
+{
+	return distance <= 256 ? d->distance_code[distance - 1] : d->distance_code[256 + ((distance - 1) >> 7)];
+}
+
+static void deflate_write_stored(LibImageDeflate *d, const uint8_t *raw, uint32_t size, int final)
+{
+uint32_t n;
+
+	do {
+		n = size < LIBIMAGE_DEFLATE_MAX_STORED ? size : LIBIMAGE_DEFLATE_MAX_STORED;
+		deflate_put_bits(d, final && n == size, 1);
+		deflate_put_bits(d, 0, 2);
+		deflate_align_to_byte(d);
+		deflate_put_bits(d, n | (~n << 16), 32);
+		memcpy(d->out->data + d->out->size, raw, n);
+		d->out->size += n;
+		raw  += n;
+		size -= n;
+	} while(size > 0);
+}
+
+static void deflate_write_symbols(LibImageDeflate *d, const LibImageDeflateCodes *codes)
+{
+uint32_t	i, length, distance, code;
+
+	for(i = 0; i < d->sym_count; i++) {
+		length	 = d->sym_length[i];
+		distance = d->sym_distance[i];
+		if(distance == 0) {
+			deflate_put_bits(d, codes->lit_code[length], codes->lit_len[length]);
+			continue;
+		}
+		code = d->length_code[length];
+		deflate_put_bits(d, codes->lit_code[257 + code], codes->lit_len[257 + code]);
+		deflate_put_bits(d, length - deflate_length_spec[code].base, deflate_length_spec[code].extra_bits);
+		code = deflate_distance_code(d, distance);
+		deflate_put_bits(d, codes->dist_code[code], codes->dist_len[code]);
+		deflate_put_bits(d, distance - deflate_distance_spec[code].base, deflate_distance_spec[code].extra_bits);
+	}
+	deflate_put_bits(d, codes->lit_code[256], codes->lit_len[256]);
+}
+
+static void deflate_write_header(LibImageDeflate *d, const LibImageDeflateHeader *h)
+{
+uint32_t i;
+
+	deflate_put_bits(d, h->hlit - 257, 5);
+	deflate_put_bits(d, h->hdist - 1, 5);
+	deflate_put_bits(d, h->hclen - 4, 4);
+	for(i = 0; i < h->hclen; i++) deflate_put_bits(d, h->len[deflate_codelen_order[i]], 3);
+	for(i = 0; i < h->count; i++) {
+		deflate_put_bits(d, h->code[h->symbol[i]], h->len[h->symbol[i]]);
+		if(h->symbol[i] == 16) deflate_put_bits(d, h->extra[i], 2);
+		else if(h->symbol[i] == 17) deflate_put_bits(d, h->extra[i], 3);
+		else if(h->symbol[i] == 18) deflate_put_bits(d, h->extra[i], 7);
+	}
+}
+
+// Raw bytes the symbols of the block stand for, a byte waiting on the lazy match isn't one of them yet.
+static uint32_t deflate_block_end(LibImageDeflate *d)
+{
+	return d->pos - d->lazy_available;
+}
+
+/*
+*	Writes the block, with whichever of stored, fixed and dynamic codes is the smallest for it, and starts the next
+*	one. The raw bytes of the block are all still in the buffer for the stored case.
+*/
+static int deflate_flush_block(LibImageDeflate *d, int final)
+{
+LibImageDeflateCodes	dynamic, fixed;
+LibImageDeflateHeader	header;
+uint64_t		stored_bits, fixed_bits, dynamic_bits, extra_bits;
+uint32_t		end, raw_size;
+int			ret;
+
+	end	 = deflate_block_end(d);
+	raw_size = end - d->block_start;
+	ret	 = encode_buffer_reserve(d->out, raw_size + (raw_size / LIBIMAGE_DEFLATE_MAX_STORED + 1) * 5 + 6 * (uint64_t)d->sym_count + 1024);
+	if(ret) return ret;
+
+	if(d->level == LIBIMAGE_ENCODE_STORED) {
+		if(raw_size || final) deflate_write_stored(d, d->buffer + d->block_start, raw_size, final);
+		d->block_start = end;
+		return 0;
+	}
+
+	memset(&dynamic, 0, sizeof(dynamic));
+	d->lit_freq[256]++;
+	deflate_build_lengths(d->lit_freq, LIBIMAGE_DEFLATE_NUM_LITLEN, LIBIMAGE_DEFLATE_HUFFMAN_LIMIT, dynamic.lit_len);
+	deflate_build_lengths(d->dist_freq, LIBIMAGE_DEFLATE_NUM_DISTS, LIBIMAGE_DEFLATE_HUFFMAN_LIMIT, dynamic.dist_len);
+	deflate_build_codes(dynamic.lit_len, LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS, dynamic.lit_code);
+	deflate_build_codes(dynamic.dist_len, LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS, dynamic.dist_code);
+	deflate_build_header(&header, &dynamic);
+	deflate_fixed_codes(&fixed);
+
+	extra_bits   = deflate_extra_bits(d);
+	dynamic_bits = 3 + deflate_header_bits(&header) + deflate_symbol_bits(d, &dynamic) + extra_bits;
+	fixed_bits   = 3 + deflate_symbol_bits(d, &fixed) + extra_bits;
+	// The first stored block is padded to a byte after its 3 bits, every one of them has LEN and NLEN.
+	stored_bits  = ((d->bit_count + 3 + 7) & ~7u) - d->bit_count + 32 + 8 * (uint64_t)raw_size;
+	stored_bits += (uint64_t)(raw_size ? (raw_size - 1) / LIBIMAGE_DEFLATE_MAX_STORED : 0) * 40;
+
+	if(stored_bits <= fixed_bits && stored_bits <= dynamic_bits) {
+		deflate_write_stored(d, d->buffer + d->block_start, raw_size, final);
+	} else if(fixed_bits <= dynamic_bits) {
+		deflate_put_bits(d, final, 1);
+		deflate_put_bits(d, 1, 2);
+		deflate_write_symbols(d, &fixed);
+	} else {
+		deflate_put_bits(d, final, 1);
+		deflate_put_bits(d, 2, 2);
+		deflate_write_header(d, &header);
+		deflate_write_symbols(d, &dynamic);
+	}
+
+	memset(d->lit_freq, 0, sizeof(d->lit_freq));
+	memset(d->dist_freq, 0, sizeof(d->dist_freq));
+	d->sym_count   = 0;
+	d->block_start = end;
+	return 0;
+}
+
+static inline int deflate_literal(LibImageDeflate *d, uint8_t value)
+{
+	d->sym_length[d->sym_count]   = value;
+	d->sym_distance[d->sym_count] = 0;
+	d->lit_freq[value]++;
+	return ++d->sym_count == LIBIMAGE_DEFLATE_BLOCK_SYMBOLS;
+}
+
+static inline int deflate_match(LibImageDeflate *d, uint32_t length, uint32_t distance)
+{
+	d->sym_length[d->sym_count]   = length;
+	d->sym_distance[d->sym_count] = distance;
+	d->lit_freq[257 + d->length_code[length]]++;
+	d->dist_freq[deflate_distance_code(d, distance)]++;
+	return ++d->sym_count == LIBIMAGE_DEFLATE_BLOCK_SYMBOLS;
+}
+
+static inline uint64_t deflate_load64(const uint8_t *p)
+{
+uint64_t value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+static inline uint32_t deflate_load32(const uint8_t *p)
+{
+uint32_t value;
+
+	memcpy(&value, p, sizeof(value));
+	return value;
+}
+
+// Bytes a and b have in common, up to max. Eight at a time, the first that differs is found from the xor.
+static inline uint32_t deflate_match_length(const uint8_t *a, const uint8_t *b, uint32_t max)
+{
+uint64_t	diff;
+uint32_t	n;
+
+	for(n = 0; n + 8 <= max; n += 8) {
+		diff = deflate_load64(a + n) ^ deflate_load64(b + n);
+		if(diff == 0) continue;
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+		return n + (__builtin_ctzll(diff) >> 3);
+#else
+		return n + (__builtin_clzll(diff) >> 3);
+#endif
+	}
+	while(n < max && a[n] == b[n]) n++;
+	return n;
+}
+
+static inline uint32_t deflate_hash(const uint8_t *p)
+{
+	return (deflate_load32(p) * 2654435761u) >> (32 - LIBIMAGE_DEFLATE_HASH_BITS);
+}
+
+// Puts the position in front of its hash chain and returns the one that was there.
+static inline uint32_t deflate_insert(LibImageDeflate *d, uint32_t pos)
+{
+uint32_t hash, stream_pos, candidate;
+
+	hash	   = deflate_hash(d->buffer + pos);
+	stream_pos = d->base + pos;
+	candidate  = d->head[hash];
+	d->head[hash] = stream_pos;
+	d->prev[stream_pos & LIBIMAGE_DEFLATE_WINDOW_MASK] = candidate;
+	return candidate;
+}
+
+/*
+*	Walks the chain from candidate for the longest match at pos. Chains hold stream positions that wrap, and the
+*	heads start at zero, so a candidate is only taken for what its bytes really match and the walk stops as soon
+*	as it doesn't go further back.
+*/
+static uint32_t deflate_longest_match(LibImageDeflate *d, uint32_t pos, uint32_t candidate, uint32_t max_chain, uint32_t *distance)
+{
+const uint8_t	*here;
+uint32_t	stream_pos, dist, last_dist, max, best, length;
+
+	here	   = d->buffer + pos;
+	stream_pos = d->base + pos;
+	max	   = d->fill - pos < LIBIMAGE_DEFLATE_MAX_MATCH_LEN ? d->fill - pos : LIBIMAGE_DEFLATE_MAX_MATCH_LEN;
+	best	   = 0;
+	last_dist  = 0;
+	while(max_chain--) {
+		dist = stream_pos - candidate;
+		if(dist <= last_dist || dist > LIBIMAGE_DEFLATE_WINDOW || dist > pos) break;
+		if(best == 0 || here[best] == (here - dist)[best]) {
+			length = deflate_match_length(here, here - dist, max);
+			if(length > best) {
+				best	  = length;
+				*distance = dist;
+				if(best >= d->nice_length || best == max) break;
+			}
+		}
+		last_dist = dist;
+		candidate = d->prev[candidate & LIBIMAGE_DEFLATE_WINDOW_MASK];
+	}
+	return best >= LIBIMAGE_DEFLATE_HASH_MATCH ? best : 0;
+}
+
+static int deflate_compress_rle(LibImageDeflate *d, uint32_t limit)
+{
+uint32_t	max, length, other, distance;
+int		ret;
+
+	while(d->pos < limit) {
+		max	 = d->fill - d->pos < LIBIMAGE_DEFLATE_MAX_MATCH_LEN ? d->fill - d->pos : LIBIMAGE_DEFLATE_MAX_MATCH_LEN;
+		length	 = d->pos >= 1 ? deflate_match_length(d->buffer + d->pos, d->buffer + d->pos - 1, max) : 0;
+		distance = 1;
+		if(length < max && d->pixel_distance > 1 && d->pos >= d->pixel_distance) {
+			other = deflate_match_length(d->buffer + d->pos, d->buffer + d->pos - d->pixel_distance, max);
+			if(other > length) {
+				length	 = other;
+				distance = d->pixel_distance;
+			}
+		}
+		if(length >= LIBIMAGE_DEFLATE_MIN_MATCH) {
+			ret = deflate_match(d, length, distance);
+			d->pos += length;
+		} else {
+			ret = deflate_literal(d, d->buffer[d->pos++]);
+		}
+		if(ret && (ret = deflate_flush_block(d, 0))) return ret;
+	}
+	return 0;
+}
+
+static int deflate_compress_greedy(LibImageDeflate *d, uint32_t limit)
+{
+uint32_t	candidate, length, distance, end;
+int		ret;
+
+	while(d->pos < limit) {
+		length = 0;
+		if(d->fill - d->pos >= LIBIMAGE_DEFLATE_HASH_MATCH) {
+			candidate = deflate_insert(d, d->pos);
+			length	  = deflate_longest_match(d, d->pos, candidate, d->max_chain, &distance);
+		}
+		if(length == 0) {
+			ret = deflate_literal(d, d->buffer[d->pos++]);
+		} else {
+			ret = deflate_match(d, length, distance);
+			end = d->pos + length;
+			// Long matches are runs of the same bytes more often than not, their positions aren't worth hashing.
+			if(length <= d->insert_limit) {
+				for(d->pos++; d->pos < end && d->fill - d->pos >= LIBIMAGE_DEFLATE_HASH_MATCH; d->pos++) deflate_insert(d, d->pos);
+			}
+			d->pos = end;
+		}
+		if(ret && (ret = deflate_flush_block(d, 0))) return ret;
+	}
+	return 0;
+}
+
+/*
+*	The match found at a position is held back one byte, it is taken only when the next position doesn't start a
+*	longer one, otherwise its first byte goes out as a literal.
+*/
+static int deflate_compress_lazy(LibImageDeflate *d, uint32_t limit)
+{
+uint32_t	candidate, length, distance, end;
+int		ret;
+
+	while(d->pos < limit) {
+		length = distance = 0;
+		if(d->fill - d->pos >= LIBIMAGE_DEFLATE_HASH_MATCH) {
+			candidate = deflate_insert(d, d->pos);
+			if(d->lazy_length < d->nice_length) length = deflate_longest_match(d, d->pos, candidate, d->lazy_length >= 32 ? d->max_chain / 4 : d->max_chain, &distance);
+		}
+		ret = 0;
+		if(d->lazy_available && d->lazy_length && length <= d->lazy_length) {
+			ret = deflate_match(d, d->lazy_length, d->lazy_distance);
+			end = d->pos - 1 + d->lazy_length;
+			for(d->pos++; d->pos < end && d->fill - d->pos >= LIBIMAGE_DEFLATE_HASH_MATCH; d->pos++) deflate_insert(d, d->pos);
+			d->pos		  = end;
+			d->lazy_available = 0;
+			d->lazy_length	  = 0;
+		} else {
+			if(d->lazy_available) ret = deflate_literal(d, d->buffer[d->pos - 1]);
+			d->lazy_available = 1;
+			d->lazy_length	  = length;
+			d->lazy_distance  = distance;
+			d->pos++;
+		}
+		if(ret && (ret = deflate_flush_block(d, 0))) return ret;
+	}
+	return 0;
+}
+
+// Compresses up to where a match could still grow with bytes not fed yet, all of it once final.
+static int deflate_compress(LibImageDeflate *d, int final)
+{
+uint32_t	limit;
+int		ret;
+
+	if(d->level == LIBIMAGE_ENCODE_STORED) {
+		while(d->fill - d->block_start >= LIBIMAGE_DEFLATE_MAX_STORED) {
+			d->pos = d->block_start + LIBIMAGE_DEFLATE_MAX_STORED;
+			if((ret = deflate_flush_block(d, 0))) return ret;
+		}
+		d->pos = d->fill;
+		return 0;
+	}
+	if(final) limit = d->fill;
+	else limit = d->fill > LIBIMAGE_DEFLATE_MAX_MATCH_LEN ? d->fill - LIBIMAGE_DEFLATE_MAX_MATCH_LEN : 0;
+	switch(d->level) {
+		case LIBIMAGE_ENCODE_RLE:	return deflate_compress_rle(d, limit);
+		case LIBIMAGE_ENCODE_GREEDY:	return deflate_compress_greedy(d, limit);
+		default:			return deflate_compress_lazy(d, limit);
+	}
+}
+
+// Drops what is behind the window, flushing the block first when its raw bytes would go with it.
+static int deflate_slide(LibImageDeflate *d)
+{
+uint32_t keep_from;
+int	 ret;
+
+	keep_from = d->pos > LIBIMAGE_DEFLATE_WINDOW + 1 ? d->pos - LIBIMAGE_DEFLATE_WINDOW - 1 : 0;
+	if(d->block_start < keep_from && (ret = deflate_flush_block(d, 0))) return ret;
+	if(keep_from == 0) return 0;
+	memmove(d->buffer, d->buffer + keep_from, d->fill - keep_from);
+	d->base	       += keep_from;
+	d->pos	       -= keep_from;
+	d->fill	       -= keep_from;
+	d->block_start -= keep_from;
+	return 0;
+}
+
+/*
+*	Starts a zlib stream at level in out. pixel_distance is the size of a pixel in bytes, the second distance RLE
+*	tries. Returns zero or the error.
+*/
+int deflate_init(LibImageDeflate *d, LibImageEncodeBuffer *out, uint32_t level, uint32_t pixel_distance)
+{
+static const uint8_t	flevel[LIBIMAGE_ENCODE_LEVEL_COUNT] = { 0x01, 0x01, 0x5e, 0x9c };	// FLEVEL of each level
+uint32_t		i, n;
+uint8_t			zlib_header[2];
+
+	memset(d, 0, sizeof(*d));
+	if(level >= LIBIMAGE_ENCODE_LEVEL_COUNT) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	d->out		  = out;
+	d->level	  = level;
+	d->pixel_distance = pixel_distance;
+	d->adler	  = LIBIMAGE_ADLER32_INIT;
+	d->max_chain	  = level == LIBIMAGE_ENCODE_LAZY ? 128 : 8;
+	d->nice_length	  = level == LIBIMAGE_ENCODE_LAZY ? LIBIMAGE_DEFLATE_MAX_MATCH_LEN : 64;
+	d->insert_limit	  = 16;
+	for(i = 0; i < LIBIMAGE_DEFLATE_NUM_LENGTHS; i++) {
+		for(n = deflate_length_spec[i].base; n < deflate_length_spec[i].base + (1u << deflate_length_spec[i].extra_bits) && n <= LIBIMAGE_DEFLATE_MAX_MATCH_LEN; n++) d->length_code[n] = i;	// 258 ends up with 285 of its own
+	}
+	for(i = 0; i < LIBIMAGE_DEFLATE_NUM_DISTS; i++) {
+		for(n = deflate_distance_spec[i].base; n < deflate_distance_spec[i].base + (1u << deflate_distance_spec[i].extra_bits); n++) {
+			if(n <= 256) d->distance_code[n - 1] = i;
+			else d->distance_code[256 + ((n - 1) >> 7)] = i;
+		}
+	}
+
+	d->buffer	= libimage_allocator_alloc(&out->allocator, LIBIMAGE_DEFLATE_BUFFER);
+	d->sym_length	= libimage_allocator_alloc(&out->allocator, LIBIMAGE_DEFLATE_BLOCK_SYMBOLS * sizeof(*d->sym_length));
+	d->sym_distance	= libimage_allocator_alloc(&out->allocator, LIBIMAGE_DEFLATE_BLOCK_SYMBOLS * sizeof(*d->sym_distance));
+	if(level >= LIBIMAGE_ENCODE_GREEDY) {
+		d->head = libimage_allocator_alloc(&out->allocator, (sizeof(*d->head) << LIBIMAGE_DEFLATE_HASH_BITS));
+		d->prev = libimage_allocator_alloc(&out->allocator, LIBIMAGE_DEFLATE_WINDOW * sizeof(*d->prev));
+		if(d->head) memset(d->head, 0, sizeof(*d->head) << LIBIMAGE_DEFLATE_HASH_BITS);
+		if(d->prev) memset(d->prev, 0, LIBIMAGE_DEFLATE_WINDOW * sizeof(*d->prev));
+	}
+	if(d->buffer == NULL || d->sym_length == NULL || d->sym_distance == NULL || (level >= LIBIMAGE_ENCODE_GREEDY && (d->head == NULL || d->prev == NULL))) {
+		deflate_deinit(d);
+		return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	}
+
+	// CM 8 with a 32K window, FCHECK makes the pair a multiple of 31 for every FLEVEL used.
+	zlib_header[0] = 0x78;
+	zlib_header[1] = flevel[level];
+	encode_buffer_bytes(out, zlib_header, sizeof(zlib_header));
+	if(out->error) deflate_deinit(d);
+	return out->error;
+}
+
+// Takes more of the stream, what is fed is copied so data can be reused right away. Returns zero or the error.
+int deflate_feed(LibImageDeflate *d, const uint8_t *data, size_t size)
+{
+size_t	n;
+int	ret;
+
+	while(size > 0) {
+		if(d->fill == LIBIMAGE_DEFLATE_BUFFER && (ret = deflate_slide(d))) return ret;
+		n = LIBIMAGE_DEFLATE_BUFFER - d->fill < size ? LIBIMAGE_DEFLATE_BUFFER - d->fill : size;
+		memcpy(d->buffer + d->fill, data, n);
+		d->adler = adler32_update(d->adler, data, n);
+		d->fill += n;
+		data	+= n;
+		size	-= n;
+		ret = deflate_compress(d, 0);
+		if(ret) return ret;
+	}
+	return 0;
+}
+
+// Compresses what is left, ends the stream with the final block and the ADLER32. Returns zero or the error.
+int deflate_finish(LibImageDeflate *d)
+{
+int ret;
+
+	ret = deflate_compress(d, 1);
+	if(ret == 0 && d->lazy_available) {
+		d->lazy_available = 0;
+		if(deflate_literal(d, d->buffer[d->pos - 1])) ret = deflate_flush_block(d, 0);
+	}
+	if(ret == 0) ret = deflate_flush_block(d, 1);
+	if(ret) return ret;
+	deflate_align_to_byte(d);
+	encode_buffer_u32(d->out, d->adler);
+	return d->out->error;
+}
+
+void deflate_deinit(LibImageDeflate *d)
+{
+	libimage_allocator_free(&d->out->allocator, d->buffer);
+	libimage_allocator_free(&d->out->allocator, d->sym_length);
+	libimage_allocator_free(&d->out->allocator, d->sym_distance);
+	libimage_allocator_free(&d->out->allocator, d->head);
+	libimage_allocator_free(&d->out->allocator, d->prev);
+	d->buffer = NULL;
+	d->sym_length = d->sym_distance = NULL;
+	d->head = d->prev = NULL;
+}
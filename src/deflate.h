@@ -0,0 +1,73 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_DEFLATE_H__
+#define __LIB_IMAGE_DEFLATE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "common.h"
+#include "arena.h"
+#include "huffman.h"
+
+#define LIBIMAGE_DEFLATE_WINDOW		Kilo(32)	// Farthest a match reaches back
+#define LIBIMAGE_DEFLATE_BUFFER		Kilo(256)	// Input held, the window behind the position and what is left to compress
+#define LIBIMAGE_DEFLATE_HASH_BITS	15
+#define LIBIMAGE_DEFLATE_BLOCK_SYMBOLS	Kilo(16)	// Literals and matches of a block, its codes are fitted to them
+#define LIBIMAGE_DEFLATE_MIN_MATCH	3
+#define LIBIMAGE_DEFLATE_HASH_MATCH	4		// The hash chains find matches of at least this many bytes
+#define LIBIMAGE_DEFLATE_MAX_STORED	65535
+#define LIBIMAGE_DEFLATE_NUM_LENGTHS	29
+#define LIBIMAGE_DEFLATE_NUM_DISTS	30
+
+/*
+*	Compression levels are the LIBIMAGE_ENCODE_* of the public header. STORED copies the input in stored blocks.
+*	RLE only looks for repeats of the previous byte and of the previous pixel, which is where the filtered scanlines
+*	of an image repeat the most, and needs no hash tables. GREEDY takes the longest match a short hash chain walk
+*	finds, LAZY walks longer chains and keeps a match only when the next byte doesn't start a longer one. Every block but the stored ones gets the cheapest of stored, fixed and dynamic codes for its symbols.
+*/
+#define LIBIMAGE_ENCODE_LEVEL_COUNT	(LIBIMAGE_ENCODE_LAZY + 1)
+
+// Growing output of the encoder, from the allocator it was given. error is set once growing failed.
+typedef struct libimage_encode_buffer {
+	LibImageAllocator	allocator;
+	uint8_t			*data;
+	size_t			size, capacity;
+	int			error;
+} LibImageEncodeBuffer;
+
+typedef struct libimage_deflate {
+	LibImageEncodeBuffer	*out;
+	uint32_t		level;
+	uint32_t		pixel_distance;		// Second distance of RLE, the bytes of a pixel
+	uint32_t		max_chain, nice_length, insert_limit;
+	uint8_t			*buffer;
+	uint32_t		fill, pos;		// Bytes in buffer and the first one not compressed yet
+	uint32_t		block_start;		// First byte of the current block in buffer
+	uint32_t		base;			// Position of buffer[0] in the stream, wraps
+	uint32_t		*head, *prev;		// Hash chains of stream positions
+	uint16_t		*sym_length, *sym_distance;	// Distance zero for a literal
+	uint32_t		sym_count;
+	uint32_t		lit_freq[LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS], dist_freq[LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS];
+	uint64_t		bit_buf;
+	uint32_t		bit_count;
+	uint32_t		lazy_length, lazy_distance;	// Match found at pos - 1, waiting for the one at pos
+	uint8_t			lazy_available;
+	uint32_t		adler;
+	uint8_t			length_code[LIBIMAGE_DEFLATE_MAX_MATCH_LEN + 1];
+	uint8_t			distance_code[512];
+} LibImageDeflate;
+
+int encode_buffer_reserve(LibImageEncodeBuffer *b, size_t n);
+void encode_buffer_bytes(LibImageEncodeBuffer *b, const void *bytes, size_t n);
+void encode_buffer_u32(LibImageEncodeBuffer *b, uint32_t value);
+
+int deflate_init(LibImageDeflate *d, LibImageEncodeBuffer *out, uint32_t level, uint32_t pixel_distance);
+int deflate_feed(LibImageDeflate *d, const uint8_t *data, size_t size);
+int deflate_finish(LibImageDeflate *d);
+void deflate_deinit(LibImageDeflate *d);
+
+#endif
@@ -0,0 +1,275 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "arena.h"
+#include "zlib.h"
+#include "png.h"
+#include "crc32.h"
+#include "filter.h"
+#include "convert.h"
+#include "deflate.h"
+#include "encode.h"
+
+static const uint8_t encode_png_sig[] = { 0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a };
+
+// Colour type and bit depth each format is written as, and its bytes per pixel.
+static const uint8_t encode_colour_type[LIBIMAGE_FORMAT_COUNT] = { 0, 6, 2, 6, 0, 6 };
+static const uint8_t encode_bit_depth[LIBIMAGE_FORMAT_COUNT]   = { 0, 8, 8, 8, 8, 16 };
+static const uint8_t encode_pixel_bytes[LIBIMAGE_FORMAT_COUNT] = { 0, 4, 3, 4, 1, 8 };
+
+typedef struct libimage_png_encoder {
+	LibImageEncodeBuffer	out;
+	LibImageDeflate		deflate;
+	size_t			idat_start;		// Length field of the IDAT being written
+	uint32_t		format, level;
+	uint32_t		row_bytes, bpp;
+	uint8_t			*scratch;		// Two rows in the PNG byte order, then two filtered rows
+} LibImagePngEncoder;
+
+// Length and type of a chunk, same bytes as the start of LibImagePngChunk.
+static void encode_chunk_header(LibImageEncodeBuffer *b, uint32_t type, uint32_t len)
+{
+LibImagePngChunk chunk;
+
+	chunk.data_len.i = u32_endian_swap(len);
+	chunk.type.i	 = u32_endian_swap(type);
+	encode_buffer_bytes(b, chunk.data_len.b, 4);
+	encode_buffer_bytes(b, chunk.type.b, 4);
+}
+
+// The CRC of the chunk whose length field is at start, over its type and data up to the end of the buffer.
+static void encode_chunk_crc(LibImageEncodeBuffer *b, size_t start)
+{
+uint32_t value;
+
+	if(b->error) return;
+	value = crc(b->data + start + 4, b->size - start - 4);
+	encode_buffer_bytes(b, &value, 4);
+}
+
+static void encode_chunk(LibImageEncodeBuffer *b, uint32_t type, const uint8_t *data, uint32_t len)
+{
+size_t start;
+
+	start = b->size;
+	encode_chunk_header(b, type, len);
+	encode_buffer_bytes(b, data, len);
+	encode_chunk_crc(b, start);
+}
+
+/*
+*	Deflate writes the stream straight after the header of the current IDAT. Once it holds more than a chunk's worth,
+*	the chunk is closed there: what went past it, at most a block, moves up to make room for the CRC and the header
+*	of the next one. The stream is never copied as a whole.
+*/
+static int encode_split_idat(LibImagePngEncoder *e)
+{
+LibImagePngChunk	chunk;
+size_t			end, tail;
+uint32_t		value;
+
+	while(e->out.error == 0 && e->out.size - e->idat_start - 8 > LIBIMAGE_ENCODE_IDAT_SIZE) {
+		if(encode_buffer_reserve(&e->out, 12)) break;
+		end  = e->idat_start + 8 + LIBIMAGE_ENCODE_IDAT_SIZE;
+		tail = e->out.size - end;
+		memmove(e->out.data + end + 12, e->out.data + end, tail);
+		chunk.data_len.i = u32_endian_swap(LIBIMAGE_ENCODE_IDAT_SIZE);
+		memcpy(e->out.data + e->idat_start, chunk.data_len.b, 4);
+		value = crc(e->out.data + e->idat_start + 4, 4 + LIBIMAGE_ENCODE_IDAT_SIZE);
+		memcpy(e->out.data + end, &value, 4);
+		chunk.type.i = u32_endian_swap(LIBIMAGE_PNG_TYPE('I','D','A','T'));
+		memcpy(e->out.data + end + 8, chunk.type.b, 4);
+		e->out.size += 12;
+		e->idat_start = end + 4;
+	}
+	return e->out.error;
+}
+
+static void encode_close_idat(LibImagePngEncoder *e)
+{
+LibImagePngChunk chunk;
+
+	if(e->out.error) return;
+	chunk.data_len.i = u32_endian_swap(e->out.size - e->idat_start - 8);
+	memcpy(e->out.data + e->idat_start, chunk.data_len.b, 4);
+	encode_chunk_crc(&e->out, e->idat_start);
+}
+
+// The row in the byte order of the file, the caller's own row when it already is.
+static const uint8_t *encode_png_row(LibImagePngEncoder *e, const uint8_t *src, uint8_t *dst)
+{
+uint32_t	i;
+uint16_t	sample;
+
+	switch(e->format) {
+		case LIBIMAGE_FORMAT_BGRA8: {
+			for(i = 0; i < e->row_bytes; i += 4) {
+				dst[i + 0] = src[i + 2];
+				dst[i + 1] = src[i + 1];
+				dst[i + 2] = src[i + 0];
+				dst[i + 3] = src[i + 3];
+			}
+		} break;
+		case LIBIMAGE_FORMAT_RGBA16: {
+			for(i = 0; i < e->row_bytes; i += 2) {
+				memcpy(&sample, src + i, 2);
+				dst[i + 0] = sample >> 8;
+				dst[i + 1] = sample;
+			}
+		} break;
+		default: return src;
+	}
+	return dst;
+}
+
+/*
+*	Filters the row with each of the five filters and keeps the one with the smallest sum of signed bytes, the
+*	lower filter type on ties. Stored output doesn't compress, so it stays unfiltered.
+*/
+static const uint8_t *encode_filter_row(LibImagePngEncoder *e, const uint8_t *row, const uint8_t *prev, uint8_t *best, uint8_t *trial)
+{
+uint8_t		*swap;
+uint64_t	cost, best_cost;
+uint8_t		filter;
+
+	best[0] = LIBIMAGE_PNG_FILTER_NONE;
+	png_filter_row(best + 1, row, prev, e->row_bytes, e->bpp, LIBIMAGE_PNG_FILTER_NONE);
+	if(e->level == LIBIMAGE_ENCODE_STORED) return best;
+	best_cost = png_filter_cost(best + 1, e->row_bytes);
+	for(filter = LIBIMAGE_PNG_FILTER_SUB; filter <= LIBIMAGE_PNG_FILTER_PAETH; filter++) {
+		trial[0] = filter;
+		png_filter_row(trial + 1, row, prev, e->row_bytes, e->bpp, filter);
+		cost = png_filter_cost(trial + 1, e->row_bytes);
+		if(cost >= best_cost) continue;
+		best_cost = cost;
+		swap	  = best;
+		best	  = trial;
+		trial	  = swap;
+	}
+	return best;
+}
+
+static int encode_png_rows(LibImagePngEncoder *e, const uint8_t *pixels, uint32_t height, size_t stride)
+{
+const uint8_t	*row, *prev, *filtered;
+uint8_t		*converted[2], *best, *trial;
+uint32_t	y;
+int		ret;
+
+	converted[0] = e->scratch;
+	converted[1] = converted[0] + e->row_bytes;
+	best	     = converted[1] + e->row_bytes;
+	trial	     = best + e->row_bytes + 1;
+	// The row above the first one is all zeros, the second converted row stands in for it.
+	memset(converted[1], 0, e->row_bytes);
+	prev = converted[1];
+	for(y = 0; y < height; y++) {
+		row	 = encode_png_row(e, pixels + (size_t)y * stride, converted[y & 1]);
+		filtered = encode_filter_row(e, row, prev, best, trial);
+		ret	 = deflate_feed(&e->deflate, filtered, e->row_bytes + 1);
+		if(ret == 0) ret = encode_split_idat(e);
+		if(ret) return ret;
+		prev = row;
+	}
+	ret = deflate_finish(&e->deflate);
+	if(ret == 0) ret = encode_split_idat(e);
+	return ret;
+}
+
+/*
+*	Encodes width x height pixels of the format of opts into a PNG file, NULL opts is packed RGBA8 at the RLE
+*	level. Returns the file, *size bytes from the allocator of opts, or NULL with *error set.
+*/
+void *libimage_encode_png(const void *pixels, uint32_t width, uint32_t height, const LibImageEncodeOptions *opts, size_t *size, int *error)
+{
+LibImagePngEncoder	e;
+LibImageEncodeOptions	defaults;
+uint8_t			ihdr[13];
+size_t			stride;
+int			ret;
+
+	if(opts == NULL) {
+		memset(&defaults, 0, sizeof(defaults));
+		defaults.format = LIBIMAGE_FORMAT_RGBA8;
+		defaults.level	= LIBIMAGE_ENCODE_RLE;
+		opts = &defaults;
+	}
+	*size = 0;
+	if(pixels == NULL || opts->format == LIBIMAGE_FORMAT_NATIVE || opts->format >= LIBIMAGE_FORMAT_COUNT || opts->level >= LIBIMAGE_ENCODE_LEVEL_COUNT) {
+		*error = LIBIMAGE_ERROR_INVALID_ARGUMENT;
+		return NULL;
+	}
+	if(width == 0 || height == 0) {
+		*error = LIBIMAGE_PNG_ERROR_ZERO_SIZE;
+		return NULL;
+	}
+	if(width > LIBIMAGE_ENCODE_MAX_DIMENSION || height > LIBIMAGE_ENCODE_MAX_DIMENSION || (uint64_t)width * encode_pixel_bytes[opts->format] >= UINT32_MAX) {
+		*error = LIBIMAGE_PNG_ERROR_BIG_IMAGE;
+		return NULL;
+	}
+
+	memset(&e, 0, sizeof(e));
+	if(opts->allocator) e.out.allocator = *opts->allocator;
+	else libimage_allocator_default(&e.out.allocator);
+	e.format    = opts->format;
+	e.level	    = opts->level;
+	e.bpp	    = encode_pixel_bytes[e.format];
+	e.row_bytes = width * e.bpp;
+	stride	    = opts->stride ? opts->stride : e.row_bytes;
+	if(stride < e.row_bytes) {
+		*error = LIBIMAGE_ERROR_INVALID_ARGUMENT;
+		return NULL;
+	}
+	e.scratch = libimage_allocator_alloc(&e.out.allocator, 4 * ((size_t)e.row_bytes + 1));
+	if(e.scratch == NULL) {
+		*error = LIBIMAGE_ERROR_OUT_OF_MEMORY;
+		return NULL;
+	}
+
+	ihdr[0]	 = width >> 24;
+	ihdr[1]	 = width >> 16;
+	ihdr[2]	 = width >> 8;
+	ihdr[3]	 = width;
+	ihdr[4]	 = height >> 24;
+	ihdr[5]	 = height >> 16;
+	ihdr[6]	 = height >> 8;
+	ihdr[7]	 = height;
+	ihdr[8]	 = encode_bit_depth[e.format];
+	ihdr[9]	 = encode_colour_type[e.format];
+	ihdr[10] = 0;	// Deflate
+	ihdr[11] = 0;	// Adaptive filtering
+	ihdr[12] = 0;	// Not interlaced
+	encode_buffer_bytes(&e.out, encode_png_sig, sizeof(encode_png_sig));
+	encode_chunk(&e.out, LIBIMAGE_PNG_TYPE('I','H','D','R'), ihdr, sizeof(ihdr));
+	e.idat_start = e.out.size;
+	encode_chunk_header(&e.out, LIBIMAGE_PNG_TYPE('I','D','A','T'), 0);
+
+	ret = e.out.error;
+	if(ret == 0) ret = deflate_init(&e.deflate, &e.out, e.level, e.bpp);
+	if(ret == 0) {
+		ret = encode_png_rows(&e, pixels, height, stride);
+		deflate_deinit(&e.deflate);
+	}
+	if(ret == 0) {
+		encode_close_idat(&e);
+		encode_chunk(&e.out, LIBIMAGE_PNG_TYPE('I','E','N','D'), NULL, 0);
+		ret = e.out.error;
+	}
+	libimage_allocator_free(&e.out.allocator, e.scratch);
+	if(ret) {
+		libimage_allocator_free(&e.out.allocator, e.out.data);
+		*error = ret;
+		return NULL;
+	}
+	*size  = e.out.size;
+	*error = 0;
+	return e.out.data;
+}
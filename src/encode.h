@@ -0,0 +1,24 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_ENCODE_H__
+#define __LIB_IMAGE_ENCODE_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "common.h"
+#include "arena.h"
+#include "deflate.h"
+
+/*
+*	PNG encoder. Rows of the LIBIMAGE_FORMAT_* are written as the colour type that holds them without loss, RGBA8
+*	and BGRA8 as truecolour with alpha, RGB8 as truecolour, GRAY8 as greyscale, all of 8 bits, and RGBA16 as
+*	truecolour with alpha of 16 bits.
+*/
+#define LIBIMAGE_ENCODE_IDAT_SIZE	Kilo(256)	// Image data bytes per IDAT chunk, the last one has what is left
+#define LIBIMAGE_ENCODE_MAX_DIMENSION	0x7fffffffu
+
+#endif
@@ -0,0 +1,504 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "filter.h"
+#include "cpu.h"
+
+#if defined(LIBIMAGE_FILTER_SSE2)
+#include <emmintrin.h>
+#elif defined(LIBIMAGE_FILTER_NEON)
+#include <arm_neon.h>
+#endif
+
+#define LIBIMAGE_FILTER_INLINE	static inline __attribute__((always_inline))
+
+/*
+*	Scalar kernels. bpp is a constant at every call site, so the compiler builds one copy per pixel size with the
+*	left neighbour at a fixed offset. simd is a constant too, the vector loops are only built into the _simd
+*	entry points.
+*/
+// Written as selects so it compiles to conditional moves, the choice is data dependent and mispredicts a lot.
+LIBIMAGE_FILTER_INLINE uint8_t png_paeth_predictor(int a, int b, int c)
+{
+int pa, pb, pc, not_a;
+
+	pa    = abs(b - c);
+	pb    = abs(a - c);
+	pc    = abs(a + b - 2 * c);
+	not_a = pb <= pc ? b : c;
+	return pa <= pb && pa <= pc ? a : not_a;
+}
+
+LIBIMAGE_FILTER_INLINE void png_unfilter_sub(uint8_t *dst, const uint8_t *src, uint32_t len, uint32_t bpp)
+{
+uint32_t i;
+
+	for(i = 0; i < bpp && i < len; i++) dst[i] = src[i];
+	for(; i < len; i++) dst[i] = src[i] + dst[i - bpp];
+}
+
+LIBIMAGE_FILTER_INLINE void png_unfilter_up(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, int simd)
+{
+uint32_t i;
+
+	i = 0;
+	(void)simd;
+#if defined(LIBIMAGE_FILTER_SSE2)
+	for(; simd && i + 16 <= len; i += 16) {
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_add_epi8(_mm_loadu_si128((const __m128i*)(src + i)), _mm_loadu_si128((const __m128i*)(prev + i))));
+	}
+#elif defined(LIBIMAGE_FILTER_NEON)
+	for(; simd && i + 16 <= len; i += 16) vst1q_u8(dst + i, vaddq_u8(vld1q_u8(src + i), vld1q_u8(prev + i)));
+#endif
+	for(; i < len; i++) dst[i] = src[i] + prev[i];
+}
+
+LIBIMAGE_FILTER_INLINE void png_unfilter_average(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp)
+{
+uint32_t i;
+
+	for(i = 0; i < bpp && i < len; i++) dst[i] = src[i] + (prev[i] >> 1);
+	for(; i < len; i++) dst[i] = src[i] + ((dst[i - bpp] + prev[i]) >> 1);
+}
+
+LIBIMAGE_FILTER_INLINE void png_unfilter_paeth(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp)
+{
+uint32_t i;
+
+	for(i = 0; i < bpp && i < len; i++) dst[i] = src[i] + prev[i];
+	for(; i < len; i++) dst[i] = src[i] + png_paeth_predictor(dst[i - bpp], prev[i], prev[i - bpp]);
+}
+
+/*
+*	Vector kernels for 3 and 4 byte pixels. Sub, Average and Paeth depend on the pixel to the left, so they run a
+*	pixel per step with every channel in its own lane. A row of these pixels is always a whole number of them.
+*
+*	Pixels are moved as 4 bytes, for 3 byte pixels the extra lane is never looked at and its store is overwritten
+*	by the next pixel. Only the last pixel of the row is moved byte by byte so nothing past the row is touched.
+*/
+LIBIMAGE_FILTER_INLINE uint32_t png_filter_load_u32(const uint8_t *p, uint32_t bpp, int last)
+{
+uint32_t v;
+
+	if(bpp == 4 || !last) memcpy(&v, p, 4);
+	else v = (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16);
+	return v;
+}
+
+LIBIMAGE_FILTER_INLINE void png_filter_store_u32(uint8_t *p, uint32_t v, uint32_t bpp, int last)
+{
+	if(bpp == 4 || !last) {
+		memcpy(p, &v, 4);
+	} else {
+		p[0] = v;
+		p[1] = v >> 8;
+		p[2] = v >> 16;
+	}
+}
+
+#if defined(LIBIMAGE_FILTER_SSE2)
+#define png_filter_load(p, bpp, last)		_mm_cvtsi32_si128((int)png_filter_load_u32((p), (bpp), (last)))
+#define png_filter_store(p, x, bpp, last)	png_filter_store_u32((p), (uint32_t)_mm_cvtsi128_si32((x)), (bpp), (last))
+
+LIBIMAGE_FILTER_INLINE void png_unfilter_sub_simd(uint8_t *dst, const uint8_t *src, uint32_t len, uint32_t bpp)
+{
+__m128i		a;
+uint32_t	i;
+
+	a = _mm_setzero_si128();
+	for(i = 0; i < len; i += bpp) {
+		a = _mm_add_epi8(a, png_filter_load(src + i, bpp, i + 4 > len));
+		png_filter_store(dst + i, a, bpp, i + 4 > len);
+	}
+}
+
+LIBIMAGE_FILTER_INLINE void png_unfilter_average_simd(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp)
+{
+__m128i		a, b, avg, ones;
+uint32_t	i;
+
+	// pavgb rounds up, taking the low bit of a ^ b back off gives the floor the filter uses.
+	ones = _mm_set1_epi8(1);
+	a    = _mm_setzero_si128();
+	for(i = 0; i < len; i += bpp) {
+		b   = png_filter_load(prev + i, bpp, i + 4 > len);
+		avg = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), ones));
+		a   = _mm_add_epi8(png_filter_load(src + i, bpp, i + 4 > len), avg);
+		png_filter_store(dst + i, a, bpp, i + 4 > len);
+	}
+}
+
+LIBIMAGE_FILTER_INLINE __m128i png_filter_abs_epi16(__m128i x)
+{
+__m128i negative;
+
+	negative = _mm_srai_epi16(x, 15);
+	return _mm_sub_epi16(_mm_xor_si128(x, negative), negative);
+}
+
+LIBIMAGE_FILTER_INLINE __m128i png_filter_select(__m128i mask, __m128i then, __m128i otherwise)
+{
+	return _mm_or_si128(_mm_and_si128(mask, then), _mm_andnot_si128(mask, otherwise));
+}
+
+/*
+*	Branchless Paeth on 16 bit lanes: with p = a + b - c the distances are pa = |b - c|, pb = |a - c| and
+*	pc = |(b - c) + (a - c)|, and the predictor is the first of a, b, c whose distance is the smallest.
+*/
+LIBIMAGE_FILTER_INLINE void png_unfilter_paeth_simd(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp)
+{
+__m128i		zero, a, b, c, pa, pb, pc, smallest, nearest;
+uint32_t	i;
+
+	zero = _mm_setzero_si128();
+	a = c = zero;
+	for(i = 0; i < len; i += bpp) {
+		b  = _mm_unpacklo_epi8(png_filter_load(prev + i, bpp, i + 4 > len), zero);
+		pa = _mm_sub_epi16(b, c);
+		pb = _mm_sub_epi16(a, c);
+		pc = png_filter_abs_epi16(_mm_add_epi16(pa, pb));
+		pa = png_filter_abs_epi16(pa);
+		pb = png_filter_abs_epi16(pb);
+
+		smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		nearest	 = png_filter_select(_mm_cmpeq_epi16(smallest, pa), a, png_filter_select(_mm_cmpeq_epi16(smallest, pb), b, c));
+
+		a = _mm_add_epi8(png_filter_load(src + i, bpp, i + 4 > len), _mm_packus_epi16(nearest, zero));
+		png_filter_store(dst + i, a, bpp, i + 4 > len);
+		a = _mm_unpacklo_epi8(a, zero);
+		c = b;
+	}
+}
+#elif defined(LIBIMAGE_FILTER_NEON)
+#define png_filter_load(p, bpp, last)		vcreate_u8((uint64_t)png_filter_load_u32((p), (bpp), (last)))
+#define png_filter_store(p, x, bpp, last)	png_filter_store_u32((p), vget_lane_u32(vreinterpret_u32_u8((x)), 0), (bpp), (last))
+
+LIBIMAGE_FILTER_INLINE void png_unfilter_sub_simd(uint8_t *dst, const uint8_t *src, uint32_t len, uint32_t bpp)
+{
+uint8x8_t	a;
+uint32_t	i;
+
+	a = vdup_n_u8(0);
+	for(i = 0; i < len; i += bpp) {
+		a = vadd_u8(a, png_filter_load(src + i, bpp, i + 4 > len));
+		png_filter_store(dst + i, a, bpp, i + 4 > len);
+	}
+}
+
+LIBIMAGE_FILTER_INLINE void png_unfilter_average_simd(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp)
+{
+uint8x8_t	a;
+uint32_t	i;
+
+	// vhadd is the truncating average the filter uses.
+	a = vdup_n_u8(0);
+	for(i = 0; i < len; i += bpp) {
+		a = vadd_u8(png_filter_load(src + i, bpp, i + 4 > len), vhadd_u8(a, png_filter_load(prev + i, bpp, i + 4 > len)));
+		png_filter_store(dst + i, a, bpp, i + 4 > len);
+	}
+}
+
+// Same formulation as the SSE2 one, see there.
+LIBIMAGE_FILTER_INLINE void png_unfilter_paeth_simd(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp)
+{
+int16x8_t	a, b, c, pa, pb, pc, nearest;
+uint16x8_t	use_a, use_b;
+uint8x8_t	x;
+uint32_t	i;
+
+	a = c = vdupq_n_s16(0);
+	for(i = 0; i < len; i += bpp) {
+		b  = vreinterpretq_s16_u16(vmovl_u8(png_filter_load(prev + i, bpp, i + 4 > len)));
+		pa = vsubq_s16(b, c);
+		pb = vsubq_s16(a, c);
+		pc = vabsq_s16(vaddq_s16(pa, pb));
+		pa = vabsq_s16(pa);
+		pb = vabsq_s16(pb);
+
+		use_a	= vandq_u16(vcleq_s16(pa, pb), vcleq_s16(pa, pc));
+		use_b	= vcleq_s16(pb, pc);
+		nearest = vbslq_s16(use_a, a, vbslq_s16(use_b, b, c));
+
+		x = vadd_u8(png_filter_load(src + i, bpp, i + 4 > len), vmovn_u16(vreinterpretq_u16_s16(nearest)));
+		png_filter_store(dst + i, x, bpp, i + 4 > len);
+		a = vreinterpretq_s16_u16(vmovl_u8(x));
+		c = b;
+	}
+}
+#endif
+
+/*
+*	Reconstructs one scanline into dst from its filtered bytes in src, prev is the reconstructed previous scanline
+*	of the same pass, all zeros for the first one. dst must not overlap prev, and either doesn't overlap src or is
+*	src - 1: every kernel loads a byte before storing over the one before it, so a scanline can be reconstructed
+*	over its own filter byte.
+*/
+LIBIMAGE_FILTER_INLINE int png_unfilter_row_with(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter, int simd)
+{
+	(void)simd;
+	switch(filter) {
+		case LIBIMAGE_PNG_FILTER_NONE: {
+			memmove(dst, src, len);
+		} break;
+		case LIBIMAGE_PNG_FILTER_SUB: {
+			switch(bpp) {
+				case 1:	png_unfilter_sub(dst, src, len, 1); break;
+				case 2:	png_unfilter_sub(dst, src, len, 2); break;
+#if defined(LIBIMAGE_FILTER_SIMD)
+				case 3:	if(simd) png_unfilter_sub_simd(dst, src, len, 3); else png_unfilter_sub(dst, src, len, 3); break;
+				case 4:	if(simd) png_unfilter_sub_simd(dst, src, len, 4); else png_unfilter_sub(dst, src, len, 4); break;
+#else
+				case 3:	png_unfilter_sub(dst, src, len, 3); break;
+				case 4:	png_unfilter_sub(dst, src, len, 4); break;
+#endif
+				case 6:	png_unfilter_sub(dst, src, len, 6); break;
+				default: png_unfilter_sub(dst, src, len, 8); break;
+			}
+		} break;
+		case LIBIMAGE_PNG_FILTER_UP: {
+			png_unfilter_up(dst, src, prev, len, simd);
+		} break;
+		case LIBIMAGE_PNG_FILTER_AVERAGE: {
+			switch(bpp) {
+				case 1:	png_unfilter_average(dst, src, prev, len, 1); break;
+				case 2:	png_unfilter_average(dst, src, prev, len, 2); break;
+#if defined(LIBIMAGE_FILTER_SIMD)
+				case 3:	if(simd) png_unfilter_average_simd(dst, src, prev, len, 3); else png_unfilter_average(dst, src, prev, len, 3); break;
+				case 4:	if(simd) png_unfilter_average_simd(dst, src, prev, len, 4); else png_unfilter_average(dst, src, prev, len, 4); break;
+#else
+				case 3:	png_unfilter_average(dst, src, prev, len, 3); break;
+				case 4:	png_unfilter_average(dst, src, prev, len, 4); break;
+#endif
+				case 6:	png_unfilter_average(dst, src, prev, len, 6); break;
+				default: png_unfilter_average(dst, src, prev, len, 8); break;
+			}
+		} break;
+		case LIBIMAGE_PNG_FILTER_PAETH: {
+			switch(bpp) {
+				case 1:	png_unfilter_paeth(dst, src, prev, len, 1); break;
+				case 2:	png_unfilter_paeth(dst, src, prev, len, 2); break;
+#if defined(LIBIMAGE_FILTER_SIMD)
+				case 3:	if(simd) png_unfilter_paeth_simd(dst, src, prev, len, 3); else png_unfilter_paeth(dst, src, prev, len, 3); break;
+				case 4:	if(simd) png_unfilter_paeth_simd(dst, src, prev, len, 4); else png_unfilter_paeth(dst, src, prev, len, 4); break;
+#else
+				case 3:	png_unfilter_paeth(dst, src, prev, len, 3); break;
+				case 4:	png_unfilter_paeth(dst, src, prev, len, 4); break;
+#endif
+				case 6:	png_unfilter_paeth(dst, src, prev, len, 6); break;
+				default: png_unfilter_paeth(dst, src, prev, len, 8); break;
+			}
+		} break;
+		default: return LIBIMAGE_PNG_ERROR_BAD_FILTER;
+	}
+	return 0;
+}
+
+int png_unfilter_row_scalar(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter)
+{
+	return png_unfilter_row_with(dst, src, prev, len, bpp, filter, 0);
+}
+
+#if defined(LIBIMAGE_FILTER_SIMD)
+int png_unfilter_row_simd(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter)
+{
+	return png_unfilter_row_with(dst, src, prev, len, bpp, filter, 1);
+}
+#endif
+
+int png_unfilter_row(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter)
+{
+	return libimage_kernels()->unfilter_row(dst, src, prev, len, bpp, filter);
+}
+
+/*
+*	Forward filters for the encoder. Every byte only depends on the unfiltered rows, so unlike reconstructing
+*	there is no chain from pixel to pixel and the whole row is done 16 bytes at a time, the left neighbours loaded
+*	bpp bytes back. The first pixel, which has no left neighbour, and the tail are scalar, as is everything
+*	without simd.
+*/
+LIBIMAGE_FILTER_INLINE void png_filter_sub(uint8_t *dst, const uint8_t *row, uint32_t len, uint32_t bpp, int simd)
+{
+uint32_t i;
+
+	(void)simd;
+	for(i = 0; i < bpp && i < len; i++) dst[i] = row[i];
+#if defined(LIBIMAGE_FILTER_SSE2)
+	for(; simd && i + 16 <= len; i += 16) {
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(row + i)), _mm_loadu_si128((const __m128i*)(row + i - bpp))));
+	}
+#elif defined(LIBIMAGE_FILTER_NEON)
+	for(; simd && i + 16 <= len; i += 16) vst1q_u8(dst + i, vsubq_u8(vld1q_u8(row + i), vld1q_u8(row + i - bpp)));
+#endif
+	for(; i < len; i++) dst[i] = row[i] - row[i - bpp];
+}
+
+LIBIMAGE_FILTER_INLINE void png_filter_up(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, int simd)
+{
+uint32_t i;
+
+	i = 0;
+	(void)simd;
+#if defined(LIBIMAGE_FILTER_SSE2)
+	for(; simd && i + 16 <= len; i += 16) {
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(row + i)), _mm_loadu_si128((const __m128i*)(prev + i))));
+	}
+#elif defined(LIBIMAGE_FILTER_NEON)
+	for(; simd && i + 16 <= len; i += 16) vst1q_u8(dst + i, vsubq_u8(vld1q_u8(row + i), vld1q_u8(prev + i)));
+#endif
+	for(; i < len; i++) dst[i] = row[i] - prev[i];
+}
+
+LIBIMAGE_FILTER_INLINE void png_filter_average(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, int simd)
+{
+uint32_t i;
+#if defined(LIBIMAGE_FILTER_SSE2)
+__m128i a, b, ones;
+#endif
+
+	(void)simd;
+	for(i = 0; i < bpp && i < len; i++) dst[i] = row[i] - (prev[i] >> 1);
+#if defined(LIBIMAGE_FILTER_SSE2)
+	// Same floor of pavgb as reconstructing.
+	ones = _mm_set1_epi8(1);
+	for(; simd && i + 16 <= len; i += 16) {
+		a = _mm_loadu_si128((const __m128i*)(row + i - bpp));
+		b = _mm_loadu_si128((const __m128i*)(prev + i));
+		a = _mm_sub_epi8(_mm_avg_epu8(a, b), _mm_and_si128(_mm_xor_si128(a, b), ones));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_sub_epi8(_mm_loadu_si128((const __m128i*)(row + i)), a));
+	}
+#elif defined(LIBIMAGE_FILTER_NEON)
+	for(; simd && i + 16 <= len; i += 16) vst1q_u8(dst + i, vsubq_u8(vld1q_u8(row + i), vhaddq_u8(vld1q_u8(row + i - bpp), vld1q_u8(prev + i))));
+#endif
+	for(; i < len; i++) dst[i] = row[i] - ((row[i - bpp] + prev[i]) >> 1);
+}
+
+LIBIMAGE_FILTER_INLINE void png_filter_paeth(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, int simd)
+{
+uint32_t i;
+#if defined(LIBIMAGE_FILTER_SSE2)
+__m128i zero, a, b, c, pa, pb, pc, smallest, nearest;
+#endif
+
+	(void)simd;
+	for(i = 0; i < bpp && i < len; i++) dst[i] = row[i] - prev[i];
+#if defined(LIBIMAGE_FILTER_SSE2)
+	// The reconstructing formulation on 8 lanes of 16 bits.
+	zero = _mm_setzero_si128();
+	for(; simd && i + 8 <= len; i += 8) {
+		a  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(row + i - bpp)), zero);
+		b  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(prev + i)), zero);
+		c  = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(prev + i - bpp)), zero);
+		pa = _mm_sub_epi16(b, c);
+		pb = _mm_sub_epi16(a, c);
+		pc = png_filter_abs_epi16(_mm_add_epi16(pa, pb));
+		pa = png_filter_abs_epi16(pa);
+		pb = png_filter_abs_epi16(pb);
+
+		smallest = _mm_min_epi16(pc, _mm_min_epi16(pa, pb));
+		nearest	 = png_filter_select(_mm_cmpeq_epi16(smallest, pa), a, png_filter_select(_mm_cmpeq_epi16(smallest, pb), b, c));
+		_mm_storel_epi64((__m128i*)(dst + i), _mm_sub_epi8(_mm_loadl_epi64((const __m128i*)(row + i)), _mm_packus_epi16(nearest, zero)));
+	}
+#endif
+	for(; i < len; i++) dst[i] = row[i] - png_paeth_predictor(row[i - bpp], prev[i], prev[i - bpp]);
+}
+
+/*
+*	Filters one scanline of len bytes into dst, prev is the unfiltered previous scanline of the same pass, all
+*	zeros for the first one. dst overlaps neither. Returns zero or LIBIMAGE_PNG_ERROR_BAD_FILTER.
+*/
+LIBIMAGE_FILTER_INLINE int png_filter_row_with(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter, int simd)
+{
+	switch(filter) {
+		case LIBIMAGE_PNG_FILTER_NONE:		memcpy(dst, row, len); break;
+		case LIBIMAGE_PNG_FILTER_SUB:		png_filter_sub(dst, row, len, bpp, simd); break;
+		case LIBIMAGE_PNG_FILTER_UP:		png_filter_up(dst, row, prev, len, simd); break;
+		case LIBIMAGE_PNG_FILTER_AVERAGE:	png_filter_average(dst, row, prev, len, bpp, simd); break;
+		case LIBIMAGE_PNG_FILTER_PAETH:		png_filter_paeth(dst, row, prev, len, bpp, simd); break;
+		default: return LIBIMAGE_PNG_ERROR_BAD_FILTER;
+	}
+	return 0;
+}
+
+int png_filter_row_scalar(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter)
+{
+	return png_filter_row_with(dst, row, prev, len, bpp, filter, 0);
+}
+
+#if defined(LIBIMAGE_FILTER_SIMD)
+int png_filter_row_simd(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter)
+{
+	return png_filter_row_with(dst, row, prev, len, bpp, filter, 1);
+}
+#endif
+
+int png_filter_row(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter)
+{
+	return libimage_kernels()->filter_row(dst, row, prev, len, bpp, filter);
+}
+
+/*
+*	Sum of the filtered bytes taken as signed, the usual estimate of how well a filter does: the smaller the
+*	bytes around zero, the better they compress.
+*/
+uint64_t png_filter_cost_scalar(const uint8_t *filtered, uint32_t len)
+{
+uint64_t	cost;
+uint32_t	i;
+
+	for(i = 0, cost = 0; i < len; i++) cost += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+	return cost;
+}
+
+#if defined(LIBIMAGE_FILTER_SIMD)
+uint64_t png_filter_cost_simd(const uint8_t *filtered, uint32_t len)
+{
+uint64_t	cost;
+uint32_t	i;
+#if defined(LIBIMAGE_FILTER_SSE2)
+__m128i		v, sum, zero;
+uint64_t	lanes[2];
+#elif defined(LIBIMAGE_FILTER_NEON)
+uint16x8_t	sum;
+uint64x2_t	wide;
+uint32_t	n;
+#endif
+
+	cost = 0;
+	i    = 0;
+#if defined(LIBIMAGE_FILTER_SSE2)
+	// min(x, -x) as unsigned is |x| as signed, 128 for -128, and psadbw against zero adds them up.
+	zero = _mm_setzero_si128();
+	sum  = zero;
+	for(; i + 16 <= len; i += 16) {
+		v   = _mm_loadu_si128((const __m128i*)(filtered + i));
+		v   = _mm_min_epu8(v, _mm_sub_epi8(zero, v));
+		sum = _mm_add_epi64(sum, _mm_sad_epu8(v, zero));
+	}
+	_mm_storeu_si128((__m128i*)lanes, sum);
+	cost = lanes[0] + lanes[1];
+#elif defined(LIBIMAGE_FILTER_NEON)
+	// Sixteen bit lanes take 256 steps of two bytes before they can overflow.
+	while(i + 16 <= len) {
+		sum = vdupq_n_u16(0);
+		for(n = 0; n < 256 && i + 16 <= len; n++, i += 16) sum = vpadalq_u8(sum, vreinterpretq_u8_s8(vabsq_s8(vreinterpretq_s8_u8(vld1q_u8(filtered + i)))));
+		wide  = vpaddlq_u32(vpaddlq_u16(sum));
+		cost += vgetq_lane_u64(wide, 0) + vgetq_lane_u64(wide, 1);
+	}
+#endif
+	for(; i < len; i++) cost += filtered[i] < 128 ? filtered[i] : 256 - filtered[i];
+	return cost;
+}
+#endif
+
+uint64_t png_filter_cost(const uint8_t *filtered, uint32_t len)
+{
+	return libimage_kernels()->filter_cost(filtered, len);
+}
@@ -0,0 +1,50 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_FILTER_H__
+#define __LIB_IMAGE_FILTER_H__
+
+#include <inttypes.h>
+
+/*
+*	Filter types a scanline can start with, https://www.w3.org/TR/2003/REC-PNG-20031110/#9Filters
+*	The filters work on bytes, bpp is the number of bytes of a complete pixel rounded up to one.
+*/
+#define LIBIMAGE_PNG_FILTER_NONE	0
+#define LIBIMAGE_PNG_FILTER_SUB		1
+#define LIBIMAGE_PNG_FILTER_UP		2
+#define LIBIMAGE_PNG_FILTER_AVERAGE	3
+#define LIBIMAGE_PNG_FILTER_PAETH	4
+
+/*
+*	Every kernel has a scalar and, where the baseline of the target has vectors ( SSE2 on x86-64, NEON ), a _simd
+*	version. The plain names call the one libimage_kernels picked.
+*/
+#if defined(__SSE2__)
+#define LIBIMAGE_FILTER_SSE2	1
+#define LIBIMAGE_FILTER_SIMD	1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define LIBIMAGE_FILTER_NEON	1
+#define LIBIMAGE_FILTER_SIMD	1
+#endif
+
+typedef int (*LibImageUnfilterRow)(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter);
+typedef int (*LibImageFilterRow)(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter);
+typedef uint64_t (*LibImageFilterCost)(const uint8_t *filtered, uint32_t len);
+
+int png_unfilter_row(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter);
+int png_unfilter_row_scalar(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter);
+int png_filter_row(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter);
+int png_filter_row_scalar(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter);
+uint64_t png_filter_cost(const uint8_t *filtered, uint32_t len);
+uint64_t png_filter_cost_scalar(const uint8_t *filtered, uint32_t len);
+#if defined(LIBIMAGE_FILTER_SIMD)
+int png_unfilter_row_simd(uint8_t *dst, const uint8_t *src, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter);
+int png_filter_row_simd(uint8_t *dst, const uint8_t *row, const uint8_t *prev, uint32_t len, uint32_t bpp, uint8_t filter);
+uint64_t png_filter_cost_simd(const uint8_t *filtered, uint32_t len);
+#endif
+
+#endif
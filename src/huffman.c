@@ -1,5 +1,5 @@
 /*
-*  ===================================================================	
+*  ===================================================================
 *	2023 - libimage by Ernesto Bayma
 *  ===================================================================
 */
@@ -9,3 +9,131 @@
 #include "huffman.h"
 #include "zlib.h"
 
+void new_huffman(LibImageHuffman *huff, int table_bits)
+{
+	huff->table_bits	= table_bits;
+	huff->entry_count	= 0;
+	huff->max_code_in_bits	= 0;
+}
+
+static void fill_invalid_entries(LibImageHuffmanEntry *entries, uint32_t count)
+{
+LibImageHuffmanEntry	invalid = { 1, LIBIMAGE_HUFFMAN_INVALID_SYMBOL, 0 };
+uint32_t		i;
+
+	for(i = 0; i < count; i++) entries[i] = invalid;
+}
+
+/*
+*	Canonical huffman codes ( RFC 1951 3.2.2 ) are assigned in order of code length and then symbol value, so the
+*	symbols are sorted that way and the codes walked in the same order. The running code is kept bit reversed, which
+*	is the order deflate stores it, so it can be used as a table index directly and only needs an increment per symbol.
+*/
+int build_huffman(LibImageHuffman *huff, uint8_t *code_len_bits, int size_code_len_bits)
+{
+uint16_t		len_count[LIBIMAGE_HUFFMAN_MAX_CODE_BITS + 1], offsets[LIBIMAGE_HUFFMAN_MAX_CODE_BITS + 1];
+uint16_t		sorted[LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS];
+uint32_t		code, step, index, len, primary_size, primary_mask, sub_prefix, sub_bits, sub_offset;
+int			i, left, total, max_len;
+LibImageHuffmanEntry	entry, *entries;
+
+	if(size_code_len_bits > LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS) return LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS;
+
+	memset(len_count, 0, sizeof(len_count));
+	for(i = 0; i < size_code_len_bits; i++) {
+		if(code_len_bits[i] > LIBIMAGE_HUFFMAN_MAX_CODE_BITS) return LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS;
+		len_count[code_len_bits[i]]++;
+	}
+	len_count[0] = 0;
+
+	// Reject over-subscribed sets. Incomplete ones are allowed, the holes decode to an invalid symbol.
+	left 	= 1;
+	max_len = 0;
+	for(len = 1; len <= LIBIMAGE_HUFFMAN_MAX_CODE_BITS; len++) {
+		left <<= 1;
+		left -= len_count[len];
+		if(left < 0) return LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS;
+		if(len_count[len]) max_len = len;
+	}
+
+	offsets[1] = 0;
+	for(len = 1; len < LIBIMAGE_HUFFMAN_MAX_CODE_BITS; len++) offsets[len + 1] = offsets[len] + len_count[len];
+	total = 0;
+	for(i = 0; i < size_code_len_bits; i++) {
+		if(code_len_bits[i]) {
+			sorted[offsets[code_len_bits[i]]++] = i;
+			total++;
+		}
+	}
+
+	entries			= huff->entries;
+	primary_size		= 1 << huff->table_bits;
+	primary_mask		= primary_size - 1;
+	huff->max_code_in_bits	= max_len;
+	huff->entry_count	= primary_size;
+	fill_invalid_entries(entries, primary_size);
+
+	code 		= 0;
+	sub_prefix 	= UINT32_MAX;
+	sub_offset 	= sub_bits = 0;
+	for(i = 0; i < total; i++) {
+		entry.code		= sorted[i];
+		entry.bits_used		= len = code_len_bits[entry.code];
+		entry.sub_table_bits	= 0;
+
+		if(len <= huff->table_bits) {
+			for(index = code; index < primary_size; index += 1 << len) entries[index] = entry;
+		} else {
+			if((code & primary_mask) != sub_prefix) {
+				// New sub-table, make it as wide as the codes sharing this prefix need.
+				sub_prefix	= code & primary_mask;
+				sub_bits 	= len - huff->table_bits;
+				left 		= 1 << sub_bits;
+				while(sub_bits + huff->table_bits < max_len) {
+					left -= len_count[sub_bits + huff->table_bits];
+					if(left <= 0) break;
+					sub_bits++;
+					left <<= 1;
+				}
+				if(huff->entry_count + (1 << sub_bits) > LIBIMAGE_HUFFMAN_MAX_TABLE_SIZE) return LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS;
+
+				sub_offset = huff->entry_count;
+				huff->entry_count += 1 << sub_bits;
+				fill_invalid_entries(entries + sub_offset, 1 << sub_bits);
+				entries[sub_prefix].bits_used 		= huff->table_bits;
+				entries[sub_prefix].code		= sub_offset;
+				entries[sub_prefix].sub_table_bits	= sub_bits;
+			}
+			for(index = code >> huff->table_bits; index < (1u << sub_bits); index += 1 << (len - huff->table_bits)) {
+				entries[sub_offset + index] = entry;
+			}
+		}
+		len_count[len]--;
+
+		// Increment the bit reversed code.
+		step = 1 << (len - 1);
+		while(code & step) step >>= 1;
+		if(step == 0) code = 0;
+		else code = (code & (step - 1)) + step;
+	}
+
+	return 0;
+}
+
+uint32_t decode_huffman(const LibImageHuffman *huff, LibImageZlibBuffer *buf)
+{
+const LibImageHuffmanEntry	*entry;
+uint32_t		bits;
+
+	zbuf_ensure_bits(buf, LIBIMAGE_HUFFMAN_MAX_CODE_BITS);
+
+	bits  = zbuf_peek_bits(buf, LIBIMAGE_HUFFMAN_MAX_CODE_BITS);
+	entry = huff->entries + (bits & ((1 << huff->table_bits) - 1));
+	if(entry->sub_table_bits) {
+		entry = huff->entries + entry->code + ((bits >> huff->table_bits) & ((1 << entry->sub_table_bits) - 1));
+	}
+
+	// Only the bits of the decoded code are consumed.
+	zbuf_consume_bits(buf, entry->bits_used);
+	return entry->code;
+}
@@ -1,5 +1,5 @@
 /*
-*  ===================================================================	
+*  ===================================================================
 *	2023 - libimage by Ernesto Bayma
 *  ===================================================================
 */
@@ -10,25 +10,65 @@
 #include "common.h"
 #include "zlib.h"
 
+/*
+*	Two level decoding tables.
+*
+*	The primary table is indexed by the next table_bits bits of the stream ( LSB first ). Codes that fit the primary
+*	table are replicated in it, longer codes have their primary entry pointing to a sub-table that is indexed by
+*	the remaining bits. Sizes are the worst case from zlib's "enough" tool for each alphabet and primary width.
+*/
+#define LIBIMAGE_HUFFMAN_MAX_CODE_BITS		15
+#define LIBIMAGE_HUFFMAN_LITLEN_TABLE_BITS	10
+#define LIBIMAGE_HUFFMAN_DIST_TABLE_BITS	8
+#define LIBIMAGE_HUFFMAN_CODELEN_TABLE_BITS	7
+#define LIBIMAGE_HUFFMAN_MAX_TABLE_SIZE		1334 // enough 288 10 15, also covers 32 8 15 (402) and 19 7 7 (128)
+#define LIBIMAGE_HUFFMAN_INVALID_SYMBOL		0xffff
+
+#define LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS	288
+#define LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS	32
+#define LIBIMAGE_DEFLATE_NUM_CODELEN_SYMBOLS	19
+
+#define LIBIMAGE_DEFLATE_MAX_MATCH_LEN		258
+
+// Base value and extra bits for the length and distance symbols, RFC 1951 3.2.5.
+typedef struct libimage_deflate_spec_entry {
+	uint16_t base;
+	uint16_t extra_bits;
+} LibImageDeflateSpecEntry;
+
 typedef struct libimage_huffman_entry {
-	uint16_t bits_used;
-	uint16_t code;
+	uint16_t bits_used;		// Total code length of the symbol
+	uint16_t code;			// Decoded symbol, or the offset of the sub-table when sub_table_bits is set
+	uint16_t sub_table_bits;	// Zero for a symbol, index width of the sub-table otherwise
 } LibImageHuffmanEntry;
 
 typedef struct libimage_huffman {
-	LibImageHuffmanEntry 	*entries;
+	LibImageHuffmanEntry 	entries[LIBIMAGE_HUFFMAN_MAX_TABLE_SIZE];
 	uint32_t		entry_count;
+	uint32_t		table_bits;
 	uint32_t		max_code_in_bits;
 } LibImageHuffman;
 
-LibImageHuffman new_huffman(int max_code_in_bits);
-LibImageHuffman free_huffman_entries(LibImageHuffman *huff);
-void build_huffman(LibImageZlibBuffer *buf, LibImageHuffman *huff, uint8_t *code_len_bits, int size_code_len_bits);
-uint32_t decode_huffman(LibImageHuffman *huff, LibImageZlibBuffer *buf);
-void decompress_huffman_block(LibImageZlibBuffer *buf, LibImageImageInfo *info, int size_lit, int size_dist);
+/*
+*	Scratch used while decoding a compressed block. Lives as long as the zlib stream so nothing is allocated per block.
+*/
+typedef struct libimage_inflate_tables {
+	LibImageHuffman	lit_huff;
+	LibImageHuffman	dist_huff;
+	LibImageHuffman	code_len_huff;
+	const LibImageHuffman *lit, *dist;	// Tables of the current block, lit_huff and dist_huff or the fixed ones
+	uint8_t		code_lengths[LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS + LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS];
+	uint16_t	lit_count, dist_count;		// Code lengths of the last dynamic block, HLIT and HDIST
+} LibImageInflateTables;
+
+void new_huffman(LibImageHuffman *huff, int table_bits);
+int build_huffman(LibImageHuffman *huff, uint8_t *code_len_bits, int size_code_len_bits);
+uint32_t decode_huffman(const LibImageHuffman *huff, LibImageZlibBuffer *buf);
+int decompress_huffman_block(LibImageZlibBuffer *buf, LibImageImageInfo *info);
 
 // This should go to png
 void png_parse_huffman_fixed_block(LibImageZlibBuffer *buf, LibImageImageInfo *info);
 void png_parse_huffman_dynamic_block(LibImageZlibBuffer *buf, LibImageImageInfo *info);
+void png_start_huffman_block(LibImageZlibBuffer *buf, LibImageImageInfo *info, int size_lit, int size_dist);
 
 #endif
@@ -0,0 +1,247 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_HUFFMAN_FIXED_H__
+#define __LIB_IMAGE_HUFFMAN_FIXED_H__
+
+#include "huffman.h"
+
+/*
+*	Decoding tables of the fixed Huffman codes, RFC 1951 3.2.6: literal/length codes of 8 bits for 0 - 143, 9 bits
+*	for 144 - 255, 7 bits for 256 - 279 and 8 bits for 280 - 287, distance codes of 5 bits. They are what
+*	build_huffman makes out of those lengths, no code is longer than the primary tables so there are no sub-tables.
+*/
+static const LibImageHuffman png_fixed_lit_huff = {
+	.entries = {
+		{ 7, 256, 0 }, { 8, 80, 0 }, { 8, 16, 0 }, { 8, 280, 0 }, { 7, 272, 0 }, { 8, 112, 0 },
+		{ 8, 48, 0 }, { 9, 192, 0 }, { 7, 264, 0 }, { 8, 96, 0 }, { 8, 32, 0 }, { 9, 160, 0 },
+		{ 8, 0, 0 }, { 8, 128, 0 }, { 8, 64, 0 }, { 9, 224, 0 }, { 7, 260, 0 }, { 8, 88, 0 },
+		{ 8, 24, 0 }, { 9, 144, 0 }, { 7, 276, 0 }, { 8, 120, 0 }, { 8, 56, 0 }, { 9, 208, 0 },
+		{ 7, 268, 0 }, { 8, 104, 0 }, { 8, 40, 0 }, { 9, 176, 0 }, { 8, 8, 0 }, { 8, 136, 0 },
+		{ 8, 72, 0 }, { 9, 240, 0 }, { 7, 258, 0 }, { 8, 84, 0 }, { 8, 20, 0 }, { 8, 284, 0 },
+		{ 7, 274, 0 }, { 8, 116, 0 }, { 8, 52, 0 }, { 9, 200, 0 }, { 7, 266, 0 }, { 8, 100, 0 },
+		{ 8, 36, 0 }, { 9, 168, 0 }, { 8, 4, 0 }, { 8, 132, 0 }, { 8, 68, 0 }, { 9, 232, 0 },
+		{ 7, 262, 0 }, { 8, 92, 0 }, { 8, 28, 0 }, { 9, 152, 0 }, { 7, 278, 0 }, { 8, 124, 0 },
+		{ 8, 60, 0 }, { 9, 216, 0 }, { 7, 270, 0 }, { 8, 108, 0 }, { 8, 44, 0 }, { 9, 184, 0 },
+		{ 8, 12, 0 }, { 8, 140, 0 }, { 8, 76, 0 }, { 9, 248, 0 }, { 7, 257, 0 }, { 8, 82, 0 },
+		{ 8, 18, 0 }, { 8, 282, 0 }, { 7, 273, 0 }, { 8, 114, 0 }, { 8, 50, 0 }, { 9, 196, 0 },
+		{ 7, 265, 0 }, { 8, 98, 0 }, { 8, 34, 0 }, { 9, 164, 0 }, { 8, 2, 0 }, { 8, 130, 0 },
+		{ 8, 66, 0 }, { 9, 228, 0 }, { 7, 261, 0 }, { 8, 90, 0 }, { 8, 26, 0 }, { 9, 148, 0 },
+		{ 7, 277, 0 }, { 8, 122, 0 }, { 8, 58, 0 }, { 9, 212, 0 }, { 7, 269, 0 }, { 8, 106, 0 },
+		{ 8, 42, 0 }, { 9, 180, 0 }, { 8, 10, 0 }, { 8, 138, 0 }, { 8, 74, 0 }, { 9, 244, 0 },
+		{ 7, 259, 0 }, { 8, 86, 0 }, { 8, 22, 0 }, { 8, 286, 0 }, { 7, 275, 0 }, { 8, 118, 0 },
+		{ 8, 54, 0 }, { 9, 204, 0 }, { 7, 267, 0 }, { 8, 102, 0 }, { 8, 38, 0 }, { 9, 172, 0 },
+		{ 8, 6, 0 }, { 8, 134, 0 }, { 8, 70, 0 }, { 9, 236, 0 }, { 7, 263, 0 }, { 8, 94, 0 },
+		{ 8, 30, 0 }, { 9, 156, 0 }, { 7, 279, 0 }, { 8, 126, 0 }, { 8, 62, 0 }, { 9, 220, 0 },
+		{ 7, 271, 0 }, { 8, 110, 0 }, { 8, 46, 0 }, { 9, 188, 0 }, { 8, 14, 0 }, { 8, 142, 0 },
+		{ 8, 78, 0 }, { 9, 252, 0 }, { 7, 256, 0 }, { 8, 81, 0 }, { 8, 17, 0 }, { 8, 281, 0 },
+		{ 7, 272, 0 }, { 8, 113, 0 }, { 8, 49, 0 }, { 9, 194, 0 }, { 7, 264, 0 }, { 8, 97, 0 },
+		{ 8, 33, 0 }, { 9, 162, 0 }, { 8, 1, 0 }, { 8, 129, 0 }, { 8, 65, 0 }, { 9, 226, 0 },
+		{ 7, 260, 0 }, { 8, 89, 0 }, { 8, 25, 0 }, { 9, 146, 0 }, { 7, 276, 0 }, { 8, 121, 0 },
+		{ 8, 57, 0 }, { 9, 210, 0 }, { 7, 268, 0 }, { 8, 105, 0 }, { 8, 41, 0 }, { 9, 178, 0 },
+		{ 8, 9, 0 }, { 8, 137, 0 }, { 8, 73, 0 }, { 9, 242, 0 }, { 7, 258, 0 }, { 8, 85, 0 },
+		{ 8, 21, 0 }, { 8, 285, 0 }, { 7, 274, 0 }, { 8, 117, 0 }, { 8, 53, 0 }, { 9, 202, 0 },
+		{ 7, 266, 0 }, { 8, 101, 0 }, { 8, 37, 0 }, { 9, 170, 0 }, { 8, 5, 0 }, { 8, 133, 0 },
+		{ 8, 69, 0 }, { 9, 234, 0 }, { 7, 262, 0 }, { 8, 93, 0 }, { 8, 29, 0 }, { 9, 154, 0 },
+		{ 7, 278, 0 }, { 8, 125, 0 }, { 8, 61, 0 }, { 9, 218, 0 }, { 7, 270, 0 }, { 8, 109, 0 },
+		{ 8, 45, 0 }, { 9, 186, 0 }, { 8, 13, 0 }, { 8, 141, 0 }, { 8, 77, 0 }, { 9, 250, 0 },
+		{ 7, 257, 0 }, { 8, 83, 0 }, { 8, 19, 0 }, { 8, 283, 0 }, { 7, 273, 0 }, { 8, 115, 0 },
+		{ 8, 51, 0 }, { 9, 198, 0 }, { 7, 265, 0 }, { 8, 99, 0 }, { 8, 35, 0 }, { 9, 166, 0 },
+		{ 8, 3, 0 }, { 8, 131, 0 }, { 8, 67, 0 }, { 9, 230, 0 }, { 7, 261, 0 }, { 8, 91, 0 },
+		{ 8, 27, 0 }, { 9, 150, 0 }, { 7, 277, 0 }, { 8, 123, 0 }, { 8, 59, 0 }, { 9, 214, 0 },
+		{ 7, 269, 0 }, { 8, 107, 0 }, { 8, 43, 0 }, { 9, 182, 0 }, { 8, 11, 0 }, { 8, 139, 0 },
+		{ 8, 75, 0 }, { 9, 246, 0 }, { 7, 259, 0 }, { 8, 87, 0 }, { 8, 23, 0 }, { 8, 287, 0 },
+		{ 7, 275, 0 }, { 8, 119, 0 }, { 8, 55, 0 }, { 9, 206, 0 }, { 7, 267, 0 }, { 8, 103, 0 },
+		{ 8, 39, 0 }, { 9, 174, 0 }, { 8, 7, 0 }, { 8, 135, 0 }, { 8, 71, 0 }, { 9, 238, 0 },
+		{ 7, 263, 0 }, { 8, 95, 0 }, { 8, 31, 0 }, { 9, 158, 0 }, { 7, 279, 0 }, { 8, 127, 0 },
+		{ 8, 63, 0 }, { 9, 222, 0 }, { 7, 271, 0 }, { 8, 111, 0 }, { 8, 47, 0 }, { 9, 190, 0 },
+		{ 8, 15, 0 }, { 8, 143, 0 }, { 8, 79, 0 }, { 9, 254, 0 }, { 7, 256, 0 }, { 8, 80, 0 },
+		{ 8, 16, 0 }, { 8, 280, 0 }, { 7, 272, 0 }, { 8, 112, 0 }, { 8, 48, 0 }, { 9, 193, 0 },
+		{ 7, 264, 0 }, { 8, 96, 0 }, { 8, 32, 0 }, { 9, 161, 0 }, { 8, 0, 0 }, { 8, 128, 0 },
+		{ 8, 64, 0 }, { 9, 225, 0 }, { 7, 260, 0 }, { 8, 88, 0 }, { 8, 24, 0 }, { 9, 145, 0 },
+		{ 7, 276, 0 }, { 8, 120, 0 }, { 8, 56, 0 }, { 9, 209, 0 }, { 7, 268, 0 }, { 8, 104, 0 },
+		{ 8, 40, 0 }, { 9, 177, 0 }, { 8, 8, 0 }, { 8, 136, 0 }, { 8, 72, 0 }, { 9, 241, 0 },
+		{ 7, 258, 0 }, { 8, 84, 0 }, { 8, 20, 0 }, { 8, 284, 0 }, { 7, 274, 0 }, { 8, 116, 0 },
+		{ 8, 52, 0 }, { 9, 201, 0 }, { 7, 266, 0 }, { 8, 100, 0 }, { 8, 36, 0 }, { 9, 169, 0 },
+		{ 8, 4, 0 }, { 8, 132, 0 }, { 8, 68, 0 }, { 9, 233, 0 }, { 7, 262, 0 }, { 8, 92, 0 },
+		{ 8, 28, 0 }, { 9, 153, 0 }, { 7, 278, 0 }, { 8, 124, 0 }, { 8, 60, 0 }, { 9, 217, 0 },
+		{ 7, 270, 0 }, { 8, 108, 0 }, { 8, 44, 0 }, { 9, 185, 0 }, { 8, 12, 0 }, { 8, 140, 0 },
+		{ 8, 76, 0 }, { 9, 249, 0 }, { 7, 257, 0 }, { 8, 82, 0 }, { 8, 18, 0 }, { 8, 282, 0 },
+		{ 7, 273, 0 }, { 8, 114, 0 }, { 8, 50, 0 }, { 9, 197, 0 }, { 7, 265, 0 }, { 8, 98, 0 },
+		{ 8, 34, 0 }, { 9, 165, 0 }, { 8, 2, 0 }, { 8, 130, 0 }, { 8, 66, 0 }, { 9, 229, 0 },
+		{ 7, 261, 0 }, { 8, 90, 0 }, { 8, 26, 0 }, { 9, 149, 0 }, { 7, 277, 0 }, { 8, 122, 0 },
+		{ 8, 58, 0 }, { 9, 213, 0 }, { 7, 269, 0 }, { 8, 106, 0 }, { 8, 42, 0 }, { 9, 181, 0 },
+		{ 8, 10, 0 }, { 8, 138, 0 }, { 8, 74, 0 }, { 9, 245, 0 }, { 7, 259, 0 }, { 8, 86, 0 },
+		{ 8, 22, 0 }, { 8, 286, 0 }, { 7, 275, 0 }, { 8, 118, 0 }, { 8, 54, 0 }, { 9, 205, 0 },
+		{ 7, 267, 0 }, { 8, 102, 0 }, { 8, 38, 0 }, { 9, 173, 0 }, { 8, 6, 0 }, { 8, 134, 0 },
+		{ 8, 70, 0 }, { 9, 237, 0 }, { 7, 263, 0 }, { 8, 94, 0 }, { 8, 30, 0 }, { 9, 157, 0 },
+		{ 7, 279, 0 }, { 8, 126, 0 }, { 8, 62, 0 }, { 9, 221, 0 }, { 7, 271, 0 }, { 8, 110, 0 },
+		{ 8, 46, 0 }, { 9, 189, 0 }, { 8, 14, 0 }, { 8, 142, 0 }, { 8, 78, 0 }, { 9, 253, 0 },
+		{ 7, 256, 0 }, { 8, 81, 0 }, { 8, 17, 0 }, { 8, 281, 0 }, { 7, 272, 0 }, { 8, 113, 0 },
+		{ 8, 49, 0 }, { 9, 195, 0 }, { 7, 264, 0 }, { 8, 97, 0 }, { 8, 33, 0 }, { 9, 163, 0 },
+		{ 8, 1, 0 }, { 8, 129, 0 }, { 8, 65, 0 }, { 9, 227, 0 }, { 7, 260, 0 }, { 8, 89, 0 },
+		{ 8, 25, 0 }, { 9, 147, 0 }, { 7, 276, 0 }, { 8, 121, 0 }, { 8, 57, 0 }, { 9, 211, 0 },
+		{ 7, 268, 0 }, { 8, 105, 0 }, { 8, 41, 0 }, { 9, 179, 0 }, { 8, 9, 0 }, { 8, 137, 0 },
+		{ 8, 73, 0 }, { 9, 243, 0 }, { 7, 258, 0 }, { 8, 85, 0 }, { 8, 21, 0 }, { 8, 285, 0 },
+		{ 7, 274, 0 }, { 8, 117, 0 }, { 8, 53, 0 }, { 9, 203, 0 }, { 7, 266, 0 }, { 8, 101, 0 },
+		{ 8, 37, 0 }, { 9, 171, 0 }, { 8, 5, 0 }, { 8, 133, 0 }, { 8, 69, 0 }, { 9, 235, 0 },
+		{ 7, 262, 0 }, { 8, 93, 0 }, { 8, 29, 0 }, { 9, 155, 0 }, { 7, 278, 0 }, { 8, 125, 0 },
+		{ 8, 61, 0 }, { 9, 219, 0 }, { 7, 270, 0 }, { 8, 109, 0 }, { 8, 45, 0 }, { 9, 187, 0 },
+		{ 8, 13, 0 }, { 8, 141, 0 }, { 8, 77, 0 }, { 9, 251, 0 }, { 7, 257, 0 }, { 8, 83, 0 },
+		{ 8, 19, 0 }, { 8, 283, 0 }, { 7, 273, 0 }, { 8, 115, 0 }, { 8, 51, 0 }, { 9, 199, 0 },
+		{ 7, 265, 0 }, { 8, 99, 0 }, { 8, 35, 0 }, { 9, 167, 0 }, { 8, 3, 0 }, { 8, 131, 0 },
+		{ 8, 67, 0 }, { 9, 231, 0 }, { 7, 261, 0 }, { 8, 91, 0 }, { 8, 27, 0 }, { 9, 151, 0 },
+		{ 7, 277, 0 }, { 8, 123, 0 }, { 8, 59, 0 }, { 9, 215, 0 }, { 7, 269, 0 }, { 8, 107, 0 },
+		{ 8, 43, 0 }, { 9, 183, 0 }, { 8, 11, 0 }, { 8, 139, 0 }, { 8, 75, 0 }, { 9, 247, 0 },
+		{ 7, 259, 0 }, { 8, 87, 0 }, { 8, 23, 0 }, { 8, 287, 0 }, { 7, 275, 0 }, { 8, 119, 0 },
+		{ 8, 55, 0 }, { 9, 207, 0 }, { 7, 267, 0 }, { 8, 103, 0 }, { 8, 39, 0 }, { 9, 175, 0 },
+		{ 8, 7, 0 }, { 8, 135, 0 }, { 8, 71, 0 }, { 9, 239, 0 }, { 7, 263, 0 }, { 8, 95, 0 },
+		{ 8, 31, 0 }, { 9, 159, 0 }, { 7, 279, 0 }, { 8, 127, 0 }, { 8, 63, 0 }, { 9, 223, 0 },
+		{ 7, 271, 0 }, { 8, 111, 0 }, { 8, 47, 0 }, { 9, 191, 0 }, { 8, 15, 0 }, { 8, 143, 0 },
+		{ 8, 79, 0 }, { 9, 255, 0 }, { 7, 256, 0 }, { 8, 80, 0 }, { 8, 16, 0 }, { 8, 280, 0 },
+		{ 7, 272, 0 }, { 8, 112, 0 }, { 8, 48, 0 }, { 9, 192, 0 }, { 7, 264, 0 }, { 8, 96, 0 },
+		{ 8, 32, 0 }, { 9, 160, 0 }, { 8, 0, 0 }, { 8, 128, 0 }, { 8, 64, 0 }, { 9, 224, 0 },
+		{ 7, 260, 0 }, { 8, 88, 0 }, { 8, 24, 0 }, { 9, 144, 0 }, { 7, 276, 0 }, { 8, 120, 0 },
+		{ 8, 56, 0 }, { 9, 208, 0 }, { 7, 268, 0 }, { 8, 104, 0 }, { 8, 40, 0 }, { 9, 176, 0 },
+		{ 8, 8, 0 }, { 8, 136, 0 }, { 8, 72, 0 }, { 9, 240, 0 }, { 7, 258, 0 }, { 8, 84, 0 },
+		{ 8, 20, 0 }, { 8, 284, 0 }, { 7, 274, 0 }, { 8, 116, 0 }, { 8, 52, 0 }, { 9, 200, 0 },
+		{ 7, 266, 0 }, { 8, 100, 0 }, { 8, 36, 0 }, { 9, 168, 0 }, { 8, 4, 0 }, { 8, 132, 0 },
+		{ 8, 68, 0 }, { 9, 232, 0 }, { 7, 262, 0 }, { 8, 92, 0 }, { 8, 28, 0 }, { 9, 152, 0 },
+		{ 7, 278, 0 }, { 8, 124, 0 }, { 8, 60, 0 }, { 9, 216, 0 }, { 7, 270, 0 }, { 8, 108, 0 },
+		{ 8, 44, 0 }, { 9, 184, 0 }, { 8, 12, 0 }, { 8, 140, 0 }, { 8, 76, 0 }, { 9, 248, 0 },
+		{ 7, 257, 0 }, { 8, 82, 0 }, { 8, 18, 0 }, { 8, 282, 0 }, { 7, 273, 0 }, { 8, 114, 0 },
+		{ 8, 50, 0 }, { 9, 196, 0 }, { 7, 265, 0 }, { 8, 98, 0 }, { 8, 34, 0 }, { 9, 164, 0 },
+		{ 8, 2, 0 }, { 8, 130, 0 }, { 8, 66, 0 }, { 9, 228, 0 }, { 7, 261, 0 }, { 8, 90, 0 },
+		{ 8, 26, 0 }, { 9, 148, 0 }, { 7, 277, 0 }, { 8, 122, 0 }, { 8, 58, 0 }, { 9, 212, 0 },
+		{ 7, 269, 0 }, { 8, 106, 0 }, { 8, 42, 0 }, { 9, 180, 0 }, { 8, 10, 0 }, { 8, 138, 0 },
+		{ 8, 74, 0 }, { 9, 244, 0 }, { 7, 259, 0 }, { 8, 86, 0 }, { 8, 22, 0 }, { 8, 286, 0 },
+		{ 7, 275, 0 }, { 8, 118, 0 }, { 8, 54, 0 }, { 9, 204, 0 }, { 7, 267, 0 }, { 8, 102, 0 },
+		{ 8, 38, 0 }, { 9, 172, 0 }, { 8, 6, 0 }, { 8, 134, 0 }, { 8, 70, 0 }, { 9, 236, 0 },
+		{ 7, 263, 0 }, { 8, 94, 0 }, { 8, 30, 0 }, { 9, 156, 0 }, { 7, 279, 0 }, { 8, 126, 0 },
+		{ 8, 62, 0 }, { 9, 220, 0 }, { 7, 271, 0 }, { 8, 110, 0 }, { 8, 46, 0 }, { 9, 188, 0 },
+		{ 8, 14, 0 }, { 8, 142, 0 }, { 8, 78, 0 }, { 9, 252, 0 }, { 7, 256, 0 }, { 8, 81, 0 },
+		{ 8, 17, 0 }, { 8, 281, 0 }, { 7, 272, 0 }, { 8, 113, 0 }, { 8, 49, 0 }, { 9, 194, 0 },
+		{ 7, 264, 0 }, { 8, 97, 0 }, { 8, 33, 0 }, { 9, 162, 0 }, { 8, 1, 0 }, { 8, 129, 0 },
+		{ 8, 65, 0 }, { 9, 226, 0 }, { 7, 260, 0 }, { 8, 89, 0 }, { 8, 25, 0 }, { 9, 146, 0 },
+		{ 7, 276, 0 }, { 8, 121, 0 }, { 8, 57, 0 }, { 9, 210, 0 }, { 7, 268, 0 }, { 8, 105, 0 },
+		{ 8, 41, 0 }, { 9, 178, 0 }, { 8, 9, 0 }, { 8, 137, 0 }, { 8, 73, 0 }, { 9, 242, 0 },
+		{ 7, 258, 0 }, { 8, 85, 0 }, { 8, 21, 0 }, { 8, 285, 0 }, { 7, 274, 0 }, { 8, 117, 0 },
+		{ 8, 53, 0 }, { 9, 202, 0 }, { 7, 266, 0 }, { 8, 101, 0 }, { 8, 37, 0 }, { 9, 170, 0 },
+		{ 8, 5, 0 }, { 8, 133, 0 }, { 8, 69, 0 }, { 9, 234, 0 }, { 7, 262, 0 }, { 8, 93, 0 },
+		{ 8, 29, 0 }, { 9, 154, 0 }, { 7, 278, 0 }, { 8, 125, 0 }, { 8, 61, 0 }, { 9, 218, 0 },
+		{ 7, 270, 0 }, { 8, 109, 0 }, { 8, 45, 0 }, { 9, 186, 0 }, { 8, 13, 0 }, { 8, 141, 0 },
+		{ 8, 77, 0 }, { 9, 250, 0 }, { 7, 257, 0 }, { 8, 83, 0 }, { 8, 19, 0 }, { 8, 283, 0 },
+		{ 7, 273, 0 }, { 8, 115, 0 }, { 8, 51, 0 }, { 9, 198, 0 }, { 7, 265, 0 }, { 8, 99, 0 },
+		{ 8, 35, 0 }, { 9, 166, 0 }, { 8, 3, 0 }, { 8, 131, 0 }, { 8, 67, 0 }, { 9, 230, 0 },
+		{ 7, 261, 0 }, { 8, 91, 0 }, { 8, 27, 0 }, { 9, 150, 0 }, { 7, 277, 0 }, { 8, 123, 0 },
+		{ 8, 59, 0 }, { 9, 214, 0 }, { 7, 269, 0 }, { 8, 107, 0 }, { 8, 43, 0 }, { 9, 182, 0 },
+		{ 8, 11, 0 }, { 8, 139, 0 }, { 8, 75, 0 }, { 9, 246, 0 }, { 7, 259, 0 }, { 8, 87, 0 },
+		{ 8, 23, 0 }, { 8, 287, 0 }, { 7, 275, 0 }, { 8, 119, 0 }, { 8, 55, 0 }, { 9, 206, 0 },
+		{ 7, 267, 0 }, { 8, 103, 0 }, { 8, 39, 0 }, { 9, 174, 0 }, { 8, 7, 0 }, { 8, 135, 0 },
+		{ 8, 71, 0 }, { 9, 238, 0 }, { 7, 263, 0 }, { 8, 95, 0 }, { 8, 31, 0 }, { 9, 158, 0 },
+		{ 7, 279, 0 }, { 8, 127, 0 }, { 8, 63, 0 }, { 9, 222, 0 }, { 7, 271, 0 }, { 8, 111, 0 },
+		{ 8, 47, 0 }, { 9, 190, 0 }, { 8, 15, 0 }, { 8, 143, 0 }, { 8, 79, 0 }, { 9, 254, 0 },
+		{ 7, 256, 0 }, { 8, 80, 0 }, { 8, 16, 0 }, { 8, 280, 0 }, { 7, 272, 0 }, { 8, 112, 0 },
+		{ 8, 48, 0 }, { 9, 193, 0 }, { 7, 264, 0 }, { 8, 96, 0 }, { 8, 32, 0 }, { 9, 161, 0 },
+		{ 8, 0, 0 }, { 8, 128, 0 }, { 8, 64, 0 }, { 9, 225, 0 }, { 7, 260, 0 }, { 8, 88, 0 },
+		{ 8, 24, 0 }, { 9, 145, 0 }, { 7, 276, 0 }, { 8, 120, 0 }, { 8, 56, 0 }, { 9, 209, 0 },
+		{ 7, 268, 0 }, { 8, 104, 0 }, { 8, 40, 0 }, { 9, 177, 0 }, { 8, 8, 0 }, { 8, 136, 0 },
+		{ 8, 72, 0 }, { 9, 241, 0 }, { 7, 258, 0 }, { 8, 84, 0 }, { 8, 20, 0 }, { 8, 284, 0 },
+		{ 7, 274, 0 }, { 8, 116, 0 }, { 8, 52, 0 }, { 9, 201, 0 }, { 7, 266, 0 }, { 8, 100, 0 },
+		{ 8, 36, 0 }, { 9, 169, 0 }, { 8, 4, 0 }, { 8, 132, 0 }, { 8, 68, 0 }, { 9, 233, 0 },
+		{ 7, 262, 0 }, { 8, 92, 0 }, { 8, 28, 0 }, { 9, 153, 0 }, { 7, 278, 0 }, { 8, 124, 0 },
+		{ 8, 60, 0 }, { 9, 217, 0 }, { 7, 270, 0 }, { 8, 108, 0 }, { 8, 44, 0 }, { 9, 185, 0 },
+		{ 8, 12, 0 }, { 8, 140, 0 }, { 8, 76, 0 }, { 9, 249, 0 }, { 7, 257, 0 }, { 8, 82, 0 },
+		{ 8, 18, 0 }, { 8, 282, 0 }, { 7, 273, 0 }, { 8, 114, 0 }, { 8, 50, 0 }, { 9, 197, 0 },
+		{ 7, 265, 0 }, { 8, 98, 0 }, { 8, 34, 0 }, { 9, 165, 0 }, { 8, 2, 0 }, { 8, 130, 0 },
+		{ 8, 66, 0 }, { 9, 229, 0 }, { 7, 261, 0 }, { 8, 90, 0 }, { 8, 26, 0 }, { 9, 149, 0 },
+		{ 7, 277, 0 }, { 8, 122, 0 }, { 8, 58, 0 }, { 9, 213, 0 }, { 7, 269, 0 }, { 8, 106, 0 },
+		{ 8, 42, 0 }, { 9, 181, 0 }, { 8, 10, 0 }, { 8, 138, 0 }, { 8, 74, 0 }, { 9, 245, 0 },
+		{ 7, 259, 0 }, { 8, 86, 0 }, { 8, 22, 0 }, { 8, 286, 0 }, { 7, 275, 0 }, { 8, 118, 0 },
+		{ 8, 54, 0 }, { 9, 205, 0 }, { 7, 267, 0 }, { 8, 102, 0 }, { 8, 38, 0 }, { 9, 173, 0 },
+		{ 8, 6, 0 }, { 8, 134, 0 }, { 8, 70, 0 }, { 9, 237, 0 }, { 7, 263, 0 }, { 8, 94, 0 },
+		{ 8, 30, 0 }, { 9, 157, 0 }, { 7, 279, 0 }, { 8, 126, 0 }, { 8, 62, 0 }, { 9, 221, 0 },
+		{ 7, 271, 0 }, { 8, 110, 0 }, { 8, 46, 0 }, { 9, 189, 0 }, { 8, 14, 0 }, { 8, 142, 0 },
+		{ 8, 78, 0 }, { 9, 253, 0 }, { 7, 256, 0 }, { 8, 81, 0 }, { 8, 17, 0 }, { 8, 281, 0 },
+		{ 7, 272, 0 }, { 8, 113, 0 }, { 8, 49, 0 }, { 9, 195, 0 }, { 7, 264, 0 }, { 8, 97, 0 },
+		{ 8, 33, 0 }, { 9, 163, 0 }, { 8, 1, 0 }, { 8, 129, 0 }, { 8, 65, 0 }, { 9, 227, 0 },
+		{ 7, 260, 0 }, { 8, 89, 0 }, { 8, 25, 0 }, { 9, 147, 0 }, { 7, 276, 0 }, { 8, 121, 0 },
+		{ 8, 57, 0 }, { 9, 211, 0 }, { 7, 268, 0 }, { 8, 105, 0 }, { 8, 41, 0 }, { 9, 179, 0 },
+		{ 8, 9, 0 }, { 8, 137, 0 }, { 8, 73, 0 }, { 9, 243, 0 }, { 7, 258, 0 }, { 8, 85, 0 },
+		{ 8, 21, 0 }, { 8, 285, 0 }, { 7, 274, 0 }, { 8, 117, 0 }, { 8, 53, 0 }, { 9, 203, 0 },
+		{ 7, 266, 0 }, { 8, 101, 0 }, { 8, 37, 0 }, { 9, 171, 0 }, { 8, 5, 0 }, { 8, 133, 0 },
+		{ 8, 69, 0 }, { 9, 235, 0 }, { 7, 262, 0 }, { 8, 93, 0 }, { 8, 29, 0 }, { 9, 155, 0 },
+		{ 7, 278, 0 }, { 8, 125, 0 }, { 8, 61, 0 }, { 9, 219, 0 }, { 7, 270, 0 }, { 8, 109, 0 },
+		{ 8, 45, 0 }, { 9, 187, 0 }, { 8, 13, 0 }, { 8, 141, 0 }, { 8, 77, 0 }, { 9, 251, 0 },
+		{ 7, 257, 0 }, { 8, 83, 0 }, { 8, 19, 0 }, { 8, 283, 0 }, { 7, 273, 0 }, { 8, 115, 0 },
+		{ 8, 51, 0 }, { 9, 199, 0 }, { 7, 265, 0 }, { 8, 99, 0 }, { 8, 35, 0 }, { 9, 167, 0 },
+		{ 8, 3, 0 }, { 8, 131, 0 }, { 8, 67, 0 }, { 9, 231, 0 }, { 7, 261, 0 }, { 8, 91, 0 },
+		{ 8, 27, 0 }, { 9, 151, 0 }, { 7, 277, 0 }, { 8, 123, 0 }, { 8, 59, 0 }, { 9, 215, 0 },
+		{ 7, 269, 0 }, { 8, 107, 0 }, { 8, 43, 0 }, { 9, 183, 0 }, { 8, 11, 0 }, { 8, 139, 0 },
+		{ 8, 75, 0 }, { 9, 247, 0 }, { 7, 259, 0 }, { 8, 87, 0 }, { 8, 23, 0 }, { 8, 287, 0 },
+		{ 7, 275, 0 }, { 8, 119, 0 }, { 8, 55, 0 }, { 9, 207, 0 }, { 7, 267, 0 }, { 8, 103, 0 },
+		{ 8, 39, 0 }, { 9, 175, 0 }, { 8, 7, 0 }, { 8, 135, 0 }, { 8, 71, 0 }, { 9, 239, 0 },
+		{ 7, 263, 0 }, { 8, 95, 0 }, { 8, 31, 0 }, { 9, 159, 0 }, { 7, 279, 0 }, { 8, 127, 0 },
+		{ 8, 63, 0 }, { 9, 223, 0 }, { 7, 271, 0 }, { 8, 111, 0 }, { 8, 47, 0 }, { 9, 191, 0 },
+		{ 8, 15, 0 }, { 8, 143, 0 }, { 8, 79, 0 }, { 9, 255, 0 }
+	},
+	.entry_count	  = 1024,
+	.table_bits	  = 10,
+	.max_code_in_bits = 9
+};
+
+static const LibImageHuffman png_fixed_dist_huff = {
+	.entries = {
+		{ 5, 0, 0 }, { 5, 16, 0 }, { 5, 8, 0 }, { 5, 24, 0 }, { 5, 4, 0 }, { 5, 20, 0 },
+		{ 5, 12, 0 }, { 5, 28, 0 }, { 5, 2, 0 }, { 5, 18, 0 }, { 5, 10, 0 }, { 5, 26, 0 },
+		{ 5, 6, 0 }, { 5, 22, 0 }, { 5, 14, 0 }, { 5, 30, 0 }, { 5, 1, 0 }, { 5, 17, 0 },
+		{ 5, 9, 0 }, { 5, 25, 0 }, { 5, 5, 0 }, { 5, 21, 0 }, { 5, 13, 0 }, { 5, 29, 0 },
+		{ 5, 3, 0 }, { 5, 19, 0 }, { 5, 11, 0 }, { 5, 27, 0 }, { 5, 7, 0 }, { 5, 23, 0 },
+		{ 5, 15, 0 }, { 5, 31, 0 }, { 5, 0, 0 }, { 5, 16, 0 }, { 5, 8, 0 }, { 5, 24, 0 },
+		{ 5, 4, 0 }, { 5, 20, 0 }, { 5, 12, 0 }, { 5, 28, 0 }, { 5, 2, 0 }, { 5, 18, 0 },
+		{ 5, 10, 0 }, { 5, 26, 0 }, { 5, 6, 0 }, { 5, 22, 0 }, { 5, 14, 0 }, { 5, 30, 0 },
+		{ 5, 1, 0 }, { 5, 17, 0 }, { 5, 9, 0 }, { 5, 25, 0 }, { 5, 5, 0 }, { 5, 21, 0 },
+		{ 5, 13, 0 }, { 5, 29, 0 }, { 5, 3, 0 }, { 5, 19, 0 }, { 5, 11, 0 }, { 5, 27, 0 },
+		{ 5, 7, 0 }, { 5, 23, 0 }, { 5, 15, 0 }, { 5, 31, 0 }, { 5, 0, 0 }, { 5, 16, 0 },
+		{ 5, 8, 0 }, { 5, 24, 0 }, { 5, 4, 0 }, { 5, 20, 0 }, { 5, 12, 0 }, { 5, 28, 0 },
+		{ 5, 2, 0 }, { 5, 18, 0 }, { 5, 10, 0 }, { 5, 26, 0 }, { 5, 6, 0 }, { 5, 22, 0 },
+		{ 5, 14, 0 }, { 5, 30, 0 }, { 5, 1, 0 }, { 5, 17, 0 }, { 5, 9, 0 }, { 5, 25, 0 },
+		{ 5, 5, 0 }, { 5, 21, 0 }, { 5, 13, 0 }, { 5, 29, 0 }, { 5, 3, 0 }, { 5, 19, 0 },
+		{ 5, 11, 0 }, { 5, 27, 0 }, { 5, 7, 0 }, { 5, 23, 0 }, { 5, 15, 0 }, { 5, 31, 0 },
+		{ 5, 0, 0 }, { 5, 16, 0 }, { 5, 8, 0 }, { 5, 24, 0 }, { 5, 4, 0 }, { 5, 20, 0 },
+		{ 5, 12, 0 }, { 5, 28, 0 }, { 5, 2, 0 }, { 5, 18, 0 }, { 5, 10, 0 }, { 5, 26, 0 },
+		{ 5, 6, 0 }, { 5, 22, 0 }, { 5, 14, 0 }, { 5, 30, 0 }, { 5, 1, 0 }, { 5, 17, 0 },
+		{ 5, 9, 0 }, { 5, 25, 0 }, { 5, 5, 0 }, { 5, 21, 0 }, { 5, 13, 0 }, { 5, 29, 0 },
+		{ 5, 3, 0 }, { 5, 19, 0 }, { 5, 11, 0 }, { 5, 27, 0 }, { 5, 7, 0 }, { 5, 23, 0 },
+		{ 5, 15, 0 }, { 5, 31, 0 }, { 5, 0, 0 }, { 5, 16, 0 }, { 5, 8, 0 }, { 5, 24, 0 },
+		{ 5, 4, 0 }, { 5, 20, 0 }, { 5, 12, 0 }, { 5, 28, 0 }, { 5, 2, 0 }, { 5, 18, 0 },
+		{ 5, 10, 0 }, { 5, 26, 0 }, { 5, 6, 0 }, { 5, 22, 0 }, { 5, 14, 0 }, { 5, 30, 0 },
+		{ 5, 1, 0 }, { 5, 17, 0 }, { 5, 9, 0 }, { 5, 25, 0 }, { 5, 5, 0 }, { 5, 21, 0 },
+		{ 5, 13, 0 }, { 5, 29, 0 }, { 5, 3, 0 }, { 5, 19, 0 }, { 5, 11, 0 }, { 5, 27, 0 },
+		{ 5, 7, 0 }, { 5, 23, 0 }, { 5, 15, 0 }, { 5, 31, 0 }, { 5, 0, 0 }, { 5, 16, 0 },
+		{ 5, 8, 0 }, { 5, 24, 0 }, { 5, 4, 0 }, { 5, 20, 0 }, { 5, 12, 0 }, { 5, 28, 0 },
+		{ 5, 2, 0 }, { 5, 18, 0 }, { 5, 10, 0 }, { 5, 26, 0 }, { 5, 6, 0 }, { 5, 22, 0 },
+		{ 5, 14, 0 }, { 5, 30, 0 }, { 5, 1, 0 }, { 5, 17, 0 }, { 5, 9, 0 }, { 5, 25, 0 },
+		{ 5, 5, 0 }, { 5, 21, 0 }, { 5, 13, 0 }, { 5, 29, 0 }, { 5, 3, 0 }, { 5, 19, 0 },
+		{ 5, 11, 0 }, { 5, 27, 0 }, { 5, 7, 0 }, { 5, 23, 0 }, { 5, 15, 0 }, { 5, 31, 0 },
+		{ 5, 0, 0 }, { 5, 16, 0 }, { 5, 8, 0 }, { 5, 24, 0 }, { 5, 4, 0 }, { 5, 20, 0 },
+		{ 5, 12, 0 }, { 5, 28, 0 }, { 5, 2, 0 }, { 5, 18, 0 }, { 5, 10, 0 }, { 5, 26, 0 },
+		{ 5, 6, 0 }, { 5, 22, 0 }, { 5, 14, 0 }, { 5, 30, 0 }, { 5, 1, 0 }, { 5, 17, 0 },
+		{ 5, 9, 0 }, { 5, 25, 0 }, { 5, 5, 0 }, { 5, 21, 0 }, { 5, 13, 0 }, { 5, 29, 0 },
+		{ 5, 3, 0 }, { 5, 19, 0 }, { 5, 11, 0 }, { 5, 27, 0 }, { 5, 7, 0 }, { 5, 23, 0 },
+		{ 5, 15, 0 }, { 5, 31, 0 }, { 5, 0, 0 }, { 5, 16, 0 }, { 5, 8, 0 }, { 5, 24, 0 },
+		{ 5, 4, 0 }, { 5, 20, 0 }, { 5, 12, 0 }, { 5, 28, 0 }, { 5, 2, 0 }, { 5, 18, 0 },
+		{ 5, 10, 0 }, { 5, 26, 0 }, { 5, 6, 0 }, { 5, 22, 0 }, { 5, 14, 0 }, { 5, 30, 0 },
+		{ 5, 1, 0 }, { 5, 17, 0 }, { 5, 9, 0 }, { 5, 25, 0 }, { 5, 5, 0 }, { 5, 21, 0 },
+		{ 5, 13, 0 }, { 5, 29, 0 }, { 5, 3, 0 }, { 5, 19, 0 }, { 5, 11, 0 }, { 5, 27, 0 },
+		{ 5, 7, 0 }, { 5, 23, 0 }, { 5, 15, 0 }, { 5, 31, 0 }
+	},
+	.entry_count	  = 256,
+	.table_bits	  = 8,
+	.max_code_in_bits = 5
+};
+
+#endif
@@ -0,0 +1,522 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "arena.h"
+#include "zlib.h"
+#include "png.h"
+#include "huffman.h"
+#include "crc32.h"
+#include "pipeline.h"
+#include "deflate.h"
+#include "index.h"
+
+// Same idea as the PNG signature, a blob that went through a text transfer doesn't load.
+static const uint8_t index_magic[8] = { 0x89, 'L', 'I', 'X', 0x0d, 0x0a, 0x1a, 0x0a };
+
+// Bounds checked reads of a saved index, error is set once one went past the end.
+typedef struct libimage_index_reader {
+	const uint8_t	*data;
+	size_t		size, pos;
+	int		error;
+} LibImageIndexReader;
+
+LibImageIndex *libimage_index_create(const LibImageAllocator *allocator, uint32_t interval)
+{
+LibImageAllocator	alloc;
+LibImageIndex		*index;
+
+	if(allocator) alloc = *allocator;
+	else libimage_allocator_default(&alloc);
+	if(alloc.alloc == NULL || alloc.free == NULL || interval == 0) return NULL;
+
+	index = libimage_allocator_alloc(&alloc, sizeof(*index));
+	if(index == NULL) return NULL;
+	memset(index, 0, sizeof(*index));
+	index->allocator = alloc;
+	index->interval	 = interval;
+	return index;
+}
+
+uint32_t libimage_index_checkpoints(const LibImageIndex *index)
+{
+	return index ? index->count : 0;
+}
+
+// Drops the checkpoints and the image they were for, the list keeps its room.
+static void index_clear(LibImageIndex *index)
+{
+uint32_t i;
+
+	for(i = 0; i < index->count; i++) libimage_allocator_free(&index->allocator, index->checkpoints[i]);
+	index->count = 0;
+	index->bound = 0;
+}
+
+void libimage_index_destroy(LibImageIndex *index)
+{
+LibImageAllocator alloc;
+
+	if(index == NULL) return;
+	alloc = index->allocator;
+	index_clear(index);
+	libimage_allocator_free(&alloc, index->checkpoints);
+	libimage_allocator_free(&alloc, index);
+}
+
+static LibImageIndexCheckpoint *index_checkpoint_alloc(LibImageIndex *index, uint32_t window_size)
+{
+LibImageIndexCheckpoint *cp;
+
+	cp = libimage_allocator_alloc(&index->allocator, sizeof(*cp) + index->row_bytes + window_size);
+	if(cp == NULL) return NULL;
+	memset(cp, 0, sizeof(*cp));
+	cp->prev_row	= (uint8_t*)(cp + 1);
+	cp->window	= cp->prev_row + index->row_bytes;
+	cp->window_size	= window_size;
+	return cp;
+}
+
+// Puts the checkpoint after the last one. Returns zero or the out of memory error, the checkpoint is then the caller's.
+static int index_append(LibImageIndex *index, LibImageIndexCheckpoint *cp)
+{
+LibImageIndexCheckpoint	**list;
+uint32_t		capacity;
+
+	if(index->count == index->capacity) {
+		capacity = index->capacity ? 2 * index->capacity : LIBIMAGE_INDEX_CHECKPOINTS;
+		list = libimage_allocator_alloc(&index->allocator, capacity * sizeof(*list));
+		if(list == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+		if(index->count) memcpy(list, index->checkpoints, index->count * sizeof(*list));
+		libimage_allocator_free(&index->allocator, index->checkpoints);
+		index->checkpoints = list;
+		index->capacity	   = capacity;
+	}
+	index->checkpoints[index->count++] = cp;
+	return 0;
+}
+
+// Ties the index to the image being decoded, the checkpoints of any other image are dropped.
+static void index_bind(LibImageIndex *index, LibImageImageInfo *info, uint64_t first_chunk, uint32_t first_crc)
+{
+uint64_t row_bytes;
+
+	row_bytes = png_row_bytes(info, info->width);
+	if(index->bound && index->width == info->width && index->height == info->height && index->bit_depth == info->bit_depth &&
+	   index->color_type == info->color_type && index->first_chunk == first_chunk && index->first_crc == first_crc &&
+	   index->row_bytes == row_bytes) return;
+
+	index_clear(index);
+	index->bound	   = 1;
+	index->width	   = info->width;
+	index->height	   = info->height;
+	index->bit_depth   = info->bit_depth;
+	index->color_type  = info->color_type;
+	index->first_chunk = first_chunk;
+	index->first_crc   = first_crc;
+	index->row_bytes   = row_bytes;
+}
+
+/*
+*	Puts the pipeline where the checkpoint was taken. What the checkpoint says about the window has to agree with
+*	the image and its chunk has to be an IDAT of the file, anything else is left to the inflate to find out, same
+*	as it would in the file itself. Returns zero, with the pipeline untouched, when the checkpoint doesn't fit.
+*/
+static int index_resume(LibImageIndexCursor *c, LibImageIndexCheckpoint *cp, LibImagePngPipeline *p)
+{
+LibImageImageInfo	*info = p->info;
+LibImageZlibBuffer	*z = &p->zbuf;
+LibImageIndex		*index = c->index;
+LibImageDataReader	reader;
+LibImagePngChunk	chunk;
+
+	if(cp->row >= info->height || cp->window_size > p->window_size || cp->row_start > cp->window_size) return 0;
+	if(cp->window_size - cp->row_start > index->row_bytes) return 0;
+	if(cp->window_base + cp->row_start != (uint64_t)cp->row * (1 + index->row_bytes)) return 0;
+	if(cp->window_base + cp->window_size > p->total_size) return 0;
+
+	reader	      = *c->reader;
+	reader.error  = 0;
+	reader.cursor = cp->chunk;
+	chunk	      = read_png_chunk(&reader);
+	if(reader.error || chunk.type.i != LIBIMAGE_PNG_TYPE('I','D','A','T') || cp->chunk_pos > chunk.data_len.i) return 0;
+#ifdef LIBIMAGE_PNG_CHECK_CRC
+	if(!png_chunk_crc_matches(&chunk)) return 0;
+#endif
+	// Code lengths that don't make a code fail here, before anything changed.
+	if(cp->state == LIBIMAGE_ZBUF_STATE_HUFFMAN && cp->block_type == 2) {
+		memcpy(p->tables.code_lengths, cp->code_lengths, cp->lit_count + cp->dist_count);
+		png_start_huffman_block(z, info, cp->lit_count, cp->dist_count);
+		if(info->error) {
+			info->error = 0;
+			return 0;
+		}
+	} else if(cp->state == LIBIMAGE_ZBUF_STATE_HUFFMAN) {
+		png_parse_huffman_fixed_block(z, info);
+	}
+
+	memcpy(info->uncompressed_data, cp->window, cp->window_size);
+	memcpy(p->prev_row, cp->prev_row, index->row_bytes);
+	info->un_offset	= cp->window_size;
+	p->window_base	= cp->window_base;
+	p->row_start	= cp->row_start;
+	p->pass_y	= cp->row;
+	info->un_size	= p->total_size - p->window_base < p->window_size ? p->total_size - p->window_base : p->window_size;
+
+	z->buf		    = chunk.start_chunk_data + cp->chunk_pos;
+	z->buf_end	    = chunk.start_chunk_data + chunk.data_len.i;
+	z->code_buf	    = cp->code_buf;
+	z->code_buf_bits    = cp->code_buf_bits;
+	z->overrun_bytes    = 0;
+	z->state	    = cp->state;
+	z->final_block	    = cp->final_block;
+	z->stored_remaining = cp->stored_remaining;
+	z->adler	    = cp->adler;
+	z->adler_offset	    = info->un_offset;
+	// The next span is the chunk after this one.
+	c->reader->cursor   = reader.cursor;
+	c->chunk	    = cp->chunk;
+	return 1;
+}
+
+/*
+*	Hooks the index to a row pipeline that was just set up on the first IDAT, for images that aren't interlaced.
+*	Rows are then unfiltered whole, the checkpoints need them so. The pipeline starts at the last checkpoint at or
+*	above the region when there is one, the chunks before it are never read.
+*/
+void png_index_attach(LibImageIndexCursor *c, LibImageIndex *index, LibImagePngPipeline *p, LibImageDataReader *r, LibImagePngChunk *first_idat)
+{
+LibImageImageInfo	*info = p->info;
+uint32_t		lo, hi, mid;
+
+	if(index == NULL || info->interlace_method) return;
+	memset(c, 0, sizeof(*c));
+	c->index  = index;
+	c->reader = r;
+	c->chunk  = first_idat->start_chunk_data - 8 - r->data;
+	index_bind(index, info, c->chunk, u32_endian_swap(first_idat->crc.i));
+	p->end_x	   = info->width;
+	p->pass_keep_bytes = p->pass_row_bytes;
+	p->index	   = c;
+
+	for(lo = 0, hi = index->count; lo < hi;) {
+		mid = lo + (hi - lo) / 2;
+		if(index->checkpoints[mid]->row <= info->roi_y) lo = mid + 1;
+		else hi = mid;
+	}
+	if(lo == 0 || index_resume(c, index->checkpoints[lo - 1], p)) return;
+	// The file changed under the index, it is built again from the start.
+	index_clear(index);
+	index_bind(index, info, c->chunk, u32_endian_swap(first_idat->crc.i));
+}
+
+/*
+*	Called by the pipeline between inflate runs, once the complete rows are out. Takes a checkpoint when the rows
+*	went interval past the last one and inflate stopped between two units with only real input in its bits.
+*/
+void png_index_record(LibImageIndexCursor *c, LibImagePngPipeline *p)
+{
+LibImageIndex		*index = c->index;
+LibImageImageInfo	*info = p->info;
+LibImageZlibBuffer	*z = &p->zbuf;
+LibImageIndexCheckpoint	*cp;
+LibImageDataReader	reader;
+LibImagePngChunk	chunk;
+uint64_t		next_row, buf_end;
+off_t			keep_from;
+
+	next_row = index->count ? (uint64_t)index->checkpoints[index->count - 1]->row + index->interval : index->interval;
+	if(c->failed || p->pass_y < next_row || p->pass_y >= info->height) return;
+	if(z->overrun_bytes || info->skip_adler) return;
+	if(z->state != LIBIMAGE_ZBUF_STATE_BLOCK_HEADER && z->state != LIBIMAGE_ZBUF_STATE_STORED && z->state != LIBIMAGE_ZBUF_STATE_HUFFMAN) return;
+
+	// The chunk the reader is in, going forward from the last one found.
+	buf_end = z->buf_end - c->reader->data;
+	reader	= *c->reader;
+	while(1) {
+		reader.error  = 0;
+		reader.cursor = c->chunk;
+		chunk	      = read_png_chunk(&reader);
+		if(reader.error || chunk.type.i != LIBIMAGE_PNG_TYPE('I','D','A','T') || c->chunk >= buf_end) {
+			c->failed = 1;
+			return;
+		}
+		if(chunk.start_chunk_data + chunk.data_len.i == z->buf_end) break;
+		c->chunk = reader.cursor;
+	}
+	if(z->buf < chunk.start_chunk_data || z->buf > z->buf_end) {
+		c->failed = 1;
+		return;
+	}
+
+	// The same bytes the window keeps when it slides.
+	keep_from = info->un_offset > LIBIMAGE_PIPELINE_HISTORY_SIZE ? info->un_offset - LIBIMAGE_PIPELINE_HISTORY_SIZE : 0;
+	if(keep_from > p->row_start) keep_from = p->row_start;
+	cp = index_checkpoint_alloc(index, info->un_offset - keep_from);
+	if(cp == NULL) {
+		c->failed = 1;
+		return;
+	}
+	memcpy(cp->window, info->uncompressed_data + keep_from, cp->window_size);
+	memcpy(cp->prev_row, p->prev_row, index->row_bytes);
+	cp->row		     = p->pass_y;
+	cp->window_base	     = p->window_base + keep_from;
+	cp->row_start	     = p->row_start - keep_from;
+	cp->chunk	     = c->chunk;
+	cp->chunk_pos	     = z->buf - chunk.start_chunk_data;
+	cp->code_buf	     = z->code_buf;
+	cp->code_buf_bits    = z->code_buf_bits;
+	cp->stored_remaining = z->stored_remaining;
+	cp->adler	     = z->adler;
+	cp->state	     = z->state;
+	cp->final_block	     = z->final_block;
+	if(z->state == LIBIMAGE_ZBUF_STATE_HUFFMAN) {
+		cp->block_type = z->tables->lit == &z->tables->lit_huff ? 2 : 1;
+		if(cp->block_type == 2) {
+			cp->lit_count  = z->tables->lit_count;
+			cp->dist_count = z->tables->dist_count;
+			memcpy(cp->code_lengths, z->tables->code_lengths, cp->lit_count + cp->dist_count);
+		}
+	}
+	if(index_append(index, cp)) {
+		libimage_allocator_free(&index->allocator, cp);
+		c->failed = 1;
+	}
+}
+
+static void index_put_u64(LibImageEncodeBuffer *b, uint64_t value)
+{
+	encode_buffer_u32(b, value >> 32);
+	encode_buffer_u32(b, value);
+}
+
+/*
+*	Writes the index out, big endian like the chunks of a PNG: the magic, the version, the interval and the image,
+*	then every checkpoint with its code lengths, the row above and the window. Returns the blob, *size bytes from
+*	the allocator of the index, or NULL with *error set.
+*/
+void *libimage_index_save(const LibImageIndex *index, size_t *size, int *error)
+{
+LibImageEncodeBuffer		out;
+const LibImageIndexCheckpoint	*cp;
+uint8_t				bytes[4];
+uint32_t			i;
+
+	*size = 0;
+	if(index == NULL) {
+		*error = LIBIMAGE_ERROR_INVALID_ARGUMENT;
+		return NULL;
+	}
+	memset(&out, 0, sizeof(out));
+	out.allocator = index->allocator;
+	encode_buffer_bytes(&out, index_magic, sizeof(index_magic));
+	encode_buffer_u32(&out, LIBIMAGE_INDEX_VERSION);
+	encode_buffer_u32(&out, index->interval);
+	encode_buffer_u32(&out, index->count);
+	bytes[0] = index->bound;
+	bytes[1] = index->bit_depth;
+	bytes[2] = index->color_type;
+	bytes[3] = 0;
+	encode_buffer_bytes(&out, bytes, sizeof(bytes));
+	encode_buffer_u32(&out, index->width);
+	encode_buffer_u32(&out, index->height);
+	index_put_u64(&out, index->first_chunk);
+	encode_buffer_u32(&out, index->first_crc);
+	index_put_u64(&out, index->row_bytes);
+
+	for(i = 0; i < index->count; i++) {
+		cp = index->checkpoints[i];
+		encode_buffer_u32(&out, cp->row);
+		index_put_u64(&out, cp->window_base);
+		encode_buffer_u32(&out, cp->window_size);
+		encode_buffer_u32(&out, cp->row_start);
+		index_put_u64(&out, cp->chunk);
+		encode_buffer_u32(&out, cp->chunk_pos);
+		index_put_u64(&out, cp->code_buf);
+		encode_buffer_u32(&out, cp->code_buf_bits);
+		encode_buffer_u32(&out, cp->stored_remaining);
+		encode_buffer_u32(&out, cp->adler);
+		bytes[0] = cp->state;
+		bytes[1] = cp->final_block;
+		bytes[2] = cp->block_type;
+		bytes[3] = 0;
+		encode_buffer_bytes(&out, bytes, sizeof(bytes));
+		encode_buffer_u32(&out, ((uint32_t)cp->lit_count << 16) | cp->dist_count);
+		if(cp->block_type == 2) encode_buffer_bytes(&out, cp->code_lengths, cp->lit_count + cp->dist_count);
+		encode_buffer_bytes(&out, cp->prev_row, index->row_bytes);
+		encode_buffer_bytes(&out, cp->window, cp->window_size);
+	}
+
+	if(out.error) {
+		libimage_allocator_free(&out.allocator, out.data);
+		*error = out.error;
+		return NULL;
+	}
+	*size  = out.size;
+	*error = 0;
+	return out.data;
+}
+
+static const uint8_t *index_get_bytes(LibImageIndexReader *r, size_t n)
+{
+const uint8_t *bytes;
+
+	if(r->error || r->size - r->pos < n) {
+		r->error = LIBIMAGE_ERROR_BAD_INDEX;
+		return NULL;
+	}
+	bytes   = r->data + r->pos;
+	r->pos += n;
+	return bytes;
+}
+
+static uint32_t index_get_u32(LibImageIndexReader *r)
+{
+const uint8_t *b;
+
+	b = index_get_bytes(r, 4);
+	if(b == NULL) return 0;
+	return ((uint32_t)b[0] << 24) | ((uint32_t)b[1] << 16) | ((uint32_t)b[2] << 8) | b[3];
+}
+
+static uint64_t index_get_u64(LibImageIndexReader *r)
+{
+uint64_t high;
+
+	high = index_get_u32(r);
+	return (high << 32) | index_get_u32(r);
+}
+
+/*
+*	Reads the fields of a checkpoint and checks them against what a pipeline can be put back to, the file itself is
+*	only there once a decode resumes from it. Returns zero or the bad index error.
+*/
+static int index_load_checkpoint(LibImageIndex *index, LibImageIndexReader *r, uint32_t min_row)
+{
+LibImageIndexCheckpoint	cp, *dst;
+const uint8_t		*bytes, *prev_row, *window;
+uint32_t		counts, i;
+
+	memset(&cp, 0, sizeof(cp));
+	cp.row		    = index_get_u32(r);
+	cp.window_base	    = index_get_u64(r);
+	cp.window_size	    = index_get_u32(r);
+	cp.row_start	    = index_get_u32(r);
+	cp.chunk	    = index_get_u64(r);
+	cp.chunk_pos	    = index_get_u32(r);
+	cp.code_buf	    = index_get_u64(r);
+	cp.code_buf_bits    = index_get_u32(r);
+	cp.stored_remaining = index_get_u32(r);
+	cp.adler	    = index_get_u32(r);
+	bytes		    = index_get_bytes(r, 4);
+	counts		    = index_get_u32(r);
+	if(r->error) return r->error;
+	cp.state	= bytes[0];
+	cp.final_block	= bytes[1];
+	cp.block_type	= bytes[2];
+	cp.lit_count	= counts >> 16;
+	cp.dist_count	= counts & 0xffff;
+
+	if(cp.row < min_row || cp.row >= index->height || cp.row_start > cp.window_size) return LIBIMAGE_ERROR_BAD_INDEX;
+	if(cp.window_size > 2 * LIBIMAGE_PIPELINE_HISTORY_SIZE + 1 + index->row_bytes) return LIBIMAGE_ERROR_BAD_INDEX;
+	if(cp.code_buf_bits >= 64 || cp.final_block > 1 || cp.stored_remaining > 0xffff) return LIBIMAGE_ERROR_BAD_INDEX;
+	if(cp.state != LIBIMAGE_ZBUF_STATE_BLOCK_HEADER && cp.state != LIBIMAGE_ZBUF_STATE_STORED && cp.state != LIBIMAGE_ZBUF_STATE_HUFFMAN) return LIBIMAGE_ERROR_BAD_INDEX;
+	if(cp.block_type > 2 || (cp.block_type != 0) != (cp.state == LIBIMAGE_ZBUF_STATE_HUFFMAN)) return LIBIMAGE_ERROR_BAD_INDEX;
+	if(cp.block_type == 2) {
+		if(cp.lit_count < 257 || cp.lit_count > LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS) return LIBIMAGE_ERROR_BAD_INDEX;
+		if(cp.dist_count < 1 || cp.dist_count > LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS) return LIBIMAGE_ERROR_BAD_INDEX;
+		bytes = index_get_bytes(r, cp.lit_count + cp.dist_count);
+		if(bytes == NULL) return r->error;
+		for(i = 0; i < (uint32_t)cp.lit_count + cp.dist_count; i++) {
+			if(bytes[i] > LIBIMAGE_HUFFMAN_MAX_CODE_BITS) return LIBIMAGE_ERROR_BAD_INDEX;
+		}
+		memcpy(cp.code_lengths, bytes, cp.lit_count + cp.dist_count);
+	} else if(counts) {
+		return LIBIMAGE_ERROR_BAD_INDEX;
+	}
+	// Both are there before anything is allocated for them.
+	prev_row = index_get_bytes(r, index->row_bytes);
+	window	 = index_get_bytes(r, cp.window_size);
+	if(r->error) return r->error;
+
+	dst = index_checkpoint_alloc(index, cp.window_size);
+	if(dst == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	cp.prev_row = dst->prev_row;
+	cp.window   = dst->window;
+	*dst = cp;
+	memcpy(dst->prev_row, prev_row, index->row_bytes);
+	memcpy(dst->window, window, cp.window_size);
+	if(index_append(index, dst)) {
+		libimage_allocator_free(&index->allocator, dst);
+		return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	}
+	return 0;
+}
+
+/*
+*	Reads back what libimage_index_save wrote, nothing of it is trusted. Returns the index, from allocator ( malloc
+*	when NULL ), or NULL with *error set.
+*/
+LibImageIndex *libimage_index_load(const LibImageAllocator *allocator, const uint8_t *data, size_t size, int *error)
+{
+LibImageIndexReader	r;
+LibImageIndex		*index;
+const uint8_t		*bytes;
+uint32_t		interval, count, i;
+int			ret;
+
+	if(data == NULL) {
+		*error = LIBIMAGE_ERROR_INVALID_ARGUMENT;
+		return NULL;
+	}
+	memset(&r, 0, sizeof(r));
+	r.data = data;
+	r.size = size;
+	bytes  = index_get_bytes(&r, sizeof(index_magic));
+	if(bytes == NULL || memcmp(bytes, index_magic, sizeof(index_magic)) || index_get_u32(&r) != LIBIMAGE_INDEX_VERSION) {
+		*error = LIBIMAGE_ERROR_BAD_INDEX;
+		return NULL;
+	}
+	interval = index_get_u32(&r);
+	count	 = index_get_u32(&r);
+	if(r.error || interval == 0) {
+		*error = LIBIMAGE_ERROR_BAD_INDEX;
+		return NULL;
+	}
+	index = libimage_index_create(allocator, interval);
+	if(index == NULL) {
+		*error = allocator && (allocator->alloc == NULL || allocator->free == NULL) ? LIBIMAGE_ERROR_INVALID_ARGUMENT : LIBIMAGE_ERROR_OUT_OF_MEMORY;
+		return NULL;
+	}
+
+	bytes		   = index_get_bytes(&r, 4);
+	index->width	   = index_get_u32(&r);
+	index->height	   = index_get_u32(&r);
+	index->first_chunk = index_get_u64(&r);
+	index->first_crc   = index_get_u32(&r);
+	index->row_bytes   = index_get_u64(&r);
+	ret = r.error;
+	if(ret == 0) {
+		index->bound	  = bytes[0];
+		index->bit_depth  = bytes[1];
+		index->color_type = bytes[2];
+		if(index->bound > 1 || (count && !index->bound) || index->row_bytes > INT32_MAX) ret = LIBIMAGE_ERROR_BAD_INDEX;
+	}
+	for(i = 0; ret == 0 && i < count; i++) ret = index_load_checkpoint(index, &r, i ? index->checkpoints[i - 1]->row + 1 : 1);
+	if(ret == 0 && r.pos != r.size) ret = LIBIMAGE_ERROR_BAD_INDEX;
+	if(ret) {
+		libimage_index_destroy(index);
+		*error = ret;
+		return NULL;
+	}
+	*error = 0;
+	return index;
+}
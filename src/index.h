@@ -0,0 +1,77 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_INDEX_H__
+#define __LIB_IMAGE_INDEX_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "common.h"
+#include "arena.h"
+#include "png.h"
+#include "huffman.h"
+
+#define LIBIMAGE_INDEX_VERSION		1
+#define LIBIMAGE_INDEX_CHECKPOINTS	16	// Checkpoints the list starts with room for
+
+struct libimage_png_pipeline;
+
+/*
+*	Row index, where the row pipeline stood at some of the rows of an image that isn't interlaced: the reader in the
+*	IDAT chunks and the bits it had buffered, the state of the deflate block it was in, the window ( the history and
+*	the unfinished scanline ) and the unfiltered row above. A decode of a region takes the inflate up again at the
+*	last checkpoint above the region instead of at the start of the stream, and adds the checkpoints it goes past.
+*
+*	Checkpoints are only taken where inflate stops anyway, when the window is full, so they are at least interval
+*	rows apart but can be more for narrow images. Offsets are from the start of the file. The code lengths are
+*	kept for a dynamic block rather than its tables, they are built again on the way back in.
+*/
+typedef struct libimage_index_checkpoint {
+	uint32_t	row;			// First row not unfiltered yet, the one above is in prev_row
+	uint64_t	window_base;		// Inflated bytes before the window
+	uint32_t	window_size, row_start;
+	uint64_t	chunk;			// IDAT the reader is in
+	uint32_t	chunk_pos;		// Bytes of its payload that went to code_buf
+	uint64_t	code_buf;
+	uint32_t	code_buf_bits;
+	uint32_t	stored_remaining;
+	uint32_t	adler;			// Of the inflated bytes up to the end of the window
+	uint8_t		state, final_block;
+	uint8_t		block_type;		// 1 fixed, 2 dynamic when state is LIBIMAGE_ZBUF_STATE_HUFFMAN
+	uint16_t	lit_count, dist_count;
+	uint8_t		code_lengths[LIBIMAGE_DEFLATE_NUM_LITLEN_SYMBOLS + LIBIMAGE_DEFLATE_NUM_DIST_SYMBOLS];
+	uint8_t		*prev_row, *window;	// Right after the struct, in the same allocation
+} LibImageIndexCheckpoint;
+
+/*
+*	The image the checkpoints are for is told apart by its IHDR and its first IDAT, an index handed another file
+*	starts over for it.
+*/
+struct libimage_index {
+	LibImageAllocator	allocator;
+	uint32_t		interval;
+	uint8_t			bound;		// The fields below are set
+	uint32_t		width, height;
+	uint8_t			bit_depth, color_type;
+	uint64_t		first_chunk;
+	uint32_t		first_crc;
+	uint64_t		row_bytes;
+	LibImageIndexCheckpoint	**checkpoints;	// By row
+	uint32_t		count, capacity;
+};
+
+// What a decode knows of the index it goes through.
+typedef struct libimage_index_cursor {
+	LibImageIndex		*index;
+	LibImageDataReader	*reader;
+	uint64_t		chunk;		// Last IDAT found, the one of the next checkpoint is this one or later
+	uint8_t			failed;		// A checkpoint couldn't be taken, the index stays as it is
+} LibImageIndexCursor;
+
+void png_index_attach(LibImageIndexCursor *c, LibImageIndex *index, struct libimage_png_pipeline *p, LibImageDataReader *r, LibImagePngChunk *first_idat);
+void png_index_record(LibImageIndexCursor *c, struct libimage_png_pipeline *p);
+
+#endif
@@ -0,0 +1,63 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_JOB_H__
+#define __LIB_IMAGE_JOB_H__
+
+#include <inttypes.h>
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "pipeline.h"
+#include "convert.h"
+#include "scale.h"
+#include "index.h"
+
+/*
+*	Sink of the row pipeline for the whole-buffer decode, the rows of the region land at their place in
+*	processed_data. Interlaced images that get converted, scaled or cut to an x-window are put together in native
+*	first, each row is written out once its last pass is in.
+*/
+typedef struct libimage_png_store_target {
+	LibImageImageInfo	*info;
+	uint8_t			*native;
+	uint8_t			*out_row;	// Converted row of a streamed output
+	uint64_t		row_bytes;
+	LibImageScaleLane	lane;
+	uint32_t		next_row;	// First row of the region the scaler hasn't had
+} LibImagePngStoreTarget;
+
+enum {
+	LIBIMAGE_PNG_JOB_CHUNKS = 0,	// Walking the chunks, before the image data or after it
+	LIBIMAGE_PNG_JOB_ROWS,		// In the row pipeline
+	LIBIMAGE_PNG_JOB_DONE
+};
+
+/*
+*	Decode of a whole buffer that can stop between rows. Each png_job_step walks the chunks up to the image data,
+*	goes through rows scanlines of the row pipeline ( all of them when rows is zero ) and walks the chunks after
+*	the image data up to IEND once the pipeline is over. Decodes that keep the whole inflated stream run to the end
+*	of the image data in one step. The error is in the reader.
+*/
+typedef struct libimage_png_job {
+	LibImageImageInfo	*info;
+	LibImageDataReader	*reader;
+	LibImagePngWalk		walk;
+	int			state;		// LIBIMAGE_PNG_JOB_*
+	uint64_t		loop_count;
+	uint8_t			input_cut;	// The reader was cut at max_input_bytes
+	LibImageConverter	*converter;
+	LibImageScaler		*scaler;
+	LibImagePngPipeline	pipeline;
+	LibImagePngStoreTarget	sink;
+	LibImageIndexCursor	cursor;
+} LibImagePngJob;
+
+void png_job_init(LibImagePngJob *job, LibImageImageInfo *info, LibImageDataReader *r);
+int png_job_step(LibImagePngJob *job, uint32_t rows);
+void png_job_deinit(LibImagePngJob *job);
+
+#endif
@@ -11,13 +11,23 @@
 #include <string.h>
 #include <limits.h>
 #include <inttypes.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #include "common.h"
 #include "zlib.h"
 #include "png.h"
 #include "huffman.h"
+#include "arena.h"
+#include "decoder.h"
+#include "pool.h"
+#include "convert.h"
+#include "scale.h"
+#include "stats.h"
+#include "index.h"
 
-#define LIBIMAGE_DEBUG 1
 int check_data_header(LibImageDataReader *r)
 {
 	if(check_png_signature(r) == 0) {
@@ -62,6 +72,21 @@ char *msg;
 	case LIBIMAGE_ERROR_ZLIB_HEADER_CORRUPTED: msg= "Zlib header is corrupted."; break;
 	case LIBIMAGE_PNG_ERROR_CORRUPTED_FILE: msg = "PNG file is corrupted."; break;
 	case LIBIMAGE_PNG_ERROR_PRESET_DICT: msg = "PNG spec don't allow preset dict on zlib header."; break;
+	case LIBIMAGE_PNG_ERROR_DATA_OVERFLOW: msg = "Decompressed data is bigger than the image described by IHDR."; break;
+	case LIBIMAGE_PNG_ERROR_NOT_ENOUGH_DATA: msg = "Decompressed data is smaller than the image described by IHDR."; break;
+	case LIBIMAGE_ERROR_BUFFER_TOO_SMALL: msg = "Destination buffer is too small for the image."; break;
+	case LIBIMAGE_PNG_ERROR_TRUNCATED_DATA: msg = "Data ended before the end of the compressed stream or of the file."; break;
+	case LIBIMAGE_PNG_ERROR_BAD_FILTER: msg = "Scanline has an unknown filter type."; break;
+	case LIBIMAGE_ERROR_INVALID_ARGUMENT: msg = "Invalid argument or call out of order."; break;
+	case LIBIMAGE_PNG_ERROR_ADLER_NOT_MATCH: msg = "Inflated data has an adler32 that don't match the one at the end of the zlib stream."; break;
+	case LIBIMAGE_ERROR_FILE_READ: msg = "Could not open or map the file."; break;
+	case LIBIMAGE_ERROR_BAD_REGION: msg = "The region to decode is not inside the image."; break;
+	case LIBIMAGE_ERROR_NOT_BUILT_IN: msg = "The library was built without this feature."; break;
+	case LIBIMAGE_ERROR_BAD_INDEX: msg = "Row index data is truncated, corrupted or of another version."; break;
+	case LIBIMAGE_PNG_ERROR_UNKNOWN_CRITICAL: msg = "Data has a critical chunk this decoder doesn't know."; break;
+	case LIBIMAGE_ERROR_LIMIT_EXCEEDED: msg = "Decoding the image would go over a limit set on the decoder."; break;
+	case LIBIMAGE_ERROR_CANCELLED: msg = "The decode was cancelled."; break;
+	case LIBIMAGE_ERROR_DEADLINE: msg = "The decode ran past its time limit."; break;
 	default: msg = "Unknown error. RUN."; break;
 	}
 
@@ -71,48 +96,331 @@ char *msg;
 void libimage_free_info_ptrs(LibImageImageInfo *info)
 {
 	if(info->uncompressed_data) {
-		free(info->uncompressed_data);
+		libimage_scratch_free(info, info->uncompressed_data);
 		info->uncompressed_data = NULL;
 	}
 	if(info->processed_data) {
-		free(info->processed_data);
+		if(!info->out_external) libimage_output_free(info, info->processed_data);
 		info->processed_data = NULL;
 	}
-	if(info->compressed_data) {
-		free(info->compressed_data);
-		info->compressed_data = NULL;
+}
+
+// Sets the reader on the size bytes at data and checks the kind of file. Returns zero or the error.
+int libimage_reader_open(LibImageDataReader *reader, uint8_t *data, uint64_t size)
+{
+	reader->data 		= data;
+	reader->error		= 0;
+	reader->cursor 		= 0;
+	reader->peek_cursor	= 0;
+	reader->size		= size;
+	return check_data_header(reader) ? reader->error : 0;
+}
+
+// What a decode gives back once the reader is done, the image, or NULL with the error and nothing left allocated.
+void *libimage_decode_result(LibImageImageInfo *info, LibImageDataReader *reader, uint32_t *width, uint32_t *height, int *error)
+{
+uint32_t	out_width, out_height;
+
+	if(reader->error) {
+		if(error) *error = reader->error;
+		libimage_free_info_ptrs(info);	
+	} else {
+		png_output_dimensions(info, &out_width, &out_height);
+		if(width) 	*width = out_width;
+		if(height)	*height = out_height;
+		// Only the reconstructed image goes back to the caller.
+		libimage_scratch_free(info, info->uncompressed_data);
 	}
+
+	return info->processed_data;
 }
 
-void *libimage_process_data(uint8_t *data, uint32_t *width, unsigned int *height, int *error)
+static void *libimage_decode(LibImageImageInfo *info, uint8_t *data, uint64_t size, uint32_t *width, uint32_t *height, int *error)
 {
 LibImageDataReader	reader;
-LibImageImageInfo	info 	= {0};
 
 	if(width)  *width  = 0;
 	if(height) *height = 0;
 	if(error)  *error  = 0;
 
-	reader.data 		= data;
-	reader.error		= 0;
-	reader.cursor 		= 0;
-	reader.peek_cursor	= 0;
-
-	if(check_data_header(&reader)) {
+	if(libimage_reader_open(&reader, data, size)) {
 		if(error) *error = reader.error;
 		return NULL;
 	}
 
-	if(reader.type == LIBIMAGE_TYPE_PNG) libimage_process_png(&reader, &info);	
+	if(reader.type == LIBIMAGE_TYPE_PNG) libimage_process_png(&reader, info);	
 	else return NULL;
 
-	if(reader.error) {
-		if(error) *error = reader.error;
-		libimage_free_info_ptrs(&info);	
-	} else {
-		if(width) 	*width = info.width;
-		if(height)	*height = info.height;
+	return libimage_decode_result(info, &reader, width, height, error);
+}
+
+/*
+*	Decodes a whole file in memory, the chunks are walked as far as they say without a length to hold them to. Only
+*	for data that is known to be a whole file, libimage_decode_data is the one for anything else.
+*/
+void *libimage_process_data(char *data, unsigned int *width, unsigned int *height, int *error)
+{
+LibImageImageInfo	info 	= {0};
+
+	return libimage_decode(&info, (uint8_t*)data, UINT64_MAX, width, height, error);
+}
+
+// Same as libimage_process_data for the size bytes at data, a file cut short fails instead of being read past.
+void *libimage_decode_data(uint8_t *data, size_t size, uint32_t *width, uint32_t *height, int *error)
+{
+LibImageImageInfo	info 	= {0};
+
+	return libimage_decode(&info, data, size, width, height, error);
+}
+
+/*
+*	Decodes the file at path straight from a read only mapping of it, the IDAT payloads are inflated from the page
+*	cache without being copied. Every chunk is checked against the length of the file. The image is freed with free().
+*/
+void *libimage_decode_file(const char *path, uint32_t *width, uint32_t *height, int *error)
+{
+LibImageImageInfo	info 	= {0};
+struct stat		st;
+void			*map, *pixels;
+int			fd;
+
+	if(width)  *width  = 0;
+	if(height) *height = 0;
+	if(error)  *error  = 0;
+	if(path == NULL) {
+		if(error) *error = LIBIMAGE_ERROR_INVALID_ARGUMENT;
+		return NULL;
 	}
 
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0 || fstat(fd, &st) || st.st_size <= 0) {
+		if(fd >= 0) close(fd);
+		if(error) *error = LIBIMAGE_ERROR_FILE_READ;
+		return NULL;
+	}
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if(map == MAP_FAILED) {
+		if(error) *error = LIBIMAGE_ERROR_FILE_READ;
+		return NULL;
+	}
+	// Read once from the front to the back, the kernel can read ahead far and drop the pages behind.
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	madvise(map, st.st_size, MADV_WILLNEED);
+
+	pixels = libimage_decode(&info, map, st.st_size, width, height, error);
+	munmap(map, st.st_size);
+	return pixels;
+}
+
+LibImageDecoder *libimage_decoder_create(const LibImageAllocator *allocator)
+{
+LibImageAllocator	alloc;
+LibImageDecoder		*d;
+
+	if(allocator) alloc = *allocator;
+	else libimage_allocator_default(&alloc);
+	if(alloc.alloc == NULL || alloc.free == NULL) return NULL;
+
+	d = libimage_allocator_alloc(&alloc, sizeof(*d));
+	if(d == NULL) return NULL;
+	arena_init(&d->arena, &alloc);
+	d->thread_count = 1;
+	d->format	= LIBIMAGE_FORMAT_NATIVE;
+	libimage_decoder_set_region(d, 0, 0, 0, 0);
+	d->scale_shift	= 0;
+	d->parallel_inflate = 0;
+	d->skip_adler	= 0;
+	memset(&d->limits, 0, sizeof(d->limits));
+	d->stats	= NULL;
+	d->trace	= NULL;
+	d->trace_user	= NULL;
+	d->index	= NULL;
+	return d;
+}
+
+// What a decode of the decoder starts from.
+void libimage_decoder_info(LibImageDecoder *d, LibImageImageInfo *info)
+{
+	memset(info, 0, sizeof(*info));
+	info->arena	    = &d->arena;
+	info->thread_count  = d->thread_count;
+	info->output_format = d->format;
+	info->roi_x	    = d->roi_x;
+	info->roi_y	    = d->roi_y;
+	info->roi_width	    = d->roi_width;
+	info->roi_height    = d->roi_height;
+	info->scale_shift   = d->scale_shift;
+	info->parallel_inflate = d->parallel_inflate;
+	info->skip_adler    = d->skip_adler;
+	info->limits	    = d->limits;
+	if(d->limits.time_limit_ns) info->deadline_ns = libimage_stats_clock() + d->limits.time_limit_ns;
+	info->stats	    = d->stats;
+	info->trace	    = d->trace;
+	info->trace_user    = d->trace_user;
+	info->index	    = d->index;
+	if(info->stats) memset(info->stats, 0, sizeof(*info->stats));
+}
+
+/*
+*	Decodes the file of size bytes at data, nothing past them is read. The scratch of the decode comes from the arena
+*	of the decoder and the image from its allocator. The arena is reset after each decode, only the first image of a
+*	bigger size allocates scratch.
+*/
+void *libimage_decoder_decode(LibImageDecoder *d, uint8_t *data, size_t size, uint32_t *width, uint32_t *height, int *error)
+{
+LibImageImageInfo	info;
+
+	if(d == NULL) {
+		if(error) *error = LIBIMAGE_ERROR_INVALID_ARGUMENT;
+		return NULL;
+	}
+	libimage_decoder_info(d, &info);
+	libimage_decode(&info, data, size, width, height, error);
+	// The scratch is done with, a base block too small for this image grows now rather than on the next decode.
+	arena_reset(&d->arena);
 	return info.processed_data;
 }
+
+/*
+*	Same as libimage_decoder_decode, into out instead of an image from the allocator. The buffer is checked once
+*	the header gives the size, before any pixel is written. Returns zero or the error.
+*/
+int libimage_decoder_decode_into(LibImageDecoder *d, uint8_t *data, size_t size, const LibImageOutput *out, uint32_t *width, uint32_t *height)
+{
+LibImageImageInfo	info;
+int			error;
+
+	if(width)  *width  = 0;
+	if(height) *height = 0;
+	if(d == NULL || out == NULL || out->pixels == NULL || out->format >= LIBIMAGE_FORMAT_COUNT) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	if((out->flags & LIBIMAGE_OUTPUT_WRITE_COMBINED) && (out->flags & LIBIMAGE_OUTPUT_CACHED)) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	libimage_decoder_info(d, &info);
+	info.output_format  = out->format;
+	info.processed_data = out->pixels;
+	info.out_stride	    = out->stride;
+	info.out_capacity   = out->size;
+	info.out_external   = 1;
+	if(out->flags & LIBIMAGE_OUTPUT_WRITE_COMBINED) info.out_stream = 1;
+	else if(out->flags & LIBIMAGE_OUTPUT_CACHED) info.out_stream = 0;
+	else info.out_stream = LIBIMAGE_OUT_STREAM_AUTO;
+	libimage_decode(&info, data, size, width, height, &error);
+	arena_reset(&d->arena);
+	return error;
+}
+
+// Threads the next decodes can use, zero for one per online CPU.
+void libimage_decoder_set_threads(LibImageDecoder *d, uint32_t thread_count)
+{
+	if(d) d->thread_count = thread_count ? thread_count : libimage_pool_thread_count(0, LIBIMAGE_POOL_MAX_THREADS);
+}
+
+// Pixel format of the next decodes, LIBIMAGE_FORMAT_NATIVE by default. Returns zero or the error for an unknown one.
+int libimage_decoder_set_format(LibImageDecoder *d, uint32_t format)
+{
+	if(d == NULL || format >= LIBIMAGE_FORMAT_COUNT) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	d->format = format;
+	return 0;
+}
+
+// Part of the images the next decodes return, the whole image when width or height is zero ( the default ).
+void libimage_decoder_set_region(LibImageDecoder *d, uint32_t x, uint32_t y, uint32_t width, uint32_t height)
+{
+	if(d == NULL) return;
+	d->roi_x	= x;
+	d->roi_y	= y;
+	d->roi_width	= width;
+	d->roi_height	= height;
+}
+
+// Shrinks the next images to 1 / denominator of their size, 1 ( the default ), 2, 4 or 8. Returns zero or the error.
+int libimage_decoder_set_scale(LibImageDecoder *d, uint32_t denominator)
+{
+uint8_t	shift;
+
+	if(d == NULL || denominator == 0 || denominator & (denominator - 1)) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	for(shift = 0; (1u << shift) < denominator; shift++);
+	if(shift > LIBIMAGE_SCALE_MAX_SHIFT) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	d->scale_shift = shift;
+	return 0;
+}
+
+// Limits of the next decodes, NULL for none ( the default ). Returns zero or the error.
+int libimage_decoder_set_limits(LibImageDecoder *d, const LibImageLimits *limits)
+{
+	if(d == NULL) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	if(limits) d->limits = *limits;
+	else memset(&d->limits, 0, sizeof(d->limits));
+	return 0;
+}
+
+// Inflates streams cut by full flushes on the threads of the decoder, off by default.
+void libimage_decoder_set_parallel_inflate(LibImageDecoder *d, int enable)
+{
+	if(d) d->parallel_inflate = enable != 0;
+}
+
+/*
+*	Whether the next decodes check the Adler-32 at the end of the zlib stream, on by default. Inputs that are
+*	trusted, files the program wrote itself for instance, can skip it, the chunk CRCs are still checked.
+*/
+void libimage_decoder_set_verify_adler(LibImageDecoder *d, int verify)
+{
+	if(d) d->skip_adler = verify == 0;
+}
+
+/*
+*	Stats each of the next decodes fills in from zero, NULL to stop. Returns zero or LIBIMAGE_ERROR_NOT_BUILT_IN
+*	when the library was built without LIBIMAGE_STATS, the hooks are then not there at all.
+*/
+int libimage_decoder_set_stats(LibImageDecoder *d, LibImageStats *stats)
+{
+	if(d == NULL) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+#ifdef LIBIMAGE_STATS
+	d->stats = stats;
+	return 0;
+#else
+	(void)stats;
+	return LIBIMAGE_ERROR_NOT_BUILT_IN;
+#endif
+}
+
+// Called from the decoding thread at the start and the end of every stage of the next decodes, NULL to stop.
+int libimage_decoder_set_trace(LibImageDecoder *d, LibImageTraceCallback trace, void *user)
+{
+	if(d == NULL) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+#ifdef LIBIMAGE_STATS
+	d->trace      = trace;
+	d->trace_user = user;
+	return 0;
+#else
+	(void)trace;
+	(void)user;
+	return LIBIMAGE_ERROR_NOT_BUILT_IN;
+#endif
+}
+
+/*
+*	Row index the next decodes start from and add to, NULL to stop. It stays the caller's and is only touched while
+*	a decode of the decoder runs.
+*/
+void libimage_decoder_set_index(LibImageDecoder *d, LibImageIndex *index)
+{
+	if(d) d->index = index;
+}
+
+// Gives back an image returned by libimage_decoder_decode.
+void libimage_decoder_free_image(LibImageDecoder *d, void *pixels)
+{
+	if(d) libimage_allocator_free(&d->arena.allocator, pixels);
+}
+
+void libimage_decoder_destroy(LibImageDecoder *d)
+{
+LibImageAllocator alloc;
+
+	if(d == NULL) return;
+	alloc = d->arena.allocator;
+	arena_deinit(&d->arena);
+	libimage_allocator_free(&alloc, d);
+}
@@ -0,0 +1,50 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <inttypes.h>
+
+#include "common.h"
+#include "log.h"
+
+// One sink for the whole library, set before decoding. The level is read on its own so no sink is a single load.
+static LibImageLogSink	log_sink;
+static void		*log_user;
+static int		log_level = -1;
+
+/*
+*	Sends the messages up to level to sink, NULL to drop them all ( the default ). sink can be called from any
+*	thread that decodes. Returns zero or LIBIMAGE_ERROR_NOT_BUILT_IN for RELEASE builds, which have no messages.
+*/
+int libimage_set_log_sink(LibImageLogSink sink, void *user, int level)
+{
+#ifdef RELEASE
+	(void)sink;
+	(void)user;
+	(void)level;
+	return LIBIMAGE_ERROR_NOT_BUILT_IN;
+#else
+	if(sink && (level < LIBIMAGE_LOG_ERROR || level > LIBIMAGE_LOG_DEBUG)) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	__atomic_store_n(&log_level, -1, __ATOMIC_RELEASE);
+	log_sink = sink;
+	log_user = user;
+	if(sink) __atomic_store_n(&log_level, level, __ATOMIC_RELEASE);
+	return 0;
+#endif
+}
+
+void libimage_log(int level, const char *fmt, ...)
+{
+char	message[LIBIMAGE_LOG_MESSAGE_SIZE];
+va_list	va;
+
+	if(level > __atomic_load_n(&log_level, __ATOMIC_ACQUIRE)) return;
+	va_start(va, fmt);
+	vsnprintf(message, sizeof(message), fmt, va);
+	va_end(va);
+	log_sink(log_user, level, message);
+}
@@ -0,0 +1,28 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_LOG_H__
+#define __LIB_IMAGE_LOG_H__
+
+#include <inttypes.h>
+#include "common.h"
+
+// A message goes out when its LIBIMAGE_LOG_* level is at most the sink's.
+#define LIBIMAGE_LOG_MESSAGE_SIZE	256	// Longer messages are cut
+
+/*
+*	Messages only exist in builds without RELEASE, there the arguments aren't even evaluated. Without a sink, the
+*	default, a message costs the level check and nothing is formatted.
+*/
+#ifdef RELEASE
+#define LIBIMAGE_LOG(level, ...)	((void)0)
+#else
+#define LIBIMAGE_LOG(level, ...)	libimage_log((level), __VA_ARGS__)
+#endif
+
+void libimage_log(int level, const char *fmt, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
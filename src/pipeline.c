@@ -0,0 +1,206 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "huffman.h"
+#include "filter.h"
+#include "pipeline.h"
+#include "arena.h"
+#include "stats.h"
+#include "index.h"
+
+static void pipeline_next_pass(LibImagePngPipeline *p)
+{
+	for(p->pass++; p->pass < p->pass_count; p->pass++) {
+		if(p->info->interlace_method) {
+			png_adam7_pass_size(p->info, p->pass, &p->pass_width, &p->pass_height);
+		} else {
+			p->pass_width	= p->info->width;
+			p->pass_height	= p->info->height;
+		}
+		if(p->pass_width && p->pass_height) break;
+	}
+	p->pass_y	   = 0;
+	p->pass_row_bytes  = p->pass < p->pass_count ? png_row_bytes(p->info, p->pass_width) : 0;
+	p->pass_keep_bytes = 0;
+	if(p->pass < p->pass_count) {
+		p->pass_keep_bytes = png_row_bytes(p->info, p->info->interlace_method ? png_adam7_pass_columns(p->pass, p->end_x) : p->end_x);
+	}
+	// The first scanline of a pass is filtered against zeros.
+	memset(p->prev_row, 0, p->pass_row_bytes);
+}
+
+// Unfilters and hands over every complete scanline sitting in the window.
+static int pipeline_emit_rows(LibImagePngPipeline *p)
+{
+uint8_t		*line, *swap;
+uint32_t	y, step_y;
+int		ret;
+
+	while(p->pass < p->pass_count && p->info->un_offset - p->row_start >= 1 + p->pass_row_bytes) {
+		if(p->yield_rows && p->yield_count++ == p->yield_rows) {
+			p->yielded = 1;
+			return 0;
+		}
+		line   = p->info->uncompressed_data + p->row_start;
+		step_y = p->info->interlace_method ? png_adam7_step_y[p->pass] : 1;
+		y      = p->info->interlace_method ? png_adam7_start_y[p->pass] + p->pass_y * step_y : p->pass_y;
+
+		// The rows of a pass below the region are only filtered against each other.
+		if(y < p->end_y) {
+			ret = png_unfilter_row(p->row, line + 1, p->prev_row, p->pass_keep_bytes, p->bpp, line[0]);
+			if(ret) return ret;
+			LIBIMAGE_STAT_ADD(p->info, filter_rows[line[0]], 1);
+			p->sink(p->sink_user, p->row, p->pass_keep_bytes, y, p->info->interlace_method ? p->pass : 0);
+
+			swap		= p->prev_row;
+			p->prev_row	= p->row;
+			p->row		= swap;
+		}
+		p->row_start += 1 + p->pass_row_bytes;
+		// The rest of the stream holds nothing of the region, it is neither inflated nor checked.
+		if(p->end_y < p->info->height && p->pass == p->last_pass && y + step_y >= p->end_y) {
+			p->done = 1;
+			return 0;
+		}
+		if(++p->pass_y == p->pass_height) pipeline_next_pass(p);
+	}
+	return 0;
+}
+
+// Drops what neither the history nor the unfinished scanline needs anymore.
+static void pipeline_slide_window(LibImagePngPipeline *p)
+{
+LibImageImageInfo	*info = p->info;
+off_t			keep_from;
+
+	keep_from = info->un_offset > LIBIMAGE_PIPELINE_HISTORY_SIZE ? info->un_offset - LIBIMAGE_PIPELINE_HISTORY_SIZE : 0;
+	if(keep_from > p->row_start) keep_from = p->row_start;
+
+	memmove(info->uncompressed_data, info->uncompressed_data + keep_from, info->un_offset - keep_from);
+	info->un_offset	-= keep_from;
+	p->zbuf.adler_offset -= keep_from;
+	p->row_start	-= keep_from;
+	p->window_base	+= keep_from;
+	info->un_size	 = p->total_size - p->window_base < p->window_size ? p->total_size - p->window_base : p->window_size;
+}
+
+/*
+*	Sets up the window and the rows for the image IHDR described. The window is the history, a whole scanline past
+*	it and as much again so it doesn't slide on every row, or the whole image when that is smaller.
+*/
+int png_pipeline_init(LibImagePngPipeline *p, LibImageImageInfo *info, LibImagePngRowSink sink, void *user)
+{
+uint64_t	row_bytes, window_size;
+uint32_t	width, height;
+int		ret;
+
+	memset(p, 0, sizeof(*p));
+	ret = png_region_init(info);
+	if(ret) return ret;
+	p->info		= info;
+	p->sink		= sink;
+	p->sink_user	= user;
+	p->total_size	= png_uncompressed_size(info);
+	row_bytes	= png_row_bytes(info, info->width);
+	if(p->total_size > PTRDIFF_MAX || row_bytes > INT32_MAX) return LIBIMAGE_PNG_ERROR_BIG_IMAGE;
+
+	window_size	= 2 * LIBIMAGE_PIPELINE_HISTORY_SIZE + 1 + row_bytes;
+	p->window_size	= p->total_size < window_size ? p->total_size : window_size;
+	info->uncompressed_data = libimage_scratch_alloc(info, p->window_size);
+	p->row_block	= libimage_scratch_alloc(info, 2 * row_bytes + 2);
+	if(info->uncompressed_data == NULL || p->row_block == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+
+	info->un_offset		= 0;
+	info->un_size		= p->window_size;
+	p->row			= p->row_block;
+	p->prev_row		= p->row_block + row_bytes + 1;
+	p->bpp			= png_filter_bpp(info);
+	p->end_x		= info->roi_x + info->roi_width;
+	p->end_y		= info->roi_y + info->roi_height;
+	p->pass			= -1;
+	p->pass_count		= info->interlace_method ? LIBIMAGE_PNG_ADAM7_PASSES : 1;
+	for(p->last_pass = p->pass_count - 1; p->last_pass > 0; p->last_pass--) {
+		png_adam7_pass_size(info, p->last_pass, &width, &height);
+		if(width && height) break;
+	}
+	pipeline_next_pass(p);
+
+	zbuf_init(&p->zbuf, NULL, 0, 0);
+	png_init_inflate_tables(&p->tables);
+	p->zbuf.tables = &p->tables;
+	return 0;
+}
+
+/*
+*	Inflates as far as the input goes, emitting rows on the way. Returns LIBIMAGE_ZBUF_NEED_INPUT or
+*	LIBIMAGE_ZBUF_DONE, or LIBIMAGE_ZBUF_FAILED with the error in info->error. Input can be added between calls.
+*	With yield_rows set it returns LIBIMAGE_PIPELINE_YIELD once that many scanlines went by, the next call goes on
+*	with the scanlines that were already inflated.
+*/
+int png_pipeline_run(LibImagePngPipeline *p)
+{
+LibImageImageInfo	*info = p->info;
+int			status, ret;
+
+	if(p->done) return LIBIMAGE_ZBUF_DONE;
+	p->yield_count = 0;
+	if(p->yielded) {
+		p->yielded = 0;
+		status	   = p->yield_status;
+	} else {
+		zbuf_drop_overrun(&p->zbuf);
+		status = png_inflate(&p->zbuf, info);
+	}
+	while(1) {
+		if(status == LIBIMAGE_ZBUF_FAILED) return status;
+		ret = pipeline_emit_rows(p);
+		if(ret) {
+			info->error = ret;
+			return LIBIMAGE_ZBUF_FAILED;
+		}
+		if(p->done) return LIBIMAGE_ZBUF_DONE;
+		if(p->yielded) {
+			p->yield_status = status;
+			return LIBIMAGE_PIPELINE_YIELD;
+		}
+		if(status != LIBIMAGE_ZBUF_OUTPUT_FULL) break;
+		if(p->index) png_index_record(p->index, p);
+
+		if(p->window_base + info->un_size == p->total_size) {
+			info->error = LIBIMAGE_PNG_ERROR_DATA_OVERFLOW;
+			return LIBIMAGE_ZBUF_FAILED;
+		}
+		pipeline_slide_window(p);
+		status = png_inflate(&p->zbuf, info);
+	}
+
+	if(status == LIBIMAGE_ZBUF_DONE) {
+		p->done = 1;
+		if(p->window_base + info->un_offset != p->total_size) {
+			info->error = LIBIMAGE_PNG_ERROR_NOT_ENOUGH_DATA;
+			return LIBIMAGE_ZBUF_FAILED;
+		}
+	}
+	return status;
+}
+
+void png_pipeline_deinit(LibImagePngPipeline *p)
+{
+	zbuf_deinit(&p->zbuf);
+	libimage_scratch_free(p->info, p->info->uncompressed_data);
+	p->info->uncompressed_data = NULL;
+	p->info->un_offset = p->info->un_size = 0;
+	libimage_scratch_free(p->info, p->row_block);
+	p->row_block = NULL;
+}
@@ -0,0 +1,63 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_PIPELINE_H__
+#define __LIB_IMAGE_PIPELINE_H__
+
+#include <inttypes.h>
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "huffman.h"
+
+/*
+*	Row pipeline, inflates into a window that only holds the LZ77 history and the scanline being completed. Every
+*	scanline is unfiltered as soon as it is whole and handed to the sink while it is still in cache, so the inflated
+*	image never exists as a whole.
+*
+*	The sink gets the reconstructed row without the filter byte, in the sample layout of the file. y is the row of
+*	the full image, pass the Adam7 pass ( 0 to 6 ) of an interlaced image and 0 otherwise. When info has a region
+*	set the rows are only reconstructed up to the pixels of its right edge ( row_size bytes ), rows below it are
+*	never handed over and the inflate stops once the last one of them is done.
+*/
+typedef void (*LibImagePngRowSink)(void *user, const uint8_t *row, uint32_t row_size, uint32_t y, int pass);
+
+#define LIBIMAGE_PIPELINE_HISTORY_SIZE	Kilo(32)	// Farthest a deflate match can reach back
+#define LIBIMAGE_PIPELINE_YIELD		(LIBIMAGE_ZBUF_FAILED + 1)	// png_pipeline_run handed over yield_rows scanlines
+
+struct libimage_index_cursor;
+
+typedef struct libimage_png_pipeline {
+	LibImageImageInfo	*info;		// uncompressed_data is the window
+	LibImageZlibBuffer	zbuf;		// Input is set up by the caller
+	LibImageInflateTables	tables;
+	LibImagePngRowSink	sink;
+	void			*sink_user;
+
+	uint64_t		total_size;	// Inflated size of the image
+	uint64_t		window_base;	// Inflated bytes that left the window
+	off_t			window_size;
+	off_t			row_start;	// First byte of the window not turned into a row yet
+
+	uint8_t			*row_block, *row, *prev_row;
+	uint32_t		bpp;
+	uint32_t		end_x, end_y;	// Right and bottom edges of the region, nothing past them is needed
+	int			pass, pass_count, last_pass;
+	uint32_t		pass_width, pass_height, pass_y;
+	uint64_t		pass_row_bytes, pass_keep_bytes;
+	uint8_t			done;
+	uint32_t		yield_rows;	// Scanlines a run goes through before it stops, all of them when zero
+	uint32_t		yield_count;
+	int			yield_status;	// Of the inflate whose scanlines are still in the window
+	uint8_t			yielded;
+	struct libimage_index_cursor *index;	// Takes checkpoints on the way when set, see index.h
+} LibImagePngPipeline;
+
+int png_pipeline_init(LibImagePngPipeline *p, LibImageImageInfo *info, LibImagePngRowSink sink, void *user);
+int png_pipeline_run(LibImagePngPipeline *p);
+void png_pipeline_deinit(LibImagePngPipeline *p);
+
+#endif
@@ -10,74 +10,37 @@
 #include <string.h>
 #include <inttypes.h>
 #include <limits.h>
+#include <stdint.h>
 
 #include "common.h"
 #include "zlib.h"
 #include "png.h"
 #include "huffman.h"
+#include "huffman_fixed.h"
+#include "filter.h"
+#include "pipeline.h"
+#include "crc32.h"
+#include "adler32.h"
+#include "arena.h"
+#include "adam7.h"
+#include "convert.h"
+#include "scale.h"
+#include "split.h"
+#include "stats.h"
+#include "log.h"
+#include "index.h"
+#include "cpu.h"
+#include "job.h"
 
-#define IDAT_DEFAULT_BLOCK_SIZE		4096
 #define MAXIMUM_LOOP_ALLOWED		UINT64_MAX - 1
 #define LIBIMAGE_DEFLATE_COMPRESSION 0
 
-/**
-*    CRC algorithm
-*
-*    Chunk CRCs are calculated using standard CRC methods with pre and post conditioning, as defined by ISO 3309 [ISO-3309] or ITU-T V.42 [ITU-T-V42]. 
-*    The CRC polynomial employed is x^32+x^26+x^23+x^22+x^16+x^12+x^11+x^10+x^8+x^7+x^5+x^4+x^2+x+1
-*
-*    The 32-bit CRC register is initialized to all 1's, and then the data from each byte is processed from the least significant bit (1) to the most significant bit (128). 
-*    After all the data bytes are processed, the CRC register is inverted (its ones complement is taken). 
-*    This value is transmitted (stored in the file) MSB first. For the purpose of separating into bytes and ordering, the least significant bit of the 32-bit CRC is defined 
-*    to be the coefficient of the x31 term. 
-**/
-
-#define CRC_POLYNOMIAL 		0xebd88320
-#define MAX_CRC_TABLE_VALUE	256
-#define ALL_32_BITS_SET		0xffffffffL
-
-/* Table of CRCs of all 8-bit messages. */
-static uint32_t crc_table[256];
-/* Flag: has the table been computed? Initially false. */
-static int crc_table_computed = 0;
-/* Make the table for a fast CRC. */
-void make_crc_table(void)
-{
-uint32_t 	c;
-int 		n, k;
-
-	for (n = 0; n < MAX_CRC_TABLE_VALUE; n++) {
-		c = (uint32_t) n;
-		for (k = 0; k < 8; k++) {
-			c = c & 1 ? (c >> 1) ^ CRC_POLYNOMIAL : c >> 1;
-		}
-		crc_table[n] = c;
-	}
-	crc_table_computed = 1;
-}
-   
-/* 
-* 	Based on the Annex D code of the PNG Spec And zlib
-*/
-uint32_t crc(uint8_t *buf, int len)
-{
-uint32_t result;
-int	 n;
-	if (!crc_table_computed)
-		make_crc_table();
-
-	result = ALL_32_BITS_SET;
-	for(int n = 0 ; n < len; n++) {
-		result = crc_table[(result ^ buf[n]) & 0xff] ^ (result >> 8);	
-	}
-
-	result = (result ^ ALL_32_BITS_SET);
-	result = u32_endian_swap(result);
-	return result;
-}
-
 static uint8_t png_file_sig[]   = { 0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a };
-static LibImageHuffmanEntry png_length_from_spec[] =
+const uint8_t png_adam7_start_x[LIBIMAGE_PNG_ADAM7_PASSES] = { 0, 4, 0, 2, 0, 1, 0 };
+const uint8_t png_adam7_start_y[LIBIMAGE_PNG_ADAM7_PASSES] = { 0, 0, 4, 0, 2, 0, 1 };
+const uint8_t png_adam7_step_x[LIBIMAGE_PNG_ADAM7_PASSES]  = { 8, 8, 4, 4, 2, 2, 1 };
+const uint8_t png_adam7_step_y[LIBIMAGE_PNG_ADAM7_PASSES]  = { 8, 8, 8, 4, 4, 2, 2 };
+static LibImageDeflateSpecEntry png_length_from_spec[] =
 {
     {3, 0}, //  257
     {4, 0}, //  258
@@ -109,7 +72,7 @@ static LibImageHuffmanEntry png_length_from_spec[] =
     {227, 5}, //  284
     {258, 0}, //  285
 };
-static LibImageHuffmanEntry png_dist_from_spec[] =
+static LibImageDeflateSpecEntry png_dist_from_spec[] =
 {
     {1, 0}, //  0
     {2, 0}, //  1
@@ -143,134 +106,118 @@ static LibImageHuffmanEntry png_dist_from_spec[] =
     {24577, 13}, //  29
 };
 
-LibImageHuffman new_huffman(int max_code_in_bits)
-{
-LibImageHuffman huff;
-	
-	huff.max_code_in_bits = max_code_in_bits;
-	huff.entry_count = 1 << max_code_in_bits;
-	huff.entries = malloc(sizeof(struct libimage_huffman_entry) * huff.entry_count);
-
-	return huff;
-}
-
-LibImageHuffman free_huffman_entries(LibImageHuffman *huff)
+/*
+*	Decodes symbols of the current block into the output until its end of block code. Stops in front of a symbol when
+*	its bits are not all there or its output doesn't fit, with the reader put back as it was before that symbol.
+*/
+int decompress_huffman_block(LibImageZlibBuffer *buf, LibImageImageInfo *info)
 {
-	if(huff->entries) free(huff->entries);
-}
+LibImageZlibCheckpoint	checkpoint;
+const LibImageHuffman	*lit_huff, *dist_huff;
+uint32_t		lit_len, distance, encoded_len, actual_len;
+uint8_t			*out, *out_end;
+LibImageDeflateSpecEntry len_from_spec, dist_from_spec;
+int			status;
+#ifdef LIBIMAGE_STATS
+uint64_t		literals = 0, matches = 0, match_bytes = 0;
+#endif
 
-void decompress_huffman_block(LibImageZlibBuffer *buf, LibImageImageInfo *info, int size_lit, int size_dist)
-{
-LibImageHuffman 	lit_huff, dist_huff;
-uint32_t		lit_len, extra_bits, distance, encoded_len, actual_len;
-uint8_t			decompressed, *source;
-LibImageHuffmanEntry	len_from_spec, dist_from_spec;
+	lit_huff 	= buf->tables->lit;
+	dist_huff	= buf->tables->dist;
 
-	lit_huff 	= new_huffman(15);
-	dist_huff	= new_huffman(15);
-	build_huffman(buf, &lit_huff, buf->sliding_window, size_lit);
-	build_huffman(buf, &dist_huff, buf->sliding_window + size_lit, size_dist);
+	out	= info->uncompressed_data + info->un_offset;
+	out_end = info->uncompressed_data + info->un_size;
+	status	= LIBIMAGE_ZBUF_OK;
 
 	while(1) {
-		lit_len = decode_huffman(&lit_huff, buf);
+		zbuf_save(buf, &checkpoint);
+		lit_len = decode_huffman(lit_huff, buf);
 		if(lit_len <= 255) {
-			decompressed = (lit_len & 0xFF);
-			write_uncompressed_data(buf, info, 1, &decompressed);
-		} else if(lit_len >= 257) {
-			encoded_len = (lit_len - 257);
-			len_from_spec = png_length_from_spec[encoded_len];
-			actual_len = len_from_spec.code;
-			if(len_from_spec.bits_used > 0) {
-				extra_bits = zbuf_get_n_bits(buf, len_from_spec.bits_used);
-				actual_len += extra_bits;
+			if(zbuf_is_overrun(buf)) {
+				status = LIBIMAGE_ZBUF_NEED_INPUT;
+				break;
 			}
-
-			encoded_len = decode_huffman(&dist_huff, buf);
-			dist_from_spec = png_dist_from_spec[encoded_len];
-			
-			distance = dist_from_spec.code;
-			if(dist_from_spec.bits_used > 0) {
-				extra_bits = zbuf_get_n_bits(buf, dist_from_spec.bits_used);
-				distance += extra_bits;
+			if(out >= out_end) {
+				status = LIBIMAGE_ZBUF_OUTPUT_FULL;
+				break;
 			}
-
-			source = (info->uncompressed_data + info->un_offset) - distance;
-			while(actual_len--) {
-				write_uncompressed_data(buf, info, 1, source);
+			*out++ = (uint8_t)lit_len;
+#ifdef LIBIMAGE_STATS
+			literals++;
+#endif
+			continue;
+		}
+		if(lit_len == 256) {
+			if(zbuf_is_overrun(buf)) {
+				status = LIBIMAGE_ZBUF_NEED_INPUT;
+				break;
 			}
-		} else {
+			buf->state = LIBIMAGE_ZBUF_STATE_BLOCK_HEADER;
 			break;
 		}
-	}
-
-	free_huffman_entries(&dist_huff);
-	free_huffman_entries(&lit_huff);
-}
-
-void build_huffman(LibImageZlibBuffer *buf, LibImageHuffman *huff, uint8_t *code_len_bits, int size_code_len_bits)
-{
-int      		i, next_code[19], c_len_bits, code_len_hist[19];
-uint32_t 		code, shift_bits, symbol, big_endian_index, entry_index, actual_index, entry_count;
-LibImageHuffmanEntry 	*entry;
-
-	memset(next_code, 0, sizeof(int) * 19);
-	memset(code_len_hist, 0, sizeof(int) * 19);
 
-	for(i = 0; i < size_code_len_bits; i++) {
-		code_len_hist[code_len_bits[i]]++;
-	}
+		// Bad codes read from the padding are only missing input.
+		encoded_len = lit_len - 257;
+		if(encoded_len >= STATIC_ARRAY_SIZE(png_length_from_spec)) {
+			status = zbuf_is_overrun(buf) ? LIBIMAGE_ZBUF_NEED_INPUT : LIBIMAGE_ZBUF_FAILED;
+			break;
+		}
+		len_from_spec = png_length_from_spec[encoded_len];
+		actual_len = len_from_spec.base + zbuf_get_n_bits(buf, len_from_spec.extra_bits);
 
-	code_len_hist[0] = 0;
-	for(i = 1; i < STATIC_ARRAY_SIZE(next_code); i++) {
-		next_code[i] = next_code[i - 1] + (code_len_hist[i - 1] << 1);
-	}
+		encoded_len = decode_huffman(dist_huff, buf);
+		if(encoded_len >= STATIC_ARRAY_SIZE(png_dist_from_spec)) {
+			status = zbuf_is_overrun(buf) ? LIBIMAGE_ZBUF_NEED_INPUT : LIBIMAGE_ZBUF_FAILED;
+			break;
+		}
+		dist_from_spec = png_dist_from_spec[encoded_len];
+		distance = dist_from_spec.base + zbuf_get_n_bits(buf, dist_from_spec.extra_bits);
 
-	for(i = 0; i < size_code_len_bits; i++) {
-		c_len_bits = code_len_bits[i];
-		if(c_len_bits > 0) {
-			code = next_code[c_len_bits]++;
-			shift_bits  = (huff->max_code_in_bits - c_len_bits);
-			entry_count = 1 << shift_bits;
-			for(entry_index = 0; entry_index < entry_count; entry_index++) {
-				big_endian_index = (code << shift_bits) | entry_index;
-				actual_index = bit_reverse(big_endian_index, huff->max_code_in_bits);
-				entry = huff->entries + actual_index;
-				symbol = i;
-				entry->bits_used = c_len_bits;
-				entry->code    = symbol;
-			}
+		if(zbuf_is_overrun(buf)) {
+			status = LIBIMAGE_ZBUF_NEED_INPUT;
+			break;
 		}
+		if(distance > out - info->uncompressed_data) {
+			status = LIBIMAGE_ZBUF_FAILED;
+			break;
+		}
+		// One bounds check for the whole match, the wide copy only while its slack still fits.
+		if(out_end - out < actual_len) {
+			status = LIBIMAGE_ZBUF_OUTPUT_FULL;
+			break;
+		}
+		if(out_end - out >= actual_len + LIBIMAGE_ZBUF_COPY_SLACK) zbuf_copy_match(out, distance, actual_len);
+		else zbuf_copy_match_exact(out, distance, actual_len);
+		out += actual_len;
+#ifdef LIBIMAGE_STATS
+		matches++;
+		match_bytes += actual_len;
+#endif
 	}
-}
 
-uint32_t decode_huffman(LibImageHuffman *huff, LibImageZlibBuffer *buf)
-{
-uint32_t entry_index;
-
-	entry_index = zbuf_get_n_bits(buf, huff->max_code_in_bits);
-	return huff->entries[entry_index].code;
+	if(status == LIBIMAGE_ZBUF_NEED_INPUT || status == LIBIMAGE_ZBUF_OUTPUT_FULL) zbuf_restore(buf, &checkpoint);
+	if(status == LIBIMAGE_ZBUF_FAILED) info->error = LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+	info->un_offset = out - info->uncompressed_data;
+	// Counted in registers, a symbol rolled back was never counted.
+	LIBIMAGE_STAT_ADD(info, literals, literals);
+	LIBIMAGE_STAT_ADD(info, matches, matches);
+	LIBIMAGE_STAT_ADD(info, match_bytes, match_bytes);
+	return status;
 }
 
 void print_ihdr(LibImagePngIHdr *h)
 {
-	printf("Width  %x\n", 		h->width);
-	printf("Height %x\n", 		h->height);
-	printf("Bit depth %x\n", 	h->bit_depth);
-	printf("Color type %x\n", 	h->colour_type);
-	printf("Compression method %x\n", h->compression_method);
-	printf("Filter method %x\n", h->filter_method);
-	printf("Interlace method %x\n", h->interlace_method);
+	(void)h;
+	LIBIMAGE_LOG(LIBIMAGE_LOG_DEBUG, "IHDR width %u height %u bit depth %u colour type %u compression %u filter %u interlace %u",
+		h->width, h->height, h->bit_depth, h->colour_type, h->compression_method, h->filter_method, h->interlace_method);
 }
 
 int check_png_signature(LibImageDataReader *r)
 {
-uint64_t sig_to_check, correct_sig;
-	correct_sig 	= *(uint64_t*)png_file_sig;
-	sig_to_check	= *(uint64_t*)r->data;	
-
-	if(sig_to_check != sig_to_check) return -1;
+	if(reader_bytes_left(r) < sizeof(png_file_sig)) return -1;
+	if(memcmp(read_from_reader(r), png_file_sig, sizeof(png_file_sig))) return -1;
 
-	consume_bytes(r, sizeof(correct_sig));
+	consume_bytes(r, sizeof(png_file_sig));
 	return 0;
 }
 
@@ -278,16 +225,18 @@ int validate_ihdr(LibImagePngIHdr *h, LibImageImageInfo *i)
 {
 	if(h == NULL) return 0;
 	
-	if(h->colour_type < PNG_COLOR_TYPE_GREYSCALE && h->colour_type > PNG_COLOR_TYPE_TRUE_COLOUR_WITH_ALPHA) return LIBIMAGE_PNG_ERROR_IHDR_COLOUR_TYPE;
+	if(h->colour_type > PNG_COLOR_TYPE_TRUE_COLOUR_WITH_ALPHA) return LIBIMAGE_PNG_ERROR_IHDR_COLOUR_TYPE;
 	if(h->colour_type == 1 || h->colour_type == 5) return LIBIMAGE_PNG_ERROR_IHDR_COLOUR_TYPE;
 
-	if(h->bit_depth > 16 && h->bit_depth < 1) return LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH;
+	if(h->bit_depth > 16 || h->bit_depth < 1) return LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH;
 	if(h->bit_depth != 1 && h->bit_depth & 1) return LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH;
-	if(h->interlace_method < 0 && h->interlace_method > 1) return LIBIMAGE_PNG_ERROR_IHDR_INTERLACE;
+	if(h->interlace_method > 1) return LIBIMAGE_PNG_ERROR_IHDR_INTERLACE;
+	if(h->compression_method != 0) return LIBIMAGE_PNG_ERROR_ZLIB_COMPRESSION;
+	if(h->filter_method != 0) return LIBIMAGE_PNG_ERROR_CORRUPT_IHDR;
 
 	switch(h->colour_type) {
 		case PNG_COLOR_TYPE_GREYSCALE: {
-			if(h->bit_depth != 1 && (IS_POWER_OF_TWO(h->bit_depth) == 0)) return LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH_COMBINATION;
+			if(IS_POWER_OF_TWO(h->bit_depth) == 0) return LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH_COMBINATION;
 
 		} break;
 		case PNG_COLOR_TYPE_TRUE_COLOUR_WITH_ALPHA:
@@ -296,121 +245,300 @@ int validate_ihdr(LibImagePngIHdr *h, LibImageImageInfo *i)
 			if(h->bit_depth != 8 && h->bit_depth != 16) return LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH_COMBINATION;
 		} break;
 		case PNG_COLOR_TYPE_INDEXED_COLOUR: {
-			if(h->bit_depth != 1 && h->bit_depth > 8 && (IS_POWER_OF_TWO(h->bit_depth) == 0)) return LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH_COMBINATION;
+			if(h->bit_depth > 8 || (IS_POWER_OF_TWO(h->bit_depth) == 0)) return LIBIMAGE_PNG_ERROR_IHDR_BIT_DEPTH_COMBINATION;
 		} break;
 	}
 
-	i->color_type = h->colour_type;
+	i->color_type 		= h->colour_type;
+	i->bit_depth		= h->bit_depth;
+	i->interlace_method	= h->interlace_method;
+	return 0;
+}
+
+int png_channel_count(uint8_t colour_type)
+{
+	switch(colour_type) {
+		case PNG_COLOR_TYPE_TRUECOLOUR: 		return 3;
+		case PNG_COLOR_TYPE_GREYSCALE_WITH_ALPHA: 	return 2;
+		case PNG_COLOR_TYPE_TRUE_COLOUR_WITH_ALPHA: 	return 4;
+		default: 					return 1;
+	}
+}
+
+// Bytes of a scanline without the filter type byte.
+uint64_t png_row_bytes(LibImageImageInfo *info, uint32_t width)
+{
+	return ((uint64_t)width * png_channel_count(info->color_type) * info->bit_depth + 7) / 8;
+}
+
+// Byte distance the filters use to reach the same byte of the previous pixel.
+uint32_t png_filter_bpp(LibImageImageInfo *info)
+{
+uint32_t bits;
+
+	bits = png_channel_count(info->color_type) * info->bit_depth;
+	return bits < 8 ? 1 : bits / 8;
+}
+
+// Columns of a pass that fall in the first width columns of the image.
+uint32_t png_adam7_pass_columns(int pass, uint32_t width)
+{
+	return width > png_adam7_start_x[pass] ? (width - png_adam7_start_x[pass] + png_adam7_step_x[pass] - 1) / png_adam7_step_x[pass] : 0;
+}
+
+void png_adam7_pass_size(LibImageImageInfo *info, int pass, uint32_t *width, uint32_t *height)
+{
+	*width  = png_adam7_pass_columns(pass, info->width);
+	*height = info->height > png_adam7_start_y[pass] ? (info->height - png_adam7_start_y[pass] + png_adam7_step_y[pass] - 1) / png_adam7_step_y[pass] : 0;
+}
+
+/*
+*	Settles the region the decode produces once IHDR is known, the whole image when roi_width or roi_height was
+*	left at zero. Returns zero or LIBIMAGE_ERROR_BAD_REGION when it isn't inside the image.
+*/
+int png_region_init(LibImageImageInfo *info)
+{
+	if(info->roi_width == 0 || info->roi_height == 0) {
+		info->roi_x	 = info->roi_y = 0;
+		info->roi_width	 = info->width;
+		info->roi_height = info->height;
+		return 0;
+	}
+	if(info->roi_x >= info->width || info->roi_width > info->width - info->roi_x) return LIBIMAGE_ERROR_BAD_REGION;
+	if(info->roi_y >= info->height || info->roi_height > info->height - info->roi_y) return LIBIMAGE_ERROR_BAD_REGION;
+	return 0;
+}
+
+/*
+*	Exact size of the zlib stream contents, every scanline is its filter type byte followed by the row. Interlaced
+*	images hold the seven reduced images one after the other, passes without pixels have no scanlines at all.
+*/
+uint64_t png_uncompressed_size(LibImageImageInfo *info)
+{
+uint64_t	size;
+uint32_t	pass_width, pass_height;
+int		pass;
+
+	if(info->interlace_method == 0) return (uint64_t)info->height * (1 + png_row_bytes(info, info->width));
+
+	size = 0;
+	for(pass = 0; pass < LIBIMAGE_PNG_ADAM7_PASSES; pass++) {
+		png_adam7_pass_size(info, pass, &pass_width, &pass_height);
+		if(pass_width == 0 || pass_height == 0) continue;
+		size += (uint64_t)pass_height * (1 + png_row_bytes(info, pass_width));
+	}
+	return size;
+}
+
+/*
+*	Whether the decode keeps the whole inflated stream instead of going row by row: interlaced images decoded on
+*	more than one thread, whose passes are reconstructed side by side, and decodes allowed to inflate in parallel.
+*/
+static int png_decode_is_flat(LibImageImageInfo *info)
+{
+	return info->thread_count > 1 && (info->interlace_method || info->parallel_inflate);
+}
+
+/*
+*	Checks the decode against info->limits from the header alone, once the region is known and before anything is
+*	allocated for the image. max_alloc_bytes is weighed against the image handed back when it isn't the caller's,
+*	then the whole inflated stream of a decode that keeps it, or the window and rows of one going row by row with
+*	the passes of an interlaced image put together in native. The small tables of the converter and the scaler
+*	aren't counted. Returns zero or LIBIMAGE_ERROR_LIMIT_EXCEEDED.
+*/
+int png_check_limits(LibImageImageInfo *info)
+{
+LibImageLimits	*l = &info->limits;
+uint64_t	out_size, need, row_bytes;
+
+	if(l->max_output_bytes == 0 && l->max_alloc_bytes == 0) return 0;
+	out_size = png_output_image_size(info);
+	if(l->max_output_bytes && out_size > l->max_output_bytes) {
+		LIBIMAGE_LOG(LIBIMAGE_LOG_ERROR, "Image takes %" PRIu64 " bytes, the limit is %" PRIu64, out_size, l->max_output_bytes);
+		return LIBIMAGE_ERROR_LIMIT_EXCEEDED;
+	}
+	if(l->max_alloc_bytes == 0) return 0;
+
+	need	  = info->out_external ? 0 : out_size;
+	row_bytes = png_row_bytes(info, info->width);
+	if(png_decode_is_flat(info)) {
+		need += png_uncompressed_size(info);
+	} else {
+		need += 2 * LIBIMAGE_PIPELINE_HISTORY_SIZE + 1 + 3 * row_bytes + 2;
+		if(info->interlace_method && (info->output_format != LIBIMAGE_FORMAT_NATIVE || info->scale_shift
+				|| info->roi_width != info->width || info->out_stream)) {
+			need += (uint64_t)info->roi_height * row_bytes;
+		}
+	}
+	if(need > l->max_alloc_bytes) {
+		LIBIMAGE_LOG(LIBIMAGE_LOG_ERROR, "Decode needs %" PRIu64 " bytes, the limit is %" PRIu64, need, l->max_alloc_bytes);
+		return LIBIMAGE_ERROR_LIMIT_EXCEEDED;
+	}
+	return 0;
+}
+
+// Cancellation and the deadline, polled while the decode inflates.
+int png_poll_limits(LibImageImageInfo *info)
+{
+	if(info->limits.cancel && __atomic_load_n(info->limits.cancel, __ATOMIC_RELAXED)) return LIBIMAGE_ERROR_CANCELLED;
+	if(info->deadline_ns && libimage_stats_clock() >= info->deadline_ns) return LIBIMAGE_ERROR_DEADLINE;
 	return 0;
 }
 
+/*
+*	Reads the chunk at the cursor and moves past it. A chunk that doesn't fit in what is left of the data sets
+*	r->error and comes back empty ( type zero ) with the cursor where it was. Fields are read a byte at a time,
+*	chunks have no alignment, and the data is left in place.
+*/
 LibImagePngChunk read_png_chunk(LibImageDataReader *r)
 {
 LibImagePngChunk c = {0};
-	
-	c.data_len.i = u32_endian_swap(*(uint32_t*)read_from_reader(r)); 
-	c.type.i     = u32_endian_swap(*(uint32_t*)peek_from_reader(r, 4));
+
+	if(reader_bytes_left(r) < 12) {
+		r->error = LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+		return c;
+	}
+	c.data_len.i = read_u32_be(read_from_reader(r));
+	if(c.data_len.i > INT32_MAX || c.data_len.i > reader_bytes_left(r) - 12) {
+		r->error = c.data_len.i > INT32_MAX ? LIBIMAGE_PNG_ERROR_CORRUPTED_FILE : LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+		c.data_len.i = 0;
+		return c;
+	}
+	c.type.i     = read_u32_be(peek_from_reader(r, 4));
 
 	consume_bytes(r, 8);
 	c.start_chunk_data = read_from_reader(r);
 	c.end_chunk_data   = peek_from_reader(r, c.data_len.i - 1);
 	consume_bytes(r, c.data_len.i);
 
-	c.crc.i      = *(uint32_t*)read_from_reader(r);
+	memcpy(&c.crc.i, read_from_reader(r), sizeof(c.crc.i));
 
 	consume_bytes(r, 4);
 	return c;
 }
 
-void process_ihdr_chunk(LibImagePngChunk *c, LibImageDataReader *r, LibImageImageInfo *info, uint8_t *compression_method)
+int process_ihdr_chunk(LibImagePngChunk *c, LibImageImageInfo *info, uint8_t *compression_method)
 {
 int			validation_ret;
 LibImagePngIHdr 	ihdr;
-
-	ihdr = *(LibImagePngIHdr*)(c->start_chunk_data);
+const uint8_t		*p = c->start_chunk_data;
+
+	ihdr.width		= read_u32_be(p);
+	ihdr.height		= read_u32_be(p + 4);
+	ihdr.bit_depth		= p[8];
+	ihdr.colour_type	= p[9];
+	ihdr.compression_method	= p[10];
+	ihdr.filter_method	= p[11];
+	ihdr.interlace_method	= p[12];
 	validation_ret = validate_ihdr(&ihdr, info);
-	if(validation_ret) {
-		r->error = validation_ret; 
-		return;
-	}
-	if(ihdr.compression_method == 0) compression_method = LIBIMAGE_DEFLATE_COMPRESSION;
-	info->width 	= u32_endian_swap(ihdr.width);
-	info->height	= u32_endian_swap(ihdr.height);
+	if(validation_ret) return validation_ret;
 
-	if(info->width > LIBIMAGE_PNG_MAX_IMAGE_SIZE || info->height > LIBIMAGE_PNG_MAX_IMAGE_SIZE) {
-		r->error = LIBIMAGE_PNG_ERROR_BIG_IMAGE;
-		return;
-	}
+	*compression_method = LIBIMAGE_DEFLATE_COMPRESSION;
+	info->width 	= ihdr.width;
+	info->height	= ihdr.height;
 
-	if(info->width == 0 || info->height == 0) {
-		r->error = LIBIMAGE_PNG_ERROR_ZERO_SIZE;
-		return;
-	}
-#if 1
+	if(info->width > LIBIMAGE_PNG_MAX_IMAGE_SIZE || info->height > LIBIMAGE_PNG_MAX_IMAGE_SIZE) return LIBIMAGE_PNG_ERROR_BIG_IMAGE;
+	if(info->width == 0 || info->height == 0) return LIBIMAGE_PNG_ERROR_ZERO_SIZE;
+	if(info->limits.max_pixels && (uint64_t)info->width * info->height > info->limits.max_pixels) return LIBIMAGE_ERROR_LIMIT_EXCEEDED;
 	print_ihdr(&ihdr);
-#endif
+	return 0;
 }
 
+// Reads LEN/NLEN, the bytes are copied by png_copy_stored_block.
 void png_parse_uncompressed_block(LibImageZlibBuffer *buf, LibImageImageInfo *info)
 {
-int 		len,nlen, k;
-uint8_t 	header[4], *tmp;
-uint32_t 	mem_size = 1;
+uint32_t 	len, nlen;
 
-	len = nlen = k = 0;
 	// Align to a byte boundary, as per spec.
-	if(buf->code_buf_bits & 7) zbuf_get_n_bits(buf, buf->code_buf_bits & 7);
-	while(buf->code_buf_bits) {
-		header[k++] = (uint8_t) buf->code_buf & 255;
-		buf->code_buf >>= 8;
-		buf->code_buf_bits -= 8;
-	}
-	if(buf->code_buf_bits < 0) {
+	zbuf_align_to_byte(buf);
+	len	= zbuf_get_n_bits(buf, 16);
+	nlen	= zbuf_get_n_bits(buf, 16);
+
+	if(len != (~nlen & 0xffff)) {
 		info->error = LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
 		return;
 	}
-	while(k < 4) header[k++] = zbuf_get_byte(buf);
-
-	len 	|= header[1] * 256 + header[0];
-	nlen	 = header[3] * 256 + header[2];
+	buf->stored_remaining	= len;
+	buf->state		= LIBIMAGE_ZBUF_STATE_STORED;
+}
 
-	if(len != ~(nlen)) {
-		info->error = LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
-		return;
+/*
+*	Copies the stored block as far as input and output allow, the block can span several IDAT chunks. Its start can
+*	already be in the bit buffer, only the real bits are taken from there and never the padding.
+*/
+int png_copy_stored_block(LibImageZlibBuffer *buf, LibImageImageInfo *info)
+{
+uint32_t 	k;
+off_t		room;
+uint8_t 	buffered[8];
+
+	// Outputs can be over 4 GiB, the room is only cut down to 32 bits by the block.
+	room = info->un_size - info->un_offset;
+	if(room > buf->stored_remaining) room = buf->stored_remaining;
+	for(k = 0; k < buf->stored_remaining && k < room && buf->code_buf_bits >= 8 + buf->overrun_bytes * 8; k++) {
+		buffered[k] = zbuf_get_n_bits(buf, 8);
 	}
-	if(buf->buf + len > buf->buf_end) {
-		info->error = LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+	if(buf->code_buf_bits <= buf->overrun_bytes * 8) {
+		buf->code_buf = 0;
+		buf->code_buf_bits = buf->overrun_bytes = 0;
+	}
+	write_uncompressed_data(buf, info, k, (char*)buffered);
+	buf->stored_remaining -= k;
+
+	while(buf->stored_remaining > 0) {
+		room = info->un_size - info->un_offset;
+		if(room == 0) return LIBIMAGE_ZBUF_OUTPUT_FULL;
+		if(room > buf->stored_remaining) room = buf->stored_remaining;
+		if(!zbuf_next_span(buf)) return LIBIMAGE_ZBUF_NEED_INPUT;
+		k = buf->buf_end - buf->buf < buf->stored_remaining ? buf->buf_end - buf->buf : buf->stored_remaining;
+		if(k > room) k = room;
+		write_uncompressed_data(buf, info, k, NULL);
+		buf->buf 		+= k;
+		buf->stored_remaining	-= k;
+	}
+	buf->state = LIBIMAGE_ZBUF_STATE_BLOCK_HEADER;
+	return LIBIMAGE_ZBUF_OK;
+}
+
+/*
+*	Builds the literal/length and distance tables from the code lengths and starts decoding the block. Also how a
+*	row index takes a dynamic block up again from the middle.
+*/
+void png_start_huffman_block(LibImageZlibBuffer *buf, LibImageImageInfo *info, int size_lit, int size_dist)
+{
+LibImageInflateTables	*tables;
+int			ret;
+
+	tables	= buf->tables;
+	ret	= build_huffman(&tables->lit_huff, tables->code_lengths, size_lit);
+	if(ret == 0) ret = build_huffman(&tables->dist_huff, tables->code_lengths + size_lit, size_dist);
+	LIBIMAGE_STAT_ADD(info, huffman_builds, 2);
+	if(ret) {
+		info->error = ret;
 		return;
 	}
-	write_uncompressed_data(buf, info, len, NULL);
+	tables->lit	   = &tables->lit_huff;
+	tables->dist	   = &tables->dist_huff;
+	tables->lit_count  = size_lit;
+	tables->dist_count = size_dist;
+	buf->state	   = LIBIMAGE_ZBUF_STATE_HUFFMAN;
 }
 
+// The codes of a fixed block are always the same, their tables are built in.
 void png_parse_huffman_fixed_block(LibImageZlibBuffer *buf, LibImageImageInfo *info)
 {
-int 		hlit, hdist, i, bit_count, bit_index, go_until_this_value;
-uint32_t 	lit_bit_count[][2] = { {143,8}, {255,9}, {279, 7}, {287, 8}, {319, 5}}; // Encode distance in the same array after 287, 319 is 287 + hdist
-
-	bit_index = 0;
-	hlit	  = 288;
-	hdist	  = 32;
-
-	for(i = 0; i < STATIC_ARRAY_SIZE(lit_bit_count); i++) {
-		bit_count = lit_bit_count[i][1];
-		go_until_this_value = lit_bit_count[i][0];	
-		while(bit_index <= go_until_this_value) {
-			zbuf_append_to_sliding_window(buf, (uint8_t*)&bit_count, sizeof(bit_count));
-			bit_index++;
-		}
-	}
-	decompress_huffman_block(buf, info, hlit, hdist);
+	(void)info;
+	buf->tables->lit  = &png_fixed_lit_huff;
+	buf->tables->dist = &png_fixed_dist_huff;
+	buf->state	  = LIBIMAGE_ZBUF_STATE_HUFFMAN;
 }
 
 void png_parse_huffman_dynamic_block(LibImageZlibBuffer *buf, LibImageImageInfo *info)
 {
 const uint8_t 		code_len_alphabet[19] = { 16,17,18,0,8,7,9,6,10,5,11,4,12,3,13,2,14,1,15 }; // Order from spec, don't ask me
-uint8_t 		code_len_lens[19];
-int 			hlit, hdist, hclen, n, run_len, run_val, actual_len, encoded_len, total;
-LibImageHuffman 	huff;
+uint8_t 		code_len_lens[19], *code_lengths;
+int 			hlit, hdist, hclen, n, run_len, run_val, encoded_len, total, ret;
+LibImageHuffman 	*huff;
 
 
 	hlit  = zbuf_get_n_bits(buf, 5) + 257;
@@ -419,202 +547,801 @@ LibImageHuffman 	huff;
 
 	total = hlit + hdist;
 
-	libimage_printf("HLIT  %d\n", hlit);
-	libimage_printf("HDIST %d\n", hdist);
-	libimage_printf("HCLEN %d\n", hclen);
-	libimage_printf("TOTAL %d\n", total);
+	LIBIMAGE_LOG(LIBIMAGE_LOG_DEBUG, "Dynamic block HLIT %d HDIST %d HCLEN %d", hlit, hdist, hclen);
 
+	memset(code_len_lens, 0, sizeof(code_len_lens));
 	for(n = 0; n < hclen; n++) {
 		code_len_lens[code_len_alphabet[n]] = (uint8_t)zbuf_get_n_bits(buf, 3);
 	}
 
-	huff = new_huffman(7);
-	build_huffman(buf, &huff, code_len_lens, STATIC_ARRAY_SIZE(code_len_lens));
+	huff = &buf->tables->code_len_huff;
+	ret  = build_huffman(huff, code_len_lens, STATIC_ARRAY_SIZE(code_len_lens));
+	LIBIMAGE_STAT_ADD(info, huffman_builds, 1);
+	if(ret) {
+		info->error = ret;
+		return;
+	}
+
+	code_lengths = buf->tables->code_lengths;
 	n    = 0;
 	while(n < total) {
-		encoded_len = decode_huffman(&huff, buf);
+		encoded_len = decode_huffman(huff, buf);
 		if(encoded_len < 0 || encoded_len >= 19) {
 			info->error = LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS;
 			return;
 		}
 
-		if(encoded_len <= 15) run_val = encoded_len;
+		if(encoded_len <= 15) {
+			run_len = 1;
+			run_val = encoded_len;
+		}
 		else if(encoded_len == 16) {
+			if(n == 0) {
+				info->error = LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS;
+				return;
+			}
 			run_len = zbuf_get_n_bits(buf, 2) + 3;
-			run_val = buf->sliding_window[n - 1];
+			run_val = code_lengths[n - 1];
 		}
 		else if(encoded_len == 17) {
 			run_len = zbuf_get_n_bits(buf, 3) + 3;
+			run_val = 0;
 		} 
-		else if(encoded_len == 18) {
+		else {
 			run_len = zbuf_get_n_bits(buf, 7) + 11;
+			run_val = 0;
 		} 
-		else {
-			libimage_printf("encoded_len is %d [%d].\n", encoded_len, __LINE__);
-			info->error = LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+
+		if(n + run_len > total) {
+			info->error = LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS;
 			return;
 		}
+		while(run_len--) code_lengths[n++] = run_val;
+	}
+	// A block without the end of block code can't be terminated.
+	if(code_lengths[256] == 0) {
+		info->error = LIBIMAGE_PNG_HUFFMAN_BAD_CODE_LENGTHS;
+		return;
+	}
+
+	png_start_huffman_block(buf, info, hlit, hdist);
+}
+
+#ifdef LIBIMAGE_PNG_CHECK_CRC
+int png_chunk_crc_matches(LibImagePngChunk *c)
+{
+uint32_t crc32;
 
-		while(encoded_len--) {
-			zbuf_append_to_sliding_window(buf, (uint8_t*)&run_val, sizeof(run_val));
-			n++;
+	// The type code sits right before the data in the file.
+	crc32 = crc(c->start_chunk_data - sizeof(c->type.b), sizeof(c->type.b) + c->data_len.i);
+	if(c->crc.i != crc32) {
+		LIBIMAGE_LOG(LIBIMAGE_LOG_ERROR, "Chunk %.4s has crc %x, calculated %x", (char*)c->start_chunk_data - sizeof(c->type.b), c->crc.i, crc32);
+		return 0;
+	}
+	return 1;
+}
+#endif
+
+/*
+*	Input callback for the zlib stream. Hands over the payload of the next chunk while it is an IDAT, otherwise
+*	leaves the reader on that chunk so the chunk walk picks it up.
+*/
+int png_next_idat_span(void *user, uint8_t **start, uint8_t **end)
+{
+LibImageDataReader	*r = user;
+LibImagePngChunk	chunk;
+uint64_t		cursor;
+
+	if(r->error) return 0;
+	cursor	= r->cursor;
+	chunk	= read_png_chunk(r);
+	if(r->error) return 0;
+	if(chunk.type.i != LIBIMAGE_PNG_TYPE('I','D','A','T')) {
+		r->cursor = cursor;
+		return 0;
+	}
+#ifdef LIBIMAGE_PNG_CHECK_CRC
+	if(!png_chunk_crc_matches(&chunk)) {
+		r->error = LIBIMAGE_PNG_ERROR_CRC_NOT_MATCH;
+		return 0;
+	}
+#endif
+	*start	= chunk.start_chunk_data;
+	*end	= chunk.start_chunk_data + chunk.data_len.i;
+	return 1;
+}
+
+// The chunk after the one whose payload ends at end comes right after its CRC.
+void png_rewind_idat_span(void *user, uint8_t *end)
+{
+LibImageDataReader	*r = user;
+
+	r->cursor = end + sizeof(uint32_t) - r->data;
+}
+
+/*
+*	Ends a unit that can't be resumed from the middle. If it read into the padding past the input, whatever it found
+*	or complained about came from zeros, so it is rolled back and the unit waits for more input.
+*/
+static int png_end_inflate_unit(LibImageZlibBuffer *buf, LibImageImageInfo *info, LibImageZlibCheckpoint *checkpoint, uint8_t state)
+{
+	if(zbuf_is_overrun(buf)) {
+		zbuf_restore(buf, checkpoint);
+		buf->state	= state;
+		info->error	= 0;
+		return LIBIMAGE_ZBUF_NEED_INPUT;
+	}
+	if(buf->error && !info->error) info->error = buf->error;
+	return info->error ? LIBIMAGE_ZBUF_FAILED : LIBIMAGE_ZBUF_OK;
+}
+
+/*
+*	Runs the Adler-32 over the output written since the last time. It is called after every block and every time
+*	inflate stops, so the bytes are checksummed while they are still in cache instead of in a pass of their own.
+*/
+static void png_adler_catch_up(LibImageZlibBuffer *buf, LibImageImageInfo *info)
+{
+#ifdef LIBIMAGE_PNG_CHECK_ADLER
+	if(!info->skip_adler) buf->adler = adler32_update(buf->adler, info->uncompressed_data + buf->adler_offset, info->un_offset - buf->adler_offset);
+#endif
+	buf->adler_offset = info->un_offset;
+}
+
+// The ADLER32 after the final block, byte aligned and MSB first.
+static int png_check_zlib_trailer(LibImageZlibBuffer *buf, LibImageImageInfo *info)
+{
+LibImageZlibCheckpoint	checkpoint;
+uint32_t		adler;
+int			i, status;
+
+	zbuf_save(buf, &checkpoint);
+	zbuf_align_to_byte(buf);
+	for(i = 0, adler = 0; i < 4; i++) adler = (adler << 8) | zbuf_get_n_bits(buf, 8);
+	status = png_end_inflate_unit(buf, info, &checkpoint, LIBIMAGE_ZBUF_STATE_TRAILER);
+	if(status != LIBIMAGE_ZBUF_OK) return status;
+
+	buf->trailer_adler = adler;
+	png_adler_catch_up(buf, info);
+#ifdef LIBIMAGE_PNG_CHECK_ADLER
+	if(!info->skip_adler && adler != buf->adler) {
+		LIBIMAGE_LOG(LIBIMAGE_LOG_ERROR, "Zlib stream has adler32 %x, calculated %x", adler, buf->adler);
+		info->error = LIBIMAGE_PNG_ERROR_ADLER_NOT_MATCH;
+		return LIBIMAGE_ZBUF_FAILED;
+	}
+#endif
+	buf->state = LIBIMAGE_ZBUF_STATE_DONE;
+	return LIBIMAGE_ZBUF_OK;
+}
+
+static int png_inflate_run(LibImageZlibBuffer *buf, LibImageImageInfo *info)
+{
+LibImageZlibCheckpoint	checkpoint;
+uint8_t			state, type;
+int			status;
+#ifdef LIBIMAGE_STATS
+off_t			start_offset = info->un_offset;
+#endif
+
+	status = LIBIMAGE_ZBUF_OK;
+	while(status == LIBIMAGE_ZBUF_OK) {
+		state = buf->state;
+		switch(state) {
+			case LIBIMAGE_ZBUF_STATE_HEADER: {
+				zbuf_save(buf, &checkpoint);
+				zbuf_parse_header(buf);
+				status = png_end_inflate_unit(buf, info, &checkpoint, state);
+				if(status == LIBIMAGE_ZBUF_OK) buf->state = LIBIMAGE_ZBUF_STATE_BLOCK_HEADER;
+			} break;
+			case LIBIMAGE_ZBUF_STATE_BLOCK_HEADER: {
+				png_adler_catch_up(buf, info);
+				if(buf->final_block) {
+					buf->state = LIBIMAGE_ZBUF_STATE_TRAILER;
+					break;
+				}
+				// The block header goes with the code lengths of the block, both are read again on a rollback.
+				zbuf_save(buf, &checkpoint);
+				buf->final_block = zbuf_get_n_bits(buf, 1);
+				type		 = zbuf_get_n_bits(buf, 2);
+				if(type == 0) {
+					png_parse_uncompressed_block(buf, info);
+				} else if(type == 1) {
+					png_parse_huffman_fixed_block(buf, info);
+				} else if(type == 2) {
+					png_parse_huffman_dynamic_block(buf, info);
+				} else {
+					LIBIMAGE_LOG(LIBIMAGE_LOG_ERROR, "Deflate block of reserved type %d", type);
+					info->error = LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+				}
+				status = png_end_inflate_unit(buf, info, &checkpoint, state);
+				if(status == LIBIMAGE_ZBUF_NEED_INPUT) buf->final_block = 0;
+#ifdef LIBIMAGE_STATS
+				// A header that waits for input is read again, it only counts once it went through.
+				if(status == LIBIMAGE_ZBUF_OK && type == 0) LIBIMAGE_STAT_ADD(info, stored_blocks, 1);
+				if(status == LIBIMAGE_ZBUF_OK && type == 1) LIBIMAGE_STAT_ADD(info, fixed_blocks, 1);
+				if(status == LIBIMAGE_ZBUF_OK && type == 2) LIBIMAGE_STAT_ADD(info, dynamic_blocks, 1);
+#endif
+			} break;
+			case LIBIMAGE_ZBUF_STATE_STORED: {
+				status = png_copy_stored_block(buf, info);
+			} break;
+			case LIBIMAGE_ZBUF_STATE_HUFFMAN: {
+				status = decompress_huffman_block(buf, info);
+			} break;
+			case LIBIMAGE_ZBUF_STATE_TRAILER: {
+				status = png_check_zlib_trailer(buf, info);
+			} break;
+			default: {
+				status = LIBIMAGE_ZBUF_DONE;
+			} break;
 		}
 	}
+	if(status != LIBIMAGE_ZBUF_FAILED) png_adler_catch_up(buf, info);
+	LIBIMAGE_STAT_ADD(info, inflated_bytes, info->un_offset - start_offset);
+	return status;
+}
+
+/*
+*	Runs the zlib stream from where it stopped until it ends, fails, or the input or the output runs out. The output
+*	goes to uncompressed_data from un_offset up to un_size, matches can reach back to the start of that buffer. A
+*	decode that can be cancelled or has a deadline inflates LIBIMAGE_INFLATE_POLL_BYTES at a time and checks both
+*	in between, a single deflate block can make up the whole image.
+*/
+int png_inflate(LibImageZlibBuffer *buf, LibImageImageInfo *info)
+{
+off_t	end;
+int	status;
+
+	if(info->limits.cancel == NULL && info->deadline_ns == 0) return png_inflate_run(buf, info);
+	end = info->un_size;
+	do {
+		status = png_poll_limits(info);
+		if(status) {
+			info->error = status;
+			return LIBIMAGE_ZBUF_FAILED;
+		}
+		if(end - info->un_offset > LIBIMAGE_INFLATE_POLL_BYTES) info->un_size = info->un_offset + LIBIMAGE_INFLATE_POLL_BYTES;
+		status	     = png_inflate_run(buf, info);
+		info->un_size = end;
+	} while(status == LIBIMAGE_ZBUF_OUTPUT_FULL && info->un_offset < end);
+	return status;
+}
 
-	decompress_huffman_block(buf, info, hlit, hdist);
-	free_huffman_entries(&huff);
+// Settles LIBIMAGE_OUT_STREAM_AUTO, an output the last level cache can't hold would only push the rest out of it.
+static void png_output_settle_stream(LibImageImageInfo *info)
+{
+	if(info->out_stream == LIBIMAGE_OUT_STREAM_AUTO) info->out_stream = png_output_image_size(info) > libimage_kernels()->cache_bytes;
 }
 
-void handle_png_data(LibImageImageInfo *info)
+/*
+*	Sets up processed_data for the image of the region, or checks that the caller's buffer holds it. Rows are
+*	out_stride bytes apart. Returns zero or the error.
+*/
+static int png_output_begin(LibImageImageInfo *info, int zeroed)
+{
+uint64_t	row_bytes;
+uint32_t	width, height, y;
+
+	png_output_settle_stream(info);
+	png_output_dimensions(info, &width, &height);
+	info->pr_size	= png_output_image_size(info);
+	info->pr_offset	= 0;
+	row_bytes	= info->pr_size / height;
+	if(info->out_stride == 0) info->out_stride = row_bytes;
+	if(info->out_external) {
+		if(info->out_stride < row_bytes) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+		if((height - 1) * info->out_stride + row_bytes > info->out_capacity) return LIBIMAGE_ERROR_BUFFER_TOO_SMALL;
+		for(y = 0; zeroed && y < height; y++) memset(info->processed_data + y * info->out_stride, 0, row_bytes);
+		return 0;
+	}
+	info->processed_data = libimage_output_alloc(info, info->pr_size, zeroed);
+	return info->processed_data ? 0 : LIBIMAGE_ERROR_OUT_OF_MEMORY;
+}
+
+/*
+*	Reconstruction stage, turns the inflated scanlines into processed_data: the rows of the decoded region one after
+*	the other in the sample layout of the file, without the filter bytes and with Adam7 passes already put in place,
+*	or in the output format when info->converter is set. Filters only look left and up, so the scanlines are only
+*	unfiltered up to the right edge of the region and none past its last row. Interlaced images go through
+*	png_adam7_decode, which can spread the work on info->thread_count threads.
+*/
+void png_unfilter_image(LibImageImageInfo *info)
+{
+LibImageScaleLane	lane = {0};
+uint64_t		row_bytes, out_row_bytes, keep_bytes;
+uint32_t		bpp, y, end_y;
+uint8_t			*line, *row, *prev, *rows;
+int			ret, direct;
+
+	row_bytes     = png_row_bytes(info, info->width);
+	keep_bytes    = png_row_bytes(info, info->roi_x + info->roi_width);
+	out_row_bytes = png_output_row_bytes(info);
+	bpp	      = png_filter_bpp(info);
+	// Every byte of the output is written, de-interlacing included.
+	ret = png_output_begin(info, 0);
+	if(ret) {
+		info->error = ret;
+		return;
+	}
+	if(info->interlace_method) {
+		ret = png_adam7_decode(info, info->thread_count);
+		if(ret) info->error = ret;
+		return;
+	}
+
+	/*
+	*	A row of zeros for the first scanline, then two rows the scanlines are unfiltered in when they get
+	*	converted, and the converted row of a streamed output.
+	*/
+	rows = libimage_scratch_alloc(info, 3 * row_bytes + 1 + (info->out_stream ? out_row_bytes : 0));
+	ret  = rows ? 0 : LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	if(ret == 0 && info->scaler) ret = png_scale_lane_alloc(info, &lane);
+	if(ret) {
+		info->error = ret;
+		png_scale_lane_free(info, &lane);
+		libimage_scratch_free(info, rows);
+		return;
+	}
+	memset(rows, 0, row_bytes + 1);
+	direct = info->converter == NULL && info->scaler == NULL && info->roi_width == info->width && !info->out_stream;
+	end_y  = info->roi_y + info->roi_height;
+	line   = info->uncompressed_data;
+	prev   = rows;
+	for(y = 0; y < end_y; y++, line += 1 + row_bytes) {
+		// Unfiltered in place in the output when it takes whole rows as they are, the row above is the previous output row.
+		if(direct && y >= info->roi_y) row = info->processed_data + (y - info->roi_y) * info->out_stride;
+		else row = rows + row_bytes + 1 + (y & 1) * row_bytes;
+		ret = png_unfilter_row(row, line + 1, prev, keep_bytes, bpp, line[0]);
+		if(ret) {
+			info->error = ret;
+			break;
+		}
+		LIBIMAGE_STAT_ADD(info, filter_rows[line[0]], 1);
+		if(info->scaler && y >= info->roi_y) png_scale_row(info, &lane, y - info->roi_y, row);
+		else if(!direct && y >= info->roi_y) png_write_output_row(info, y - info->roi_y, row, rows + 3 * row_bytes + 1);
+		prev = row;
+	}
+	png_scale_lane_free(info, &lane);
+	libimage_scratch_free(info, rows);
+}
+
+/*
+*	Inflates straight into a buffer of the exact size IHDR describes, then reconstructs the image from it. With
+*	parallel_inflate the stream is first tried in segments on thread_count threads, whatever that can't take is
+*	inflated here as it always was.
+*/
+static void png_decode_flat(LibImageImageInfo *info, LibImageDataReader *r, LibImagePngChunk *first_idat)
 {
 LibImageZlibBuffer	zlib_buf;
-off_t			i, contents_size;
-uint8_t			type, end;
+LibImageInflateTables	tables;
+uint64_t		size;
+int			status;
+#ifdef LIBIMAGE_STATS
+uint64_t		start;
+#endif
 
-	zbuf_init(&zlib_buf, info->compressed_data, info->cd_offset, 1);
-	zbuf_parse_header(&zlib_buf);
+	size = png_uncompressed_size(info);
+	if(size > PTRDIFF_MAX) {
+		info->error = LIBIMAGE_PNG_ERROR_BIG_IMAGE;
+		return;
+	}
+	info->uncompressed_data = libimage_scratch_alloc(info, size);
+	if(info->uncompressed_data == NULL) {
+		info->error = LIBIMAGE_ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	info->un_size	= size;
+	info->un_offset = 0;
+
+	status = LIBIMAGE_ZBUF_DONE;
+	LIBIMAGE_STAGE_BEGIN(info, LIBIMAGE_STAGE_INFLATE, start);
+	if(!info->parallel_inflate || info->thread_count < 2 || !png_split_inflate(info, r, first_idat, info->thread_count)) {
+		// The output buffer is the LZ77 history, no separate window is needed.
+		zbuf_init(&zlib_buf, first_idat->start_chunk_data, first_idat->data_len.i, 0);
+		zlib_buf.next_input	 = png_next_idat_span;
+		zlib_buf.rewind_input	 = png_rewind_idat_span;
+		zlib_buf.next_input_user = r;
+		png_init_inflate_tables(&tables);
+		zlib_buf.tables = &tables;
+
+		// All the input is there, running out of it or of the output means the stream doesn't match the image.
+		status = png_inflate(&zlib_buf, info);
+		zbuf_deinit(&zlib_buf);
+	}
+	LIBIMAGE_STAGE_END(info, LIBIMAGE_STAGE_INFLATE, start);
+	if(r->error && !info->error) info->error = r->error;
+	if(info->error) return;
+	if(status == LIBIMAGE_ZBUF_NEED_INPUT) {
+		info->error = LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+		return;
+	}
+	if(status == LIBIMAGE_ZBUF_OUTPUT_FULL) {
+		info->error = LIBIMAGE_PNG_ERROR_DATA_OVERFLOW;
+		return;
+	}
 
-	if(zlib_buf.error) {
-		info->error = zlib_buf.error;
+	if(info->un_offset != info->un_size) {
+		info->error = LIBIMAGE_PNG_ERROR_NOT_ENOUGH_DATA;
 		return;
 	}
+	LIBIMAGE_STAGE_BEGIN(info, LIBIMAGE_STAGE_RECONSTRUCT, start);
+	png_unfilter_image(info);
+	LIBIMAGE_STAGE_END(info, LIBIMAGE_STAGE_RECONSTRUCT, start);
+}
 
-	end = 0;
-	do {
-		end	= zbuf_get_n_bits(&zlib_buf, 1);
-		type 	= zbuf_get_n_bits(&zlib_buf, 2);
 
-		if(type == 3) {
-			libimage_printf("Got type %d for deflate\n", type);	
-			continue;
-		}
-		if(type == 0) {
-			png_parse_uncompressed_block(&zlib_buf, info);
-		} else if(type == 1) {
-			png_parse_huffman_fixed_block(&zlib_buf, info);
+static void png_store_region_row(LibImagePngStoreTarget *sink, uint32_t r, const uint8_t *row)
+{
+	if(sink->info->scaler) png_scale_row(sink->info, &sink->lane, r, row);
+	else png_write_output_row(sink->info, r, row, sink->out_row);
+}
+
+static void png_store_row(void *user, const uint8_t *row, uint32_t row_size, uint32_t y, int pass)
+{
+LibImagePngStoreTarget	*sink = user;
+LibImageImageInfo	*info = sink->info;
+uint8_t			*dst;
+int			last_pass;
+
+	(void)row_size;
+	// Rows above the region are only there for the filters of the ones below.
+	if(y < info->roi_y) return;
+	if(info->interlace_method == 0) {
+		png_store_region_row(sink, y - info->roi_y, row);
+		return;
+	}
+	if(sink->native) dst = sink->native + (uint64_t)(y - info->roi_y) * sink->row_bytes;
+	else dst = info->processed_data + (uint64_t)(y - info->roi_y) * info->out_stride;
+	png_adam7_scatter_row(info, dst, row, png_adam7_pass_columns(pass, info->roi_x + info->roi_width), pass);
+	if(sink->native == NULL || pass != png_adam7_last_pass(info, y)) return;
+	if(info->scaler == NULL) {
+		png_store_region_row(sink, y - info->roi_y, dst);
+		return;
+	}
+	/*
+	*	Passes complete the rows out of order, the even ones before the odd ones, but the scaler takes them one
+	*	after the other. A row is whole once the pass it ends with went past it.
+	*/
+	for(; sink->next_row < info->roi_height; sink->next_row++) {
+		last_pass = png_adam7_last_pass(info, info->roi_y + sink->next_row);
+		if(last_pass > pass || (last_pass == pass && info->roi_y + sink->next_row > y)) break;
+		png_store_region_row(sink, sink->next_row, sink->native + (uint64_t)sink->next_row * sink->row_bytes);
+	}
+}
+
+/*
+*	Inflates through the row pipeline, every scanline is unfiltered and stored as soon as it is complete. Only the
+*	32K window and two scanlines are live next to processed_data. The inflate stops once the last row of the
+*	region is in, whatever follows in the stream is not decoded. With a row index it starts at the last checkpoint
+*	above the region, whatever comes before is not decoded either. Sets the pipeline of the job up, the steps of the
+*	job run it.
+*/
+static int png_rows_begin(LibImagePngJob *job, LibImagePngChunk *first_idat)
+{
+LibImageImageInfo	*info = job->info;
+LibImagePngStoreTarget	*sink = &job->sink;
+uint64_t		native_size;
+int			ret;
+
+	memset(sink, 0, sizeof(*sink));
+	sink->info	= info;
+	sink->row_bytes	= png_row_bytes(info, info->width);
+	/*
+	*	Adam7 passes only fill some of the bits of a packed byte, the rest has to start cleared. A streamed output
+	*	is never read back, so the passes are put together in native there too.
+	*/
+	png_output_settle_stream(info);
+	native_size = 0;
+	if(info->interlace_method && (info->converter || info->scaler || info->roi_width != info->width || info->out_stream)) native_size = (uint64_t)info->roi_height * sink->row_bytes;
+	ret = png_output_begin(info, info->interlace_method && !native_size);
+	if(ret) return ret;
+	if(native_size) sink->native = libimage_scratch_alloc(info, native_size);
+	if(info->out_stream && !info->scaler) sink->out_row = libimage_scratch_alloc(info, png_output_row_bytes(info));
+	if((native_size && sink->native == NULL) || (info->out_stream && !info->scaler && sink->out_row == NULL)) ret = LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	if(ret == 0 && native_size) memset(sink->native, 0, native_size);
+
+	if(ret == 0 && info->scaler) ret = png_scale_lane_alloc(info, &sink->lane);
+	if(ret) {
+		png_scale_lane_free(info, &sink->lane);
+		libimage_scratch_free(info, sink->native);
+		libimage_scratch_free(info, sink->out_row);
+		sink->native = sink->out_row = NULL;
+		return ret;
+	}
+	// From here png_rows_end tears the pipeline down, whether it could be set up or not.
+	ret = png_pipeline_init(&job->pipeline, info, png_store_row, sink);
+	job->state = LIBIMAGE_PNG_JOB_ROWS;
+	if(ret) return ret;
+	job->pipeline.zbuf.buf		   = first_idat->start_chunk_data;
+	job->pipeline.zbuf.buf_end	   = first_idat->start_chunk_data + first_idat->data_len.i;
+	job->pipeline.zbuf.next_input	   = png_next_idat_span;
+	job->pipeline.zbuf.rewind_input	   = png_rewind_idat_span;
+	job->pipeline.zbuf.next_input_user = job->reader;
+	png_index_attach(&job->cursor, info->index, &job->pipeline, job->reader, first_idat);
+	return 0;
+}
+
+// Gives back what the rows took, status is the last one of the pipeline. Returns the error of the image data.
+static int png_rows_end(LibImagePngJob *job, int status)
+{
+LibImageImageInfo	*info = job->info;
+int			ret;
+
+	png_pipeline_deinit(&job->pipeline);
+	png_scale_lane_free(info, &job->sink.lane);
+	libimage_scratch_free(info, job->sink.native);
+	libimage_scratch_free(info, job->sink.out_row);
+	job->sink.native = job->sink.out_row = NULL;
+	ret = info->error;
+	if(job->reader->error && !ret) ret = job->reader->error;
+	if(status == LIBIMAGE_ZBUF_NEED_INPUT && !ret) ret = LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+	return ret;
+}
+
+/*
+*	Decodes the image from the first IDAT chunk, reading the following ones in place through the reader so the
+*	compressed stream is never copied. The reader is left on the first chunk after the IDATs that were consumed.
+*
+*	Goes row by row unless png_decode_is_flat, then the whole inflated stream is kept in uncompressed_data. Either
+*	way rows are converted to info->output_format as they are stored, there is no pass over the image afterwards,
+*	and only the region set by the roi_* fields is written, box filtered down by 1 << scale_shift when that is set.
+*/
+static int png_data_begin(LibImagePngJob *job, LibImagePngChunk *first_idat)
+{
+LibImageImageInfo	*info = job->info;
+int			ret;
+
+	ret = png_region_init(info);
+	if(ret == 0) ret = png_check_limits(info);
+	if(ret == 0 && info->output_format != LIBIMAGE_FORMAT_NATIVE) {
+		job->converter = libimage_scratch_alloc(info, sizeof(*job->converter));
+		ret = job->converter ? png_converter_init(job->converter, info, info->output_format) : LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	}
+	if(ret == 0 && info->scale_shift) {
+		job->scaler = libimage_scratch_alloc(info, sizeof(*job->scaler));
+		ret = job->scaler ? png_scaler_init(job->scaler, info, info->scale_shift) : LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	}
+	if(ret) return ret;
+
+	info->converter = job->converter;
+	info->scaler	= job->scaler;
+	if(png_decode_is_flat(info)) {
+		png_decode_flat(info, job->reader, first_idat);
+		return info->error;
+	}
+	return png_rows_begin(job, first_idat);
+}
+
+static void png_data_end(LibImagePngJob *job)
+{
+	job->info->converter = NULL;
+	job->info->scaler    = NULL;
+	libimage_scratch_free(job->info, job->scaler);
+	libimage_scratch_free(job->info, job->converter);
+	job->scaler    = NULL;
+	job->converter = NULL;
+}
+
+void png_init_inflate_tables(LibImageInflateTables *tables)
+{
+	new_huffman(&tables->lit_huff, LIBIMAGE_HUFFMAN_LITLEN_TABLE_BITS);
+	new_huffman(&tables->dist_huff, LIBIMAGE_HUFFMAN_DIST_TABLE_BITS);
+	new_huffman(&tables->code_len_huff, LIBIMAGE_HUFFMAN_CODELEN_TABLE_BITS);
+	tables->lit  = &tables->lit_huff;
+	tables->dist = &tables->dist_huff;
+}
+
+void png_walk_init(LibImagePngWalk *walk)
+{
+	memset(walk, 0, sizeof(*walk));
+	walk->compression_method = -1;
+	walk->first_chunk	 = 1;
+}
+
+// Chunk types are four ASCII letters.
+static int png_chunk_type_valid(uint32_t type)
+{
+uint8_t	c;
+int	i;
+
+	for(i = 0; i < 4; i++) {
+		c = (type >> (8 * i)) & 0xdf;
+		if(c < 'A' || c > 'Z') return 0;
+	}
+	return 1;
+}
+
+/*
+*	Chunk ordering rules of the file, shared by the whole-buffer and the streaming decoders. The chunk data only
+*	needs to be there for the chunks that are read here, IDAT payloads are left to the caller. idat_begins is set when
+*	the chunk is the first IDAT, the zlib stream starts there, and an IDAT after another chunk ended their run fails
+*	the file. Ancillary chunks that aren't known are stepped over, critical ones fail the file.
+*/
+int png_walk_chunk(LibImagePngWalk *walk, LibImagePngChunk *chunk, LibImageImageInfo *info)
+{
+uint32_t	i;
+int		ret;
+
+	walk->idat_begins = 0;
+	if(!png_chunk_type_valid(chunk->type.i)) return LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+	if(walk->got_idat_chunk && chunk->type.i != LIBIMAGE_PNG_TYPE('I','D','A','T')) walk->idat_run_over = 1;
+	switch(chunk->type.i) {
+		case LIBIMAGE_PNG_TYPE('I','H','D','R'): {
+			if(!walk->first_chunk) return LIBIMAGE_PNG_ERROR_MULTIPLE_IHDR;
+			if(chunk->data_len.i != 13) return LIBIMAGE_PNG_ERROR_CORRUPT_IHDR;
+			ret = process_ihdr_chunk(chunk, info, &walk->compression_method);
+			if(ret) return ret;
+			walk->first_chunk = 0;
+		} break;
+		case LIBIMAGE_PNG_TYPE('g','A','M','A'): {
+			if(walk->first_chunk) return LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
+			if(walk->got_plte_chunk) return LIBIMAGE_PNG_ERROR_GAMA_AFTER_PLTE;
+			if(walk->got_gama_chunk) return LIBIMAGE_PNG_ERROR_MULTIPLE_GAMA;
+			if(chunk->data_len.i != 4) return LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+			info->gamma = read_u32_be(chunk->start_chunk_data);
+			walk->got_gama_chunk = 1;
+		} break;
+		case LIBIMAGE_PNG_TYPE('P','L','T','E'): {
+			if(walk->first_chunk) return LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
+			if(info->color_type == PNG_COLOR_TYPE_GREYSCALE
+				  	|| info->color_type == PNG_COLOR_TYPE_GREYSCALE_WITH_ALPHA) {
+				return LIBIMAGE_PNG_ERROR_UNEXPECTED_PLTE;
+			}
+			// One to 256 RGB entries.
+			if(chunk->data_len.i == 0 || chunk->data_len.i % 3 || chunk->data_len.i > 256 * 3) return LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+			walk->got_plte_chunk = 1;
+			walk->plte_entries   = chunk->data_len.i / 3;
+			if(chunk->start_chunk_data) {
+				for(i = 0; i < walk->plte_entries; i++) {
+					memcpy(info->palette[i], chunk->start_chunk_data + 3 * i, 3);
+					info->palette[i][3] = 0xff;
+				}
+				info->palette_entries = walk->plte_entries;
+			}
+		} break;
+		case LIBIMAGE_PNG_TYPE('t','R','N','S'): {
+			if(walk->first_chunk) return LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
+			if(walk->got_trns_chunk || walk->got_idat_chunk) return LIBIMAGE_PNG_ERROR_INVALID_FILE;
+			// One grey sample, one RGB sample or up to one alpha per palette entry, never with an alpha channel.
+			switch(info->color_type) {
+				case PNG_COLOR_TYPE_GREYSCALE:	     ret = chunk->data_len.i == 2; break;
+				case PNG_COLOR_TYPE_TRUECOLOUR:	     ret = chunk->data_len.i == 6; break;
+				case PNG_COLOR_TYPE_INDEXED_COLOUR: ret = walk->got_plte_chunk && chunk->data_len.i <= walk->plte_entries; break;
+				default:			     ret = 0; break;
+			}
+			if(!ret) return LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+			walk->got_trns_chunk = 1;
+			if(chunk->start_chunk_data == NULL) break;
+			if(info->color_type == PNG_COLOR_TYPE_INDEXED_COLOUR) {
+				for(i = 0; i < chunk->data_len.i; i++) info->palette[i][3] = chunk->start_chunk_data[i];
+			} else {
+				for(i = 0; i < chunk->data_len.i / 2; i++) info->trns_key[i] = ((uint16_t)chunk->start_chunk_data[2 * i] << 8) | chunk->start_chunk_data[2 * i + 1];
+			}
+			info->has_trns = 1;
+		} break;
+		case LIBIMAGE_PNG_TYPE('I','D','A','T'): {
+			if(walk->first_chunk) return LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
+			if(chunk->data_len.i > ( 1 << 30)) return LIBIMAGE_PNG_ERROR_IDAT_SIZE_LIMIT;
+			// The IDATs are consecutive, those left after the end of the zlib stream carry nothing else.
+			if(walk->idat_run_over) return LIBIMAGE_PNG_ERROR_INVALID_FILE;
+			if(walk->got_idat_chunk) break;
+			if(info->color_type == PNG_COLOR_TYPE_INDEXED_COLOUR && !walk->got_plte_chunk) return LIBIMAGE_PNG_ERROR_NO_PLTE;
+			walk->got_idat_chunk = 1;
+			walk->idat_begins    = 1;
+		} break;
+		case LIBIMAGE_PNG_TYPE('I','E','N','D'): {
+			if(walk->first_chunk) return LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
+			if(!walk->got_idat_chunk) return LIBIMAGE_PNG_ERROR_NO_IDAT;
+			LIBIMAGE_LOG(LIBIMAGE_LOG_DEBUG, "IEND, end of the file");
+			walk->got_iend_chunk = 1;
+		} break;
+		default: {
+			if(walk->first_chunk) return LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
+			if(LIBIMAGE_PNG_ANCILLARY(chunk->type.i)) break;
+			LIBIMAGE_LOG(LIBIMAGE_LOG_ERROR, "Chunk %c%c%c%c is not supported", chunk->type.i >> 24, (chunk->type.i >> 16) & 0xff, (chunk->type.i >> 8) & 0xff, chunk->type.i & 0xff);
+			return LIBIMAGE_PNG_ERROR_UNKNOWN_CRITICAL;
+		} break;
+	}
+	return 0;
+}
+
+void png_job_init(LibImagePngJob *job, LibImageImageInfo *info, LibImageDataReader *r)
+{
+	memset(job, 0, sizeof(*job));
+	job->info   = info;
+	job->reader = r;
+	job->state  = LIBIMAGE_PNG_JOB_CHUNKS;
+	png_walk_init(&job->walk);
+	// Nothing past max_input_bytes is read: a file known to be longer fails now, one of unknown length is cut there.
+	if(info->limits.max_input_bytes && r->size > info->limits.max_input_bytes) {
+		if(r->size != UINT64_MAX) {
+			r->error   = LIBIMAGE_ERROR_LIMIT_EXCEEDED;
+			job->state = LIBIMAGE_PNG_JOB_DONE;
 		} else {
-			png_parse_huffman_dynamic_block(&zlib_buf, info);
+			r->size	       = info->limits.max_input_bytes;
+			job->input_cut = 1;
 		}
-		if(info->error) return;
-	} while( !end);
-	zbuf_deinit(&zlib_buf);
+	}
 }
 
-void libimage_process_png(LibImageDataReader *r, LibImageImageInfo *info)
+/*
+*	Goes on with the decode, see LibImagePngJob. Returns non zero while there is more to do, zero once the
+*	decode is over with the error in the reader.
+*/
+int png_job_step(LibImagePngJob *job, uint32_t rows)
 {
+LibImageDataReader	*r = job->reader;
+LibImageImageInfo	*info = job->info;
 LibImagePngChunk 	chunk;
-uint8_t			*tmp_ptr, compression_method = -1;
-uint8_t			first_chunk = 1, got_idat_chunk = 0, got_plte_chunk = 0, got_gama_chunk=0;
-uint64_t		loop_count;
-uint32_t		state, size_data;
-uint32_t		crc32;
-
-	size_data = 0;
-	for(loop_count = 0; loop_count < MAXIMUM_LOOP_ALLOWED; loop_count++) {
+int			status, ret;
+#ifdef LIBIMAGE_STATS
+uint64_t		start;
+#endif
+
+	if(job->state == LIBIMAGE_PNG_JOB_ROWS) {
+		job->pipeline.yield_rows = rows;
+		LIBIMAGE_STAGE_BEGIN(info, LIBIMAGE_STAGE_ROWS, start);
+		status = png_pipeline_run(&job->pipeline);
+		LIBIMAGE_STAGE_END(info, LIBIMAGE_STAGE_ROWS, start);
+		if(status == LIBIMAGE_PIPELINE_YIELD && !r->error) return 1;
+		ret = png_rows_end(job, status);
+		if(ret) r->error = ret;
+		job->state = LIBIMAGE_PNG_JOB_CHUNKS;
+		png_data_end(job);
+		if(r->error) job->state = LIBIMAGE_PNG_JOB_DONE;
+	}
+
+	LIBIMAGE_STAGE_BEGIN(info, LIBIMAGE_STAGE_CHUNKS, start);
+	for(; job->state == LIBIMAGE_PNG_JOB_CHUNKS && job->loop_count < MAXIMUM_LOOP_ALLOWED; job->loop_count++) {
 		chunk = read_png_chunk(r);
+		if(r->error) break;
 #ifdef LIBIMAGE_PNG_CHECK_CRC
-		crc32  = crc(chunk.type.b, sizeof(chunk.type.b) + chunk.data_len.i);
-		if(chunk.crc.i != crc32) {
-			libimage_printf("Corrupted file crc-chunk %x crc-calc %x\n", chunk.crc.i, crc32);
+		if(!png_chunk_crc_matches(&chunk)) {
 			r->error = LIBIMAGE_PNG_ERROR_CRC_NOT_MATCH;
-			return;
+			break;
 		}
 #endif
-		switch(chunk.type.i) {
-			case LIBIMAGE_PNG_TYPE('I','H','D','R'): {
-				if(!first_chunk) {
-					r->error = LIBIMAGE_PNG_ERROR_MULTIPLE_IHDR;
-					return;
-				}
-				if(chunk.data_len.i != 13) {
-					r->error = LIBIMAGE_PNG_ERROR_CORRUPT_IHDR;
-					return;
-				}
-				process_ihdr_chunk(&chunk, r, info, &compression_method);
-				if(r->error) return;
-				first_chunk = 0;
-			} break;
-			case LIBIMAGE_PNG_TYPE('g','A','M','A'): {
-				if(first_chunk) {
-					r->error = LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
-					return;
-				}
-				if(got_plte_chunk) {
-					r->error = LIBIMAGE_PNG_ERROR_GAMA_AFTER_PLTE;
-					return;
-				}
-				if(got_gama_chunk) {
-					r->error = LIBIMAGE_PNG_ERROR_MULTIPLE_GAMA;
-					return;
-				}
-				info->gamma = u32_endian_swap(*(uint32_t*)chunk.start_chunk_data);
-				got_gama_chunk=1;
-			} break;
-			case LIBIMAGE_PNG_TYPE('P','L','T','E'): {
-				if(first_chunk) {
-					r->error = LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
-					return;
-				}
-				if(info->color_type == PNG_COLOR_TYPE_GREYSCALE
-					  	|| info->color_type == PNG_COLOR_TYPE_GREYSCALE_WITH_ALPHA) {
-					r->error = LIBIMAGE_PNG_ERROR_UNEXPECTED_PLTE;
-					return;
-				}
-				got_plte_chunk = 1;
-			} break;
-			case LIBIMAGE_PNG_TYPE('I','D','A','T'): {
-				if(first_chunk) {
-					r->error = LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
-					return;
-				}
-				got_idat_chunk = 1;
-				if(chunk.data_len.i > ( 1 << 30)) {
-					r->error = LIBIMAGE_PNG_ERROR_IDAT_SIZE_LIMIT;
-					return;
-				}
-				if(info->cd_offset + chunk.data_len.i > size_data) {
-					if(size_data == 0) size_data = chunk.data_len.i > IDAT_DEFAULT_BLOCK_SIZE ? chunk.data_len.i : IDAT_DEFAULT_BLOCK_SIZE;
-					while(info->cd_offset + chunk.data_len.i > size_data) size_data *= 2;
-					tmp_ptr = realloc(info->compressed_data, size_data);
-					if(tmp_ptr == NULL) {
-						r->error = LIBIMAGE_ERROR_MEMORY_ERROR;
-						return;
-					}
-					info->compressed_data = tmp_ptr;
-					info->cd_size = size_data;
-				}
-				// Append to the buffer
-				copy_to_buffer(info->compressed_data + info->cd_offset, chunk.start_chunk_data, chunk.end_chunk_data - chunk.start_chunk_data);
-				info->cd_offset += chunk.data_len.i;
-			} break;
-			case LIBIMAGE_PNG_TYPE('I','E','N','D'): {
-				if(first_chunk) {
-					r->error = LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
-					return;
-				}
-				if(!got_idat_chunk) {
-					r->error = LIBIMAGE_PNG_ERROR_NO_IDAT;
-					return;
-				}
-				if(info->color_type == PNG_COLOR_TYPE_INDEXED_COLOUR && !got_plte_chunk) {
-					r->error = LIBIMAGE_PNG_ERROR_NO_PLTE;
-					return;
-				}
-				// At the end process the actual image.
-				handle_png_data(info);
-				if(info->error) 
-					r->error = info->error;
-				libimage_printf("Color type %d\n", info->color_type); //TODO ern
-				libimage_printf("Got to the end of the file\n");
-				return;
-			} break;
-			default: {
-				libimage_printf("Type is %s(%x) which is not supported.\n", chunk.type.b, chunk.type.i);
-				r->error = LIBIMAGE_PNG_ERROR_INVALID_FILE;
-				goto bail;
-			} break;
+		r->error = png_walk_chunk(&job->walk, &chunk, info);
+		if(r->error || job->walk.got_iend_chunk) break;
+
+		if(job->walk.idat_begins) {
+			// Decode now, the following IDATs are pulled by the zlib stream itself.
+			LIBIMAGE_STAGE_END(info, LIBIMAGE_STAGE_CHUNKS, start);
+			ret = png_data_begin(job, &chunk);
+			LIBIMAGE_STAGE_BEGIN(info, LIBIMAGE_STAGE_CHUNKS, start);
+			if(ret) r->error = ret;
+			if(job->state == LIBIMAGE_PNG_JOB_ROWS && ret == 0) break;
+			if(job->state == LIBIMAGE_PNG_JOB_ROWS) png_rows_end(job, LIBIMAGE_ZBUF_FAILED);
+			job->state = LIBIMAGE_PNG_JOB_CHUNKS;
+			png_data_end(job);
+			if(r->error) break;
 		}
 	}
-bail:
+	LIBIMAGE_STAGE_END(info, LIBIMAGE_STAGE_CHUNKS, start);
+	if(job->state == LIBIMAGE_PNG_JOB_ROWS) return 1;
+	// A file that runs on past the cut is over the limit rather than truncated.
+	if(job->input_cut && r->error == LIBIMAGE_PNG_ERROR_TRUNCATED_DATA) r->error = LIBIMAGE_ERROR_LIMIT_EXCEEDED;
+	job->state = LIBIMAGE_PNG_JOB_DONE;
+	return 0;
+}
+
+// Gives back what a job stopped before its end still holds.
+void png_job_deinit(LibImagePngJob *job)
+{
+	if(job->state == LIBIMAGE_PNG_JOB_ROWS) png_rows_end(job, LIBIMAGE_ZBUF_FAILED);
+	png_data_end(job);
+	job->state = LIBIMAGE_PNG_JOB_DONE;
 }
 
+void libimage_process_png(LibImageDataReader *r, LibImageImageInfo *info)
+{
+LibImagePngJob	job;
+#ifdef LIBIMAGE_STATS
+uint64_t	start;
+#endif
+
+	LIBIMAGE_STAGE_BEGIN(info, LIBIMAGE_STAGE_DECODE, start);
+	png_job_init(&job, info, r);
+	while(png_job_step(&job, 0));
+	png_job_deinit(&job);
+	LIBIMAGE_STAGE_END(info, LIBIMAGE_STAGE_DECODE, start);
+}
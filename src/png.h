@@ -70,6 +70,9 @@
 #define LIBIMAGE_PNG_MAX_IMAGE_SIZE	( 1 << 24 )
 #endif
 
+#define LIBIMAGE_PNG_ADAM7_PASSES		7
+#define LIBIMAGE_INFLATE_POLL_BYTES		Kilo(256)	// Inflated between checks of cancellation and the deadline
+
 #define PNG_COLOR_TYPE_GREYSCALE 		0 // Each pixel is a greyscale sample
 #define PNG_COLOR_TYPE_TRUECOLOUR		2 // Each pixel is a R,G,B triple
 #define PNG_COLOR_TYPE_INDEXED_COLOUR		3 // Each pixel is a palette index; a PLTE chunk shall appear.
@@ -77,6 +80,8 @@
 #define PNG_COLOR_TYPE_TRUE_COLOUR_WITH_ALPHA	6 // Each pixel is an R,G,B triple followed by an alpha sample.
 
 #define LIBIMAGE_PNG_TYPE(a,b,c,d) 		(((uint32_t)((a) << 24)) + ((uint32_t)((b) << 16)) + ((uint32_t)((c) << 8)) + (uint32_t)(d))
+// Lower case first letter: a decoder that doesn't know the chunk can go on without it.
+#define LIBIMAGE_PNG_ANCILLARY(type)		(((type) >> 24) & 0x20)
 
 /*
  *
@@ -88,6 +93,7 @@
  *
  * Bit depth restrictions for each colour type are imposed to simplify implementations and to prohibit combinations that do not compress well
 */
+// Fields of the IHDR data, read one by one from the file, width and height in host order.
 typedef struct libimage_png_ihdr {
 	uint32_t width;
 	uint32_t height;
@@ -140,14 +146,47 @@ typedef struct libimage_png_chunk {
 	} crc;      		// calculated on the preceding bytes in the chunk, including the chunk type field and chunk data fields, but not including the length field.
 } LibImagePngChunk;
 
+/*
+*	State of the chunk walk, what has been seen so far decides what the next chunk can be.
+*/
+typedef struct libimage_png_walk {
+	uint8_t	compression_method;
+	uint8_t	first_chunk, got_idat_chunk, got_plte_chunk, got_gama_chunk, got_trns_chunk, got_iend_chunk;
+	uint8_t	idat_begins;
+	uint8_t	idat_run_over;		// A chunk came after the IDATs, there can't be more of them
+	uint16_t plte_entries;
+} LibImagePngWalk;
+
+extern const uint8_t png_adam7_start_x[LIBIMAGE_PNG_ADAM7_PASSES];
+extern const uint8_t png_adam7_start_y[LIBIMAGE_PNG_ADAM7_PASSES];
+extern const uint8_t png_adam7_step_x[LIBIMAGE_PNG_ADAM7_PASSES];
+extern const uint8_t png_adam7_step_y[LIBIMAGE_PNG_ADAM7_PASSES];
+
 int validate_ihdr(LibImagePngIHdr *h, LibImageImageInfo *i);
+int png_channel_count(uint8_t colour_type);
+uint64_t png_row_bytes(LibImageImageInfo *info, uint32_t width);
+uint32_t png_filter_bpp(LibImageImageInfo *info);
+uint32_t png_adam7_pass_columns(int pass, uint32_t width);
+void png_adam7_pass_size(LibImageImageInfo *info, int pass, uint32_t *width, uint32_t *height);
+int png_region_init(LibImageImageInfo *info);
+uint64_t png_uncompressed_size(LibImageImageInfo *info);
 void print_ihdr(LibImagePngIHdr *h);
+int png_check_limits(LibImageImageInfo *info);
+int png_poll_limits(LibImageImageInfo *info);
 LibImagePngChunk read_png_chunk(LibImageDataReader *r);
+int png_chunk_crc_matches(LibImagePngChunk *c);
 int check_png_signature(LibImageDataReader *r);
-void process_ihdr_chunk(LibImagePngChunk *c, LibImageDataReader *r, LibImageImageInfo *info, uint8_t *compression_method);
+int process_ihdr_chunk(LibImagePngChunk *c, LibImageImageInfo *info, uint8_t *compression_method);
 void png_parse_uncompressed_block(LibImageZlibBuffer *buf, LibImageImageInfo *info);
+int png_copy_stored_block(LibImageZlibBuffer *buf, LibImageImageInfo *info);
 void png_parse_huffman_fixed_block(LibImageZlibBuffer *buf, LibImageImageInfo *info);
 void png_parse_huffman_dynamic_block(LibImageZlibBuffer *buf, LibImageImageInfo *info);
-void handle_png_data(LibImageImageInfo *info);
+void png_init_inflate_tables(struct libimage_inflate_tables *tables);
+int png_inflate(LibImageZlibBuffer *buf, LibImageImageInfo *info);
+int png_next_idat_span(void *user, uint8_t **start, uint8_t **end);
+void png_rewind_idat_span(void *user, uint8_t *end);
+void png_walk_init(LibImagePngWalk *walk);
+int png_walk_chunk(LibImagePngWalk *walk, LibImagePngChunk *chunk, LibImageImageInfo *info);
+void png_unfilter_image(LibImageImageInfo *info);
 void libimage_process_png(LibImageDataReader *r, LibImageImageInfo *info);
 #endif
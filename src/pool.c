@@ -0,0 +1,142 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "common.h"
+#include "pool.h"
+
+static int pool_pop(LibImagePoolWorker *w, size_t *task)
+{
+int found;
+
+	pthread_mutex_lock(&w->queue.lock);
+	found = w->queue.head < w->queue.tail;
+	if(found) *task = w->queue.head++;
+	pthread_mutex_unlock(&w->queue.lock);
+	return found;
+}
+
+/*
+*	Takes the back half of the longest run of another worker and makes it the own run. The runs only ever shrink,
+*	so once no victim has anything left the worker can stop.
+*/
+static int pool_steal(LibImagePoolWorker *w)
+{
+LibImagePool		*pool = w->pool;
+LibImagePoolWorker	*victim, *best;
+size_t			left, best_left, take, head, tail;
+uint32_t		i;
+
+	while(1) {
+		best	  = NULL;
+		best_left = 0;
+		for(i = 1; i < pool->worker_count; i++) {
+			victim = &pool->workers[(w->index + i) % pool->worker_count];
+			pthread_mutex_lock(&victim->queue.lock);
+			left = victim->queue.tail - victim->queue.head;
+			pthread_mutex_unlock(&victim->queue.lock);
+			if(left > best_left) {
+				best	  = victim;
+				best_left = left;
+			}
+		}
+		if(best == NULL) return 0;
+
+		pthread_mutex_lock(&best->queue.lock);
+		left = best->queue.tail - best->queue.head;
+		take = (left + 1) / 2;
+		tail = best->queue.tail;
+		head = tail - take;
+		best->queue.tail = head;
+		pthread_mutex_unlock(&best->queue.lock);
+		// It may have been emptied since it was looked at.
+		if(take == 0) continue;
+
+		pthread_mutex_lock(&w->queue.lock);
+		w->queue.head = head;
+		w->queue.tail = tail;
+		pthread_mutex_unlock(&w->queue.lock);
+		return 1;
+	}
+}
+
+static void *pool_worker_run(void *arg)
+{
+LibImagePoolWorker	*w = arg;
+size_t			task;
+
+	do {
+		while(pool_pop(w, &task)) w->pool->task(w->pool->user, task, w->index);
+	} while(pool_steal(w));
+	return NULL;
+}
+
+// Zero asks for one per online CPU. There is never more workers than tasks.
+uint32_t libimage_pool_thread_count(uint32_t requested, size_t task_count)
+{
+long	cpus;
+size_t	count;
+
+	count = requested;
+	if(count == 0) {
+		cpus  = sysconf(_SC_NPROCESSORS_ONLN);
+		count = cpus > 0 ? (size_t)cpus : 1;
+	}
+	if(count > LIBIMAGE_POOL_MAX_THREADS) count = LIBIMAGE_POOL_MAX_THREADS;
+	if(count > task_count) count = task_count;
+	return count ? (uint32_t)count : 1;
+}
+
+/*
+*	Runs every task once on worker_count workers and returns when all are done. Returns zero or
+*	LIBIMAGE_ERROR_OUT_OF_MEMORY, in which case no task ran.
+*/
+int libimage_pool_run(size_t task_count, uint32_t worker_count, LibImagePoolTask task, void *user)
+{
+LibImagePool	pool;
+size_t		i, per_worker;
+uint32_t	t;
+
+	if(task_count == 0) return 0;
+	if(worker_count == 0) worker_count = 1;
+	if(worker_count > task_count) worker_count = task_count;
+
+	pool.task	  = task;
+	pool.user	  = user;
+	pool.worker_count = worker_count;
+	pool.workers	  = calloc(worker_count, sizeof(*pool.workers));
+	if(pool.workers == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+
+	// Contiguous runs keep neighbouring tasks on the same worker until stealing starts.
+	per_worker = task_count / worker_count;
+	for(t = 0, i = 0; t < worker_count; t++) {
+		pool.workers[t].pool	   = &pool;
+		pool.workers[t].index	   = t;
+		pool.workers[t].queue.head = i;
+		i += per_worker + (t < task_count % worker_count);
+		pool.workers[t].queue.tail = i;
+		pthread_mutex_init(&pool.workers[t].queue.lock, NULL);
+	}
+
+	// A worker whose thread can't start keeps its run, the others steal it.
+	for(t = 1; t < worker_count; t++) {
+		pool.workers[t].started = pthread_create(&pool.workers[t].thread, NULL, pool_worker_run, &pool.workers[t]) == 0;
+	}
+	pool_worker_run(&pool.workers[0]);
+	for(t = 1; t < worker_count; t++) {
+		if(pool.workers[t].started) pthread_join(pool.workers[t].thread, NULL);
+	}
+
+	for(t = 0; t < worker_count; t++) pthread_mutex_destroy(&pool.workers[t].queue.lock);
+	free(pool.workers);
+	return 0;
+}
@@ -0,0 +1,49 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_POOL_H__
+#define __LIB_IMAGE_POOL_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <pthread.h>
+#include "common.h"
+
+/*
+*	Work-stealing pool for a set of independent tasks numbered from zero. Every worker starts with a contiguous run
+*	of tasks and takes them from the front, one that runs out steals the back half of the longest run left. The
+*	calling thread is worker 0. Tasks get the index of the worker running them, for per worker scratch.
+*/
+#define LIBIMAGE_POOL_MAX_THREADS	256
+
+typedef void (*LibImagePoolTask)(void *user, size_t task, uint32_t worker);
+
+typedef struct libimage_pool_queue {
+	pthread_mutex_t	lock;
+	size_t		head, tail;	// Tasks not taken yet
+} LibImagePoolQueue;
+
+struct libimage_pool;
+
+typedef struct libimage_pool_worker {
+	struct libimage_pool	*pool;
+	LibImagePoolQueue	queue;
+	pthread_t		thread;
+	uint32_t		index;
+	uint8_t			started;
+} LibImagePoolWorker;
+
+typedef struct libimage_pool {
+	LibImagePoolTask	task;
+	void			*user;
+	LibImagePoolWorker	*workers;
+	uint32_t		worker_count;
+} LibImagePool;
+
+uint32_t libimage_pool_thread_count(uint32_t requested, size_t task_count);
+int libimage_pool_run(size_t task_count, uint32_t worker_count, LibImagePoolTask task, void *user);
+
+#endif
@@ -0,0 +1,80 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "crc32.h"
+
+static const uint8_t probe_png_sig[] = { 0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a };
+
+static int probe_skips_chunk(uint32_t type)
+{
+	if(type == LIBIMAGE_PNG_TYPE('g','A','M','A') || type == LIBIMAGE_PNG_TYPE('t','R','N','S')) return 0;
+	return LIBIMAGE_PNG_ANCILLARY(type);
+}
+
+/*
+*	Header probe. The chunks that describe the image all come before the first IDAT, so the walk stops at its header
+*	and nothing is inflated.
+*
+*	Walks the chunks of data up to the first IDAT, size can be a prefix of the file. Every chunk before it has to be
+*	whole in the prefix and is checked as the decode would, a prefix that ends earlier gives
+*	LIBIMAGE_PNG_ERROR_TRUNCATED_DATA so the caller can try with more. Returns zero or the error.
+*/
+int libimage_probe(const uint8_t *data, size_t size, LibImageProbeInfo *probe)
+{
+LibImageImageInfo	info = {0};
+LibImagePngWalk		walk;
+LibImagePngChunk	chunk;
+size_t			pos;
+int			ret;
+
+	if(data == NULL || probe == NULL) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	memset(probe, 0, sizeof(*probe));
+	if(size < sizeof(probe_png_sig)) return LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+	if(memcmp(data, probe_png_sig, sizeof(probe_png_sig))) return LIBIMAGE_ERROR_TYPE_NOT_SUPPORTED;
+
+	png_walk_init(&walk);
+	for(pos = sizeof(probe_png_sig); ; pos += 12 + (size_t)chunk.data_len.i) {
+		if(size - pos < 8) return LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+		memset(&chunk, 0, sizeof(chunk));
+		chunk.data_len.i = read_u32_be(data + pos);
+		chunk.type.i	 = read_u32_be(data + pos + 4);
+		if(chunk.data_len.i > INT32_MAX) return LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+
+		// The first IDAT is only looked at for its place in the walk, its payload doesn't have to be there.
+		if(chunk.type.i != LIBIMAGE_PNG_TYPE('I','D','A','T')) {
+			if(size - pos - 8 < (size_t)chunk.data_len.i + 4) return LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+			chunk.start_chunk_data = (uint8_t*)data + pos + 8;
+			chunk.end_chunk_data   = chunk.start_chunk_data + chunk.data_len.i;
+			memcpy(&chunk.crc.i, chunk.end_chunk_data, sizeof(chunk.crc.i));
+#ifdef LIBIMAGE_PNG_CHECK_CRC
+			if(!png_chunk_crc_matches(&chunk)) return LIBIMAGE_PNG_ERROR_CRC_NOT_MATCH;
+#endif
+		}
+		// Ancillary chunks the probe doesn't report on are only stepped over, whether the decode takes them or not.
+		if(!walk.first_chunk && probe_skips_chunk(chunk.type.i)) continue;
+		ret = png_walk_chunk(&walk, &chunk, &info);
+		if(ret) return ret;
+		if(walk.idat_begins) break;
+	}
+
+	probe->width		= info.width;
+	probe->height		= info.height;
+	probe->gamma		= info.gamma;
+	probe->palette_entries	= walk.plte_entries;
+	probe->bit_depth	= info.bit_depth;
+	probe->color_type	= info.color_type;
+	probe->interlace_method	= info.interlace_method;
+	probe->has_transparency	= walk.got_trns_chunk;
+	return 0;
+}
@@ -0,0 +1,276 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "arena.h"
+#include "convert.h"
+#include "scale.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#define LIBIMAGE_SCALE_SSE2	1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define LIBIMAGE_SCALE_NEON	1
+#endif
+
+#define LIBIMAGE_SCALE_INLINE	static inline __attribute__((always_inline))
+
+/*
+*	Scales the region of info by 1 << shift, once IHDR and the region are known. 8 bit samples sum up in 16 bits, a
+*	block of 8 x 8 is at most 16320. Returns zero or LIBIMAGE_ERROR_INVALID_ARGUMENT for a shift past
+*	LIBIMAGE_SCALE_MAX_SHIFT or samples that can't be averaged: palette indices, packed or big endian 16 bit ones.
+*/
+int png_scaler_init(LibImageScaler *s, LibImageImageInfo *info, uint32_t shift)
+{
+	if(shift == 0 || shift > LIBIMAGE_SCALE_MAX_SHIFT) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	memset(s, 0, sizeof(*s));
+	if(info->output_format == LIBIMAGE_FORMAT_NATIVE) {
+		if(info->bit_depth != 8 || info->color_type == PNG_COLOR_TYPE_INDEXED_COLOUR) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+		s->channels	= png_channel_count(info->color_type);
+		s->sample_bytes	= 1;
+	} else {
+		s->sample_bytes	= info->output_format == LIBIMAGE_FORMAT_RGBA16 ? 2 : 1;
+		s->channels	= png_format_pixel_bytes(info->output_format) / s->sample_bytes;
+	}
+	s->shift	 = shift;
+	s->width	 = info->roi_width;
+	s->height	 = info->roi_height;
+	s->out_width	 = png_scaled_size(s->width, shift);
+	s->out_height	 = png_scaled_size(s->height, shift);
+	s->row_bytes	 = png_output_row_bytes(info);
+	s->out_row_bytes = (uint64_t)s->out_width * s->channels * s->sample_bytes;
+	s->acc_bytes	 = (uint64_t)s->width * s->channels * (s->sample_bytes == 1 ? sizeof(uint16_t) : sizeof(uint32_t));
+	return 0;
+}
+
+// Size of processed_data: the rows of the region, scaled down when info->scale_shift is set.
+uint64_t png_output_image_size(LibImageImageInfo *info)
+{
+uint32_t	width, height;
+
+	if(info->scale_shift == 0) return (uint64_t)info->roi_height * png_output_row_bytes(info);
+	png_output_dimensions(info, &width, &height);
+	if(info->output_format == LIBIMAGE_FORMAT_NATIVE) return (uint64_t)height * png_row_bytes(info, width);
+	return (uint64_t)height * width * png_format_pixel_bytes(info->output_format);
+}
+
+// Width and height of the image handed back.
+void png_output_dimensions(LibImageImageInfo *info, uint32_t *width, uint32_t *height)
+{
+	*width	= png_scaled_size(info->roi_width, info->scale_shift);
+	*height	= png_scaled_size(info->roi_height, info->scale_shift);
+}
+
+int png_scale_lane_alloc(LibImageImageInfo *info, LibImageScaleLane *lane)
+{
+	lane->row = libimage_scratch_alloc(info, info->scaler->row_bytes);
+	lane->acc = libimage_scratch_alloc(info, info->scaler->acc_bytes);
+	lane->out = info->out_stream ? libimage_scratch_alloc(info, info->scaler->out_row_bytes) : NULL;
+	if(lane->row == NULL || lane->acc == NULL || (info->out_stream && lane->out == NULL)) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	memset(lane->acc, 0, info->scaler->acc_bytes);
+	return 0;
+}
+
+void png_scale_lane_free(LibImageImageInfo *info, LibImageScaleLane *lane)
+{
+	libimage_scratch_free(info, lane->row);
+	libimage_scratch_free(info, lane->acc);
+	libimage_scratch_free(info, lane->out);
+	lane->row = NULL;
+	lane->acc = NULL;
+	lane->out = NULL;
+}
+
+// Vertical part of the box, adds a row of count 8 bit samples to the column sums.
+LIBIMAGE_SCALE_INLINE void scale_accumulate8(uint16_t *acc, const uint8_t *row, uint64_t count)
+{
+uint64_t i = 0;
+
+#if defined(LIBIMAGE_SCALE_SSE2)
+	__m128i zero = _mm_setzero_si128(), v;
+
+	for(; i + 16 <= count; i += 16) {
+		v = _mm_loadu_si128((const __m128i*)(row + i));
+		_mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi16(_mm_loadu_si128((const __m128i*)(acc + i)), _mm_unpacklo_epi8(v, zero)));
+		_mm_storeu_si128((__m128i*)(acc + i + 8), _mm_add_epi16(_mm_loadu_si128((const __m128i*)(acc + i + 8)), _mm_unpackhi_epi8(v, zero)));
+	}
+#elif defined(LIBIMAGE_SCALE_NEON)
+	for(; i + 16 <= count; i += 16) {
+		uint8x16_t v = vld1q_u8(row + i);
+		vst1q_u16(acc + i, vaddw_u8(vld1q_u16(acc + i), vget_low_u8(v)));
+		vst1q_u16(acc + i + 8, vaddw_u8(vld1q_u16(acc + i + 8), vget_high_u8(v)));
+	}
+#endif
+	for(; i < count; i++) acc[i] += row[i];
+}
+
+// Same for 16 bit samples in the byte order of the machine.
+LIBIMAGE_SCALE_INLINE void scale_accumulate16(uint32_t *acc, const uint8_t *row, uint64_t count)
+{
+uint64_t i = 0;
+uint16_t sample;
+
+#if defined(LIBIMAGE_SCALE_SSE2)
+	__m128i zero = _mm_setzero_si128(), v;
+
+	for(; i + 8 <= count; i += 8) {
+		v = _mm_loadu_si128((const __m128i*)(row + 2 * i));
+		_mm_storeu_si128((__m128i*)(acc + i), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i)), _mm_unpacklo_epi16(v, zero)));
+		_mm_storeu_si128((__m128i*)(acc + i + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i*)(acc + i + 4)), _mm_unpackhi_epi16(v, zero)));
+	}
+#elif defined(LIBIMAGE_SCALE_NEON)
+	for(; i + 8 <= count; i += 8) {
+		uint16x8_t v = vreinterpretq_u16_u8(vld1q_u8(row + 2 * i));
+		vst1q_u32(acc + i, vaddw_u16(vld1q_u32(acc + i), vget_low_u16(v)));
+		vst1q_u32(acc + i + 4, vaddw_u16(vld1q_u32(acc + i + 4), vget_high_u16(v)));
+	}
+#endif
+	for(; i < count; i++) {
+		memcpy(&sample, row + 2 * i, sizeof(sample));
+		acc[i] += sample;
+	}
+}
+
+/*
+*	Horizontal part, adds the pixels of the column sums two by two in place: width pixels of channels samples
+*	become ( width + 1 ) / 2, the last one alone when width is odd. Run shift times it sums whole blocks.
+*/
+LIBIMAGE_SCALE_INLINE void scale_halve16(uint16_t *acc, uint32_t width, uint32_t channels)
+{
+uint32_t	i, c, pairs;
+
+	pairs = width / 2;
+	i     = 0;
+#if defined(LIBIMAGE_SCALE_SSE2)
+	if(channels == 4) {
+		__m128i a, b;
+
+		// Two pixels per register, the low halves of a and b against their high halves.
+		for(; i + 2 <= pairs; i += 2) {
+			a = _mm_loadu_si128((const __m128i*)(acc + 8 * i));
+			b = _mm_loadu_si128((const __m128i*)(acc + 8 * i + 8));
+			_mm_storeu_si128((__m128i*)(acc + 4 * i), _mm_add_epi16(_mm_unpacklo_epi64(a, b), _mm_unpackhi_epi64(a, b)));
+		}
+	} else if(channels == 1) {
+		__m128i ones = _mm_set1_epi16(1), a, b;
+
+		// Sums stay below 32768, the signed multiply add and pack keep them as they are.
+		for(; i + 8 <= pairs; i += 8) {
+			a = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(acc + 2 * i)), ones);
+			b = _mm_madd_epi16(_mm_loadu_si128((const __m128i*)(acc + 2 * i + 8)), ones);
+			_mm_storeu_si128((__m128i*)(acc + i), _mm_packs_epi32(a, b));
+		}
+	}
+#elif defined(LIBIMAGE_SCALE_NEON)
+	if(channels == 4) {
+		for(; i + 2 <= pairs; i += 2) {
+			uint16x8_t a = vld1q_u16(acc + 8 * i), b = vld1q_u16(acc + 8 * i + 8);
+			vst1q_u16(acc + 4 * i, vaddq_u16(vcombine_u16(vget_low_u16(a), vget_low_u16(b)), vcombine_u16(vget_high_u16(a), vget_high_u16(b))));
+		}
+	} else if(channels == 1) {
+		for(; i + 8 <= pairs; i += 8) {
+			uint16x8x2_t v = vld2q_u16(acc + 2 * i);
+			vst1q_u16(acc + i, vaddq_u16(v.val[0], v.val[1]));
+		}
+	}
+#endif
+	for(; i < pairs; i++) {
+		for(c = 0; c < channels; c++) acc[i * channels + c] = acc[2 * i * channels + c] + acc[(2 * i + 1) * channels + c];
+	}
+	if(width & 1) {
+		for(c = 0; c < channels; c++) acc[pairs * channels + c] = acc[2 * pairs * channels + c];
+	}
+}
+
+LIBIMAGE_SCALE_INLINE void scale_halve32(uint32_t *acc, uint32_t width, uint32_t channels)
+{
+uint32_t	i, c, pairs;
+
+	pairs = width / 2;
+	for(i = 0; i < pairs; i++) {
+		for(c = 0; c < channels; c++) acc[i * channels + c] = acc[2 * i * channels + c] + acc[(2 * i + 1) * channels + c];
+	}
+	if(width & 1) {
+		for(c = 0; c < channels; c++) acc[pairs * channels + c] = acc[2 * pairs * channels + c];
+	}
+}
+
+// Rounded mean of each block, the sums of rows rows hold the whole blocks but for the last column.
+LIBIMAGE_SCALE_INLINE void scale_store(const LibImageScaler *s, uint8_t *dst, const void *acc, uint32_t rows, uint32_t channels)
+{
+const uint16_t	*acc16 = acc;
+const uint32_t	*acc32 = acc;
+uint32_t	x, c, n, full, sum, value, last_cols;
+uint16_t	sample;
+
+	full	  = rows << s->shift;
+	last_cols = s->width - ((s->out_width - 1) << s->shift);
+	for(x = 0; x < s->out_width; x++) {
+		n = x + 1 < s->out_width ? full : last_cols * rows;
+		for(c = 0; c < channels; c++) {
+			sum   = s->sample_bytes == 1 ? acc16[x * channels + c] : acc32[x * channels + c];
+			// Whole blocks divide by a power of two.
+			value = n == (1u << (2 * s->shift)) ? (sum + (n >> 1)) >> (2 * s->shift) : (sum + n / 2) / n;
+			if(s->sample_bytes == 1) {
+				dst[x * channels + c] = value;
+			} else {
+				sample = value;
+				memcpy(dst + 2 * (x * channels + c), &sample, sizeof(sample));
+			}
+		}
+	}
+}
+
+LIBIMAGE_SCALE_INLINE void scale_finish_block(const LibImageScaler *s, uint8_t *dst, void *acc, uint32_t rows, uint32_t channels)
+{
+uint32_t	level, width;
+
+	width = s->width;
+	for(level = 0; level < s->shift; level++, width = (width + 1) / 2) {
+		if(s->sample_bytes == 1) scale_halve16(acc, width, channels);
+		else scale_halve32(acc, width, channels);
+	}
+	scale_store(s, dst, acc, rows, channels);
+}
+
+/*
+*	Takes row r of the region, a complete row in the sample layout of the file, and adds it to the block it falls
+*	in. The output row is written to processed_data once the last row of the block is in, lane is then ready for
+*	the next block. Rows of a block come in order and through the same lane.
+*/
+void png_scale_row(LibImageImageInfo *info, LibImageScaleLane *lane, uint32_t r, const uint8_t *row)
+{
+const LibImageScaler	*s = info->scaler;
+uint32_t		mask, rows;
+uint8_t			*dst, *out;
+
+	png_output_row(info, lane->row, row);
+	if(s->sample_bytes == 1) scale_accumulate8(lane->acc, lane->row, (uint64_t)s->width * s->channels);
+	else scale_accumulate16(lane->acc, lane->row, (uint64_t)s->width * s->channels);
+
+	mask = (1u << s->shift) - 1;
+	if((r & mask) != mask && r + 1 != s->height) return;
+	rows = (r & mask) + 1;
+	dst  = info->processed_data + (uint64_t)(r >> s->shift) * info->out_stride;
+	out  = info->out_stream ? lane->out : dst;
+	// The channel count is a constant in each of these.
+	switch(s->channels) {
+		case 1:  scale_finish_block(s, out, lane->acc, rows, 1); break;
+		case 2:  scale_finish_block(s, out, lane->acc, rows, 2); break;
+		case 3:  scale_finish_block(s, out, lane->acc, rows, 3); break;
+		default: scale_finish_block(s, out, lane->acc, rows, 4); break;
+	}
+	if(info->out_stream) png_stream_row(dst, out, s->out_row_bytes);
+	memset(lane->acc, 0, s->acc_bytes);
+}
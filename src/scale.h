@@ -0,0 +1,52 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_SCALE_H__
+#define __LIB_IMAGE_SCALE_H__
+
+#include <inttypes.h>
+#include "common.h"
+
+#define LIBIMAGE_SCALE_MAX_SHIFT	3	// Down to 1/8
+
+/*
+*	Box filter that shrinks the decoded region by 1 << shift on both sides while it is decoded. Each output pixel
+*	is the rounded mean of the block of pixels it covers, the blocks of the right and bottom edges can be smaller.
+*	Works on the samples of the output format, 8 bit ones or the 16 bit ones of RGBA16.
+*/
+typedef struct libimage_scaler {
+	uint32_t	shift;
+	uint32_t	channels, sample_bytes;
+	uint32_t	width, height;		// Of the region
+	uint32_t	out_width, out_height;
+	uint64_t	row_bytes, out_row_bytes;
+	uint64_t	acc_bytes;
+} LibImageScaler;
+
+/*
+*	What each thread that scales rows needs for itself: the row in the output format and the sums of the columns
+*	of the rows of the current block, 16 bits per sample for 8 bit samples and 32 bits for 16 bit ones. A streamed
+*	output gets its rows from out.
+*/
+typedef struct libimage_scale_lane {
+	uint8_t		*row;
+	void		*acc;
+	uint8_t		*out;
+} LibImageScaleLane;
+
+int png_scaler_init(LibImageScaler *s, LibImageImageInfo *info, uint32_t shift);
+int png_scale_lane_alloc(LibImageImageInfo *info, LibImageScaleLane *lane);
+void png_scale_lane_free(LibImageImageInfo *info, LibImageScaleLane *lane);
+void png_scale_row(LibImageImageInfo *info, LibImageScaleLane *lane, uint32_t r, const uint8_t *row);
+uint64_t png_output_image_size(LibImageImageInfo *info);
+void png_output_dimensions(LibImageImageInfo *info, uint32_t *width, uint32_t *height);
+
+static inline uint32_t png_scaled_size(uint32_t size, uint32_t shift)
+{
+	return (uint32_t)(((uint64_t)size + (1u << shift) - 1) >> shift);
+}
+
+#endif
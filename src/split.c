@@ -0,0 +1,365 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "huffman.h"
+#include "adler32.h"
+#include "arena.h"
+#include "pool.h"
+#include "split.h"
+#include "stats.h"
+
+#define LIBIMAGE_SPLIT_SPANS	64	// IDAT chunks the span list starts with room for
+
+// Payload of an IDAT chunk and where it sits in the compressed stream.
+typedef struct libimage_split_span {
+	uint8_t		*data;
+	uint64_t	offset;
+	uint32_t	size;
+} LibImageSplitSpan;
+
+struct libimage_split_job;
+
+typedef struct libimage_split_segment {
+	struct libimage_split_job *job;
+	LibImageImageInfo	info;		// Output of the segment, the first one writes straight into the image's
+	LibImageZlibBuffer	zbuf;
+	LibImageInflateTables	tables;
+	uint64_t		cursor, end;	// Compressed bytes not handed to zbuf yet
+	uint32_t		span;		// Span of the cursor
+	uint64_t		out_offset;	// Where its output goes in the image's uncompressed_data
+	uint32_t		adler;		// Of its output
+	int			status;
+} LibImageSplitSegment;
+
+typedef struct libimage_split_job {
+	LibImageImageInfo	*info;
+	LibImageSplitSpan	*spans;
+	uint32_t		span_count;
+	uint64_t		stream_size;
+	LibImageSplitSegment	*segments;
+	uint32_t		segment_count;
+	uint32_t		*kept;		// Segments whose output makes up the stream, in order
+	uint32_t		kept_count;
+} LibImageSplitJob;
+
+// Reads every IDAT chunk up front, they are all needed to know where the shares of the stream are.
+static int split_collect_spans(LibImageSplitJob *job, LibImageDataReader *r, LibImagePngChunk *first_idat)
+{
+LibImageSplitSpan	*spans;
+uint32_t		capacity;
+uint8_t			*start, *end;
+
+	capacity   = LIBIMAGE_SPLIT_SPANS;
+	job->spans = libimage_scratch_alloc(job->info, capacity * sizeof(*job->spans));
+	if(job->spans == NULL) return 0;
+	start = first_idat->start_chunk_data;
+	end   = start + first_idat->data_len.i;
+	do {
+		if(end == start) continue;
+		if(job->span_count == capacity) {
+			spans = libimage_scratch_alloc(job->info, 2 * capacity * sizeof(*spans));
+			if(spans == NULL) return 0;
+			memcpy(spans, job->spans, capacity * sizeof(*spans));
+			libimage_scratch_free(job->info, job->spans);
+			job->spans = spans;
+			capacity  *= 2;
+		}
+		job->spans[job->span_count].data   = start;
+		job->spans[job->span_count].offset = job->stream_size;
+		job->spans[job->span_count].size   = end - start;
+		job->stream_size += end - start;
+		job->span_count++;
+	} while(png_next_idat_span(r, &start, &end));
+	return r->error == 0 && job->span_count;
+}
+
+// Byte of the stream at offset, looked for from the given span on. -1 past the end.
+static int split_stream_byte(LibImageSplitJob *job, uint32_t span, uint64_t offset)
+{
+	while(span < job->span_count && offset >= job->spans[span].offset + job->spans[span].size) span++;
+	return span < job->span_count ? job->spans[span].data[offset - job->spans[span].offset] : -1;
+}
+
+// Offset right after the first 00 00 ff ff that starts in [from, to), zero when there is none.
+static uint64_t split_find_flush(LibImageSplitJob *job, uint64_t from, uint64_t to)
+{
+LibImageSplitSpan	*span;
+uint8_t			*p, *stop;
+uint64_t		at;
+uint32_t		s;
+
+	for(s = 0; s < job->span_count; s++) {
+		span = &job->spans[s];
+		if(span->offset + span->size <= from) continue;
+		if(span->offset >= to) break;
+		p    = span->data + (from > span->offset ? from - span->offset : 0);
+		stop = span->data + (to < span->offset + span->size ? to - span->offset : span->size);
+		while(p < stop && (p = memchr(p, 0, stop - p)) != NULL) {
+			at = span->offset + (p - span->data);
+			// The marker can run over into the next chunks.
+			if(split_stream_byte(job, s, at + 1) == 0 && split_stream_byte(job, s, at + 2) == 0xff && split_stream_byte(job, s, at + 3) == 0xff) return at + 4;
+			p++;
+		}
+	}
+	return 0;
+}
+
+// Hands the segment its compressed bytes, cut to the spans they sit in.
+static int split_next_input(void *user, uint8_t **start, uint8_t **end)
+{
+LibImageSplitSegment	*seg = user;
+LibImageSplitSpan	*span;
+uint64_t		stop;
+
+	if(seg->cursor >= seg->end) return 0;
+	while(seg->job->spans[seg->span].offset + seg->job->spans[seg->span].size <= seg->cursor) seg->span++;
+	span   = &seg->job->spans[seg->span];
+	stop   = seg->end < span->offset + span->size ? seg->end : span->offset + span->size;
+	*start = span->data + (seg->cursor - span->offset);
+	*end   = span->data + (stop - span->offset);
+	seg->cursor = stop;
+	return 1;
+}
+
+// Goes back to the end of the span that ends at end, the spans of the segment are searched from the current one down.
+static void split_rewind_input(void *user, uint8_t *end)
+{
+LibImageSplitSegment	*seg = user;
+LibImageSplitSpan	*span;
+
+	span = &seg->job->spans[seg->span];
+	while(end <= span->data || end > span->data + span->size) span--;
+	seg->span   = span - seg->job->spans;
+	seg->cursor = span->offset + (end - span->data);
+}
+
+/*
+*	The first segment is the start of the zlib stream and the only one whose output goes straight to the image.
+*	The others start on a block and get a buffer of twice the share of the output their share of the input gives,
+*	it grows if that isn't enough.
+*/
+static int split_segment_init(LibImageSplitJob *job, LibImageSplitSegment *seg, uint64_t begin, uint64_t end)
+{
+uint64_t	capacity;
+
+	seg->job	   = job;
+	seg->info	   = *job->info;
+	seg->info.un_offset = 0;
+	seg->info.error	   = 0;
+	seg->cursor	   = begin;
+	seg->end	   = end;
+	seg->span	   = 0;
+	zbuf_init(&seg->zbuf, job->spans[0].data, 0, 0);
+	seg->zbuf.next_input	  = split_next_input;
+	seg->zbuf.rewind_input	  = split_rewind_input;
+	seg->zbuf.next_input_user = seg;
+	png_init_inflate_tables(&seg->tables);
+	seg->zbuf.tables = &seg->tables;
+	if(seg == job->segments) return 1;
+
+	seg->zbuf.state	     = LIBIMAGE_ZBUF_STATE_BLOCK_HEADER;
+	seg->info.skip_adler = 1;
+	capacity = 2 * (uint64_t)((double)(end - begin) / job->stream_size * job->info->un_size) + Kilo(64);
+	if(capacity > (uint64_t)job->info->un_size) capacity = job->info->un_size;
+	seg->info.uncompressed_data = libimage_scratch_alloc(job->info, capacity);
+	seg->info.un_size = capacity;
+	return seg->info.uncompressed_data != NULL;
+}
+
+// One segment per worker, each at the first flush past an even share of the stream. Zero when it doesn't split.
+static int split_segments_init(LibImageSplitJob *job, uint32_t thread_count)
+{
+uint64_t	begin[LIBIMAGE_POOL_MAX_THREADS], share, at, end;
+uint32_t	count, n, i;
+
+	n = libimage_pool_thread_count(thread_count, job->stream_size / LIBIMAGE_SPLIT_MIN_SEGMENT);
+	if(n < 2) return 0;
+	share	 = job->stream_size / n;
+	begin[0] = 0;
+	for(i = 1, count = 1; i < n; i++) {
+		at = split_find_flush(job, i * share, i + 1 < n ? (i + 1) * share : job->stream_size);
+		if(at && at < job->stream_size) begin[count++] = at;
+	}
+	if(count < 2) return 0;
+
+	job->segments = libimage_scratch_alloc(job->info, count * sizeof(*job->segments));
+	job->kept     = libimage_scratch_alloc(job->info, count * sizeof(*job->kept));
+	if(job->segments == NULL || job->kept == NULL) return 0;
+	memset(job->segments, 0, count * sizeof(*job->segments));
+	for(i = 0; i < count; i++) {
+		job->segment_count++;
+		end = i + 1 < count ? begin[i + 1] : job->stream_size;
+		if(!split_segment_init(job, &job->segments[i], begin[i], end)) return 0;
+	}
+	return 1;
+}
+
+static void split_inflate_segment(void *user, size_t task, uint32_t worker)
+{
+LibImageSplitJob	*job = user;
+LibImageSplitSegment	*seg = &job->segments[task];
+
+	(void)worker;
+	seg->status = png_inflate(&seg->zbuf, &seg->info);
+}
+
+// Carries on with a segment that filled its buffer, on a bigger one. Calling thread only, it allocates.
+static int split_segment_finish(LibImageSplitJob *job, LibImageSplitSegment *seg)
+{
+uint8_t		*data;
+uint64_t	size;
+
+	while(seg->status == LIBIMAGE_ZBUF_OUTPUT_FULL && seg != job->segments && seg->info.un_size < job->info->un_size) {
+		size = 2 * (uint64_t)seg->info.un_size;
+		if(size > (uint64_t)job->info->un_size) size = job->info->un_size;
+		data = libimage_scratch_alloc(job->info, size);
+		if(data == NULL) {
+			seg->status = LIBIMAGE_ZBUF_FAILED;
+			break;
+		}
+		LIBIMAGE_STAT_ADD(job->info, reallocations, 1);
+		memcpy(data, seg->info.uncompressed_data, seg->info.un_offset);
+		libimage_scratch_free(job->info, seg->info.uncompressed_data);
+		seg->info.uncompressed_data = data;
+		seg->info.un_size = size;
+		seg->status = png_inflate(&seg->zbuf, &seg->info);
+	}
+	return seg->status;
+}
+
+// Stopped on a block boundary with every bit it was given used, which is where the next segment starts.
+static int split_segment_is_clean(LibImageSplitSegment *seg)
+{
+	return seg->status == LIBIMAGE_ZBUF_NEED_INPUT && seg->zbuf.state == LIBIMAGE_ZBUF_STATE_BLOCK_HEADER && !seg->zbuf.final_block &&
+	       seg->cursor == seg->end && seg->zbuf.buf == seg->zbuf.buf_end && seg->zbuf.code_buf_bits <= seg->zbuf.overrun_bytes * 8;
+}
+
+/*
+*	Walks the segments in order from the first one, the only one known to start where it says. The next one is kept
+*	when the current one ended right on its start and it didn't fail, otherwise the current one decodes its input
+*	too. Gives 1 when the last one kept got the whole stream to its end, with all of the IDAT chunks used.
+*/
+static int split_stitch(LibImageSplitJob *job)
+{
+LibImageSplitSegment	*cur, *next;
+uint32_t		i;
+
+	cur = job->segments;
+	job->kept[job->kept_count++] = 0;
+	for(i = 1; i < job->segment_count; i++) {
+		next = &job->segments[i];
+		if(split_segment_finish(job, cur) != LIBIMAGE_ZBUF_NEED_INPUT) return 0;
+		split_segment_finish(job, next);
+		if(split_segment_is_clean(cur) && next->status != LIBIMAGE_ZBUF_FAILED) {
+			job->kept[job->kept_count++] = i;
+			cur = next;
+			continue;
+		}
+		libimage_scratch_free(job->info, next->info.uncompressed_data);
+		next->info.uncompressed_data = NULL;
+		// The padding zeros read past the old end give way to the real bits.
+		zbuf_drop_overrun(&cur->zbuf);
+		cur->end = next->end;
+		cur->zbuf.next_input = split_next_input;
+		cur->status = png_inflate(&cur->zbuf, &cur->info);
+	}
+	return split_segment_finish(job, cur) == LIBIMAGE_ZBUF_DONE && cur->cursor == job->stream_size;
+}
+
+// Puts the output of a kept segment at its place in the image, its checksum is taken while it is in cache.
+static void split_copy_segment(void *user, size_t task, uint32_t worker)
+{
+LibImageSplitJob	*job = user;
+LibImageSplitSegment	*seg = &job->segments[job->kept[task + 1]];
+uint8_t			*dst;
+
+	(void)worker;
+	dst = job->info->uncompressed_data + seg->out_offset;
+	memcpy(dst, seg->info.uncompressed_data, seg->info.un_offset);
+#ifdef LIBIMAGE_PNG_CHECK_ADLER
+	if(!job->info->skip_adler) seg->adler = adler32_update(LIBIMAGE_ADLER32_INIT, dst, seg->info.un_offset);
+#endif
+}
+
+#ifdef LIBIMAGE_PNG_CHECK_ADLER
+// The first segment has the checksum of its output, the ones after it are put together with it in order.
+static int split_adler_matches(LibImageSplitJob *job)
+{
+LibImageSplitSegment	*seg;
+uint32_t		adler, i;
+
+	// A single segment checked the trailer itself.
+	if(job->info->skip_adler || job->kept_count == 1) return 1;
+	// The trailer is read by the last segment.
+	seg   = &job->segments[job->kept[job->kept_count - 1]];
+	adler = job->segments[0].zbuf.adler;
+	for(i = 1; i < job->kept_count; i++) {
+		seg   = &job->segments[job->kept[i]];
+		adler = adler32_combine(adler, seg->adler, seg->info.un_offset);
+	}
+	return adler == seg->zbuf.trailer_adler;
+}
+#endif
+
+static int split_assemble(LibImageSplitJob *job, uint32_t thread_count)
+{
+LibImageSplitSegment	*seg, *prev;
+uint32_t		i;
+
+	prev = job->segments;
+	for(i = 1; i < job->kept_count; i++, prev = seg) {
+		seg = &job->segments[job->kept[i]];
+		seg->out_offset = prev->out_offset + prev->info.un_offset;
+	}
+	if(prev->out_offset + prev->info.un_offset > (uint64_t)job->info->un_size) return 0;
+	if(libimage_pool_run(job->kept_count - 1, libimage_pool_thread_count(thread_count, job->kept_count - 1), split_copy_segment, job)) return 0;
+#ifdef LIBIMAGE_PNG_CHECK_ADLER
+	if(!split_adler_matches(job)) return 0;
+#endif
+	job->info->un_offset = prev->out_offset + prev->info.un_offset;
+	return 1;
+}
+
+static void split_free(LibImageSplitJob *job)
+{
+uint32_t	i;
+
+	for(i = 1; i < job->segment_count; i++) libimage_scratch_free(job->info, job->segments[i].info.uncompressed_data);
+	libimage_scratch_free(job->info, job->kept);
+	libimage_scratch_free(job->info, job->segments);
+	libimage_scratch_free(job->info, job->spans);
+}
+
+int png_split_inflate(LibImageImageInfo *info, LibImageDataReader *r, LibImagePngChunk *first_idat, uint32_t thread_count)
+{
+LibImageSplitJob	job = {0};
+uint64_t		cursor;
+uint16_t		error;
+int			done;
+
+	cursor	 = r->cursor;
+	error	 = r->error;
+	job.info = info;
+	done = split_collect_spans(&job, r, first_idat);
+	if(done) done = split_segments_init(&job, thread_count);
+	if(done) done = libimage_pool_run(job.segment_count, libimage_pool_thread_count(thread_count, job.segment_count), split_inflate_segment, &job) == 0;
+	if(done) done = split_stitch(&job);
+	if(done) done = split_assemble(&job, thread_count);
+	split_free(&job);
+	if(!done) {
+		r->cursor = cursor;
+		r->error  = error;
+	}
+	return done;
+}
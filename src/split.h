@@ -0,0 +1,30 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_SPLIT_H__
+#define __LIB_IMAGE_SPLIT_H__
+
+#include <inttypes.h>
+#include "common.h"
+#include "png.h"
+
+#define LIBIMAGE_SPLIT_MIN_SEGMENT	Kilo(256)	// Compressed bytes below which a segment isn't worth a thread
+
+/*
+*	Parallel inflate of a zlib stream written as pieces separated by full flushes, each one starting with an empty
+*	history. A flush ends with an empty stored block, so the byte after 00 00 ff ff is where a piece can start. The
+*	stream is cut at the first of these past even shares of it and the segments are inflated on their own threads,
+*	each one into a buffer of its own since what it inflates to isn't known beforehand.
+*
+*	Nothing in the stream is trusted. A segment only counts once the one before it, decoded from a known point,
+*	ended on a block boundary right where it starts, and one that fails, for instance because it points back past
+*	its start after a sync flush, is decoded again by the one before it carrying on. Returns 1 once the whole stream
+*	is in uncompressed_data and checked. Returns 0, with the reader where it was, for any other outcome, the serial
+*	inflate then gives the result or the error it always did.
+*/
+int png_split_inflate(LibImageImageInfo *info, LibImageDataReader *r, LibImagePngChunk *first_idat, uint32_t thread_count);
+
+#endif
@@ -0,0 +1,40 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <inttypes.h>
+#include <time.h>
+
+#include "common.h"
+#include "stats.h"
+
+uint64_t libimage_stats_clock(void)
+{
+struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// The clock is only read when the decode wants the time, zero otherwise.
+uint64_t libimage_stage_begin(LibImageImageInfo *info, uint32_t stage)
+{
+uint64_t now;
+
+	if(info->stats == NULL && info->trace == NULL) return 0;
+	now = libimage_stats_clock();
+	if(info->trace) info->trace(info->trace_user, stage, 0, now);
+	return now;
+}
+
+void libimage_stage_end(LibImageImageInfo *info, uint32_t stage, uint64_t start)
+{
+uint64_t now;
+
+	if(info->stats == NULL && info->trace == NULL) return;
+	now = libimage_stats_clock();
+	if(info->stats) info->stats->stage_ns[stage] += now - start;
+	if(info->trace) info->trace(info->trace_user, stage, 1, now);
+}
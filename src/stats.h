@@ -0,0 +1,35 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_STATS_H__
+#define __LIB_IMAGE_STATS_H__
+
+#include <inttypes.h>
+#include "common.h"
+
+/*
+*	A decode given a LibImageStats fills it in when the library is built with LIBIMAGE_STATS, and times each
+*	LIBIMAGE_STAGE_* of the public header. The row pipeline inflates and reconstructs a few rows at a time, its time
+*	is one stage of its own. DECODE is the whole of it, the other stages are parts of it. Threads of a decode add to
+*	the stats with atomics, the counts are only read once it is over.
+*/
+#define LIBIMAGE_STATS_FILTER_TYPES	5	// The filter_rows of LibImageStats
+
+#ifdef LIBIMAGE_STATS
+#define LIBIMAGE_STAT_ADD(info, field, n)	do { if((info)->stats) __atomic_fetch_add(&(info)->stats->field, (uint64_t)(n), __ATOMIC_RELAXED); } while(0)
+#define LIBIMAGE_STAGE_BEGIN(info, stage, start)	((start) = libimage_stage_begin((info), (stage)))
+#define LIBIMAGE_STAGE_END(info, stage, start)	libimage_stage_end((info), (stage), (start))
+#else
+#define LIBIMAGE_STAT_ADD(info, field, n)	((void)0)
+#define LIBIMAGE_STAGE_BEGIN(info, stage, start)	((void)0)
+#define LIBIMAGE_STAGE_END(info, stage, start)	((void)0)
+#endif
+
+uint64_t libimage_stats_clock(void);
+uint64_t libimage_stage_begin(LibImageImageInfo *info, uint32_t stage);
+void libimage_stage_end(LibImageImageInfo *info, uint32_t stage, uint64_t start);
+
+#endif
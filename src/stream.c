@@ -0,0 +1,258 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <stdint.h>
+
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "huffman.h"
+#include "pipeline.h"
+#include "crc32.h"
+#include "stream.h"
+
+static const uint8_t stream_png_sig[] = { 0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a };
+
+// Gathers up to want bytes of a field split between feeds, returns how many were taken.
+static size_t stream_gather(uint8_t *dst, uint32_t *have, uint32_t want, const uint8_t *data, size_t size)
+{
+size_t n;
+
+	n = want - *have < size ? want - *have : size;
+	memcpy(dst + *have, data, n);
+	*have += n;
+	return n;
+}
+
+// Sets up the row pipeline once IHDR is known and the first IDAT shows up.
+static void stream_start_image(LibImageStream *s)
+{
+	s->input = malloc(LIBIMAGE_STREAM_INPUT_SIZE);
+	if(s->input == NULL) {
+		s->error = LIBIMAGE_ERROR_OUT_OF_MEMORY;
+		return;
+	}
+	s->input_len	= 0;
+	s->started	= 1;
+	s->error	= png_pipeline_init(&s->pipeline, &s->info, s->row_callback, s->row_user);
+	s->pipeline.zbuf.buf = s->pipeline.zbuf.buf_end = s->input;
+}
+
+// Inflates the buffered IDAT bytes as far as they go, the bytes the zlib stream didn't reach stay buffered.
+static void stream_inflate(LibImageStream *s)
+{
+LibImageZlibBuffer	*zbuf = &s->pipeline.zbuf;
+uint32_t		left;
+int			status;
+
+	zbuf->buf_end = s->input + s->input_len;
+	status = png_pipeline_run(&s->pipeline);
+	if(status == LIBIMAGE_ZBUF_FAILED) {
+		s->error = s->info.error;
+		return;
+	}
+	if(status == LIBIMAGE_ZBUF_DONE) return;
+
+	left = zbuf->buf_end - zbuf->buf;
+	memmove(s->input, zbuf->buf, left);
+	s->input_len	= left;
+	zbuf->buf	= s->input;
+	zbuf->buf_end	= s->input + left;
+}
+
+// IDAT payload, copied into the input buffer while the zlib stream is running and only checksummed after it.
+static size_t stream_feed_idat(LibImageStream *s, const uint8_t *data, size_t size)
+{
+size_t	n;
+
+	n = s->chunk_left < size ? s->chunk_left : size;
+	if(!s->pipeline.done) {
+		if(n > LIBIMAGE_STREAM_INPUT_SIZE - s->input_len) n = LIBIMAGE_STREAM_INPUT_SIZE - s->input_len;
+		// A full buffer is far more than any single unit the inflate waits for.
+		if(n == 0) {
+			s->error = LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+			return 0;
+		}
+		memcpy(s->input + s->input_len, data, n);
+		s->input_len += n;
+	}
+#ifdef LIBIMAGE_PNG_CHECK_CRC
+	s->crc = crc_update(s->crc, data, n);
+#endif
+	s->chunk_left -= n;
+	if(!s->pipeline.done) stream_inflate(s);
+	return n;
+}
+
+static void stream_begin_chunk(LibImageStream *s)
+{
+	s->chunk.data_len.i = read_u32_be(s->hold);
+	s->chunk.type.i	    = read_u32_be(s->hold + 4);
+	s->chunk.start_chunk_data = s->chunk.end_chunk_data = NULL;
+	s->chunk_left	= s->chunk.data_len.i;
+	s->hold_len	= 0;
+	s->crc		= crc_update(LIBIMAGE_CRC32_INIT, s->hold + 4, 4);
+	if(s->chunk.data_len.i > INT32_MAX) {
+		s->error = LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+		return;
+	}
+
+	// The zlib stream has to be over by the first chunk after the IDATs.
+	if(s->chunk.type.i != LIBIMAGE_PNG_TYPE('I','D','A','T') && s->walk.got_idat_chunk && !s->pipeline.done) {
+		s->error = LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+		return;
+	}
+
+	if(s->chunk.type.i == LIBIMAGE_PNG_TYPE('I','D','A','T')) {
+		s->error = png_walk_chunk(&s->walk, &s->chunk, &s->info);
+		if(s->error) return;
+		if(s->walk.idat_begins) stream_start_image(s);
+		s->state = LIBIMAGE_STREAM_IDAT_DATA;
+		return;
+	}
+
+	// Bigger chunks are walked on their header alone, none of the chunks that get read can be that big.
+	s->chunk_held = s->chunk.data_len.i <= LIBIMAGE_STREAM_HOLD_SIZE;
+	if(!s->chunk_held) {
+		s->error = png_walk_chunk(&s->walk, &s->chunk, &s->info);
+		if(s->error) return;
+	}
+	s->state = LIBIMAGE_STREAM_CHUNK_DATA;
+}
+
+static void stream_end_chunk(LibImageStream *s)
+{
+#ifdef LIBIMAGE_PNG_CHECK_CRC
+uint32_t	crc32;
+
+	memcpy(&crc32, s->crc_bytes, sizeof(crc32));
+	if(crc32 != crc_final(s->crc)) {
+		s->error = LIBIMAGE_PNG_ERROR_CRC_NOT_MATCH;
+		return;
+	}
+#endif
+	s->crc_len  = 0;
+	s->state    = LIBIMAGE_STREAM_CHUNK_HEADER;
+	if(s->chunk.type.i == LIBIMAGE_PNG_TYPE('I','D','A','T') || !s->chunk_held) return;
+
+	s->chunk.start_chunk_data = s->hold;
+	s->error    = png_walk_chunk(&s->walk, &s->chunk, &s->info);
+	s->hold_len = 0;
+	if(s->walk.got_iend_chunk) s->state = LIBIMAGE_STREAM_END;
+}
+
+LibImageStream *libimage_stream_create(LibImageRowCallback row_callback, void *user)
+{
+LibImageStream *s;
+
+	if(row_callback == NULL) return NULL;
+	s = calloc(1, sizeof(*s));
+	if(s == NULL) return NULL;
+
+	s->row_callback	= row_callback;
+	s->row_user	= user;
+	s->state	= LIBIMAGE_STREAM_SIGNATURE;
+	png_walk_init(&s->walk);
+	return s;
+}
+
+/*
+*	Takes the next size bytes of the file, as many times as needed. Returns the error that stopped the decode, the
+*	same one for every later call, or zero. Bytes after IEND are ignored.
+*/
+int libimage_stream_feed(LibImageStream *s, const uint8_t *data, size_t size)
+{
+size_t	n;
+
+	if(s == NULL || (data == NULL && size)) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+
+	while(size > 0 && !s->error && s->state != LIBIMAGE_STREAM_END) {
+		switch(s->state) {
+			case LIBIMAGE_STREAM_SIGNATURE: {
+				n = stream_gather(s->hold, &s->hold_len, sizeof(stream_png_sig), data, size);
+				if(s->hold_len == sizeof(stream_png_sig)) {
+					if(memcmp(s->hold, stream_png_sig, sizeof(stream_png_sig))) s->error = LIBIMAGE_ERROR_TYPE_NOT_SUPPORTED;
+					s->hold_len = 0;
+					s->state    = LIBIMAGE_STREAM_CHUNK_HEADER;
+				}
+			} break;
+			case LIBIMAGE_STREAM_CHUNK_HEADER: {
+				n = stream_gather(s->hold, &s->hold_len, 8, data, size);
+				if(s->hold_len == 8) stream_begin_chunk(s);
+			} break;
+			case LIBIMAGE_STREAM_CHUNK_DATA: {
+				n = s->chunk_left < size ? s->chunk_left : size;
+				if(s->chunk_held) {
+					memcpy(s->hold + s->hold_len, data, n);
+					s->hold_len += n;
+				}
+#ifdef LIBIMAGE_PNG_CHECK_CRC
+				s->crc = crc_update(s->crc, data, n);
+#endif
+				s->chunk_left -= n;
+			} break;
+			case LIBIMAGE_STREAM_IDAT_DATA: {
+				n = stream_feed_idat(s, data, size);
+			} break;
+			case LIBIMAGE_STREAM_CHUNK_CRC: {
+				n = stream_gather(s->crc_bytes, &s->crc_len, sizeof(s->crc_bytes), data, size);
+				if(s->crc_len == sizeof(s->crc_bytes)) stream_end_chunk(s);
+			} break;
+			default: {
+				n = size;
+			} break;
+		}
+		data += n;
+		size -= n;
+
+		if((s->state == LIBIMAGE_STREAM_CHUNK_DATA || s->state == LIBIMAGE_STREAM_IDAT_DATA) && s->chunk_left == 0 && !s->error) {
+			s->state = LIBIMAGE_STREAM_CHUNK_CRC;
+		}
+	}
+	return s->error;
+}
+
+// Called once the file is over, tells whether it was complete.
+int libimage_stream_finish(LibImageStream *s)
+{
+	if(s == NULL) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	if(s->error) return s->error;
+	if(s->state != LIBIMAGE_STREAM_END) s->error = LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+	return s->error;
+}
+
+// Whether the Adler-32 of the zlib stream is checked, on by default. Only before the image data has been fed.
+int libimage_stream_set_verify_adler(LibImageStream *s, int verify)
+{
+	if(s == NULL || s->started) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	s->info.skip_adler = verify == 0;
+	return 0;
+}
+
+// Available once IHDR has been fed.
+int libimage_stream_get_header(LibImageStream *s, uint32_t *width, uint32_t *height, uint8_t *bit_depth, uint8_t *color_type, uint8_t *interlace_method)
+{
+	if(s == NULL) return LIBIMAGE_ERROR_INVALID_ARGUMENT;
+	if(s->walk.first_chunk) return s->error ? s->error : LIBIMAGE_PNG_ERROR_IHDR_NOT_FOUND;
+
+	if(width)		*width		  = s->info.width;
+	if(height)		*height		  = s->info.height;
+	if(bit_depth)		*bit_depth	  = s->info.bit_depth;
+	if(color_type)		*color_type	  = s->info.color_type;
+	if(interlace_method)	*interlace_method = s->info.interlace_method;
+	return 0;
+}
+
+void libimage_stream_destroy(LibImageStream *s)
+{
+	if(s == NULL) return;
+	if(s->started) png_pipeline_deinit(&s->pipeline);
+	free(s->input);
+	free(s);
+}
@@ -0,0 +1,60 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
+#ifndef __LIB_IMAGE_STREAM_H__
+#define __LIB_IMAGE_STREAM_H__
+
+#include <inttypes.h>
+#include <stddef.h>
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "huffman.h"
+#include "pipeline.h"
+
+/*
+*	Push decoder, the file arrives in pieces of any size and every scanline is handed to the callback as soon as it
+*	is inflated and unfiltered. Only the row pipeline ( LZ77 history and two scanlines ) and the IDAT bytes not
+*	inflated yet are kept. The LibImageRowCallback gets the rows the pipeline hands to its sink, the two have the
+*	same type.
+*	CRCs are checked once the chunk is over, when its rows already went out. Chunks bigger than the hold are walked
+*	on their header before their CRC comes, only their type and length are taken from them unchecked.
+*/
+
+#define LIBIMAGE_STREAM_INPUT_SIZE	Kilo(32)
+#define LIBIMAGE_STREAM_HOLD_SIZE	1024		// Chunks up to this size are kept whole, PLTE is at most 768
+
+enum {
+	LIBIMAGE_STREAM_SIGNATURE = 0,
+	LIBIMAGE_STREAM_CHUNK_HEADER,
+	LIBIMAGE_STREAM_CHUNK_DATA,
+	LIBIMAGE_STREAM_IDAT_DATA,
+	LIBIMAGE_STREAM_CHUNK_CRC,
+	LIBIMAGE_STREAM_END
+};
+
+struct libimage_stream {
+	LibImageRowCallback	row_callback;
+	void			*row_user;
+	int			state, error;
+
+	LibImageImageInfo	info;
+	LibImagePngWalk		walk;
+	LibImagePngChunk	chunk;
+	uint8_t			hold[LIBIMAGE_STREAM_HOLD_SIZE];
+	uint32_t		hold_len;	// Bytes of the signature, chunk header or chunk data gathered in hold
+	uint32_t		chunk_left;	// Data bytes of the current chunk still to come
+	uint8_t			crc_bytes[4];
+	uint32_t		crc_len, crc;
+	uint8_t			chunk_held;
+
+	LibImagePngPipeline	pipeline;	// Its window is info.uncompressed_data
+	uint8_t			started;
+	uint8_t			*input;		// IDAT bytes the zlib stream hasn't reached yet
+	uint32_t		input_len;
+};
+
+#endif
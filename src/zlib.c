@@ -9,6 +9,7 @@
 
 #include "zlib.h"
 #include "common.h"
+#include "adler32.h"
 
 void zbuf_init(LibImageZlibBuffer *buf, uint8_t *contents, uint32_t content_len, int alloc_window)
 {
@@ -16,6 +17,9 @@ int i;
 
 	buf->buf = contents;
 	buf->buf_end = contents + content_len;
+	buf->next_input = NULL;
+	buf->rewind_input = NULL;
+	buf->next_input_user = NULL;
 	buf->sliding_window_cur_pos = buf->sliding_window = NULL;
 	buf->sliding_window_off = 0;
 	buf->sliding_window_limit = 0;
@@ -23,6 +27,14 @@ int i;
 	buf->allocated_window = 0;
 	buf->code_buf = 0;
 	buf->code_buf_bits = 0;
+	buf->overrun_bytes = 0;
+	buf->tables = NULL;
+	buf->state = LIBIMAGE_ZBUF_STATE_HEADER;
+	buf->final_block = 0;
+	buf->stored_remaining = 0;
+	buf->adler = LIBIMAGE_ADLER32_INIT;
+	buf->adler_offset = 0;
+	buf->trailer_adler = 0;
 	if(alloc_window	> 0) {
 		buf->sliding_window = malloc(sizeof(uint8_t) * Kilo(32) + 256);
 		if(buf->sliding_window == NULL) {
@@ -58,42 +70,69 @@ int zbuf_is_eof(LibImageZlibBuffer *buf)
 	return buf->buf >= buf->buf_end;
 }
 
+// Moves to the next input span, skipping empty ones. Returns zero once the input is over.
+int zbuf_next_span(LibImageZlibBuffer *buf)
+{
+	while(buf->buf >= buf->buf_end) {
+		if(buf->next_input == NULL) return 0;
+		if(!buf->next_input(buf->next_input_user, &buf->buf, &buf->buf_end)) {
+			buf->next_input = NULL;
+			buf->buf = buf->buf_end;
+			return 0;
+		}
+	}
+	return 1;
+}
+
+// True when bits that were padded past the end of the input got consumed.
+int zbuf_is_overrun(LibImageZlibBuffer *buf)
+{
+	return buf->overrun_bytes * 8 > buf->code_buf_bits;
+}
+
+// Reads the raw input, only valid while code_buf is empty.
 uint8_t zbuf_get_byte(LibImageZlibBuffer *buf)
 {
-	return zbuf_is_eof(buf) ? 0 : *buf->buf++;
+	return zbuf_next_span(buf) ? *buf->buf++ : 0;
 }
 
-void zbuf_fill_code_buf(LibImageZlibBuffer *buf)
+void zbuf_fill_code_buf_slow(LibImageZlibBuffer *buf)
 {
-	do {
-		if(buf->code_buf >= (1 << buf->code_buf_bits)) {
-			buf->buf = buf->buf_end;
-			return;
+	while(buf->code_buf_bits < LIBIMAGE_ZBUF_MIN_BITS_AFTER_REFILL) {
+		if(buf->buf < buf->buf_end || zbuf_next_span(buf)) {
+			buf->code_buf |= (uint64_t)*buf->buf++ << buf->code_buf_bits;
+		} else if(buf->overrun_bytes++ >= LIBIMAGE_ZBUF_MAX_OVERRUN_BYTES) {
+			// Padding with zeros lets a peek look past the end, more than a buffer's worth means we are consuming it.
+			buf->error = LIBIMAGE_PNG_ERROR_CORRUPTED_FILE;
+			buf->overrun_bytes = LIBIMAGE_ZBUF_MAX_OVERRUN_BYTES;
 		}
-		buf->code_buf |= (uint32_t) zbuf_get_byte(buf) << buf->code_buf_bits;
 		buf->code_buf_bits += 8;
-
-	} while(buf->code_buf_bits <= 24);	
+	}
 }
 
 uint32_t zbuf_get_n_bits(LibImageZlibBuffer *buf, int n)
 {
 uint32_t code;
-	if(buf->code_buf_bits < n) zbuf_fill_code_buf(buf);
-	code = buf->code_buf & ((1 << n) - 1);
-	buf->code_buf >>= n;
-	buf->code_buf_bits -= n;
+
+	zbuf_ensure_bits(buf, n);
+	code = zbuf_peek_bits(buf, n);
+	zbuf_consume_bits(buf, n);
 	return code;
 }
 
+void zbuf_align_to_byte(LibImageZlibBuffer *buf)
+{
+	zbuf_consume_bits(buf, buf->code_buf_bits & 7);
+}
+
 void zbuf_parse_header(LibImageZlibBuffer *buf)
 {
 int	cmf, cm,flags;
 	
-	cmf = zbuf_get_byte(buf);
-	flags = zbuf_get_byte(buf);
+	cmf = zbuf_get_n_bits(buf, 8);
+	flags = zbuf_get_n_bits(buf, 8);
 	cm = cmf & 15;
-	if( zbuf_is_eof(buf) || (((cmf*256+flags) % 31) != 0)) {
+	if( zbuf_is_overrun(buf) || (((cmf*256+flags) % 31) != 0)) {
 		buf->error = LIBIMAGE_ERROR_ZLIB_HEADER_CORRUPTED;
 		return;	
 	}
@@ -106,38 +145,29 @@ int	cmf, cm,flags;
 		return;
 	}
 }
+/*
+*	Takes the zero padding back out of code_buf, for when more input arrived after the reader ran past the end.
+*	Only the real bits are kept, the padding sits above them.
+*/
+void zbuf_drop_overrun(LibImageZlibBuffer *buf)
+{
+	if(buf->overrun_bytes == 0) return;
+	buf->code_buf_bits = buf->code_buf_bits > buf->overrun_bytes * 8 ? buf->code_buf_bits - buf->overrun_bytes * 8 : 0;
+	buf->code_buf	  &= buf->code_buf_bits ? (~0ull >> (64 - buf->code_buf_bits)) : 0;
+	buf->overrun_bytes = 0;
+}
+
 void write_uncompressed_data(LibImageZlibBuffer *buf, LibImageImageInfo *info, int size, char *opt_value)
 {
-uint8_t *tmp, *src_used;
-uint32_t mem_size;
-
-	if(info->uncompressed_data == NULL) {
-		mem_size = size > 1024 ? size : 1024;
-		tmp = realloc(info->uncompressed_data, sizeof(char) * mem_size);
-		if(tmp == NULL) {
-			info->error = LIBIMAGE_ERROR_OUT_OF_MEMORY;
-			return;
-		}
-		info->uncompressed_data = tmp;
-		info->un_size = mem_size;
-		info->un_offset = 0;
-	} else {
-		mem_size = info->un_size;
-		while((size + info->un_offset) > mem_size) mem_size *= 2;
-		if(mem_size != info->un_size) {
-			tmp = realloc(info->uncompressed_data, sizeof(char) * mem_size);
-			if(tmp == NULL) {
-				info->error = LIBIMAGE_ERROR_OUT_OF_MEMORY;
-				return;
-			}
-			info->uncompressed_data = tmp;
-			info->un_size = mem_size;
-		}
+uint8_t *src_used;
+
+	if(size > info->un_size - info->un_offset) {
+		info->error = LIBIMAGE_PNG_ERROR_DATA_OVERFLOW;
+		return;
 	}
-	if(opt_value != NULL) src_used = opt_value;
+	if(opt_value != NULL) src_used = (uint8_t*)opt_value;
 	else src_used = buf->buf;
 
 	copy_to_buffer(info->uncompressed_data + info->un_offset, src_used, size);
-	src_used += size;
 	info->un_offset += size;
 }
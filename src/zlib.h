@@ -1,29 +1,214 @@
+/*
+*  ===================================================================
+*	2023 - libimage by Ernesto Bayma
+*  ===================================================================
+*/
+
 #ifndef __LIB_IMAGE_ZLIB_H__
 #define __LIB_IMAGE_ZLIB_H__
 
 #include <inttypes.h>
+#include <string.h>
 #include "common.h"
 
+/*
+*	Bits are kept LSB first in a 64 bit buffer. A refill always leaves at least LIBIMAGE_ZBUF_MIN_BITS_AFTER_REFILL
+*	bits available, so a whole length/distance pair ( 15 + 5 + 15 + 13 = 48 bits ) can be decoded on a single refill.
+*	Bits above code_buf_bits are either zero or the next bits of the stream, never garbage.
+*/
+#define LIBIMAGE_ZBUF_MIN_BITS_AFTER_REFILL	56
+#define LIBIMAGE_ZBUF_MAX_OVERRUN_BYTES		8
+#define LIBIMAGE_ZBUF_COPY_SLACK		16	// zbuf_copy_match may write up to this many bytes past the match
+
 typedef struct libimage_zlib_header {
 	uint32_t compression_method_and_info;
 	uint32_t extra_flags;
 } LibImageZlibHeader;
 
+/*
+*	Called when the current input span runs out, returns zero when there is no more input. Lets the stream be
+*	read straight from the IDAT chunks of the file, whatever the way it was split between them.
+*/
+typedef int (*LibImageZlibNextInput)(void *user, uint8_t **start, uint8_t **end);
+
+/*
+*	Rolling a unit back can take the reader back to a span it had already left, the source is then told to hand
+*	the spans after the one ending at end again. Needed by any source that hands more than one span.
+*/
+typedef void (*LibImageZlibRewindInput)(void *user, uint8_t *end);
+
+/*
+*	Inflate is resumable, it stops on a unit boundary ( the zlib header, a block header, a symbol or a stored run )
+*	when the input or the output runs out and carries on from there on the next call.
+*/
+enum {
+	LIBIMAGE_ZBUF_STATE_HEADER = 0,
+	LIBIMAGE_ZBUF_STATE_BLOCK_HEADER,
+	LIBIMAGE_ZBUF_STATE_STORED,
+	LIBIMAGE_ZBUF_STATE_HUFFMAN,
+	LIBIMAGE_ZBUF_STATE_TRAILER,
+	LIBIMAGE_ZBUF_STATE_DONE
+};
+
+enum {
+	LIBIMAGE_ZBUF_OK = 0,
+	LIBIMAGE_ZBUF_DONE,		// Final block decoded
+	LIBIMAGE_ZBUF_NEED_INPUT,	// Stopped before a unit whose bits are not all there yet
+	LIBIMAGE_ZBUF_OUTPUT_FULL,	// Stopped before a unit whose output doesn't fit
+	LIBIMAGE_ZBUF_FAILED		// The error is in info->error
+};
+
 typedef struct libimage_zlib_buf {
 	uint8_t *buf, *buf_end;
+	LibImageZlibNextInput next_input;
+	LibImageZlibRewindInput rewind_input;
+	void	*next_input_user;
 	uint8_t *sliding_window, *sliding_window_cur_pos;
-	off_t	 sliding_window_off, sliding_window_limit;	
-	uint32_t code_buf, code_buf_bits;
+	off_t	 sliding_window_off, sliding_window_limit;
+	uint64_t code_buf;
+	uint32_t code_buf_bits;
+	uint32_t overrun_bytes;		// Zero bytes fed to code_buf after the input ended
 	int	 error, allocated_window;
+	struct libimage_inflate_tables *tables;
+	uint8_t	 state, final_block;
+	uint32_t stored_remaining;	// Bytes left of the current stored block
+	uint32_t adler;			// Adler-32 of the output up to adler_offset
+	off_t	 adler_offset;
+	uint32_t trailer_adler;		// Adler-32 the zlib trailer gives, once it is read
 } LibImageZlibBuffer;
 
+// Bit reader position before a unit, restoring it rolls the unit back.
+typedef struct libimage_zlib_checkpoint {
+	uint8_t	 *buf, *buf_end;
+	LibImageZlibNextInput next_input;
+	uint64_t code_buf;
+	uint32_t code_buf_bits;
+	uint32_t overrun_bytes;
+} LibImageZlibCheckpoint;
+
 void zbuf_init(LibImageZlibBuffer *buf, uint8_t *contents, uint32_t content_len, int alloc_window);
 int zbuf_append_to_sliding_window(LibImageZlibBuffer *buf, uint8_t *value, int size_value);
 void zbuf_deinit(LibImageZlibBuffer *buf);
 int zbuf_is_eof(LibImageZlibBuffer *buf);
+int zbuf_next_span(LibImageZlibBuffer *buf);
+int zbuf_is_overrun(LibImageZlibBuffer *buf);
 uint8_t zbuf_get_byte(LibImageZlibBuffer *buf);
-void zbuf_fill_code_buf(LibImageZlibBuffer *buf);
+void zbuf_fill_code_buf_slow(LibImageZlibBuffer *buf);
 uint32_t zbuf_get_n_bits(LibImageZlibBuffer *buf, int n);
+void zbuf_align_to_byte(LibImageZlibBuffer *buf);
 void zbuf_parse_header(LibImageZlibBuffer *buf);
+void zbuf_drop_overrun(LibImageZlibBuffer *buf);
 void write_uncompressed_data(LibImageZlibBuffer *buf, LibImageImageInfo *info, int size, char *opt_value);
+
+static inline uint64_t zbuf_load_le64(const uint8_t *p)
+{
+uint64_t value;
+
+	__builtin_memcpy(&value, p, sizeof(value));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	value = __builtin_bswap64(value);
+#endif
+	return value;
+}
+
+/*
+*	Branchless refill while 8 bytes of the current span remain: one unaligned load, then only the whole bytes that
+*	fit are accounted as consumed. Near the end of a span the byte at a time path takes over and moves to the next.
+*/
+static inline void zbuf_fill_code_buf(LibImageZlibBuffer *buf)
+{
+	if(buf->buf_end - buf->buf >= 8) {
+		buf->code_buf |= zbuf_load_le64(buf->buf) << buf->code_buf_bits;
+		buf->buf += (63 - buf->code_buf_bits) >> 3;
+		buf->code_buf_bits |= LIBIMAGE_ZBUF_MIN_BITS_AFTER_REFILL;
+	} else {
+		zbuf_fill_code_buf_slow(buf);
+	}
+}
+
+static inline void zbuf_ensure_bits(LibImageZlibBuffer *buf, uint32_t n)
+{
+	if(buf->code_buf_bits < n) zbuf_fill_code_buf(buf);
+}
+
+// Caller must have ensured at least n bits.
+static inline uint32_t zbuf_peek_bits(LibImageZlibBuffer *buf, uint32_t n)
+{
+	return (uint32_t)(buf->code_buf & ((1ull << n) - 1));
+}
+
+static inline void zbuf_consume_bits(LibImageZlibBuffer *buf, uint32_t n)
+{
+	buf->code_buf 	  >>= n;
+	buf->code_buf_bits -= n;
+}
+
+/*
+*	LZ77 back reference copy, dst - distance must be already written output. Copies in 16 or 8 byte blocks when the
+*	distance keeps source and destination of a block apart, and replicates the pattern for the short distances
+*	that overlap. Can write up to LIBIMAGE_ZBUF_COPY_SLACK bytes after dst + length.
+*/
+static inline void zbuf_copy_match(uint8_t *dst, uint32_t distance, uint32_t length)
+{
+const uint8_t	*src = dst - distance;
+uint8_t		*end = dst + length;
+uint8_t		pattern[8];
+uint32_t	i, step;
+
+	if(distance >= 16) {
+		do {
+			memcpy(dst, src, 16);
+			dst += 16;
+			src += 16;
+		} while(dst < end);
+	} else if(distance >= 8) {
+		do {
+			memcpy(dst, src, 8);
+			dst += 8;
+			src += 8;
+		} while(dst < end);
+	} else if(distance == 1) {
+		memset(dst, *src, length);
+	} else {
+		// Any multiple of the distance keeps the pattern in phase.
+		for(i = 0; i < 8; i++) pattern[i] = i < distance ? src[i] : pattern[i - distance];
+		step = 8 - (8 % distance);
+		do {
+			memcpy(dst, pattern, 8);
+			dst += step;
+		} while(dst < end);
+	}
+}
+
+static inline void zbuf_save(LibImageZlibBuffer *buf, LibImageZlibCheckpoint *checkpoint)
+{
+	checkpoint->buf			= buf->buf;
+	checkpoint->buf_end		= buf->buf_end;
+	checkpoint->next_input		= buf->next_input;
+	checkpoint->code_buf		= buf->code_buf;
+	checkpoint->code_buf_bits	= buf->code_buf_bits;
+	checkpoint->overrun_bytes	= buf->overrun_bytes;
+}
+
+// The spans of the checkpoint must still be valid, errors raised by reading past the input are dropped.
+static inline void zbuf_restore(LibImageZlibBuffer *buf, LibImageZlibCheckpoint *checkpoint)
+{
+	if(checkpoint->buf_end != buf->buf_end && buf->rewind_input) buf->rewind_input(buf->next_input_user, checkpoint->buf_end);
+	buf->next_input		= checkpoint->next_input;
+	buf->buf		= checkpoint->buf;
+	buf->buf_end		= checkpoint->buf_end;
+	buf->code_buf		= checkpoint->code_buf;
+	buf->code_buf_bits	= checkpoint->code_buf_bits;
+	buf->overrun_bytes	= checkpoint->overrun_bytes;
+	buf->error		= 0;
+}
+
+// Same as zbuf_copy_match without writing past dst + length, for the end of the output.
+static inline void zbuf_copy_match_exact(uint8_t *dst, uint32_t distance, uint32_t length)
+{
+	while(length--) {
+		*dst = *(dst - distance);
+		dst++;
+	}
+}
 #endif
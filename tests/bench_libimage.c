@@ -0,0 +1,662 @@
+/*
+ *	Decode benchmark. Times every file of the PngSuite corpus ( or the files and directories given ) and a set of
+ *	large generated images, stage by stage: the chunk walk with its CRCs, the inflate, the unfiltering and the
+ *	conversion to RGBA8, then the whole decode through a decoder. Each image is decoded -n times and the best time
+ *	of each stage is kept. Speeds are given as MB/s of compressed file and Mpix/s of output.
+ *
+ *	Links against the internals of the library to time the stages one at a time, so it is built with src/ in the
+ *	include path and uses the internal headers instead of libimage.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include "common.h"
+#include "zlib.h"
+#include "png.h"
+#include "huffman.h"
+#include "crc32.h"
+#include "adler32.h"
+#include "convert.h"
+#include "decoder.h"
+#include "cpu.h"
+
+#define BENCH_DEFAULT_RUNS	10
+#define BENCH_DEFAULT_SIDE	2048
+#define BENCH_HASH_BITS		15
+#define BENCH_WINDOW		Kilo(32)
+
+enum {
+	BENCH_STAGE_WALK = 0,
+	BENCH_STAGE_INFLATE,
+	BENCH_STAGE_UNFILTER,
+	BENCH_STAGE_CONVERT,
+	BENCH_STAGE_TOTAL,
+	BENCH_STAGE_COUNT
+};
+
+static const char *bench_stage_names[BENCH_STAGE_COUNT] = { "walk", "inflate", "unfilter", "convert", "total" };
+
+typedef struct benchSpan {
+	uint8_t		*data;
+	uint32_t	size;
+} BenchSpan;
+
+typedef struct benchSpans {
+	BenchSpan	*spans;
+	uint32_t	count, capacity, next;
+} BenchSpans;
+
+typedef struct benchResult {
+	uint64_t	best_ns[BENCH_STAGE_COUNT];
+	uint64_t	sum_ns[BENCH_STAGE_COUNT];
+	uint64_t	bytes, pixels;
+	uint32_t	width, height, runs;
+} BenchResult;
+
+typedef struct benchOptions {
+	uint32_t	runs, side, threads;
+	FILE		*csv;
+} BenchOptions;
+
+static uint64_t nowNs(void)
+{
+struct timespec	ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static uint8_t *readWholeFile(const char *path, uint64_t *size)
+{
+FILE	*f;
+uint8_t	*contents;
+long	file_size;
+
+	*size = 0;
+	f = fopen(path, "rb");
+	if(f == NULL) return NULL;
+	fseek(f, 0, SEEK_END);
+	file_size = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	contents = file_size > 0 ? malloc(file_size) : NULL;
+	if(contents && fread(contents, file_size, 1, f) != 1) {
+		free(contents);
+		contents = NULL;
+	}
+	fclose(f);
+	if(contents) *size = file_size;
+	return contents;
+}
+
+/*
+*	Minimal PNG writer for the generated images: rows filtered with each filter type in turn, greedy LZ77 on a one
+*	entry hash and a single fixed Huffman block. Far from a good encoder, but the streams have the mix of literals
+*	and matches of real files.
+*/
+typedef struct benchWriter {
+	uint8_t		*data;
+	size_t		size, capacity;
+	uint64_t	bits;
+	uint32_t	count;
+} BenchWriter;
+
+static const uint16_t bench_length_base[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+static const uint8_t bench_length_extra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+static const uint16_t bench_dist_base[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+static const uint8_t bench_dist_extra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+static const uint8_t bench_adam7_start_x[7] = { 0, 4, 0, 2, 0, 1, 0 };
+static const uint8_t bench_adam7_start_y[7] = { 0, 0, 4, 0, 2, 0, 1 };
+static const uint8_t bench_adam7_step_x[7]  = { 8, 8, 4, 4, 2, 2, 1 };
+static const uint8_t bench_adam7_step_y[7]  = { 8, 8, 8, 4, 4, 2, 2 };
+
+static void writerReserve(BenchWriter *w, size_t n)
+{
+	if(w->size + n <= w->capacity) return;
+	w->capacity = (w->size + n) * 2;
+	w->data = realloc(w->data, w->capacity);
+	if(w->data == NULL) {
+		fprintf(stderr, "Out of memory generating the images\n");
+		exit(EXIT_FAILURE);
+	}
+}
+
+static void writerBytes(BenchWriter *w, const void *bytes, size_t n)
+{
+	writerReserve(w, n);
+	memcpy(w->data + w->size, bytes, n);
+	w->size += n;
+}
+
+static void writerU32(BenchWriter *w, uint32_t value)
+{
+uint8_t	b[4] = { value >> 24, value >> 16, value >> 8, value };
+
+	writerBytes(w, b, 4);
+}
+
+// LSB first, as deflate wants everything but the Huffman codes.
+static void writerBits(BenchWriter *w, uint32_t value, uint32_t n)
+{
+	w->bits  |= (uint64_t)value << w->count;
+	w->count += n;
+	writerReserve(w, 8);
+	while(w->count >= 8) {
+		w->data[w->size++] = w->bits;
+		w->bits  >>= 8;
+		w->count  -= 8;
+	}
+}
+
+static void writerCode(BenchWriter *w, uint32_t code, uint32_t n)
+{
+	writerBits(w, bit_reverse(code, n), n);
+}
+
+static void writerLiteral(BenchWriter *w, uint32_t symbol)
+{
+	if(symbol < 144) writerCode(w, 0x30 + symbol, 8);
+	else if(symbol < 256) writerCode(w, 0x190 + symbol - 144, 9);
+	else if(symbol < 280) writerCode(w, symbol - 256, 7);
+	else writerCode(w, 0xc0 + symbol - 280, 8);
+}
+
+static void writerMatch(BenchWriter *w, uint32_t length, uint32_t distance)
+{
+uint32_t	i;
+
+	for(i = 28; bench_length_base[i] > length; i--);
+	writerLiteral(w, 257 + i);
+	writerBits(w, length - bench_length_base[i], bench_length_extra[i]);
+	for(i = 29; bench_dist_base[i] > distance; i--);
+	writerCode(w, i, 5);
+	writerBits(w, distance - bench_dist_base[i], bench_dist_extra[i]);
+}
+
+static void writerDeflate(BenchWriter *w, const uint8_t *src, size_t size)
+{
+int64_t		*head, cand;
+size_t		pos, len, max;
+uint32_t	hash;
+
+	head = malloc(sizeof(*head) << BENCH_HASH_BITS);
+	memset(head, 0xff, sizeof(*head) << BENCH_HASH_BITS);
+	writerBits(w, 1, 1);
+	writerBits(w, 1, 2);
+	for(pos = 0; pos < size; ) {
+		len = 0;
+		if(pos + 3 <= size) {
+			hash = ((src[pos] << 16 | src[pos + 1] << 8 | src[pos + 2]) * 2654435761u) >> (32 - BENCH_HASH_BITS);
+			cand = head[hash];
+			head[hash] = pos;
+			if(cand >= 0 && pos - cand <= BENCH_WINDOW) {
+				max = size - pos < 258 ? size - pos : 258;
+				while(len < max && src[cand + len] == src[pos + len]) len++;
+			}
+		}
+		if(len >= 3) {
+			writerMatch(w, len, pos - cand);
+			pos += len;
+		} else {
+			writerLiteral(w, src[pos++]);
+		}
+	}
+	writerLiteral(w, 256);
+	writerBits(w, 0, 7);
+	w->count = 0;
+	w->bits  = 0;
+	free(head);
+}
+
+static void writerChunk(BenchWriter *w, const char *type, const uint8_t *data, uint32_t size)
+{
+size_t		start;
+uint32_t	sum;
+
+	writerU32(w, size);
+	start = w->size;
+	writerBytes(w, type, 4);
+	if(size) writerBytes(w, data, size);
+	// crc() gives the value the way the chunk walk compares it, as it sits in memory.
+	sum = crc(w->data + start, w->size - start);
+	writerBytes(w, &sum, sizeof(sum));
+}
+
+static uint8_t benchPaeth(int a, int b, int c)
+{
+int	p = a + b - c, pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+
+	if(pa <= pb && pa <= pc) return a;
+	return pb <= pc ? b : c;
+}
+
+// Appends the scanline with a filter byte, the filter type goes round with the rows.
+static void filterRow(uint8_t *dst, const uint8_t *row, const uint8_t *prev, size_t row_bytes, uint32_t bpp, int type)
+{
+size_t	i;
+int	a, b, c;
+
+	dst[0] = type;
+	for(i = 0; i < row_bytes; i++) {
+		a = i >= bpp ? row[i - bpp] : 0;
+		b = prev ? prev[i] : 0;
+		c = prev && i >= bpp ? prev[i - bpp] : 0;
+		switch(type) {
+			case 1: dst[1 + i] = row[i] - a; break;
+			case 2: dst[1 + i] = row[i] - b; break;
+			case 3: dst[1 + i] = row[i] - ((a + b) >> 1); break;
+			case 4: dst[1 + i] = row[i] - benchPaeth(a, b, c); break;
+			default: dst[1 + i] = row[i]; break;
+		}
+	}
+}
+
+// PNG of the 8 / 16 bit pixels, interlaced when asked. The palette is written for colour type 3.
+static uint8_t *encodePng(const uint8_t *pixels, uint32_t width, uint32_t height, uint8_t depth, uint8_t colour_type, uint8_t interlace, const uint8_t *palette, uint64_t *size)
+{
+BenchWriter	w = {0}, z = {0};
+uint8_t		ihdr[13], *raw, *row, *cur, *prev, *out;
+uint32_t	bpp, adler, pass, x, y, src_x, src_y, pass_width, pass_height, first, count;
+size_t		raw_size, row_bytes;
+
+	bpp = (colour_type == 2 ? 3 : colour_type == 6 ? 4 : colour_type == 4 ? 2 : 1) * (depth / 8);
+	raw_size = (size_t)height * (1 + (size_t)width * bpp) + 7 * height;
+	raw = malloc(raw_size);
+	row = malloc((size_t)width * bpp * 2);
+	out = raw;
+	for(pass = interlace ? 0 : 6, count = 0; pass < 7; pass++) {
+		first = interlace ? bench_adam7_start_x[pass] : 0;
+		pass_width  = width > first ? (width - first + (interlace ? bench_adam7_step_x[pass] : 1) - 1) / (interlace ? bench_adam7_step_x[pass] : 1) : 0;
+		pass_height = interlace ? (height > bench_adam7_start_y[pass] ? (height - bench_adam7_start_y[pass] + bench_adam7_step_y[pass] - 1) / bench_adam7_step_y[pass] : 0) : height;
+		if(pass_width == 0 || pass_height == 0) continue;
+		row_bytes = (size_t)pass_width * bpp;
+		prev = NULL;
+		for(y = 0; y < pass_height; y++, count++) {
+			cur   = row + (y & 1) * row_bytes;
+			src_y = interlace ? bench_adam7_start_y[pass] + y * bench_adam7_step_y[pass] : y;
+			for(x = 0; x < pass_width; x++) {
+				src_x = interlace ? first + x * bench_adam7_step_x[pass] : x;
+				memcpy(cur + (size_t)x * bpp, pixels + ((size_t)src_y * width + src_x) * bpp, bpp);
+			}
+			filterRow(out, cur, prev, row_bytes, bpp, count % 5);
+			out += 1 + row_bytes;
+			prev = cur;
+		}
+	}
+	raw_size = out - raw;
+
+	writerBits(&z, 0x78, 8);
+	writerBits(&z, 0x01, 8);
+	writerDeflate(&z, raw, raw_size);
+	adler = adler32_update(LIBIMAGE_ADLER32_INIT, raw, raw_size);
+	writerU32(&z, adler);
+
+	writerBytes(&w, "\x89PNG\r\n\x1a\n", 8);
+	ihdr[0] = width >> 24; ihdr[1] = width >> 16; ihdr[2] = width >> 8; ihdr[3] = width;
+	ihdr[4] = height >> 24; ihdr[5] = height >> 16; ihdr[6] = height >> 8; ihdr[7] = height;
+	ihdr[8] = depth; ihdr[9] = colour_type; ihdr[10] = 0; ihdr[11] = 0; ihdr[12] = interlace;
+	writerChunk(&w, "IHDR", ihdr, sizeof(ihdr));
+	if(palette) writerChunk(&w, "PLTE", palette, 256 * 3);
+	// IDATs of 64K like most encoders write.
+	for(first = 0; first < z.size; first += Kilo(64)) writerChunk(&w, "IDAT", z.data + first, z.size - first < Kilo(64) ? z.size - first : Kilo(64));
+	writerChunk(&w, "IEND", NULL, 0);
+
+	free(z.data);
+	free(raw);
+	free(row);
+	*size = w.size;
+	return w.data;
+}
+
+// Smooth shading with some grain, about what a photograph filters to.
+static uint32_t photoSample(uint32_t x, uint32_t y, uint32_t channel, uint32_t *seed)
+{
+	*seed = *seed * 1103515245u + 12345u;
+	return ((x * (3 + channel) + y * (5 - channel)) / 4 + ((x / 64 + y / 32) & 1) * 40 + ((*seed >> 16) & 3)) & 0xffff;
+}
+
+static uint8_t *generateImage(const char *kind, uint32_t side, uint64_t *size)
+{
+uint8_t		*pixels, *png, palette[256 * 3], depth, colour_type, interlace;
+uint32_t	x, y, c, channels, seed, value, bpp;
+int		is_palette;
+
+	is_palette = !strcmp(kind, "palette");
+	depth	    = !strcmp(kind, "rgba16") ? 16 : 8;
+	colour_type = is_palette ? 3 : !strcmp(kind, "flat") || !strcmp(kind, "photo") ? 2 : 6;
+	interlace   = !strcmp(kind, "interlaced");
+	channels    = colour_type == 2 ? 3 : colour_type == 6 ? 4 : 1;
+	bpp	    = channels * depth / 8;
+	pixels	    = malloc((size_t)side * side * bpp);
+	seed	    = side;
+	for(y = 0; y < side; y++) {
+		for(x = 0; x < side; x++) {
+			for(c = 0; c < channels; c++) {
+				value = !strcmp(kind, "flat") ? 0x40 * (c + 1) : photoSample(x, y, c, &seed);
+				if(c == 3) value = 255 - ((x + y) & 127);
+				if(depth == 16) {
+					pixels[((size_t)y * side + x) * bpp + 2 * c]	 = value >> 2;
+					pixels[((size_t)y * side + x) * bpp + 2 * c + 1] = value * 37;
+				} else {
+					pixels[((size_t)y * side + x) * bpp + c] = value;
+				}
+			}
+		}
+	}
+	for(c = 0; c < 256; c++) {
+		palette[3 * c] = c;
+		palette[3 * c + 1] = 255 - c;
+		palette[3 * c + 2] = c * 7;
+	}
+	png = encodePng(pixels, side, side, depth, colour_type, interlace, is_palette ? palette : NULL, size);
+	free(pixels);
+	return png;
+}
+
+static int benchNextSpan(void *user, uint8_t **start, uint8_t **end)
+{
+BenchSpans	*s = user;
+
+	if(s->next >= s->count) return 0;
+	*start = s->spans[s->next].data;
+	*end   = s->spans[s->next].data + s->spans[s->next].size;
+	s->next++;
+	return 1;
+}
+
+// The chunk walk of libimage_process_png with the CRCs, the IDAT payloads are kept for the inflate.
+static int walkChunks(uint8_t *data, uint64_t size, LibImageImageInfo *info, BenchSpans *spans)
+{
+LibImageDataReader	r = {0};
+LibImagePngChunk	chunk;
+LibImagePngWalk		walk;
+int			ret;
+
+	r.data	= data;
+	r.size	= size;
+	spans->count = 0;
+	if(check_data_header(&r)) return r.error;
+	png_walk_init(&walk);
+	while(!walk.got_iend_chunk) {
+		chunk = read_png_chunk(&r);
+		if(r.error) return r.error;
+		if(!png_chunk_crc_matches(&chunk)) return LIBIMAGE_PNG_ERROR_CRC_NOT_MATCH;
+		ret = png_walk_chunk(&walk, &chunk, info);
+		if(ret) return ret;
+		if(chunk.type.i != LIBIMAGE_PNG_TYPE('I','D','A','T')) continue;
+		if(spans->count == spans->capacity) {
+			spans->capacity = spans->capacity ? 2 * spans->capacity : 64;
+			spans->spans = realloc(spans->spans, spans->capacity * sizeof(*spans->spans));
+			if(spans->spans == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+		}
+		spans->spans[spans->count].data = chunk.start_chunk_data;
+		spans->spans[spans->count].size = chunk.data_len.i;
+		spans->count++;
+	}
+	return spans->count ? 0 : LIBIMAGE_PNG_ERROR_NO_IDAT;
+}
+
+static int inflateSpans(LibImageImageInfo *info, BenchSpans *spans)
+{
+LibImageZlibBuffer	zbuf;
+LibImageInflateTables	tables;
+int			status;
+
+	spans->next = 1;
+	zbuf_init(&zbuf, spans->spans[0].data, spans->spans[0].size, 0);
+	zbuf.next_input	     = benchNextSpan;
+	zbuf.next_input_user = spans;
+	png_init_inflate_tables(&tables);
+	zbuf.tables	= &tables;
+	info->un_offset	= 0;
+	status = png_inflate(&zbuf, info);
+	zbuf_deinit(&zbuf);
+	if(status != LIBIMAGE_ZBUF_DONE && !info->error) info->error = LIBIMAGE_PNG_ERROR_TRUNCATED_DATA;
+	return info->error;
+}
+
+static void stageTime(BenchResult *result, int stage, uint64_t start)
+{
+uint64_t	ns = nowNs() - start;
+
+	if(result->runs == 0 || ns < result->best_ns[stage]) result->best_ns[stage] = ns;
+	result->sum_ns[stage] += ns;
+}
+
+/*
+*	One run of every stage, in the order the decode does them. Each stage runs on the output of the one before
+*	so only that stage is inside the timer.
+*/
+static int benchRun(uint8_t *data, uint64_t size, LibImageDecoder *decoder, BenchSpans *spans, BenchResult *result)
+{
+LibImageImageInfo	info = {0};
+LibImageConverter	converter;
+uint8_t			*out, *pixels;
+uint64_t		start, row_bytes, out_row_bytes;
+uint32_t		y, width, height;
+int			ret;
+
+	start = nowNs();
+	ret = walkChunks(data, size, &info, spans);
+	stageTime(result, BENCH_STAGE_WALK, start);
+	if(ret == 0) ret = png_region_init(&info);
+	if(ret) return ret;
+
+	info.un_size		= png_uncompressed_size(&info);
+	info.uncompressed_data	= malloc(info.un_size);
+	if(info.uncompressed_data == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	start = nowNs();
+	ret = inflateSpans(&info, spans);
+	stageTime(result, BENCH_STAGE_INFLATE, start);
+	if(ret == 0 && info.un_offset != info.un_size) ret = LIBIMAGE_PNG_ERROR_NOT_ENOUGH_DATA;
+
+	if(ret == 0) {
+		start = nowNs();
+		png_unfilter_image(&info);
+		stageTime(result, BENCH_STAGE_UNFILTER, start);
+		ret = info.error;
+	}
+	free(info.uncompressed_data);
+	info.uncompressed_data = NULL;
+
+	out = NULL;
+	if(ret == 0) ret = png_converter_init(&converter, &info, LIBIMAGE_FORMAT_RGBA8);
+	if(ret == 0) {
+		row_bytes     = png_row_bytes(&info, info.width);
+		info.converter	   = &converter;
+		info.output_format = LIBIMAGE_FORMAT_RGBA8;
+		out_row_bytes	   = png_output_row_bytes(&info);
+		out = malloc(out_row_bytes * info.height);
+		ret = out ? 0 : LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	}
+	if(ret == 0) {
+		start = nowNs();
+		for(y = 0; y < info.height; y++) png_output_row(&info, out + y * out_row_bytes, info.processed_data + y * row_bytes);
+		stageTime(result, BENCH_STAGE_CONVERT, start);
+	}
+	free(out);
+	free(info.processed_data);
+	if(ret) return ret;
+
+	start  = nowNs();
+	pixels = libimage_decoder_decode(decoder, data, size, &width, &height, &ret);
+	stageTime(result, BENCH_STAGE_TOTAL, start);
+	libimage_decoder_free_image(decoder, pixels);
+	if(ret) return ret;
+
+	result->bytes  = size;
+	result->width  = info.width;
+	result->height = info.height;
+	result->pixels = (uint64_t)info.width * info.height;
+	return 0;
+}
+
+static double megaPerSecond(uint64_t amount, uint64_t ns)
+{
+	return ns ? amount * 1e3 / ns : 0;
+}
+
+static void reportResult(const char *name, BenchResult *result, BenchOptions *opts)
+{
+int	stage;
+
+	if(result->width) fprintf(stderr, "%-28s %9llu %5ux%-5u", name, (unsigned long long)result->bytes, result->width, result->height);
+	else fprintf(stderr, "%-28s %9llu %11s", name, (unsigned long long)result->bytes, "");
+	for(stage = 0; stage < BENCH_STAGE_COUNT; stage++) {
+		fprintf(stderr, " %9.1f/%-7.1f", megaPerSecond(result->bytes, result->best_ns[stage]), megaPerSecond(result->pixels, result->best_ns[stage]));
+	}
+	fprintf(stderr, "\n");
+	if(opts->csv == NULL) return;
+	for(stage = 0; stage < BENCH_STAGE_COUNT; stage++) {
+		fprintf(opts->csv, "%s,%llu,%u,%u,%s,%u,%llu,%llu,%.3f,%.3f\n", name, (unsigned long long)result->bytes, result->width, result->height,
+			bench_stage_names[stage], result->runs, (unsigned long long)result->best_ns[stage], (unsigned long long)(result->sum_ns[stage] / result->runs),
+			megaPerSecond(result->bytes, result->best_ns[stage]), megaPerSecond(result->pixels, result->best_ns[stage]));
+	}
+}
+
+// Returns zero when the image was timed, the decode error of the first run otherwise.
+static int benchImage(const char *name, uint8_t *data, uint64_t size, BenchOptions *opts, BenchResult *total)
+{
+LibImageDecoder	*decoder;
+BenchSpans	spans = {0};
+BenchResult	result = {{0}};
+uint32_t	run;
+int		ret, stage;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return LIBIMAGE_ERROR_OUT_OF_MEMORY;
+	libimage_decoder_set_format(decoder, LIBIMAGE_FORMAT_RGBA8);
+	libimage_decoder_set_threads(decoder, opts->threads);
+	for(run = 0, ret = 0; run < opts->runs && ret == 0; run++, result.runs++) ret = benchRun(data, size, decoder, &spans, &result);
+	libimage_decoder_destroy(decoder);
+	free(spans.spans);
+	if(ret) return ret;
+
+	reportResult(name, &result, opts);
+	for(stage = 0; stage < BENCH_STAGE_COUNT; stage++) {
+		total->best_ns[stage] += result.best_ns[stage];
+		total->sum_ns[stage]  += result.sum_ns[stage] / result.runs;
+	}
+	total->bytes  += result.bytes;
+	total->pixels += result.pixels;
+	total->runs    = result.runs;
+	return 0;
+}
+
+static void benchFile(const char *path, BenchOptions *opts, BenchResult *total, uint32_t *skipped)
+{
+uint8_t		*data;
+uint64_t	size;
+const char	*name;
+
+	data = readWholeFile(path, &size);
+	name = strrchr(path, '/') ? strrchr(path, '/') + 1 : path;
+	if(data == NULL || benchImage(name, data, size, opts, total)) (*skipped)++;
+	free(data);
+}
+
+static int comparePaths(const void *a, const void *b)
+{
+	return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+// Every .png of the directory, in name order so runs compare line by line.
+static void benchDirectory(const char *path, BenchOptions *opts, BenchResult *total, uint32_t *skipped)
+{
+DIR		*dir;
+struct dirent	*entry;
+char		**paths;
+size_t		count, capacity, len, i;
+
+	dir = opendir(path);
+	if(dir == NULL) return;
+	paths = NULL;
+	count = capacity = 0;
+	while((entry = readdir(dir)) != NULL) {
+		len = strlen(entry->d_name);
+		if(len < 4 || strcmp(entry->d_name + len - 4, ".png")) continue;
+		if(count == capacity) {
+			capacity = capacity ? 2 * capacity : 256;
+			paths = realloc(paths, capacity * sizeof(*paths));
+		}
+		paths[count] = malloc(strlen(path) + len + 2);
+		sprintf(paths[count++], "%s/%s", path, entry->d_name);
+	}
+	closedir(dir);
+	qsort(paths, count, sizeof(*paths), comparePaths);
+	for(i = 0; i < count; i++) {
+		benchFile(paths[i], opts, total, skipped);
+		free(paths[i]);
+	}
+	free(paths);
+}
+
+void usage(int code)
+{
+	fprintf(stderr, "bench_libimage [-n runs] [-s side] [-t threads] [-o file.csv] [file_or_directory...]\n");
+	fprintf(stderr, "	-n	Decodes of each image, the best time of each stage is kept ( %d ).\n", BENCH_DEFAULT_RUNS);
+	fprintf(stderr, "	-s	Side of the generated images, 0 leaves them out ( %d ).\n", BENCH_DEFAULT_SIDE);
+	fprintf(stderr, "	-t	Threads of the whole decode ( 1 ).\n");
+	fprintf(stderr, "	-o	Also writes every stage of every image as CSV: image,bytes,width,height,stage,runs,best_ns,mean_ns,mb_s,mpix_s\n");
+	fprintf(stderr, "Files and directories default to tests/res. LIBIMAGE_CPU limits the kernels, see cpu.h.\n");
+	exit(code);
+}
+
+int main(int argc, char **argv)
+{
+static const char	*kinds[] = { "flat", "photo", "rgba16", "palette", "interlaced" };
+BenchOptions		opts = { BENCH_DEFAULT_RUNS, BENCH_DEFAULT_SIDE, 1, NULL };
+BenchResult		corpus = {{0}}, generated = {{0}};
+struct stat		st;
+uint8_t			*png;
+uint64_t		size;
+uint32_t		skipped, k;
+char			name[64];
+int			i, stage;
+
+	for(i = 1; i < argc && argv[i][0] == '-'; i++) {
+		if(!strcmp(argv[i], "-h")) usage(EXIT_SUCCESS);
+		if(i + 1 >= argc) usage(EXIT_FAILURE);
+		if(!strcmp(argv[i], "-n")) opts.runs = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-s")) opts.side = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-t")) opts.threads = atoi(argv[++i]);
+		else if(!strcmp(argv[i], "-o")) {
+			opts.csv = fopen(argv[++i], "w");
+			if(opts.csv == NULL) usage(EXIT_FAILURE);
+		} else {
+			usage(EXIT_FAILURE);
+		}
+	}
+	if(opts.runs == 0) usage(EXIT_FAILURE);
+
+	fprintf(stderr, "CPU features in use: 0x%x\n", libimage_cpu_features());
+	fprintf(stderr, "%-28s %9s %-11s", "image", "bytes", "size");
+	for(stage = 0; stage < BENCH_STAGE_COUNT; stage++) fprintf(stderr, " %17s", bench_stage_names[stage]);
+	fprintf(stderr, "\n%51s", "");
+	for(stage = 0; stage < BENCH_STAGE_COUNT; stage++) fprintf(stderr, " %17s", "MB/s / Mpix/s");
+	fprintf(stderr, "\n");
+
+	skipped = 0;
+	if(i == argc) benchDirectory("tests/res", &opts, &corpus, &skipped);
+	for(; i < argc; i++) {
+		if(stat(argv[i], &st) == 0 && S_ISDIR(st.st_mode)) benchDirectory(argv[i], &opts, &corpus, &skipped);
+		else benchFile(argv[i], &opts, &corpus, &skipped);
+	}
+	if(corpus.bytes) reportResult("corpus", &corpus, &opts);
+	if(skipped) fprintf(stderr, "%u files did not decode and were left out\n", skipped);
+
+	for(k = 0; opts.side && k < sizeof(kinds) / sizeof(kinds[0]); k++) {
+		png = generateImage(kinds[k], opts.side, &size);
+		snprintf(name, sizeof(name), "%s-%u", kinds[k], opts.side);
+		if(benchImage(name, png, size, &opts, &generated)) fprintf(stderr, "%s: did not decode\n", name);
+		free(png);
+	}
+	if(generated.bytes) reportResult("generated", &generated, &opts);
+
+	if(opts.csv) fclose(opts.csv);
+	return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ *	libFuzzer target. Each input goes through the whole-buffer decode with its length given, as a job stepped a few
+ *	rows at a time, and through the streaming decoder fed in two pieces. The decoder has a limit on what it allocates so that
+ *	headers asking for huge images are turned down the way a server would turn them down.
+ *
+ *	Built with clang against the sources, CRCs off so the fuzzer gets past the chunk layer:
+ *
+ *	clang -g -O1 -fsanitize=fuzzer,address,undefined -DLIBIMAGE_PNG_SKIP_CRC -Iinclude tests/fuzz_libimage.c \
+ *		src/*.c -lpthread -lm -o build/fuzz_libimage
+ *	./build/fuzz_libimage -max_len=65536 tests/res
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#include "libimage.h"
+
+#define FUZZ_MEMORY_LIMIT	(64u << 20)
+#define FUZZ_STEP_ROWS		16
+
+static LibImageDecoder *fuzz_decoder;
+
+static void fuzz_row(void *user, const uint8_t *row, uint32_t row_size, uint32_t y, int pass)
+{
+	// Touches the row so that a row past its buffer shows up under the sanitizers.
+	if(row_size) *(uint8_t*)user ^= row[0] ^ row[row_size - 1];
+	(void)y;
+	(void)pass;
+}
+
+static void fuzz_decode(const uint8_t *data, size_t size)
+{
+LibImageJob	*job;
+void		*pixels;
+uint32_t	width, height;
+int		error;
+
+	// The first byte picks the output format, the data itself doesn't have to start with it.
+	libimage_decoder_set_format(fuzz_decoder, size ? data[0] % 6 : 0);
+	pixels = libimage_decoder_decode(fuzz_decoder, (uint8_t*)data, size, &width, &height, &error);
+	libimage_decoder_free_image(fuzz_decoder, pixels);
+	job = libimage_job_create(fuzz_decoder, (uint8_t*)data, size);
+	while(libimage_job_step(job, FUZZ_STEP_ROWS));
+	pixels = libimage_job_finish(job, &width, &height, &error);
+	libimage_decoder_free_image(fuzz_decoder, pixels);
+}
+
+static void fuzz_stream(const uint8_t *data, size_t size)
+{
+LibImageStream	*s;
+uint8_t		sink = 0;
+size_t		half;
+
+	s = libimage_stream_create(fuzz_row, &sink);
+	if(s == NULL) return;
+	half = size / 2;
+	if(libimage_stream_feed(s, data, half) == 0 && libimage_stream_feed(s, data + half, size - half) == 0) libimage_stream_finish(s);
+	libimage_stream_destroy(s);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+LibImageLimits limits = {0};
+
+	if(fuzz_decoder == NULL) {
+		fuzz_decoder = libimage_decoder_create(NULL);
+		if(fuzz_decoder == NULL) abort();
+		limits.max_alloc_bytes = FUZZ_MEMORY_LIMIT;
+		libimage_decoder_set_limits(fuzz_decoder, &limits);
+	}
+	fuzz_decode(data, size);
+	fuzz_stream(data, size);
+	return 0;
+}
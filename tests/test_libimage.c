@@ -6,6 +6,7 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <poll.h>
 
 #include <libimage.h>
 
@@ -55,6 +56,911 @@ char 	*contents;
 	return contents;
 }
 
+static void count_row(void *user, const uint8_t *row, uint32_t row_size, uint32_t y, int pass)
+{
+	(*(unsigned int*)user)++;
+}
+
+// Feeds the file in small pieces, as it would come from a socket.
+int streamFile(char *contents, int size, unsigned int *rows)
+{
+LibImageStream	*stream;
+int		offset, piece, error;
+
+	*rows  = 0;
+	stream = libimage_stream_create(count_row, rows);
+	if(stream == NULL) return -1;
+
+	error = 0;
+	for(offset = 0; offset < size && !error; offset += piece) {
+		piece = size - offset < 97 ? size - offset : 97;
+		error = libimage_stream_feed(stream, (uint8_t*)contents + offset, piece);
+	}
+	if(!error) error = libimage_stream_finish(stream);
+
+	libimage_stream_destroy(stream);
+	return error;
+}
+
+// Decodes from the mapped file, the image has to match the one decoded from the buffer.
+int decodeFile(char *path, void *expected, size_t expected_size, unsigned int width, unsigned int height)
+{
+uint32_t	file_width, file_height;
+int		error;
+void		*ptr;
+
+	ptr = libimage_decode_file(path, &file_width, &file_height, &error);
+	if(!error && (file_width != width || file_height != height)) error = -2;
+	if(!error && (ptr == NULL) != (expected == NULL)) error = -2;
+	if(!error && expected && memcmp(ptr, expected, expected_size)) error = -2;
+	free(ptr);
+	return error;
+}
+
+/*
+*	Decodes the file in every output format, they all have to be the same pixels: RGBA16 cut to 8 bits is RGBA8,
+*	BGRA8 and RGB8 are RGBA8 swizzled or without alpha.
+*/
+int decodeFormats(char *contents, int size)
+{
+LibImageDecoder	*decoder;
+uint8_t		*pixels[6] = {0};
+unsigned int	width, height, i, channel;
+uint16_t	wide;
+int		error, format;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+
+	error = 0;
+	for(format = LIBIMAGE_FORMAT_RGBA8; format <= LIBIMAGE_FORMAT_RGBA16 && !error; format++) {
+		libimage_decoder_set_format(decoder, format);
+		pixels[format] = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+	}
+	for(i = 0; !error && i < width * height; i++) {
+		for(channel = 0; channel < 4; channel++) {
+			memcpy(&wide, pixels[LIBIMAGE_FORMAT_RGBA16] + 8 * i + 2 * channel, sizeof(wide));
+			if(wide >> 8 != pixels[LIBIMAGE_FORMAT_RGBA8][4 * i + channel]) error = -2;
+		}
+		if(memcmp(pixels[LIBIMAGE_FORMAT_RGB8] + 3 * i, pixels[LIBIMAGE_FORMAT_RGBA8] + 4 * i, 3)) error = -2;
+		if(pixels[LIBIMAGE_FORMAT_BGRA8][4 * i] != pixels[LIBIMAGE_FORMAT_RGBA8][4 * i + 2]) error = -2;
+		if(pixels[LIBIMAGE_FORMAT_BGRA8][4 * i + 2] != pixels[LIBIMAGE_FORMAT_RGBA8][4 * i]) error = -2;
+	}
+	for(format = 0; format < 6; format++) libimage_decoder_free_image(decoder, pixels[format]);
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+// Decodes the middle of the image as RGBA8 and checks it against the same pixels of the whole image.
+int decodeRegion(char *contents, int size)
+{
+LibImageDecoder	*decoder;
+uint8_t		*full, *region;
+unsigned int	width, height, x, y, region_width, region_height, row;
+int		error;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+
+	libimage_decoder_set_format(decoder, LIBIMAGE_FORMAT_RGBA8);
+	full   = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+	region = NULL;
+	if(!error) {
+		x = width / 4;
+		y = height / 4;
+		libimage_decoder_set_region(decoder, x, y, width / 2 + 1, height / 2 + 1);
+		region = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &region_width, &region_height, &error);
+	}
+	if(!error && (region_width != width / 2 + 1 || region_height != height / 2 + 1)) error = -2;
+	for(row = 0; !error && row < region_height; row++) {
+		if(memcmp(region + 4 * row * region_width, full + 4 * ((y + row) * width + x), 4 * region_width)) error = -2;
+	}
+	libimage_decoder_free_image(decoder, full);
+	libimage_decoder_free_image(decoder, region);
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+// Decodes the image at half its size as RGBA8, every pixel should be the mean of the 2 x 2 block of the whole image.
+int decodeScaled(char *contents, int size)
+{
+LibImageDecoder	*decoder;
+uint8_t		*full, *half;
+unsigned int	width, height, half_width, half_height, x, y, dx, dy, channel, sum, count;
+int		error;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+
+	libimage_decoder_set_format(decoder, LIBIMAGE_FORMAT_RGBA8);
+	full = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+	half = NULL;
+	if(!error) {
+		libimage_decoder_set_scale(decoder, 2);
+		half = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &half_width, &half_height, &error);
+	}
+	if(!error && (half_width != (width + 1) / 2 || half_height != (height + 1) / 2)) error = -2;
+	for(y = 0; !error && y < half_height; y++) {
+		for(x = 0; x < half_width; x++) {
+			for(channel = 0; channel < 4; channel++) {
+				sum = count = 0;
+				for(dy = 2 * y; dy < 2 * y + 2 && dy < height; dy++) {
+					for(dx = 2 * x; dx < 2 * x + 2 && dx < width; dx++, count++) sum += full[4 * (dy * width + dx) + channel];
+				}
+				if(half[4 * (y * half_width + x) + channel] != (sum + count / 2) / count) error = -2;
+			}
+		}
+	}
+	libimage_decoder_free_image(decoder, full);
+	libimage_decoder_free_image(decoder, half);
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+int decodeParallelInflate(char *contents, int size)
+{
+LibImageDecoder	*serial, *parallel;
+uint8_t		*expected, *pixels;
+unsigned int	width, height, parallel_width, parallel_height;
+int		error;
+
+	serial	 = libimage_decoder_create(NULL);
+	parallel = libimage_decoder_create(NULL);
+	if(serial == NULL || parallel == NULL) {
+		libimage_decoder_destroy(serial);
+		libimage_decoder_destroy(parallel);
+		return -1;
+	}
+
+	libimage_decoder_set_format(serial, LIBIMAGE_FORMAT_RGBA8);
+	libimage_decoder_set_format(parallel, LIBIMAGE_FORMAT_RGBA8);
+	libimage_decoder_set_threads(parallel, 4);
+	libimage_decoder_set_parallel_inflate(parallel, 1);
+	expected = libimage_decoder_decode(serial, (uint8_t*)contents, size, &width, &height, &error);
+	pixels	 = NULL;
+	if(!error) pixels = libimage_decoder_decode(parallel, (uint8_t*)contents, size, &parallel_width, &parallel_height, &error);
+	if(!error && (parallel_width != width || parallel_height != height || memcmp(expected, pixels, (size_t)width * height * 4))) error = -2;
+	libimage_decoder_free_image(serial, expected);
+	libimage_decoder_free_image(parallel, pixels);
+	libimage_decoder_destroy(serial);
+	libimage_decoder_destroy(parallel);
+	return error;
+}
+
+static void count_message(void *user, int level, const char *message)
+{
+	(void)level;
+	(void)message;
+	(*(int*)user)++;
+}
+
+// A build with messages says something about every file it reads the header of.
+int decodeLogged(char *contents, int size)
+{
+unsigned int	width, height;
+int		error, messages;
+void		*pixels;
+
+	messages = 0;
+	error = libimage_set_log_sink(count_message, &messages, LIBIMAGE_LOG_DEBUG);
+	if(error) return 0;
+	pixels = libimage_decode_data((uint8_t*)contents, size, &width, &height, &error);
+	libimage_set_log_sink(NULL, NULL, 0);
+	free(pixels);
+	return !error && messages == 0 ? -2 : 0;
+}
+
+static void count_stage(void *user, uint32_t stage, int end, uint64_t ns)
+{
+	(void)stage;
+	(void)ns;
+	*(int*)user += end ? -1 : 1;
+}
+
+// Stats of a decode have to add up, a library built without them has nothing to check.
+int decodeStats(char *contents, int size)
+{
+LibImageDecoder	*decoder;
+LibImageStats	stats;
+uint8_t		*pixels;
+unsigned int	width, height;
+uint64_t	rows;
+int		error, open_stages, i;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+	open_stages = 0;
+	error = libimage_decoder_set_stats(decoder, &stats);
+	if(error == 0) error = libimage_decoder_set_trace(decoder, count_stage, &open_stages);
+	if(error) {
+		libimage_decoder_destroy(decoder);
+		return 0;
+	}
+
+	pixels = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+	for(i = 0, rows = 0; i < 5; i++) rows += stats.filter_rows[i];
+	if(!error && (open_stages || rows < height || stats.inflated_bytes < rows || stats.stored_blocks + stats.fixed_blocks + stats.dynamic_blocks == 0)) error = -2;
+	if(!error && stats.stage_ns[LIBIMAGE_STAGE_DECODE] < stats.stage_ns[LIBIMAGE_STAGE_ROWS]) error = -2;
+	libimage_decoder_free_image(decoder, pixels);
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+// Decodes, encodes again and decodes that: every level and format has to give back the same pixels.
+int encodeRoundTrip(char *contents, int size)
+{
+LibImageDecoder		*decoder;
+LibImageEncodeOptions	opts;
+static const uint8_t	pixel_bytes[6] = { 0, 4, 3, 4, 1, 8 };
+uint8_t			*pixels, *file, *again;
+unsigned int		width, height, again_width, again_height;
+size_t			file_size;
+int			error, format, level;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+
+	error = 0;
+	memset(&opts, 0, sizeof(opts));
+	for(format = LIBIMAGE_FORMAT_RGBA8; format <= LIBIMAGE_FORMAT_RGBA16 && !error; format++) {
+		libimage_decoder_set_format(decoder, format);
+		pixels = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+		for(level = LIBIMAGE_ENCODE_STORED; level <= LIBIMAGE_ENCODE_LAZY && !error; level++) {
+			// Every level for RGBA8, one each for the others.
+			if(format != LIBIMAGE_FORMAT_RGBA8 && level != format % 4) continue;
+			opts.format = format;
+			opts.level  = level;
+			file  = libimage_encode_png(pixels, width, height, &opts, &file_size, &error);
+			again = NULL;
+			if(!error) again = libimage_decoder_decode(decoder, file, file_size, &again_width, &again_height, &error);
+			if(!error && (again_width != width || again_height != height || memcmp(again, pixels, (size_t)width * height * pixel_bytes[format]))) error = -2;
+			libimage_decoder_free_image(decoder, again);
+			free(file);
+		}
+		libimage_decoder_free_image(decoder, pixels);
+	}
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+/*
+*	Tiles the image into a file big enough for the row index to take checkpoints, stored and compressed, then
+*	decodes strips of it through an index built by a whole decode and saved and loaded back.
+*/
+int decodeIndexed(char *contents, int size)
+{
+LibImageDecoder		*decoder;
+LibImageEncodeOptions	opts;
+LibImageIndex		*index, *loaded;
+uint8_t			*pixels, *tiled, *file, *blob, *again, *region;
+unsigned int		width, height, x, y, region_width, region_height, level;
+const unsigned int	tiled_width = 64, tiled_height = 1024;
+size_t			file_size, blob_size, again_size;
+int			error;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+	libimage_decoder_set_format(decoder, LIBIMAGE_FORMAT_RGBA8);
+	pixels = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+	tiled  = error ? NULL : malloc(4 * tiled_width * tiled_height);
+	if(!error && tiled == NULL) error = -1;
+	for(y = 0; !error && y < tiled_height; y++) {
+		for(x = 0; x < tiled_width; x++) memcpy(tiled + 4 * (y * tiled_width + x), pixels + 4 * ((y % height) * width + x % width), 4);
+	}
+
+	memset(&opts, 0, sizeof(opts));
+	opts.format = LIBIMAGE_FORMAT_RGBA8;
+	for(level = LIBIMAGE_ENCODE_STORED; level <= LIBIMAGE_ENCODE_GREEDY && !error; level += LIBIMAGE_ENCODE_GREEDY) {
+		opts.level = level;
+		file   = libimage_encode_png(tiled, tiled_width, tiled_height, &opts, &file_size, &error);
+		index  = error ? NULL : libimage_index_create(NULL, 16);
+		loaded = NULL;
+		blob   = again = NULL;
+		if(!error && index == NULL) error = -1;
+		if(!error) {
+			libimage_decoder_set_index(decoder, index);
+			libimage_decoder_set_region(decoder, 0, 0, 0, 0);
+			libimage_decoder_free_image(decoder, libimage_decoder_decode(decoder, file, file_size, &region_width, &region_height, &error));
+		}
+		if(!error && libimage_index_checkpoints(index) == 0) error = -2;
+		if(!error) blob = libimage_index_save(index, &blob_size, &error);
+		// A cut blob doesn't load.
+		if(!error && (loaded = libimage_index_load(NULL, blob, blob_size - 1, &error)) != NULL) error = -2;
+		if(error > 0) error = 0;
+		if(!error) loaded = libimage_index_load(NULL, blob, blob_size, &error);
+		if(!error) again = libimage_index_save(loaded, &again_size, &error);
+		if(!error && (again_size != blob_size || memcmp(again, blob, blob_size))) error = -2;
+
+		libimage_decoder_set_index(decoder, loaded);
+		for(y = 0; !error && y + 16 <= tiled_height; y += tiled_height / 5) {
+			libimage_decoder_set_region(decoder, tiled_width / 3, y, tiled_width / 2, 16);
+			region = libimage_decoder_decode(decoder, file, file_size, &region_width, &region_height, &error);
+			for(x = 0; !error && x < region_height; x++) {
+				if(memcmp(region + 4 * x * region_width, tiled + 4 * ((y + x) * tiled_width + tiled_width / 3), 4 * region_width)) error = -2;
+			}
+			libimage_decoder_free_image(decoder, region);
+		}
+		libimage_decoder_set_index(decoder, NULL);
+		libimage_decoder_set_region(decoder, 0, 0, 0, 0);
+		libimage_index_destroy(index);
+		libimage_index_destroy(loaded);
+		free(blob);
+		free(again);
+		free(file);
+	}
+	free(tiled);
+	libimage_decoder_free_image(decoder, pixels);
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+/*
+*	Decodes into a buffer with padding between the rows, streamed, cached and left to the size, whole and scaled:
+*	the rows have to be the ones of a decode to an image and the padding left alone. One byte short fails.
+*/
+int decodeInto(char *contents, int size)
+{
+LibImageDecoder		*decoder;
+LibImageOutput		out;
+static const uint32_t	flags[3] = { 0, LIBIMAGE_OUTPUT_WRITE_COMBINED, LIBIMAGE_OUTPUT_CACHED };
+uint8_t			*pixels, *buffer;
+unsigned int		width, height, into_width, into_height, scale, i, y;
+size_t			row, stride, j;
+int			error;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+	libimage_decoder_set_format(decoder, LIBIMAGE_FORMAT_RGBA8);
+	error = 0;
+	for(scale = 1; scale <= 2 && !error; scale++) {
+		libimage_decoder_set_scale(decoder, scale);
+		pixels = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+		row    = 4 * (size_t)width;
+		stride = row + 12;
+		buffer = error ? NULL : malloc(stride * height);
+		if(!error && buffer == NULL) error = -1;
+
+		memset(&out, 0, sizeof(out));
+		out.pixels = buffer;
+		out.stride = stride;
+		out.size   = (height - 1) * stride + row - 1;
+		out.format = LIBIMAGE_FORMAT_RGBA8;
+		if(!error && libimage_decoder_decode_into(decoder, (uint8_t*)contents, size, &out, &into_width, &into_height) == 0) error = -2;
+		out.size = stride * height;
+		for(i = 0; i < 3 && !error; i++) {
+			memset(buffer, 0xa5, stride * height);
+			out.flags = flags[i];
+			error = libimage_decoder_decode_into(decoder, (uint8_t*)contents, size, &out, &into_width, &into_height);
+			if(!error && (into_width != width || into_height != height)) error = -2;
+			for(y = 0; !error && y < height; y++) {
+				if(memcmp(buffer + y * stride, pixels + y * row, row)) error = -2;
+				for(j = row; j < stride; j++) if(buffer[y * stride + j] != 0xa5) error = -2;
+			}
+		}
+		free(buffer);
+		libimage_decoder_free_image(decoder, pixels);
+	}
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+typedef struct alloc_count {
+	unsigned int	allocs;
+	size_t		last_size;
+} AllocCount;
+
+static void *count_alloc(void *user, size_t size)
+{
+AllocCount *count = user;
+
+	count->allocs++;
+	count->last_size = size;
+	return malloc(size);
+}
+
+static void count_free(void *user, void *ptr)
+{
+	free(ptr);
+}
+
+/*
+*	Decodes the file twice with the same decoder, the second time only the image should be allocated. It runs on 4
+*	threads, so interlaced images take the parallel path and are checked against the serial one.
+*/
+int decodeWithDecoder(char *contents, int size, void *expected, unsigned int *allocs, size_t *image_size)
+{
+LibImageAllocator	allocator;
+LibImageDecoder		*decoder;
+AllocCount		count = {0};
+unsigned int		width, height;
+int			i, error;
+void			*ptr;
+
+	allocator.alloc	= count_alloc;
+	allocator.free	= count_free;
+	allocator.user	= &count;
+	decoder = libimage_decoder_create(&allocator);
+	if(decoder == NULL) return -1;
+	libimage_decoder_set_threads(decoder, 4);
+
+	for(i = 0, error = 0; i < 2 && !error; i++) {
+		count.allocs = 0;
+		ptr = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+		if(i == 1 && ptr && (expected == NULL || memcmp(ptr, expected, count.last_size))) error = -2;
+		libimage_decoder_free_image(decoder, ptr);
+	}
+	*allocs	    = count.allocs;
+	*image_size = count.last_size;
+
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+// Called from the worker threads.
+static void batch_done(void *user, size_t index, const LibImageBatchOutput *output)
+{
+	__atomic_fetch_add((unsigned int*)user, 1, __ATOMIC_RELAXED);
+}
+
+// Decodes copies of the file on a few threads, every copy has to come out as libimage_decode_data made it.
+int decodeBatch(char *contents, int size, void *expected, size_t expected_size, unsigned int *done)
+{
+LibImageBatchInput	inputs[64];
+LibImageBatchOutput	outputs[64];
+LibImageBatchOptions	opts = {0};
+int			i, error;
+
+	for(i = 0; i < 64; i++) {
+		inputs[i].data = (uint8_t*)contents;
+		inputs[i].size = size;
+	}
+	*done			= 0;
+	opts.thread_count	= 4;
+	opts.grain_bytes	= 4 * size;
+	opts.on_complete	= batch_done;
+	opts.user		= done;
+	error = libimage_decode_batch(inputs, 64, outputs, &opts);
+	if(error) return error;
+
+	for(i = 0; i < 64; i++) {
+		if(!error && outputs[i].error) error = outputs[i].error;
+		if(!error && (outputs[i].pixels == NULL) != (expected == NULL)) error = -2;
+		if(!error && expected && memcmp(outputs[i].pixels, expected, expected_size)) error = -2;
+		free(outputs[i].pixels);
+	}
+	return error;
+}
+
+// Collects the results of the async decodes, from the loop thread once they are polled.
+typedef struct async_results {
+	void		*expected;
+	size_t		expected_size;
+	unsigned int	done;
+	int		error;
+	LibImageAsync	*async;
+} AsyncResults;
+
+static void async_done(void *user, const LibImageAsyncResult *result)
+{
+AsyncResults *r = user;
+
+	r->done++;
+	if(result->error && !r->error) r->error = result->error;
+	if(!result->error && memcmp(result->pixels, r->expected, r->expected_size)) r->error = -2;
+	libimage_async_free_image(r->async, result->pixels);
+}
+
+/*
+*	Steps a job a row at a time, then has the async decoder decode copies of the file on its workers and polls its
+*	fd for them. Every image has to come out as libimage_decode_data made it.
+*/
+int decodeAsync(char *contents, int size, void *expected, size_t expected_size, unsigned int *steps)
+{
+LibImageDecoder		*decoder;
+LibImageJob		*job;
+LibImageAsyncOptions	opts = {0};
+AsyncResults		results = {0};
+struct pollfd		pfd;
+unsigned int		width, height, i;
+uint8_t			*pixels;
+int			error, left, left_error;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+	*steps = 0;
+	job    = libimage_job_create(decoder, (uint8_t*)contents, size);
+	while(libimage_job_step(job, 1)) (*steps)++;
+	pixels = libimage_job_finish(job, &width, &height, &error);
+	if(!error && (expected == NULL || memcmp(pixels, expected, expected_size))) error = -2;
+	libimage_decoder_free_image(decoder, pixels);
+	// One left halfway fails.
+	job    = libimage_job_create(decoder, (uint8_t*)contents, size);
+	left   = libimage_job_step(job, 1);
+	pixels = libimage_job_finish(job, &width, &height, &left_error);
+	if(!error && left && (pixels || !left_error)) error = -2;
+	libimage_decoder_free_image(decoder, pixels);
+	libimage_decoder_destroy(decoder);
+	if(error) return error;
+
+	opts.thread_count = 2;
+	opts.inline_bytes = 1;
+	opts.poll	  = 1;
+	results.expected      = expected;
+	results.expected_size = expected_size;
+	results.async	      = libimage_async_create(&opts);
+	if(results.async == NULL) return -1;
+	for(i = 0; i < 8 && !error; i++) error = libimage_async_decode(results.async, (uint8_t*)contents, size, async_done, &results);
+	pfd.fd	   = libimage_async_fd(results.async);
+	pfd.events = POLLIN;
+	while(!error && results.done < i && poll(&pfd, 1, 10000) > 0) libimage_async_poll(results.async);
+	libimage_async_destroy(results.async);
+	if(!error && results.done != 8) error = -2;
+	return error ? error : results.error;
+}
+
+static uint32_t chunk_crc(const uint8_t *bytes, size_t len)
+{
+uint32_t	crc = 0xffffffffu;
+size_t		i;
+int		k;
+
+	for(i = 0; i < len; i++) {
+		crc ^= bytes[i];
+		for(k = 0; k < 8; k++) crc = (crc >> 1) ^ (0xedb88320u & -(crc & 1));
+	}
+	return crc ^ 0xffffffffu;
+}
+
+// Copy of the file with a chunk of type and four data bytes put right after IHDR.
+static uint8_t *insert_chunk(char *contents, int size, const char *type)
+{
+uint8_t		*copy, *c;
+uint32_t	crc;
+
+	copy = malloc(size + 16);
+	if(copy == NULL) return NULL;
+	memcpy(copy, contents, 33);
+	c = copy + 33;
+	memcpy(c, "\0\0\0\4", 4);
+	memcpy(c + 4, type, 4);
+	memcpy(c + 8, "data", 4);
+	crc = chunk_crc(c + 4, 8);
+	c[12] = crc >> 24; c[13] = crc >> 16; c[14] = crc >> 8; c[15] = crc;
+	memcpy(c + 16, contents + 33, size - 33);
+	return copy;
+}
+
+/*
+*	Copy of the file with an ancillary chunk and an empty IDAT after the last IDAT, the IDATs aren't consecutive
+*	any more. NULL when the file has no IDAT to find.
+*/
+static uint8_t *split_idat_run(char *contents, int size)
+{
+uint8_t		*copy, *c;
+uint32_t	len, crc;
+int		offset, end;
+
+	end = 0;
+	for(offset = 8; offset + 12 <= size; offset += 12 + len) {
+		c   = (uint8_t*)contents + offset;
+		len = (uint32_t)c[0] << 24 | c[1] << 16 | c[2] << 8 | c[3];
+		if(len > (uint32_t)(size - offset - 12)) break;
+		if(!memcmp(c + 4, "IDAT", 4)) end = offset + 12 + len;
+	}
+	if(end == 0) return NULL;
+	copy = malloc(size + 28);
+	if(copy == NULL) return NULL;
+	memcpy(copy, contents, end);
+	c = copy + end;
+	memcpy(c, "\0\0\0\4quINdata", 12);
+	crc = chunk_crc(c + 4, 8);
+	c[12] = crc >> 24; c[13] = crc >> 16; c[14] = crc >> 8; c[15] = crc;
+	memcpy(c + 16, "\0\0\0\0IDAT", 8);
+	crc = chunk_crc(c + 20, 4);
+	c[24] = crc >> 24; c[25] = crc >> 16; c[26] = crc >> 8; c[27] = crc;
+	memcpy(c + 28, contents + end, size - end);
+	return copy;
+}
+
+/*
+*	An ancillary chunk the decoder doesn't know is stepped over, a critical one fails the file, and so does a
+*	memory limit that only holds the image, without the buffers of the inflate. An IDAT after the chunk that ended
+*	the IDATs fails the file, decoded whole or streamed.
+*/
+int decodeHostile(char *contents, int size, void *expected, size_t expected_size)
+{
+LibImageDecoder	*decoder;
+LibImageLimits	limits;
+unsigned int	width, height, rows;
+uint8_t		*copy;
+void		*pixels;
+int		error;
+
+	if(expected == NULL) return 0;
+	decoder = libimage_decoder_create(NULL);
+	copy	= insert_chunk(contents, size, "quIN");
+	if(decoder == NULL || copy == NULL) {
+		libimage_decoder_destroy(decoder);
+		free(copy);
+		return -1;
+	}
+	pixels = libimage_decoder_decode(decoder, copy, size + 16, &width, &height, &error);
+	if(!error && memcmp(pixels, expected, expected_size)) error = -2;
+	libimage_decoder_free_image(decoder, pixels);
+	free(copy);
+	copy = error ? NULL : insert_chunk(contents, size, "QuIN");
+	if(copy) {
+		pixels = libimage_decoder_decode(decoder, copy, size + 16, &width, &height, &error);
+		libimage_decoder_free_image(decoder, pixels);
+		error = pixels || error != LIBIMAGE_PNG_ERROR_UNKNOWN_CRITICAL ? -2 : 0;
+		free(copy);
+	}
+	copy = error ? NULL : split_idat_run(contents, size);
+	if(copy) {
+		pixels = libimage_decoder_decode(decoder, copy, size + 28, &width, &height, &error);
+		libimage_decoder_free_image(decoder, pixels);
+		error = pixels || error != LIBIMAGE_PNG_ERROR_INVALID_FILE ? -2 : 0;
+		if(!error && streamFile((char*)copy, size + 28, &rows) != LIBIMAGE_PNG_ERROR_INVALID_FILE) error = -2;
+		free(copy);
+	}
+	if(!error) {
+		memset(&limits, 0, sizeof(limits));
+		limits.max_alloc_bytes = expected_size;
+		libimage_decoder_set_limits(decoder, &limits);
+		pixels = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+		libimage_decoder_free_image(decoder, pixels);
+		error = pixels || error != LIBIMAGE_ERROR_LIMIT_EXCEEDED ? -2 : 0;
+	}
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+/*
+*	Copy of the file with the last byte of the zlib stream, the low byte of its Adler-32, flipped. It is the last
+*	data byte of the last IDAT that has any, whose CRC is made again so only the trailer is wrong.
+*/
+static uint8_t *corrupt_adler(char *contents, int size)
+{
+uint8_t		*copy, *c, *last;
+uint32_t	len, crc;
+int		offset;
+
+	copy = malloc(size);
+	if(copy == NULL) return NULL;
+	memcpy(copy, contents, size);
+	last = NULL;
+	for(offset = 8; offset + 12 <= size; offset += 12 + len) {
+		c   = copy + offset;
+		len = (uint32_t)c[0] << 24 | c[1] << 16 | c[2] << 8 | c[3];
+		if(len > (uint32_t)(size - offset - 12)) break;
+		if(len && !memcmp(c + 4, "IDAT", 4)) last = c;
+	}
+	if(last == NULL) {
+		free(copy);
+		return NULL;
+	}
+	len = (uint32_t)last[0] << 24 | last[1] << 16 | last[2] << 8 | last[3];
+	last[8 + len - 1] ^= 0x01;
+	crc = chunk_crc(last + 4, 4 + len);
+	c = last + 8 + len;
+	c[0] = crc >> 24; c[1] = crc >> 16; c[2] = crc >> 8; c[3] = crc;
+	return copy;
+}
+
+/*
+*	A file whose Adler-32 is wrong fails by default, and decodes to the same image as the good file when the check
+*	is turned off on the decoder or on the stream.
+*/
+int decodeAdler(char *contents, int size, void *expected, size_t expected_size)
+{
+LibImageDecoder	*decoder;
+LibImageStream	*stream;
+unsigned int	width, height, rows;
+uint8_t		*copy;
+void		*pixels;
+int		error;
+
+	if(expected == NULL) return 0;
+	copy = corrupt_adler(contents, size);
+	if(copy == NULL) return 0;
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) {
+		free(copy);
+		return -1;
+	}
+	pixels = libimage_decoder_decode(decoder, copy, size, &width, &height, &error);
+	libimage_decoder_free_image(decoder, pixels);
+	error = pixels || error != LIBIMAGE_PNG_ERROR_ADLER_NOT_MATCH ? -2 : 0;
+	if(!error) {
+		libimage_decoder_set_verify_adler(decoder, 0);
+		pixels = libimage_decoder_decode(decoder, copy, size, &width, &height, &error);
+		if(!error && memcmp(pixels, expected, expected_size)) error = -2;
+		libimage_decoder_free_image(decoder, pixels);
+	}
+	libimage_decoder_destroy(decoder);
+
+	stream = error ? NULL : libimage_stream_create(count_row, &rows);
+	if(stream) {
+		libimage_stream_set_verify_adler(stream, 0);
+		error = libimage_stream_feed(stream, copy, size);
+		if(!error) error = libimage_stream_finish(stream);
+		libimage_stream_destroy(stream);
+	}
+	free(copy);
+	return error;
+}
+
+// Decodes with the limits through a job or in one call, returns the error of the decode, zero when it went through.
+static int decode_limited(LibImageDecoder *decoder, const LibImageLimits *limits, char *contents, int size, int stepped)
+{
+LibImageJob	*job;
+unsigned int	width, height;
+void		*pixels;
+int		error;
+
+	libimage_decoder_set_limits(decoder, limits);
+	if(stepped) {
+		job = libimage_job_create(decoder, (uint8_t*)contents, size);
+		while(libimage_job_step(job, 0));
+		pixels = libimage_job_finish(job, &width, &height, &error);
+	} else {
+		pixels = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+	}
+	libimage_decoder_free_image(decoder, pixels);
+	if(pixels == NULL && !error) error = -2;
+	return error;
+}
+
+/*
+*	Every limit set right at the size of the image lets it through and one below turns it down, stepped as a job and
+*	decoded in one call. A decode cancelled up front or with a time limit of a nanosecond never finishes.
+*/
+int decodeLimited(char *contents, int size, void *expected, size_t expected_size, unsigned int width, unsigned int height)
+{
+LibImageDecoder	*decoder;
+LibImageLimits	limits;
+int		cancel, ok;
+
+	if(expected == NULL) return 0;
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+	memset(&limits, 0, sizeof(limits));
+	limits.max_pixels	= (uint64_t)width * height;
+	limits.max_output_bytes	= expected_size;
+	limits.max_input_bytes	= size;
+	ok = !decode_limited(decoder, &limits, contents, size, 1) && !decode_limited(decoder, &limits, contents, size, 0);
+
+	memset(&limits, 0, sizeof(limits));
+	limits.max_pixels = (uint64_t)width * height - 1;
+	if(limits.max_pixels) ok = ok && decode_limited(decoder, &limits, contents, size, 1) == LIBIMAGE_ERROR_LIMIT_EXCEEDED;
+	memset(&limits, 0, sizeof(limits));
+	limits.max_output_bytes = expected_size - 1;
+	if(limits.max_output_bytes) ok = ok && decode_limited(decoder, &limits, contents, size, 1) == LIBIMAGE_ERROR_LIMIT_EXCEEDED;
+	memset(&limits, 0, sizeof(limits));
+	limits.max_input_bytes = size - 1;
+	ok = ok && decode_limited(decoder, &limits, contents, size, 1) == LIBIMAGE_ERROR_LIMIT_EXCEEDED;
+	ok = ok && decode_limited(decoder, &limits, contents, size, 0) == LIBIMAGE_ERROR_LIMIT_EXCEEDED;
+
+	memset(&limits, 0, sizeof(limits));
+	cancel	      = 1;
+	limits.cancel = &cancel;
+	ok = ok && decode_limited(decoder, &limits, contents, size, 1) == LIBIMAGE_ERROR_CANCELLED;
+	memset(&limits, 0, sizeof(limits));
+	limits.time_limit_ns = 1;
+	ok = ok && decode_limited(decoder, &limits, contents, size, 0) == LIBIMAGE_ERROR_DEADLINE;
+	libimage_decoder_destroy(decoder);
+	return ok ? 0 : -2;
+}
+
+// Every prefix of the file is cut short: the sized decode has to fail on it without reading past its end.
+int decodeTruncated(char *contents, int size)
+{
+LibImageDecoder	*decoder;
+unsigned int	width, height;
+void		*pixels;
+int		cut, error;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+	for(cut = size - 1; cut > 0; cut = cut > 64 ? cut / 2 : cut - 8) {
+		pixels = libimage_decoder_decode(decoder, (uint8_t*)contents, cut, &width, &height, &error);
+		libimage_decoder_free_image(decoder, pixels);
+		if(pixels || !error) break;
+	}
+	libimage_decoder_destroy(decoder);
+	return cut > 0 ? -2 : 0;
+}
+
+// Probes from a prefix of the file, growing it until the header chunks fit.
+int probeFile(char *contents, int size, LibImageProbeInfo *probe, int *prefix)
+{
+int error;
+
+	for(*prefix = 64; ; *prefix *= 2) {
+		if(*prefix > size) *prefix = size;
+		error = libimage_probe((uint8_t*)contents, *prefix, probe);
+		if(!error || *prefix == size) return error;
+	}
+}
+
+static uint32_t fnv1a(const uint8_t *bytes, size_t len)
+{
+uint32_t	hash = 0x811c9dc5u;
+size_t		i;
+
+	for(i = 0; i < len; i++) hash = (hash ^ bytes[i]) * 0x01000193u;
+	return hash;
+}
+
+// FNV-1a of the RGBA8 pixels, from a decoder written apart from the library: 16 bit samples cut to their high byte.
+static const struct known_image {
+	const char	*name;
+	uint32_t	width, height, hash;
+} known_images[] = {
+	{ "basn0g08.png", 32, 32, 0x262ef46d },
+	{ "basn2c08.png", 32, 32, 0x1fc92bc5 },
+	{ "basn3p08.png", 32, 32, 0x30ef4f45 },
+	{ "basn4a08.png", 32, 32, 0x23c8536d },
+	{ "basn6a08.png", 32, 32, 0xb472197d },
+	{ "basn2c16.png", 32, 32, 0xccc70a45 },
+	{ "basn6a16.png", 32, 32, 0x3016e9b5 },
+	{ "basi2c08.png", 32, 32, 0x1fc92bc5 },
+	{ "basi6a16.png", 32, 32, 0x3016e9b5 },
+	{ "f00n2c08.png", 32, 32, 0x8bcd69c2 },
+	{ "f01n2c08.png", 32, 32, 0xba4bdcfa },
+	{ "f02n2c08.png", 32, 32, 0xaf1c8eac },
+	{ "f03n2c08.png", 32, 32, 0x2ddddd8c },
+	{ "f04n2c08.png", 32, 32, 0x0bd29bc6 },
+	{ "z00n2c08.png", 32, 32, 0xaa698493 },
+	{ "z09n2c08.png", 32, 32, 0xaa698493 },
+};
+
+/*
+*	Checks the file against what is known of it from outside the library: PngSuite starts the names of the files that
+*	are broken on purpose with an x, they must not decode, and some others have the hash of their pixels above.
+*/
+int decodeKnown(const char *name, char *contents, int size)
+{
+LibImageDecoder	*decoder;
+uint8_t		*pixels;
+unsigned int	width, height, i;
+int		error;
+
+	decoder = libimage_decoder_create(NULL);
+	if(decoder == NULL) return -1;
+	libimage_decoder_set_format(decoder, LIBIMAGE_FORMAT_RGBA8);
+	pixels = libimage_decoder_decode(decoder, (uint8_t*)contents, size, &width, &height, &error);
+	if(name[0] == 'x') error = pixels || !error ? -2 : 0;
+	for(i = 0; !error && i < sizeof(known_images) / sizeof(known_images[0]); i++) {
+		if(strcmp(name, known_images[i].name)) continue;
+		if(width != known_images[i].width || height != known_images[i].height) error = -2;
+		else if(fnv1a(pixels, 4 * (size_t)width * height) != known_images[i].hash) error = -2;
+	}
+	libimage_decoder_free_image(decoder, pixels);
+	libimage_decoder_destroy(decoder);
+	return error;
+}
+
+static int failures, rejected;
+
+/*
+*	Prints what went wrong with a check and counts it: an error of the library, or mismatch when the check returned
+*	below zero. Errors are what a file broken on purpose should give, so they don't count for those.
+*/
+static void report(const char *what, int error, const char *mismatch)
+{
+char error_buffer[1024];
+
+	if(error > 0) {
+		libimage_error_code_to_msg(error_buffer, sizeof(error_buffer), error);
+		fprintf(stderr, "%s: %s\n", what, error_buffer);
+		if(!rejected) failures++;
+	} else if(error < 0) {
+		fprintf(stderr, "%s: %s\n", what, mismatch);
+		failures++;
+	}
+}
+
 void usage(int code)
 {
 	fprintf(stderr, "<file_path_to_image>\n");
@@ -63,10 +969,13 @@ void usage(int code)
 
 int main(int argc, char **argv)
 {
-char 		*file_contents, *path, error_buffer[1024];
+char 		*file_contents, *path, *name;
 int  		size,  error;
-unsigned int 	width, height;
+size_t		image_size;
+unsigned int 	width, height, rows, allocs, done, steps;
 void 		*ptr;
+LibImageProbeInfo probe;
+int		prefix;
 
 	if(argc < 2) usage(EXIT_FAILURE);	
 
@@ -74,22 +983,69 @@ void 		*ptr;
 
 	error = 0;
 	path = argv[1];
+	name = strrchr(path, '/');
+	name = name ? name + 1 : path;
 
 	file_contents = readEntireFile(path, &size);
 	if(file_contents == NULL) {
 		LIBIMAGE_ERROR_MSG("Could not read file", NULL);
-		return -1;
+		return EXIT_FAILURE;
 	}
 
-	ptr = libimage_process_data(file_contents, &width, &height, &error);
-	if(error != 0) {
-		libimage_error_code_to_msg(error_buffer, sizeof(error_buffer), error);
-		fprintf(stderr, "%s\n", error_buffer);
-	}
+	ptr = libimage_decode_data((uint8_t*)file_contents, size, &width, &height, &error);
+	rejected = ptr == NULL && name[0] == 'x';
+	report("Decode", error, "no image");
 
 	fprintf(stderr, "Got width equal to %u\n", width);
 	fprintf(stderr, "Got height equal to %u\n", height);
 
+	report("Known", decodeKnown(name, file_contents, size), "differs from the expected image or a broken file decoded");
+
+	error = streamFile(file_contents, size, &rows);
+	if(rejected && !error) error = -2;
+	report("Streaming", error, "a broken file streamed through");
+	fprintf(stderr, "Streamed %u rows\n", rows);
+
+	error = decodeWithDecoder(file_contents, size, ptr, &allocs, &image_size);
+	report("Decoder", error, "image differs from libimage_decode_data");
+	fprintf(stderr, "Decoder reuse made %u allocations\n", allocs);
+
+	report("File", decodeFile(path, ptr, image_size, width, height), "image differs from libimage_decode_data");
+
+	error = decodeBatch(file_contents, size, ptr, image_size, &done);
+	report("Batch", error, "image differs from libimage_decode_data");
+	fprintf(stderr, "Batch decoded %u images\n", done);
+
+	report("Formats", decodeFormats(file_contents, size), "output formats disagree");
+	report("Region", decodeRegion(file_contents, size), "differs from the whole image");
+	report("Scaled", decodeScaled(file_contents, size), "differs from the box filtered image");
+	report("Parallel inflate", decodeParallelInflate(file_contents, size), "differs from the serial inflate");
+	report("Stats", decodeStats(file_contents, size), "counts don't add up");
+	report("Log", decodeLogged(file_contents, size), "no message from a decode");
+	report("Encode", encodeRoundTrip(file_contents, size), "round trip differs");
+	report("Index", decodeIndexed(file_contents, size), "strips differ from the whole image");
+	report("Into", decodeInto(file_contents, size), "strided output differs from the image");
+
+	error = decodeAsync(file_contents, size, ptr, image_size, &steps);
+	report("Async", error, "image differs from libimage_decode_data");
+	fprintf(stderr, "Job took %u steps\n", steps);
+
+	report("Hostile", decodeHostile(file_contents, size, ptr, image_size), "unknown chunk, IDAT order or memory limit handled wrong");
+	report("Adler", decodeAdler(file_contents, size, ptr, image_size), "a wrong trailer was let through or skipping it changed the image");
+	report("Limits", decodeLimited(file_contents, size, ptr, image_size, width, height), "a limit let the wrong decode through");
+	report("Truncated", decodeTruncated(file_contents, size), "a file cut short decoded");
+
+	error = probeFile(file_contents, size, &probe, &prefix);
+	if(!error && ptr && (probe.width != width || probe.height != height)) error = -2;
+	report("Probe", error, "dimensions differ from libimage_decode_data");
+	fprintf(stderr, "Probed %ux%u from %d bytes\n", probe.width, probe.height, prefix);
+
+	free(ptr);
 	free(file_contents);
-	return 0;
+	if(failures) {
+		LIBIMAGE_ERROR_MSG("%d checks failed", failures);
+		return EXIT_FAILURE;
+	}
+	LIBIMAGE_SUCCESS_MSG("All checks passed", NULL);
+	return EXIT_SUCCESS;
 }